@@ -0,0 +1,65 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include <arena.h>
+
+#define ARENA_ALIGN 16
+#define ARENA_FIRST_CHUNK (64 * 1024)
+
+// the header of a chunk is padded so the data is aligned
+#define CHUNK_HEADER \
+  ((sizeof(arena_chunk_t) + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1))
+#define chunk_data(c) ((char *)(c) + CHUNK_HEADER)
+
+static arena_chunk_t *chunk_new(size_t size) {
+  arena_chunk_t *c = (arena_chunk_t *)malloc(CHUNK_HEADER + size);
+  c->next = NULL;
+  c->size = size;
+  c->used = 0;
+  return c;
+}
+
+CONSTRUCTOR(arena_t) {
+  ALLOC_VAR(r, arena_t)
+  r->chunks = chunk_new(ARENA_FIRST_CHUNK);
+  return r;
+}
+
+DESTRUCTOR(arena_t) {
+  if (r == NULL) return;
+  while (r->chunks) {
+    arena_chunk_t *c = r->chunks;
+    r->chunks = c->next;
+    free(c);
+  }
+  free(r);
+}
+
+void *arena_alloc(arena_t *a, size_t size) {
+  size = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+  arena_chunk_t *c = a->chunks;
+  if (c->used + size > c->size) {
+    size_t next = 2 * c->size;
+    while (next < size) next *= 2;
+    c = chunk_new(next);
+    c->next = a->chunks;
+    a->chunks = c;
+  }
+  void *p = chunk_data(c) + c->used;
+  c->used += size;
+  return p;
+}
+
+char *arena_strdup(arena_t *a, const char *s) {
+  size_t n = strlen(s) + 1;
+  char *r = (char *)arena_alloc(a, n);
+  memcpy(r, s, n);
+  return r;
+}
+
+int arena_owns(arena_t *a, void *p) {
+  for (arena_chunk_t *c = a->chunks; c; c = c->next)
+    if ((char *)p >= chunk_data(c) && (char *)p < chunk_data(c) + c->size)
+      return 1;
+  return 0;
+}
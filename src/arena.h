@@ -0,0 +1,41 @@
+/**
+ * @file arena.h
+ * @brief region allocator: many small blocks freed all at once
+ *
+ * Blocks are carved from large chunks; a chunk is twice as large as the
+ * previous one, so there are only a few of them. Blocks are never freed
+ * one by one, destroying the arena releases all its memory.
+ */
+#ifndef __ARENA_H__
+#define __ARENA_H__
+#include <stddef.h>
+
+#include <utils.h>
+
+//! chunk of memory, the blocks follow the header
+typedef struct _arena_chunk_t {
+  struct _arena_chunk_t *next;  //!< previously allocated chunk
+  size_t size,                  //!< size of the data
+      used;                     //!< bytes already given out
+} arena_chunk_t;
+
+//! the arena
+typedef struct {
+  arena_chunk_t *chunks;  //!< list of chunks, the current one first
+} arena_t;
+
+//! create an empty arena
+CONSTRUCTOR(arena_t);
+//! free all blocks of the arena, and the arena
+DESTRUCTOR(arena_t);
+
+//! allocate `size` bytes (aligned for any type)
+void *arena_alloc(arena_t *a, size_t size);
+
+//! copy of the string `s` in the arena
+char *arena_strdup(arena_t *a, const char *s);
+
+//! 1 if the block `p` was allocated from the arena
+int arena_owns(arena_t *a, void *p);
+
+#endif
@@ -5,34 +5,60 @@
 #include <ast.h>
 #include <code.h>
 
-// each node created in the constructor gets a unique id
-static int __ast_node_t_id__ = 0;
+/* ----------------------------------------------------------------------------
+ * memory of the AST objects
+ *
+ * objects are allocated from the arena of the current ast_t of the thread
+ * (the last one created in it, see ast_use()); the destructors do nothing for
+ * them, the memory is released at once when the ast is deleted
+ */
+
+static _Thread_local ast_t *current = NULL;
+
+#define AST_ALLOC_VAR(var, type) type *var = (type *)ast_alloc(sizeof(type));
+
+static int in_arena(void *p) {
+  return current && arena_owns(current->arena, p);
+}
+
+void *ast_alloc(size_t size) {
+  return current ? arena_alloc(current->arena, size) : malloc(size);
+}
+
+char *ast_strdup(const char *s) {
+  return current ? arena_strdup(current->arena, s) : strdup(s);
+}
+
+void ast_use(ast_t *ast) { current = ast; }
+
+ast_t *ast_current() { return current; }
+
+void ast_free(void *p) {
+  if (p && !in_arena(p)) free(p);
+}
 
 /* ----------------------------------------------------------------------------
  * static types
  */
 
-extern ast_node_t *__type__int;
-extern ast_node_t *__type__void;
-
 CONSTRUCTOR(static_type_t, char *name) {
-  ALLOC_VAR(r, static_type_t);
-  r->name = strdup(name);
+  AST_ALLOC_VAR(r, static_type_t);
+  r->name = ast_strdup(name);
   r->size = 0;
   r->members = NULL;
   return r;
 }
 
 DESTRUCTOR(static_type_t) {
-  if (r == NULL) return;
-  free(r->name);
+  if (r == NULL || in_arena(r)) return;
+  ast_free(r->name);
   static_type_member_t_delete(r->members);
   free(r);
 }
 
 CONSTRUCTOR(static_type_member_t, char *name, static_type_t *type) {
-  ALLOC_VAR(r, static_type_member_t);
-  r->name = strdup(name);
+  AST_ALLOC_VAR(r, static_type_member_t);
+  r->name = ast_strdup(name);
   r->type = type;
   r->parent = NULL;
   r->offset = 0;
@@ -41,11 +67,11 @@ CONSTRUCTOR(static_type_member_t, char *name, static_type_t *type) {
 }
 
 DESTRUCTOR(static_type_member_t) {
-  if (r == NULL) return;
-  free(r->name);
+  if (r == NULL || in_arena(r)) return;
+  ast_free(r->name);
   list_for(m, static_type_member_t, r->next) {
-    free(m->name);
-    free(m);
+    ast_free(m->name);
+    ast_free(m);
   }
   list_for_end;
   free(r);
@@ -63,8 +89,8 @@ static_type_member_t *static_type_member_find(static_type_member_t *list,
  */
 
 CONSTRUCTOR(variable_t, char *name) {
-  ALLOC_VAR(r, variable_t)
-  r->name = strdup(name);
+  AST_ALLOC_VAR(r, variable_t)
+  r->name = ast_strdup(name);
   r->base_type = NULL;
   r->addr = r->num_dim = 0;
   r->scope = NULL;
@@ -77,8 +103,8 @@ CONSTRUCTOR(variable_t, char *name) {
 }
 
 DESTRUCTOR(variable_t) {
-  if (r == NULL) return;
-  free(r->name);
+  if (r == NULL || in_arena(r)) return;
+  ast_free(r->name);
   ast_node_t_delete(r->initializer);
   ast_node_t_delete(r->ranges);
   free(r);
@@ -89,15 +115,15 @@ DESTRUCTOR(variable_t) {
  */
 
 CONSTRUCTOR(scope_t) {
-  ALLOC_VAR(r, scope_t)
+  AST_ALLOC_VAR(r, scope_t)
   r->parent = NULL;
-  r->items = NULL;
+  r->items = r->last = NULL;
   r->fn = NULL;
   return r;
 }
 
 DESTRUCTOR(scope_t) {
-  if (r == NULL) return;
+  if (r == NULL || in_arena(r)) return;
   ast_node_t_delete(r->items);
   free(r);
 }
@@ -107,17 +133,20 @@ DESTRUCTOR(scope_t) {
  */
 
 CONSTRUCTOR(function_t, char *name) {
-  ALLOC_VAR(r, function_t);
-  r->name = strdup(name);
+  AST_ALLOC_VAR(r, function_t);
+  r->name = ast_strdup(name);
   r->out_type = NULL;
   r->params = NULL;
   r->root_scope = NULL;
+  r->op_depth = r->acc_depth = 0;
+  r->inline_hint = 0;
+  r->builtin = 0;
   return r;
 }
 
 DESTRUCTOR(function_t) {
-  if (r == NULL) return;
-  free(r->name);
+  if (r == NULL || in_arena(r)) return;
+  ast_free(r->name);
   ast_node_t_delete(r->params);
   scope_t_delete(r->root_scope);
 }
@@ -127,27 +156,27 @@ DESTRUCTOR(function_t) {
  */
 
 CONSTRUCTOR(inferred_type_t) {
-  ALLOC_VAR(r, inferred_type_t);
+  AST_ALLOC_VAR(r, inferred_type_t);
   r->compound = 0;
-  r->type = __type__void->val.t;
+  r->type = current->type_void->val.t;
   return r;
 }
 
 DESTRUCTOR(inferred_type_t) {
-  if (r == NULL) return;
+  if (r == NULL || in_arena(r)) return;
   if (r->compound) inferred_type_item_t_delete(r->list);
   free(r);
 }
 
 CONSTRUCTOR(inferred_type_item_t, inferred_type_t *tt) {
-  ALLOC_VAR(r, inferred_type_item_t);
+  AST_ALLOC_VAR(r, inferred_type_item_t);
   r->next = NULL;
   r->type = tt;
   return r;
 }
 
 DESTRUCTOR(inferred_type_item_t) {
-  if (r == NULL) return;
+  if (r == NULL || in_arena(r)) return;
   if (r->next) inferred_type_item_t_delete(r->next);
   free(r);
 }
@@ -205,7 +234,7 @@ inferred_type_t *inferred_type_append(inferred_type_t *dst,
   }
 
   append(inferred_type_item_t, &(dst->list), src->list);
-  free(src);
+  ast_free(src);
   return dst;
 }
 
@@ -228,20 +257,36 @@ int static_type_basic(static_type_t *t) {
     return TYPE_FLOAT;
   else if (!strcmp(t->name, "char"))
     return TYPE_CHAR;
+  else if (!strcmp(t->name, "int8"))
+    return TYPE_INT8;
+  else if (!strcmp(t->name, "int16"))
+    return TYPE_INT16;
+  else if (!strcmp(t->name, "int64"))
+    return TYPE_INT64;
   else
     assert(0);
   return -1;
 }
 
+int static_type_int(static_type_t *t) {
+  return t == current->type_int->val.t || t == current->type_int8->val.t ||
+         t == current->type_int16->val.t;
+}
+
+int static_type_int64(static_type_t *t) {
+  return t == current->type_int64->val.t;
+}
+
 int static_type_layout(static_type_t *t, uint8_t **layout) {
   int n = 0;
 
   if (t->members == NULL) {
     if (t->size != 0) {
-      n = 1;
+      // an int64 is two values (see code.h)
+      n = static_type_int64(t) ? 2 : 1;
       if (layout) {
-        *layout = (uint8_t *)malloc(1);
-        **layout = static_type_basic(t);
+        *layout = (uint8_t *)malloc(n);
+        memset(*layout, static_type_basic(t), n);
       }
     } else {
       n = 0;
@@ -311,6 +356,13 @@ int static_type_compatible(static_type_t *st, static_type_t *t, int **casts,
         return 0;
       }
       int *tmpc, tmpn;
+      // the values of a record are converted one by one, an int64 member
+      // (two values) takes only an int64
+      if (!stm->type->members &&
+          static_type_int64(stm->type) != static_type_int64(tm->type)) {
+        if (my_casts) free(my_casts);
+        return 0;
+      }
       if (static_type_compatible(stm->type, tm->type, (casts) ? &tmpc : NULL,
                                  &tmpn)) {
         if (casts) {
@@ -338,6 +390,19 @@ int static_type_compatible(static_type_t *st, static_type_t *t, int **casts,
     int from = static_type_basic(t);
 
     if (from == TYPE_FLOAT && to == TYPE_CHAR) return 0;
+    // int64 converts only from and to the int types
+    if ((from == TYPE_INT64 || to == TYPE_INT64) &&
+        (from == TYPE_FLOAT || to == TYPE_FLOAT))
+      return 0;
+    if (from == TYPE_INT64 && to == TYPE_INT64) {
+      // both values as they are
+      if (casts) {
+        (*casts) = (int *)malloc(2 * sizeof(int));
+        *n_casts = 2;
+        (*casts)[0] = (*casts)[1] = CONVERT_FROM_INT | CONVERT_TO_INT;
+      }
+      return 1;
+    }
 
     if (casts) {
       (*casts) = (int *)malloc(sizeof(int));
@@ -351,8 +416,13 @@ int static_type_compatible(static_type_t *st, static_type_t *t, int **casts,
           (*casts)[0] = CONVERT_FROM_FLOAT;
           break;
         case TYPE_CHAR:
+        case TYPE_INT8:
+        case TYPE_INT16:
           (*casts)[0] = CONVERT_FROM_INT;
           break;
+        case TYPE_INT64:
+          (*casts)[0] = CONVERT_FROM_INT64;
+          break;
       }
       switch (to) {
         case TYPE_INT:
@@ -364,7 +434,20 @@ int static_type_compatible(static_type_t *st, static_type_t *t, int **casts,
         case TYPE_CHAR:
           (*casts)[0] |= CONVERT_TO_CHAR;
           break;
+        case TYPE_INT8:
+          (*casts)[0] |= CONVERT_TO_INT8;
+          break;
+        case TYPE_INT16:
+          (*casts)[0] |= CONVERT_TO_INT16;
+          break;
+        case TYPE_INT64:
+          (*casts)[0] |= CONVERT_TO_INT64;
+          break;
       }
+      if ((to == TYPE_INT8 && from != TYPE_INT8) ||
+          (to == TYPE_INT16 && from != TYPE_INT8 && from != TYPE_INT16 &&
+           from != TYPE_CHAR))
+        (*casts)[0] |= CONVERT_NARROW;
     }
     return 1;
   }
@@ -384,6 +467,11 @@ int inferred_type_compatible(static_type_t *st, inferred_type_t *it,
         return 0;
       }
       int *tmpc, tmpn;
+      if (!stm->type->members && !tm->type->compound &&
+          static_type_int64(stm->type) != static_type_int64(tm->type->type)) {
+        if (my_casts) free(my_casts);
+        return 0;
+      }
       if (inferred_type_compatible(stm->type, tm->type, (casts) ? &tmpc : NULL,
                                    &tmpn)) {
         if (casts) {
@@ -409,9 +497,10 @@ int inferred_type_compatible(static_type_t *st, inferred_type_t *it,
 }
 
 CONSTRUCTOR(expression_t, int variant) {
-  ALLOC_VAR(r, expression_t);
+  AST_ALLOC_VAR(r, expression_t);
   r->variant = variant;
   r->type = inferred_type_t_new();
+  r->uniform = 0;
 
   switch (variant) {
     case EXPR_EMPTY:
@@ -422,35 +511,38 @@ CONSTRUCTOR(expression_t, int variant) {
       r->val.i = NULL;
       break;
     case EXPR_CALL: {
-      ALLOC_VAR(v, expr_function_t);
+      AST_ALLOC_VAR(v, expr_function_t);
       v->fn = NULL;
       v->params = NULL;
+      v->inlined = NULL;
       r->val.f = v;
     } break;
     case EXPR_ARRAY_ELEMENT:
     case EXPR_VAR_NAME:
     case EXPR_SORT:
-    case EXPR_SIZEOF: {
-      ALLOC_VAR(v, expr_variable_t);
+    case EXPR_SIZEOF:
+    case EXPR_SLICE: {
+      AST_ALLOC_VAR(v, expr_variable_t);
       v->var = NULL;
       v->params = NULL;
+      v->in_bounds = v->exclusive = v->row = 0;
       r->val.v = v;
     } break;
     case EXPR_POSTFIX:
     case EXPR_PREFIX:
     case EXPR_BINARY: {
-      ALLOC_VAR(v, expr_oper_t);
+      AST_ALLOC_VAR(v, expr_oper_t);
       v->first = v->second = NULL;
       r->val.o = v;
     } break;
     case EXPR_CAST: {
-      ALLOC_VAR(v, expr_cast_t);
+      AST_ALLOC_VAR(v, expr_cast_t);
       v->type = NULL;
       v->ex = NULL;
       r->val.c = v;
     } break;
     case EXPR_SPECIFIER: {
-      ALLOC_VAR(v, expr_specif_t);
+      AST_ALLOC_VAR(v, expr_specif_t);
       v->memb = NULL;
       v->ex = NULL;
       r->val.s = v;
@@ -460,22 +552,24 @@ CONSTRUCTOR(expression_t, int variant) {
 }
 
 DESTRUCTOR(expression_t) {
-  if (r == NULL) return;
+  if (r == NULL || in_arena(r)) return;
   inferred_type_t_delete(r->type);
   switch (r->variant) {
     case EXPR_EMPTY:
     case EXPR_LITERAL:
-      if (r->val.l) free(r->val.l);
+      ast_free(r->val.l);
       break;
     case EXPR_INITIALIZER:
       ast_node_t_delete(r->val.i);
       break;
     case EXPR_CALL:
       ast_node_t_delete(r->val.f->params);
+      ast_node_t_delete(r->val.f->inlined);
       break;
     case EXPR_ARRAY_ELEMENT:
     case EXPR_VAR_NAME:
     case EXPR_SIZEOF:
+    case EXPR_SLICE:
       ast_node_t_delete(r->val.v->params);
       break;
     case EXPR_POSTFIX:
@@ -498,10 +592,10 @@ int expr_int(expression_t *e) {
   if (e->type->compound) {
     if (e->type->list == NULL || e->type->list->next != NULL) return 0;
     if (e->type->list->type->compound) return 0;
-    if (e->type->list->type->type == __type__int->val.t) return 1;
+    if (static_type_int(e->type->list->type->type)) return 1;
     return 0;
   } else {
-    if (e->type->type == __type__int->val.t) return 1;
+    if (static_type_int(e->type->type)) return 1;
     return 0;
   }
 }
@@ -511,14 +605,18 @@ int expr_int(expression_t *e) {
  */
 
 CONSTRUCTOR(statement_t, int variant) {
-  ALLOC_VAR(r, statement_t);
+  AST_ALLOC_VAR(r, statement_t);
   for (int i = 0; i < 2; i++) r->par[i] = NULL;
   r->variant = variant;
+  r->tag = 0;
+  r->ret_fn = NULL;
+  r->uniform = 0;
+  r->row = r->n_rows = 0;
   return r;
 }
 
 DESTRUCTOR(statement_t) {
-  if (r == NULL) return;
+  if (r == NULL || in_arena(r)) return;
   for (int i = 0; i < 2; i++)
     if (r->par[i]) ast_node_t_delete(r->par[i]);
 }
@@ -528,8 +626,8 @@ DESTRUCTOR(statement_t) {
  */
 
 CONSTRUCTOR(ast_node_t, YYLTYPE *iloc, int node_type, ...) {
-  ALLOC_VAR(r, ast_node_t)
-  r->id = __ast_node_t_id__++;
+  AST_ALLOC_VAR(r, ast_node_t)
+  r->id = current ? current->n_nodes++ : 0;
   r->code_from = r->code_to = -1;
   r->next = NULL;
   r->emitted = 0;
@@ -610,7 +708,7 @@ CONSTRUCTOR(ast_node_t, YYLTYPE *iloc, int node_type, ...) {
 }
 
 DESTRUCTOR(ast_node_t) {
-  if (r == NULL) return;
+  if (r == NULL || in_arena(r)) return;
   if (r->next) ast_node_t_delete(r->next);
   switch (r->node_type) {
     case AST_NODE_STATIC_TYPE:
@@ -676,8 +774,15 @@ void unchain_last(ast_node_t **list) {
 
 CONSTRUCTOR(ast_t) {
   ALLOC_VAR(r, ast_t);
-  r->types = NULL;
-  r->functions = NULL;
+  r->arena = arena_t_new();
+  current = r;
+  r->n_nodes = 0;
+  r->type_int = r->type_float = r->type_void = r->type_char = NULL;
+  r->type_int8 = r->type_int16 = r->type_int64 = NULL;
+  r->scanner = NULL;
+  r->symbols = hash_table_t_new(1024, NULL);
+  r->types = r->last_type = NULL;
+  r->functions = r->last_function = NULL;
   r->root_scope = scope_t_new();
   r->current_scope = r->root_scope;
   r->error_occured = 0;
@@ -686,25 +791,74 @@ CONSTRUCTOR(ast_t) {
 
 DESTRUCTOR(ast_t) {
   if (r == NULL) return;
-  ast_node_t_delete(r->types);
-  ast_node_t_delete(r->functions);
-  scope_t_delete(r->root_scope);
+  // all objects of the ast are in its arena
+  if (current == r) current = NULL;
+  arena_t_delete(r->arena);
+  hash_table_t_delete(r->symbols);
   free(r);
 }
 
+/* ----------------------------------------------------------------------------
+ * symbol tables
+ *
+ * a named node is stored in ast->symbols under the hash of its name and of
+ * the list it is in (given by its owner: the scope, or &ast->types,
+ * &ast->functions); only the first node of a name is stored, and when hashes
+ * of different names collide, the list is searched
+ */
+
+static uint64_t symbol_key(void *owner, const char *name) {
+  return hash_bytes(HASH_INIT ^ (uint64_t)(uintptr_t)owner, name,
+                    strlen(name));
+}
+
+static void add_symbol(ast_t *ast, void *owner, ast_node_t *n) {
+  char *name = ast_node_name(n);
+  if (!name) return;
+  uint64_t key = symbol_key(owner, name);
+  if (!hash_get(ast->symbols, key)) hash_put(ast->symbols, key, n);
+}
+
+static ast_node_t *find_symbol(ast_t *ast, void *owner, ast_node_t *list,
+                               const char *name) {
+  ast_node_t *n = hash_get(ast->symbols, symbol_key(owner, name));
+  if (!n || !strcmp(ast_node_name(n), name)) return n;
+  return ast_node_find(list, (char *)name);
+}
+
+void scope_append(ast_t *ast, scope_t *sc, ast_node_t *items) {
+  append_last(ast_node_t, &sc->items, sc->last, items);
+  for (ast_node_t *n = items; n; n = n->next)
+    if (n->node_type == AST_NODE_VARIABLE) add_symbol(ast, sc, n);
+}
+
+void ast_append_function(ast_t *ast, ast_node_t *fn) {
+  append_last(ast_node_t, &ast->functions, ast->last_function, fn);
+  if (fn) add_symbol(ast, &ast->functions, fn);
+}
+
+void ast_append_type(ast_t *ast, ast_node_t *t) {
+  append_last(ast_node_t, &ast->types, ast->last_type, t);
+  if (t) add_symbol(ast, &ast->types, t);
+}
+
+ast_node_t *ast_find_type(ast_t *ast, const char *name) {
+  return find_symbol(ast, &ast->types, ast->types, name);
+}
+
 int ident_role(ast_t *ast, char *ident, ast_node_t **result) {
   int res = IDENT_FREE;
   ast_node_t *nd;
 
   if (result) (*result)=NULL;
 
-  nd = ast_node_find(ast->functions, ident);
+  nd = find_symbol(ast, &ast->functions, ast->functions, ident);
   if (nd) {
     res |= IDENT_FUNCTION;
     if (result) (*result) = nd;
   }
 
-  nd = ast_node_find(ast->root_scope->items, ident);
+  nd = find_symbol(ast, ast->root_scope, ast->root_scope->items, ident);
   if (nd) {
     res |= IDENT_GLOBAL_VAR;
     if (result) (*result) = nd;
@@ -720,7 +874,7 @@ int ident_role(ast_t *ast, char *ident, ast_node_t **result) {
         if (result) (*result) = nd;
         break;
       } else {
-        nd = ast_node_find(sc->items, ident);
+        nd = find_symbol(ast, sc, sc->items, ident);
         if (nd) {
           res |= IDENT_PARENT_LOCAL_VAR;
           if (result) (*result) = nd;
@@ -736,7 +890,8 @@ int ident_role(ast_t *ast, char *ident, ast_node_t **result) {
     res |= IDENT_LOCAL_VAR;
     if (result) (*result) = nd;
   } else {
-    nd = ast_node_find(ast->current_scope->items, ident);
+    nd = find_symbol(ast, ast->current_scope, ast->current_scope->items,
+                     ident);
     if (nd) {
       res |= IDENT_LOCAL_VAR;
       if (result) (*result) = nd;
@@ -9,6 +9,8 @@
 #include <inttypes.h>
 #include <stdarg.h>
 
+#include <arena.h>
+#include <hash.h>
 #include <utils.h>
 #include <writer.h>
 
@@ -52,6 +54,12 @@ DESTRUCTOR(static_type_t);
 //! (for non-basic type assert fails)
 int static_type_basic(static_type_t *t);
 
+//! is `t` `int`, `int8` or `int16`? (the values of all of them are `int`s)
+int static_type_int(static_type_t *t);
+
+//! is `t` `int64`? (its value takes two slots, see code.h)
+int static_type_int64(static_type_t *t);
+
 /**
  * @brief list of members of a static_type_t
  *
@@ -126,6 +134,7 @@ DESTRUCTOR(variable_t);
 typedef struct _scope_t {
   struct _scope_t *parent;    //!< NULL for root_scope
   struct _ast_node_t *items;  //!< list for nodes in the scope (owned)
+  struct _ast_node_t *last;   //!< last of the items (used while parsing)
   struct _function_t *fn;     //!< function the scope belongs to or NULL
 } scope_t;
 
@@ -149,7 +158,11 @@ typedef struct _function_t {
   scope_t *root_scope;  //!< root scope (owned), parent is ast->root_scope
 
   uint32_t n,  //!< id -  entry in the fnmap table
-      addr;    //!< absolute address in code (set during code generation)
+      addr,    //!< absolute address in code (set during code generation)
+      op_depth,   //!< max. depth of `op_stack` (set during code generation)
+      acc_depth;  //!< max. depth of `acc_stack` (set during code generation)
+  int inline_hint;  //!< declared with the `inline` keyword
+  int builtin;      //!< built-in function computed by an instruction
 } function_t;
 
 //! constructor
@@ -174,7 +187,8 @@ typedef enum {
   EXPR_BINARY = 27,         //!< binary expression
   EXPR_CAST = 28,           //!< typecast
   EXPR_SPECIFIER = 29,      //!< specifier expression (<name>.<member>)
-  EXPR_SORT = 30            //!< sort built-in
+  EXPR_SORT = 30,           //!< sort built-in
+  EXPR_SLICE = 31           //!< slice of an array (<name>[<l>:<r>])
 } expression_variant_t;
 
 /*
@@ -227,17 +241,24 @@ int inferred_type_equal(inferred_type_t *a, inferred_type_t *b);
 typedef enum {
   CONVERT_FROM_INT = 1U,    //!< from int
   CONVERT_FROM_FLOAT = 2U,  //!< from float
-  CONVERT_FROM = 3U,        //!< from
+  CONVERT_FROM_INT64 = 128U, //!< from int64 (to a single int value)
+  CONVERT_FROM = 131U,      //!< from
   CONVERT_TO_INT = 4U,      //!< to int
   CONVERT_TO_FLOAT = 8U,    //!< to float
   CONVERT_TO_CHAR = 16U,    //!< to char
-  CONVERT_TO = 28U          //!< to
+  CONVERT_TO_INT8 = 32U,    //!< to int8
+  CONVERT_TO_INT16 = 64U,   //!< to int16
+  CONVERT_TO_INT64 = 256U,  //!< to int64 (from a single int value)
+  CONVERT_TO = 380U,        //!< to
+  CONVERT_NARROW = 512U     //!< to int8 or int16 from a type with more values
 } conversion_flag_t;
 
 /**
  * Test if static_type_t st can be assigned to from a value of static_type_t t.
  * if yes, and #casts is not NULL, an array of n_casts is allocated, and
- * populated with conversion flags
+ * populated with conversion flags (one for each value; the single flag of a
+ * conversion between `int64` and an int type has #CONVERT_FROM_INT64 or
+ * #CONVERT_TO_INT64)
  */
 int static_type_compatible(static_type_t *st, static_type_t *t, int **casts,
                            int *n_casts);
@@ -258,6 +279,9 @@ typedef struct {
   function_t *fn;  //!< function (external)
   struct _ast_node_t
       *params;  //!< parameters (owned); list of AST_NODE_EXPRESSION
+  //! owned; NULL, or the copy of `fn` (AST_NODE_FUNCTION) whose body is
+  //! emitted instead of the call (see inline_functions in optimize.h)
+  struct _ast_node_t *inlined;
 } expr_function_t;
 
 //! expression variant for variables and array elements
@@ -265,6 +289,11 @@ typedef struct {
   variable_t *var;  //!< variable (external)
   //! owned; NULL for variables, list of AST_NODE_EXPRESSION for array elements
   struct _ast_node_t *params;
+  int in_bounds;  //!< array element with indices proven in range (optimize.h)
+  int exclusive;  //!< array element accessed by the threads at different
+                  //!< addresses (optimize.h)
+  int row;  //!< array element whose row is computed before a loop, 0 if none
+            //!< (see hoist_rows in optimize.h)
 } expr_variable_t;
 
 //! expression variant for expressions with operator
@@ -304,6 +333,7 @@ typedef struct {
  * orig. ex. specifier    | expr_specif_t *  | static_type_member_t* member,
  * expression_t ex sort         | expr_variable_t *| var = array to be sorted,
  * params = specifier list
+ * slice        | expr_variable_t *| var = array, params = the bounds l, r
  *
  */
 typedef struct _expression_t {
@@ -320,7 +350,7 @@ typedef struct _expression_t {
     expr_cast_t *c;
     expr_specif_t *s;
   } val;  //!< the value of the variant
-
+  int uniform;  //!< value same in all threads, computed once (optimize.h)
 } expression_t;
 
 //! constructor
@@ -379,6 +409,9 @@ typedef struct _statement_t {
   struct _ast_node_t *par[2];  //!< parameters ( owned)
   int tag;                     //!< used for breakpoints
   function_t *ret_fn;          //!< external, only used for return
+  int uniform;                 //!< condition same in all threads (optimize.h)
+  int row, n_rows;  //!< rows computed before the loop, numbered from `row`
+                    //!< (see hoist_rows in optimize.h)
 } statement_t;
 
 //! constructor
@@ -469,13 +502,46 @@ typedef struct {
   static_type_t *current_type;  //!< used while parsing
   int error_occured;            //!< flag if parsing was correct
   int mem_mode;                 //!< last issued token for memory mode
+  arena_t *arena;               //!< memory of all the objects (owned)
+  hash_table_t *symbols;  //!< named nodes by their list and name (see below)
+  ast_node_t *last_type,  //!< last of the types (used while parsing)
+      *last_function;     //!< last of the functions (used while parsing)
+  ast_node_t *type_int,   //!< the basic types (see add_basic_types)
+      *type_float, *type_void, *type_char, *type_int8, *type_int16,
+      *type_int64;
+  int n_nodes;            //!< number of nodes created, the next id
+  void *scanner;          //!< the scanner of driver_parse (used while parsing)
 } ast_t;
 
-//! allocates the ast_t structure and returns pointer
+/**
+ * @brief allocates the ast_t structure and returns pointer
+ *
+ * The new ast becomes the current ast of the calling thread: all AST objects
+ * (nodes, expressions, types, variables, names, literal values) created in
+ * the thread until the ast is deleted or another one is created, are
+ * allocated from the arena of the ast (see ast_alloc()), and expressions get
+ * the basic types of the ast.
+ */
 CONSTRUCTOR(ast_t);
-//! free the structure and its members
+//! free the structure and all its objects at once
 DESTRUCTOR(ast_t);
 
+/**
+ * @brief make `ast` the current ast of the calling thread
+ * Needed in threads working on an ast created in another thread (only one
+ * thread may create objects of an ast at a time).
+ */
+void ast_use(ast_t *ast);
+//! the current ast of the calling thread (NULL if none)
+ast_t *ast_current();
+
+//! allocate memory of an AST object (from the arena of the current ast)
+void *ast_alloc(size_t size);
+//! copy of the string `s` allocated by ast_alloc()
+char *ast_strdup(const char *s);
+//! free memory from ast_alloc(); a no-op for memory in the arena
+void ast_free(void *p);
+
 //----------------------------------------------------------------------------
 /**
  * @brief identifier roles
@@ -492,6 +558,24 @@ typedef enum {
   IDENT_VAR = 0xEU  //!<  local or globar or parent local
 } ident_role_t;
 
+/*
+ * symbol tables
+ *
+ * While parsing, the types, the functions and the items of the scopes are
+ * appended by the following functions. They keep the last element of each
+ * list, and record the named nodes in `ast->symbols`, so that appending and
+ * looking up a name does not walk the lists. Lists changed otherwise (by the
+ * optimizations after parsing) must not be used with them.
+ */
+//! append a list of nodes to the items of the scope
+void scope_append(ast_t *ast, scope_t *sc, ast_node_t *items);
+//! append a function (AST_NODE_FUNCTION) to `ast->functions`
+void ast_append_function(ast_t *ast, ast_node_t *fn);
+//! append a type (AST_NODE_STATIC_TYPE) to `ast->types`
+void ast_append_type(ast_t *ast, ast_node_t *t);
+//! the type with given name, or NULL
+ast_node_t *ast_find_type(ast_t *ast, const char *name);
+
 //! returns combination of values in current scope, and (if not NULL) stores
 //! the node (of the closest variable)
 int ident_role(ast_t *ast, char *ident, ast_node_t **result);
@@ -24,7 +24,8 @@ static const char *const expr_names[] = {
     "EXPR_EMPTY",  "EXPR_LITERAL",       "EXPR_INITIALIZER",
     "EXPR_CALL",   "EXPR_ARRAY_ELEMENT", "EXPR_VAR_NAME",
     "EXPR_SIZEOF", "EXPR_POSTFIX",       "EXPR_PREFIX",
-    "EXPR_BINARY", "EXPR_CAST",          "EXPR_SPECIFIER"};
+    "EXPR_BINARY", "EXPR_CAST",          "EXPR_SPECIFIER",
+    "EXPR_SORT",   "EXPR_SLICE"};
 
 static const char *const ioflag_names[] = {"IO_FLAG_NONE", "IO_FLAG_IN",
                                            "IO_FLAG_OUT"};
@@ -107,7 +108,8 @@ static void print_expr_props(expression_t *e) {
     MSG("array:'%s' ", e->val.v->var->name);
   }
 
-  if (e->variant == EXPR_SIZEOF) MSG("variable:'%s' ", e->val.v->var->name);
+  if (e->variant == EXPR_SIZEOF || e->variant == EXPR_SLICE)
+    MSG("variable:'%s' ", e->val.v->var->name);
 
   if (e->variant == EXPR_BINARY || e->variant == EXPR_PREFIX ||
       e->variant == EXPR_POSTFIX) {
@@ -193,6 +195,7 @@ static void print_node(int ofs, ast_node_t *node) {
   if (node->node_type == AST_NODE_EXPRESSION &&
       (node->val.e->variant == EXPR_ARRAY_ELEMENT ||
        node->val.e->variant == EXPR_SIZEOF ||
+       node->val.e->variant == EXPR_SLICE ||
        node->val.e->variant == EXPR_CALL)) {
     for (ast_node_t *t = node->val.e->val.v->params; t; t = t->next)
       print_node(ofs + 5, t);
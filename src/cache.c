@@ -0,0 +1,184 @@
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utime.h>
+
+#include <cache.h>
+#include <driver.h>
+#include <hash.h>
+#include <writer.h>
+
+uint64_t cache_limit = UINT64_C(256) << 20;
+
+// path of the cache file with given key and extension
+static char *cache_path(const char *dir, uint64_t key, const char *ext) {
+  int n = strlen(dir) + 32;
+  char *r = (char *)malloc(n);
+  snprintf(r, n, "%s/%016" PRIx64 ".%s", dir, key, ext);
+  return r;
+}
+
+// copy a file (`-` is stdout); return 1 on success
+static int copy_file(const char *from, const char *to) {
+  long n;
+  char *data = driver_read_file(from, &n);
+  if (!data) return 0;
+  FILE *f = strcmp(to, "-") ? fopen(to, "wb") : stdout;
+  int ok = f && fwrite(data, 1, n, f) == (size_t)n;
+  if (f && f != stdout) ok = !fclose(f) && ok;
+  free(data);
+  return ok;
+}
+
+// copy a file to the cache under its final name only when complete
+static int put_file(const char *from, const char *to) {
+  int n = strlen(to) + 32;
+  char *tmp = (char *)malloc(n);
+  snprintf(tmp, n, "%s.%d.tmp", to, (int)getpid());
+  int ok = copy_file(from, tmp) && !rename(tmp, to);
+  if (!ok) unlink(tmp);
+  free(tmp);
+  return ok;
+}
+
+uint64_t cache_compiler_hash() {
+  long n;
+  char *exe = driver_read_file("/proc/self/exe", &n);
+  if (!exe) return hash_text(HASH_INIT, __DATE__ " " __TIME__);
+  uint64_t h = hash_bytes(HASH_INIT, exe, n);
+  free(exe);
+  return h;
+}
+
+// key of the binary: the manifest key extended by the visited files
+static uint64_t add_file(uint64_t key, const char *name, uint64_t hash) {
+  key = hash_text(key, name);
+  return hash_bytes(key, &hash, sizeof(hash));
+}
+
+int cache_lookup(const char *dir, uint64_t config, const char *input,
+                 const char *output) {
+  uint64_t key = hash_text(config, input);
+  char *dep = cache_path(dir, key, "dep");
+  FILE *f = fopen(dep, "r");
+  if (!f) {
+    free(dep);
+    return 0;
+  }
+
+  int ok = 1;
+  char *line = NULL;
+  size_t size = 0;
+  ssize_t len;
+  while (ok && (len = getline(&line, &size, f)) > 18) {
+    if (line[len - 1] == '\n') line[len - 1] = 0;
+    uint64_t hash = strtoull(line, NULL, 16);
+    char *name = line + 17;
+    char *content = driver_read_file(name, NULL);
+    if (!content || hash_text(HASH_INIT, content) != hash) ok = 0;
+    free(content);
+    key = add_file(key, name, hash);
+  }
+  free(line);
+  fclose(f);
+
+  char *bin = cache_path(dir, key, "wt");
+  if (ok) ok = copy_file(bin, output);
+  if (ok) {
+    utime(dep, NULL);
+    utime(bin, NULL);
+  }
+  free(bin);
+  free(dep);
+  return ok;
+}
+
+typedef struct {
+  uint64_t key;
+  writer_t *manifest;
+} store_t;
+
+static void store_file(const char *name, uint64_t hash, void *data) {
+  store_t *s = (store_t *)data;
+  out_text(s->manifest, "%016" PRIx64 " %s\n", hash, name);
+  s->key = add_file(s->key, name, hash);
+}
+
+typedef struct {
+  char *name;
+  off_t size;
+  time_t used;
+} entry_t;
+
+static int entry_cmp(const void *a, const void *b) {
+  time_t x = ((entry_t *)a)->used, y = ((entry_t *)b)->used;
+  return (x > y) - (x < y);
+}
+
+// remove the least recently used files over the size limit
+static void evict(const char *dir) {
+  DIR *d = opendir(dir);
+  if (!d) return;
+  entry_t *entries = NULL;
+  int n = 0;
+  uint64_t total = 0;
+  for (struct dirent *e; (e = readdir(d));) {
+    int len = strlen(e->d_name);
+    if (len < 4 || (strcmp(e->d_name + len - 3, ".wt") &&
+                    strcmp(e->d_name + len - 4, ".dep")))
+      continue;
+    entry_t en;
+    en.name = (char *)malloc(strlen(dir) + len + 2);
+    sprintf(en.name, "%s/%s", dir, e->d_name);
+    struct stat st;
+    if (stat(en.name, &st) || !S_ISREG(st.st_mode)) {
+      free(en.name);
+      continue;
+    }
+    en.size = st.st_size;
+    en.used = st.st_mtime;
+    entries = (entry_t *)realloc(entries, (n + 1) * sizeof(entry_t));
+    entries[n++] = en;
+    total += en.size;
+  }
+  closedir(d);
+
+  qsort(entries, n, sizeof(entry_t), entry_cmp);
+  for (int i = 0; i < n; i++) {
+    if (total > cache_limit && !unlink(entries[i].name))
+      total -= entries[i].size;
+    free(entries[i].name);
+  }
+  free(entries);
+}
+
+void cache_store(compiler_ctx_t *ctx, const char *dir, uint64_t config,
+                 const char *input, const char *output) {
+  mkdir(dir, 0777);
+
+  store_t s;
+  s.key = hash_text(config, input);
+  s.manifest = writer_t_new(WRITER_STRING);
+  char *dep = cache_path(dir, s.key, "dep");
+  driver_visited_files(ctx, store_file, &s);
+
+  char *bin = cache_path(dir, s.key, "wt");
+  if (put_file(output, bin)) {
+    int n = strlen(dep) + 32;
+    char *tmp = (char *)malloc(n);
+    snprintf(tmp, n, "%s.%d.tmp", dep, (int)getpid());
+    FILE *f = fopen(tmp, "w");
+    int ok = f && fwrite(s.manifest->str.base, 1, s.manifest->str.ptr, f) ==
+                      (size_t)s.manifest->str.ptr;
+    if (f) ok = !fclose(f) && ok;
+    if (!ok || rename(tmp, dep)) unlink(tmp);
+    free(tmp);
+  }
+  free(bin);
+  free(dep);
+  writer_t_delete(s.manifest);
+  evict(dir);
+}
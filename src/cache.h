@@ -0,0 +1,52 @@
+/**
+ * @file cache.h
+ * @brief content-addressed cache of compiled programs (used by `wtc`)
+ *
+ * A compiled program is stored in the cache directory under a key computed
+ * from the compiler and its options (the `config` hash), the name of the
+ * input file, and the names and contents of all files the parser visited
+ * (the input and everything it `#include`s, see #driver_visited_files).
+ *
+ * The included files are only known after parsing, so the cache keeps for
+ * every `config` and input a manifest `<key>.dep` listing the visited files
+ * with the hashes of their contents. A lookup reads the files of the manifest;
+ * if none of them changed, the binary `<key>.wt` is copied to the output
+ * without parsing.
+ *
+ * Files of the cache are touched when used; when the cache grows over its
+ * size limit, the least recently used ones are removed.
+ */
+#ifndef __CACHE_H__
+#define __CACHE_H__
+
+#include <inttypes.h>
+
+#include <driver.h>
+
+//! size limit of the cache directory in bytes (set by `wtc -cache-size`)
+extern uint64_t cache_limit;
+
+//! hash of the running compiler (its executable), to start `config` from
+uint64_t cache_compiler_hash();
+
+/**
+ * @brief copy the cached binary of `input` to `output`
+ *
+ * `output` is a file name, or `-` for stdout. Return 1 on a hit, 0 if the
+ * program has to be compiled.
+ */
+int cache_lookup(const char *dir, uint64_t config, const char *input,
+                 const char *output);
+
+/**
+ * @brief store the compiled binary `output` of `input`
+ *
+ * Must be called after a successful #driver_parse of `input` in `ctx` (before
+ * the context is deleted), when `output` is written and closed. The directory
+ * is created if it does not exist. Errors are ignored, the cache is only
+ * skipped.
+ */
+void cache_store(compiler_ctx_t *ctx, const char *dir, uint64_t config,
+                 const char *input, const char *output);
+
+#endif
@@ -12,6 +12,7 @@
  *   uint8  | version byte
  *   uint32 | size of static memory
  *   uint8  | memory mode
+ *   uint8  | array layout: 1 if arrays of records are stored by columns, 0 otherwise (since version 5)
  *
  * Following the header are in arbitrary order sections INPUT, OUTPUT, CODE, and optionally
  * DEBUG.
@@ -43,6 +44,8 @@
  *  --------|-------
  *   uint8  | `SECTION_FNMAP`
  *   uint32 | `n_fn` - number of functions
+ *   uint32 | `op_depth` of the main scope (since version 2)
+ *   uint32 | `acc_depth` of the main scope (since version 2)
  *
  * followed by `n_fn` function descriptors:
  *
@@ -50,9 +53,17 @@
  *  --------|-------
  *   uint32 | address in the code segment
  *   int32  | `stack_change`: how should the `op_stack` change after the call
+ *   uint32 | `op_depth` (since version 2)
+ *   uint32 | `acc_depth` (since version 2)
  *  
  * `stack_change` = `out_type_size` - `overall_size_of_parameters`
  *
+ * `op_depth` and `acc_depth` are upper bounds (in bytes) on how much the
+ * `op_stack` and `acc_stack` of a thread can grow while executing the
+ * function (or the main scope), not counting the nested calls. They are
+ * also the bounds for the threads created by `FORK` within the function, so
+ * the virtual machine can allocate the stacks once at `CALL` and `FORK`.
+ *
  * The DEBUG section is optional, and has the following structure:
  *
  *  type                                | meaning
@@ -86,6 +97,17 @@
  *  ### Storage ###
  *
  *  `int`, `float`, `char` are stored directly in memory as `int32_t`, `float`, `uint8_t`.
+ *  Since version 6, `int8` and `int16` are stored as `int8_t` and `int16_t`; on
+ *  the stack, like `char`, they take 4B and are used as `int`. A value
+ *  is truncated when it is stored; since version 12, also when it is converted
+ *  to `int8` or `int16` (a cast, an argument, a return value) by `INT2INT8`,
+ *  `INT2INT16`.
+ *  Since version 9, `int64` (`int64_t`) takes two 4B values, in memory and on
+ *  the stack: the low half at offset 0 (on top of the stack), the high half
+ *  at offset 4. Both halves have the type descriptor `TYPE_INT64`, so the
+ *  layout of an `int64` has two values (e.g. two columns with `wtc -soa`).
+ *  Loads and stores move the halves as `int`s; the `*_INT64` instructions
+ *  compute on the pairs, `INT2INT64` and `INT642INT` convert from and to `int`.
  *
  *  Arrays have header in static memory, and the contents is allocated on heap
  *  when the array is created. The header has the following structure
@@ -96,6 +118,128 @@
  *  uint32                 |  `n_dim`
  *  `n_dim`  uint32 ranges |  size in i-th dimension
  *
+ * ### Arrays of records ###
+ *
+ * The elements of an array are stored one after another, each element with
+ * its values at the offsets of its type. If the array layout in the header is
+ * 1 (`wtc -soa`), the arrays whose elements have more than one basic value
+ * are stored by columns instead: for an array of `n` elements, value `k` of
+ * element `i` is at `base + 4 * (k * n + i)`, each value (also `char`) taking
+ * 4B. A loop over one member of the elements then reads consecutive memory.
+ * The compiler computes the address of an element as for elements of size 4
+ * (the address of value 0), and adds `4 * k * n`, computed from the header,
+ * for value `k`.
+ *
+ * ### Frame slots ###
+ *
+ * Since version 3, the instructions `LDL`, `STL`, `LDG`, `STG` access a 4B
+ * variable at a constant address given in the instruction: relative to the
+ * frame base (local variables of a function, the per-thread "registers"), or
+ * absolute (global variables). Each replaces the sequence `PUSHC a`, (`FBASE`),
+ * `LDC` / `STC` with the same effect on the stacks and the memory checks. In
+ * the cost model each counts as one instruction, like any other, so `W` and
+ * `T` are the number of executed instructions of the fused code.
+ *
+ * Since version 11, the frame slots also serve as the registers of
+ * three-operand arithmetic: `ALU3` computes `d = a op b` for slots (or a
+ * small constant `b`) given in the instruction, without the op stack. It
+ * replaces `LDL b` (or `PUSHB b`), `LDL a`, `op`, `STL d` (or the same with
+ * `LDG` and `STG`); the values are read in all threads before any is stored,
+ * with the memory checks of the four instructions. It counts as the four
+ * instructions it replaces, so the fusion does not change `W` and `T`.
+ *
+ * ### Register encoding ###
+ *
+ * Since version 13, the code can also be written in the register encoding
+ * (`wtc -regs`): the version byte has the flag #CODE_REGISTERS set, and the
+ * code may use #NUM_REGISTERS per-thread registers for the temporary values
+ * of expressions, which otherwise live on the op stack. The variables stay
+ * in the frame slots. `ALUR` computes `r = a op b` into a register, `ALU3`
+ * may take its operands from registers (#ALU3_AREG, #ALU3_BREG), and `PUSHR`
+ * pushes a register to the op stack for the instructions that take their
+ * operands from there. A register holds a value only from the instruction
+ * that sets it to the one that uses it, within a basic block, so the
+ * registers are not saved by `CALL` or `FORK`. The instructions are not
+ * allowed in the stack encoding.
+ *
+ * The register code stands for the stack code it was made from, and `W`
+ * and `T` count the instructions of that stack code: `ALU3` and `ALUR` count
+ * one for the operation, one for each operand in a slot or a constant (a
+ * load or a `PUSHB`), and one for the store of `ALU3` (see #ALU3_COST); an
+ * operand in a register was on the op stack, and `PUSHR` is not counted.
+ *
+ * ### Array elements ###
+ *
+ * The header of an array does not change after the array is created. Since
+ * version 4, `IDXA` computes the heap address of an element in one step: it
+ * does the checks of `IDX`, loads the base address from the header (with the
+ * memory check of `LDC`) and adds the offset scaled by the size of the element.
+ * It replaces the sequence `S2A`, `IDX n`, `PUSHC s`, `MULT_INT`, `A2S`,
+ * `POPA`, `LDC`, `ADD_INT`.
+ *
+ * The compiler emits `IDX_NC` (and `IDXA` with #IDXA_NO_CHECK) for accesses
+ * whose indices it has proven to be in range; the machine then skips the
+ * comparisons.
+ *
+ * Since version 14, the row of an element whose indices except the last do
+ * not change in a loop is computed once before the loop (see `hoist_rows` in
+ * optimize.h). `ROW` reads the header and leaves the address of the element
+ * with the last index 0, the size of the last dimension (or #IDXR_BAD if an
+ * index is out of range) and the header address; the compiler stores them to
+ * three slots after the variables. In the loop, `IDXR` computes the address
+ * of the element from the slots and the last index, with the range checks
+ * of `IDXA` (an index out of range found by `ROW` is reported by the first
+ * `IDXR`, with the same message).
+ *
+ * In the EREW and CREW modes the machine checks that the threads executing
+ * one instruction do not access the same address. Loads and stores of array
+ * elements that the compiler has proven to be at different addresses for
+ * all these threads (see `check_exclusive` in optimize.h) use `LDCH_NC`,
+ * `LDBH_NC`, `STCH_NC`, `STBH_NC`, which skip the check.
+ *
+ * ### Slices ###
+ *
+ * The expression `a[l:r]` is an array with the elements `l,...,r-1` of `a` in
+ * the first dimension and the other sizes of `a`. Since version 7, `SLICE`
+ * makes its value (the header, as it is passed to a function) from the header
+ * of `a`: the base address moves by `l` times the size of a row of `a`, and the
+ * size in the first dimension is `r - l`. The elements stay where they are, so
+ * writes to the elements of the slice change `a`. `SLICE` checks the number
+ * of dimensions and `0 <= l <= r <= s1` (with the memory check of `LDC` on the
+ * header). Arrays stored by columns cannot be sliced.
+ *
+ * ### Random numbers ###
+ *
+ * Since version 8, `RAND` and `RANDF` (the built-in functions
+ * `philox_rand(seed, counter)` and `philox_randf(seed, counter)`) compute a
+ * random number from the seed and the counter alone, by the counter-based generator Philox-2x32-10
+ * (philox() in vm.h). The numbers do not depend on the order in which the
+ * threads run, nor on the machine or the engine (`wtrun`, `wtc -emit-c`),
+ * and each costs one instruction. Threads get independent numbers by using
+ * different counters (e.g. the index of the thread), calls by using different
+ * seeds or counters.
+ *
+ * ### Uniform branches ###
+ *
+ * A condition of `if`, `while`, `do` or `for` is normally tested by `SPLIT`,
+ * which creates two groups that are joined again. If the compiler has proven
+ * that the condition has the same value in all threads of the group (see
+ * `check_uniform` in optimize.h), it emits `JMPZ` instead: the group stays as
+ * it is and jumps over the branch (or out of the loop) as a whole. Like
+ * `SPLIT`, `JMPZ` counts as one instruction of `W`; the condition itself is
+ * still counted in every active thread.
+ *
+ * ### Uniform values ###
+ *
+ * An expression in a pardo or a function whose value is proven to be the same
+ * in all threads (by the same analysis, e.g. a global variable, `a.size`,
+ * `n - 1`, but not a bare literal) is preceded by `UNIFORM x`. The machine
+ * runs the instructions of the expression in the first active thread only and
+ * pushes the resulting values to the stacks of the other active threads. `W`
+ * and `T` are counted as if every active thread ran the instructions;
+ * `UNIFORM` itself is not counted. An expression is not marked in the EREW
+ * mode, where each thread has to read the memory to check for the conflicts.
+ *
  * ### Function calls ###
  *
  * on `call x`
@@ -113,6 +257,21 @@
 #define __CODE__H__
 #include <utils.h>
 
+//! version byte written by the compiler
+#define CODE_VERSION 14
+//! oldest version byte still accepted by the virtual machine
+#define CODE_MIN_VERSION 1
+//! flag in the version byte: the code is in the register encoding (since
+//! version 13, see Register encoding)
+#define CODE_REGISTERS 0x80U
+//! 1 if the virtual machine accepts the version byte `v`
+#define code_version_ok(v)                                                  \
+  (((v) & ~CODE_REGISTERS) >= CODE_MIN_VERSION &&                           \
+   ((v) & ~CODE_REGISTERS) <= CODE_VERSION &&                               \
+   (!((v) & CODE_REGISTERS) || ((v) & ~CODE_REGISTERS) >= 13))
+//! number of registers of a thread in the register encoding
+#define NUM_REGISTERS 16
+
 /**
  * @brief instruction set
  *
@@ -225,14 +384,101 @@ SORT,       /*!< `addr, size, offs, type, ... -> ...` :
               `addr` is a 1-dimensional array of elements of `size`, 
                sort it based on a key of `type`, located at `offs` in
                the record; 
-               type = `TYPE_INT`, `TYPE_FLOAT`, or `TYPE_CHAR`
+               type = `TYPE_INT`, `TYPE_FLOAT`, `TYPE_CHAR`, `TYPE_INT8`,
+               `TYPE_INT16` or `TYPE_INT64` (the key is the whole
+               `int64`), with
+               #SORT_COLUMNS if the array is stored by columns (then
+               `size` is 4 times the number of values of an element, and
+               the key is in column `offs / 4`)
              */  
 
 LOGF,         //!<  `a... -> b...` (a,b:float) b=log2
 LOG,          //!<  `a... -> b...` (a,b:int) b = ceiling log2
 SQRT,         //!<  `a... -> b...` (a,b:int) b = ceiling(sqrt(a))
 SQRTF,        //!<  `a... -> b...` (a,b:float) b = sqrt(a)
-BREAK        //!<  followed by x (4B)  : `a ... -> ....` if `(a)`, fire breakpoint number `x`  
+BREAK,       //!<  followed by x (4B)  : `a ... -> ....` if `(a)`, fire breakpoint number `x`  
+
+LDL,        //!<  followed by a (4B)  : `... -> val(fbase+a),...` (since version 3)
+STL,        //!<  followed by a (4B)  : `val,... -> ...` store to `fbase+a` (since version 3)
+LDG,        //!<  followed by a (4B)  : `... -> val(a),...` (since version 3)
+STG,        //!<  followed by a (4B)  : `val,... -> ...` store to `a` (since version 3)
+IDXA,       /*!< followed by `d` (4B), makes `addr,i1,...,in,... -> haddr ...`
+              (since version 4) where `n` = `d & 0xff` is the number of dimensions,
+              `(d >> 8) & 0x7fffff` the size of an element, and `haddr` the address of
+              the element (relative to heap); if `d & IDXA_NO_CHECK`, the checks
+              of `IDX` are omitted
+             */
+IDX_NC,     //!<  followed by 1B `n`: same as `IDX` without the dimension and range checks (since version 4)
+LDCH_NC,    //!<  same as `LDCH` without the memory access check (since version 4)
+LDBH_NC,    //!<  same as `LDBH` without the memory access check (since version 4)
+STCH_NC,    //!<  same as `STCH` without the memory access check (since version 4)
+STBH_NC,    //!<  same as `STBH` without the memory access check (since version 4)
+JMPZ,       /*!<  followed by `x` (4B): `c,... -> ...` `c` must be the same in all
+              active threads; if `c == 0` or the group is empty, add `x` to pc
+              (relative as in `JMP`, since version 4)
+             */
+LDSB,       //!<  same as `LDB`, `val(a)` is sign-extended (`int8`, since version 6)
+LDSBH,      //!<  same as `LDSB`, but address is relative to heap (since version 6)
+LDSBH_NC,   //!<  same as `LDSBH` without the memory access check (since version 6)
+LDS,        //!<  same as `LDC`, `val(a)` is 2B sign-extended to 4B on stack (`int16`, since version 6)
+STS,        //!<  same as `STC`, `val` 4B on stack converted to 2B in memory (since version 6)
+LDSH,       //!<  same as `LDS`, but address is relative to heap (since version 6)
+STSH,       //!<  same as `STS`, but address is relative to heap (since version 6)
+LDSH_NC,    //!<  same as `LDSH` without the memory access check (since version 6)
+STSH_NC,    //!<  same as `STSH` without the memory access check (since version 6)
+SLICE,      /*!< followed by `d` (4B), makes `addr,l,r,... -> b,n,r-l,s2,...,sn,...`
+              (since version 7) where `n` = `d & 0xff` is the number of dimensions,
+              `d >> 8` the size of an element, and `addr` the address of the header
+              of an array with sizes `s1,...,sn`; the result is the value of the
+              array of elements `l,...,r-1` in the first dimension, with base
+              address `b` (see Slices)
+             */
+RAND,       //!<  `s,c,... -> x,...` (int) x = philox(s, c) >> 1, in [0, 2^31) (since version 8)
+RANDF,      //!<  `s,c,... -> x,...` (s,c:int, x:float) x = (philox(s, c) >> 8) / 2^24, in [0, 1) (since version 8)
+ADD_INT64,  //!<  `a,b,... -> a+b,...` (int64_t, two values each, see Storage; since version 9)
+SUB_INT64,  //!<  `a,b,... -> a-b,...` (int64_t, since version 9)
+MULT_INT64, //!<  `a,b,... -> a*b,...` (int64_t, since version 9)
+DIV_INT64,  //!<  `a,b,... -> a/b,...` (int64_t, since version 9)
+MOD_INT64,  //!<  `a,b,... -> a%b,...` (int64_t, since version 9)
+EQ_INT64,   //!<  `a,b,... -> x,...` x=1 if a=b (a,b:int64_t, x:int32_t, since version 9)
+GT_INT64,   //!<  `a,b,... -> x,...` x=1 if a>b (int64_t, since version 9)
+GEQ_INT64,  //!<  `a,b,... -> x,...` x=1 if a>=b (int64_t, since version 9)
+LT_INT64,   //!<  `a,b,... -> x,...` x=1 if a<b (int64_t, since version 9)
+LEQ_INT64,  //!<  `a,b,... -> x,...` x=1 if a<=b (int64_t, since version 9)
+INT2INT64,  //!<  `a,... -> x,...` (a:int32_t, x:int64_t) sign-extend (since version 9)
+INT642INT,  //!<  `x,... -> a,...` (x:int64_t, a:int32_t) the low half (since version 9)
+UNIFORM,    /*!<  followed by `x` (4B): the instructions up to pc+`x` (relative as in
+              `JMP`) compute values that are the same in all active threads; they
+              are run by the first active thread and the values it pushes are
+              copied to the others (see Uniform values, since version 10)
+             */
+ALU3,       /*!<  followed by `x` (4B): `... -> ...`, `val(d) = val(a) op val(b)`
+              (since version 11) where `op` is the instruction `ALU3_OPS[x & 0xf]`,
+              and `d`, `a`, `b` are the bytes 1, 2, 3 of `x` times 4: addresses
+              relative to `fbase` if `x & ALU3_FRAME`, absolute otherwise; if
+              `x & ALU3_CONST`, byte 3 is the value of `b` (see Frame slots); in
+              the register encoding, byte 2 (3) is a register if `x & ALU3_AREG`
+              (`x & ALU3_BREG`)
+             */
+INT2INT8,   //!<  `a,... -> x,...` (int) x = a truncated to `int8_t`, sign-extended (since version 12)
+INT2INT16,  //!<  `a,... -> x,...` (int) x = a truncated to `int16_t`, sign-extended (since version 12)
+ALUR,       /*!<  followed by `x` (4B): `... -> ...`, `reg(d) = val(a) op val(b)`
+              (since version 13, register encoding only) where `x` is as in
+              `ALU3`, and `d` is a register (see Register encoding)
+             */
+PUSHR,      //!<  followed by `r` (1B): `... -> reg(r),...` (since version 13, register encoding only)
+ROW,        /*!< followed by `d` (4B), makes `addr,i1,...,i(n-1),... -> row,lim,addr,...`
+              (since version 14) where `n` = `d & 0xff` is the number of dimensions,
+              `d >> 8` the size of an element, `row` the address of the element
+              `i1,...,i(n-1),0` (relative to heap), and `lim` the size in dimension `n`,
+              or #IDXR_BAD if an index is out of range (see Array elements)
+             */
+IDXR        /*!< followed by `x` (4B), makes `i,... -> haddr,...` (since version 14)
+              where `haddr` = `val(a) + i * (x >> 18)`, `a` = `4 * (x & 0xffff)`
+              (relative to `fbase` if `x & IDXR_FRAME`) is the slot of the row
+              stored from `ROW` (`row`, `lim`, `addr` at `a`, `a+4`, `a+8`); unless
+              `x & IDXR_NO_CHECK`, fails as `IDXA` if `i >= lim`
+             */
 } instruction_t;
 
 
@@ -250,7 +496,10 @@ SECTION_DEBUG   =0xccU  //!< DEBUG
 typedef enum {
 TYPE_INT   =0U, //!< `int`
 TYPE_FLOAT,     //!< `float`
-TYPE_CHAR       //!< `char`
+TYPE_CHAR,      //!< `char`
+TYPE_INT8,      //!< `int8` (since version 6)
+TYPE_INT16,     //!< `int16` (since version 6)
+TYPE_INT64      //!< half of an `int64` (since version 9, see Storage)
 } type_descriptor_t;
 
 //! supported memory modes
@@ -261,6 +510,49 @@ MEM_MODE_CCRCW      //!< common CRCW
 } memory_mode_t;
 
 
+//! length (in bytes) of an instruction including its parameter
+#define instr_length(op) ( \
+      ((op) == PUSHC || (op) == JMP || (op) == CALL || (op) == JOIN_JMP || \
+       (op) == BREAK || (op) == LDL || (op) == STL || (op) == LDG ||      \
+       (op) == STG || (op) == IDXA || (op) == JMPZ || (op) == SLICE ||   \
+       (op) == UNIFORM || (op) == ALU3 || (op) == ALUR || (op) == ROW || \
+       (op) == IDXR) ? 5 :                                                \
+      ((op) == PUSHB || (op) == IDX || (op) == IDX_NC ||                 \
+       (op) == PUSHR) ? 2 : 1)
+
+//! flag in the parameter of `IDXA`: the indices are known to be in range
+#define IDXA_NO_CHECK 0x80000000U
+//! flag in the parameter of `IDXR`: the slot is relative to the frame base
+#define IDXR_FRAME 0x10000U
+//! flag in the parameter of `IDXR`: the indices are known to be in range
+#define IDXR_NO_CHECK 0x20000U
+//! size of the last dimension left by `ROW` if an index is out of range
+#define IDXR_BAD 0x80000000U
+
+//! the operations of `ALU3`, indexed by the low 4 bits of its parameter
+#define ALU3_OPS                                                         \
+  {ADD_INT,  MULT_INT, BIT_AND,   BIT_OR,    BIT_XOR,   SUB_INT,        \
+   DIV_INT,  MOD_INT,  ADD_FLOAT, SUB_FLOAT, MULT_FLOAT, DIV_FLOAT}
+//! the first operations of #ALU3_OPS are commutative
+#define ALU3_COMMUTATIVE 5
+//! flag in the parameter of `ALU3`: the slots are relative to the frame base
+#define ALU3_FRAME 0x10U
+//! flag in the parameter of `ALU3`: `b` is a constant (0..255, as in `PUSHB`)
+#define ALU3_CONST 0x20U
+//! flag in the parameter of `ALU3`, `ALUR`: `a` is a register (register
+//! encoding only)
+#define ALU3_AREG 0x40U
+//! flag in the parameter of `ALU3`, `ALUR`: `b` is a register (register
+//! encoding only)
+#define ALU3_BREG 0x80U
+//! the instructions of the stack code counted for `ALU3` or `ALUR` (`op`)
+//! with the parameter `x` (see Register encoding)
+#define ALU3_COST(op, x)                                                 \
+  (4 - !!((x) & ALU3_AREG) - !!((x) & ALU3_BREG) - ((op) == ALUR))
+
+//! flag in the type of `SORT`: the array is stored by columns
+#define SORT_COLUMNS 0x10
+
 //! returns true if `oper` (token value) is assignment operator
 #define assign_oper(oper) ( \
       (oper) == '=' || (oper) == TOK_PLUS_ASSIGN || (oper) == TOK_MINUS_ASSIGN || \
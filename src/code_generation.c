@@ -6,8 +6,17 @@
 #include <code_generation.h>
 #include <debug.h>
 #include <errors.h>
+#include <ir.h>
+#include <optimize.h>
 #include <parser.h>
 
+// the web version is single-threaded
+#ifndef __EMSCRIPTEN__
+#define PARALLEL_CODEGEN
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
 #define NODEBUG
 
 #ifdef NODEBUG
@@ -16,17 +25,55 @@
 #define DEBUG(...) printf(__VA_ARGS__)
 #endif
 
-extern ast_node_t *__type__int;  // from parser_utils.c
+int codegen_threads = 0;
+codegen_cache_t *codegen_cache = NULL;
+
+/* ----------------------------------------------------------------------------
+ * context of the code generation
+ *
+ * the main scope and each function are generated into separate code blocks,
+ * the functions possibly in parallel (see emit_parts); each part has its own
+ * context, current in the thread generating it
+ */
+//! rows row..row+n_rows-1 of a loop, kept at address `at` (12B each)
+typedef struct {
+  int row, n_rows;
+  uint32_t at;
+} loop_rows_t;
+
+typedef struct {
+  ast_t *ast;          //!< the program (external)
+  ast_node_t *fn;      //!< the function, NULL for the main scope (external)
+  int opt_level;       //!< level of the code passes (optimize.h)
+  int soa;             //!< arrays of records are stored by columns
+  int regs;            //!< the code is in the register encoding
+  code_block_t *code;  //!< generated code (owned)
+  int was_error;       //!< some error was found
+  error_t **errors;    //!< errors found, not yet in the errors.h log (owned)
+  int n_errors;
+  uint32_t frame_end;  //!< the first address after the variables of the part
+                       //!< and of the inlined functions being emitted
+  int inlined;         //!< depth of the inlined functions being emitted
+  loop_rows_t *loops;  //!< loops with rows being emitted, innermost last
+  int n_loops;         //!< (owned)
+  ast_node_t *rest;    //!< statements emitted as the else of the next `if`
+                       //!< (see emit_code_items)
+} codegen_ctx_t;
+
+static _Thread_local codegen_ctx_t *ctx;
 
-static ast_t *ast;
-static int was_error = 0;
 static void emit_code_scope(code_block_t *code, scope_t *sc);
+static void emit_code_items(code_block_t *code, ast_node_t *p);
+static void emit_code_expression(code_block_t *code, ast_node_t *exn, int addr,
+                                 int clear);
 
 /* ----------------------------------------------------------------------------
- * create error, and insert into errors.h log
+ * create error, and keep it in the context; the errors are inserted into the
+ * errors.h log in the order of the parts of the program (see flush_errors),
+ * so the log does not depend on the order in which the parts are generated
  */
 static void error(YYLTYPE *loc, const char *format, ...) {
-  was_error = 1;
+  ctx->was_error = 1;
   error_t *err = error_t_new();
   int n;
   get_printed_length(format, n);
@@ -35,7 +82,22 @@ static void error(YYLTYPE *loc, const char *format, ...) {
   va_start(args, format);
   append_error_vmsg(err, n, format, args);
   va_end(args);
-  emit_error(err);
+  ctx->errors = (error_t **)realloc(ctx->errors,
+                                    (ctx->n_errors + 1) * sizeof(error_t *));
+  ctx->errors[ctx->n_errors++] = err;
+}
+
+// the expression is of the basic type int
+static int is_int(ast_node_t *node) {
+  return !node->val.e->type->compound &&
+         node->val.e->type->type == ctx->ast->type_int->val.t;
+}
+
+static void flush_errors(codegen_ctx_t *c) {
+  for (int i = 0; i < c->n_errors; i++) emit_error(c->errors[i]);
+  free(c->errors);
+  c->errors = NULL;
+  c->n_errors = 0;
 }
 
 /* ----------------------------------------------------------------------------
@@ -74,7 +136,7 @@ void add_code_block(code_block_t *dst, code_block_t *src) {
 
 // add one instruction with parameters to code block
 void add_instr(code_block_t *out, int code, ...) {
-  static uint8_t buf[4096];
+  uint8_t buf[4096];
   int len = 0;
   va_list args;
   va_start(args, code);
@@ -84,14 +146,28 @@ void add_instr(code_block_t *out, int code, ...) {
     switch (code) {
       case PUSHC:
       case JMP:
+      case JMPZ:
+      case UNIFORM:
+      case ALU3:
+      case ALUR:
       case CALL:
       case JOIN_JMP:
       case BREAK:
+      case LDL:
+      case STL:
+      case LDG:
+      case STG:
+      case IDXA:
+      case ROW:
+      case IDXR:
+      case SLICE:
         lval(buf + len, int32_t) = va_arg(args, int);
         len += 4;
         break;
       case PUSHB:
       case IDX:
+      case IDX_NC:
+      case PUSHR:
         lval(buf + len, uint8_t) = va_arg(args, int);
         len += 1;
         break;
@@ -104,6 +180,18 @@ void add_instr(code_block_t *out, int code, ...) {
   va_end(args);
 }
 
+// add `JMPZ` with the target to be set later; return its position
+static int add_jmpz(code_block_t *code) {
+  int pos = code->pos;
+  add_instr(code, JMPZ, 0, 0);
+  return pos;
+}
+
+// let the jump at position `pos` go to the end of the code
+static void set_jump_target(code_block_t *code, int pos) {
+  lval(code->data + pos + 1, int32_t) = code->pos - pos - 1;
+}
+
 /* ----------------------------------------------------------------------------
  * assign addresses to variables
  *
@@ -155,6 +243,29 @@ static int assign_scope_variable_addresses(uint32_t base, scope_t *sc) {
   return base;
 }
 
+// the first address after the variables in the list (and in the scopes and
+// statements in it) with assigned addresses, at least `end`
+static uint32_t variables_end(uint32_t end, ast_node_t *list) {
+  for (ast_node_t *p = list; p; p = p->next) {
+    switch (p->node_type) {
+      case AST_NODE_VARIABLE: {
+        variable_t *v = p->val.v;
+        uint32_t e = v->addr + (v->num_dim > 0 ? 4 * (v->num_dim + 2)
+                                               : v->base_type->size);
+        if (e > end) end = e;
+      } break;
+      case AST_NODE_SCOPE:
+        end = variables_end(end, p->val.sc->items);
+        break;
+      case AST_NODE_STATEMENT:
+        end = variables_end(end, p->val.s->par[0]);
+        end = variables_end(end, p->val.s->par[1]);
+        break;
+    }
+  }
+  return end;
+}
+
 /* ----------------------------------------------------------------------------
  * size (in bytes) of an inferred type (defined in ast.h )
  */
@@ -189,13 +300,22 @@ static int is_lval_expression(expression_t *ex) {
   }
 }
 
+// the value of the expression is an array (a variable or a slice)
+static int is_array_expression(expression_t *ex) {
+  return (ex->variant == EXPR_VAR_NAME && ex->val.v->var->num_dim > 0) ||
+         ex->variant == EXPR_SLICE;
+}
+
 /* ----------------------------------------------------------------------------
  * is this an expression that creates address relative to heap?
+ *
+ * 2 if the threads executing one instruction access different addresses
+ * (see check_exclusive in optimize.h)
  */
 static int expr_on_heap(expression_t *ex) {
   switch (ex->variant) {
     case EXPR_ARRAY_ELEMENT:
-      return 1;
+      return ex->val.v->exclusive ? 2 : 1;
       break;
     case EXPR_CAST:
       return expr_on_heap(ex->val.c->ex->val.e);
@@ -208,6 +328,71 @@ static int expr_on_heap(expression_t *ex) {
   }
 }
 
+/* ----------------------------------------------------------------------------
+ * size in memory of a value of basic type `type` (#type_descriptor_t)
+ */
+static int basic_size(int type) {
+  switch (type) {
+    case TYPE_CHAR:
+    case TYPE_INT8:
+      return 1;
+    case TYPE_INT16:
+      return 2;
+    default:
+      return 4;
+  }
+}
+
+/* ----------------------------------------------------------------------------
+ * type of the values of a basic type in expressions (`int8` and `int16` are
+ * used as `int`, `int64` is `TYPE_INT64`)
+ */
+static int value_type(static_type_t *t) {
+  int r = static_type_basic(t);
+  return (r == TYPE_INT8 || r == TYPE_INT16) ? TYPE_INT : r;
+}
+
+/* ----------------------------------------------------------------------------
+ * instruction to load / store a value of basic type `type` at an address
+ * given by an expression with expr_on_heap value `on_heap`
+ */
+static int load_instr(int on_heap, int type) {
+  switch (type) {
+    case TYPE_CHAR:
+      return (on_heap == 2) ? LDBH_NC : on_heap ? LDBH : LDB;
+    case TYPE_INT8:
+      return (on_heap == 2) ? LDSBH_NC : on_heap ? LDSBH : LDSB;
+    case TYPE_INT16:
+      return (on_heap == 2) ? LDSH_NC : on_heap ? LDSH : LDS;
+    default:
+      return (on_heap == 2) ? LDCH_NC : on_heap ? LDCH : LDC;
+  }
+}
+
+static int store_instr(int on_heap, int type) {
+  switch (basic_size(type)) {
+    case 1:
+      return (on_heap == 2) ? STBH_NC : on_heap ? STBH : STB;
+    case 2:
+      return (on_heap == 2) ? STSH_NC : on_heap ? STSH : STS;
+    default:
+      return (on_heap == 2) ? STCH_NC : on_heap ? STCH : STC;
+  }
+}
+
+// the basic type a value is stored as with the cast `cast`
+static int cast_type(int cast) {
+  if (cast & CONVERT_TO_CHAR) return TYPE_CHAR;
+  if (cast & CONVERT_TO_INT8) return TYPE_INT8;
+  if (cast & CONVERT_TO_INT16) return TYPE_INT16;
+  return (cast & CONVERT_TO_FLOAT) ? TYPE_FLOAT : TYPE_INT;
+}
+
+// truncation of a value converted to int8 or int16 (#CONVERT_NARROW)
+static int narrow_instr(int cast) {
+  return (cast & CONVERT_TO_INT8) ? INT2INT8 : INT2INT16;
+}
+
 /* ----------------------------------------------------------------------------
  * base address of a variable (if it is in a function, add FBASE)
  */
@@ -216,29 +401,72 @@ static void emit_code_var_addr(code_block_t *code, variable_t *var) {
   if (var->scope->fn) add_instr(code, FBASE, 0);
 }
 
+/* ----------------------------------------------------------------------------
+ * arrays stored by columns (see code.h)
+ *
+ * `var` if its elements are stored by columns, otherwise NULL
+ */
+static variable_t *soa_array(variable_t *var) {
+  if (!ctx->soa || var->num_dim == 0) return NULL;
+  return static_type_layout(var->base_type, NULL) > 1 ? var : NULL;
+}
+
+// the array stored by columns that contains the value of expression `ex`
+static variable_t *expr_soa_array(expression_t *ex) {
+  switch (ex->variant) {
+    case EXPR_ARRAY_ELEMENT:
+      return soa_array(ex->val.v->var);
+    case EXPR_CAST:
+      return expr_soa_array(ex->val.c->ex->val.e);
+    case EXPR_SPECIFIER:
+      return expr_soa_array(ex->val.s->ex->val.e);
+    default:
+      return NULL;
+  }
+}
+
+// index of the first basic value of the member `tm` within its record
+static int member_column(static_type_member_t *tm) {
+  int k = 0;
+  for (static_type_member_t *x = tm->parent->members; x != tm; x = x->next)
+    k += static_type_layout(x->type, NULL);
+  return k;
+}
+
+// push the distance 4 * k * n of column `k` from column 0 of `var`
+static void emit_code_soa_column(code_block_t *code, variable_t *var, int k) {
+  add_instr(code, PUSHC, 4 * k, 0);
+  for (int i = 0; i < var->num_dim; i++) {
+    add_instr(code, PUSHC, var->addr + 4 * (i + 2), 0);
+    if (var->scope->fn) add_instr(code, FBASE, 0);
+    add_instr(code, LDC, MULT_INT, 0);
+  }
+}
+
 /* ----------------------------------------------------------------------------
  * the stack contains the address; emit code to load the variable
  *
  * if the variable is array, load from heap
  * transfer the value of the variable's type
+ * (if `soa` is set, the value is in the columns of the array `soa`)
  */
 static void emit_code_load_value(code_block_t *code, int on_heap, int type_size,
-                                 uint8_t *type_layout) {
-  int ld4 = (on_heap) ? LDCH : LDC;
-  int ld1 = (on_heap) ? LDBH : LDB;
-
+                                 uint8_t *type_layout, variable_t *soa) {
   if (type_size > 1) add_instr(code, S2A, 0);
 
   int offs = 0;
-  for (int i = 0; i < type_size - 1; i++)
-    offs += (type_layout[i] == TYPE_CHAR) ? 1 : 4;
+  for (int i = 0; i < type_size - 1; i++) offs += basic_size(type_layout[i]);
 
   for (int i = type_size - 1; i >= 0; i--) {
-    if (offs > 0) add_instr(code, PUSHC, offs, ADD_INT, 0);
-    add_instr(code, (type_layout[i] == TYPE_CHAR) ? ld1 : ld4, 0);
+    if (soa && i > 0) {
+      emit_code_soa_column(code, soa, i);
+      add_instr(code, ADD_INT, 0);
+    } else if (!soa && offs > 0)
+      add_instr(code, PUSHC, offs, ADD_INT, 0);
+    add_instr(code, load_instr(on_heap, type_layout[i]), 0);
     if (i > 0) {
       add_instr(code, A2S, 0);
-      offs -= (type_layout[i - 1] == TYPE_CHAR) ? 1 : 4;
+      offs -= basic_size(type_layout[i - 1]);
     }
   }
 
@@ -250,6 +478,7 @@ static void emit_code_load_value(code_block_t *code, int on_heap, int type_size,
  *
  * if the variable is array, store to heap
  * perform conversion casts on the way
+ * (if `soa` is set, the value is in the columns of the array `soa`)
  */
 static int conversion_needed(int cast) {
   int from = (cast & CONVERT_FROM_FLOAT) ? TYPE_FLOAT : TYPE_INT;
@@ -258,33 +487,41 @@ static int conversion_needed(int cast) {
 }
 
 static void emit_code_store_value(code_block_t *code, int on_heap, int *casts,
-                                  int n_casts) {
-  int st4 = (on_heap) ? STCH : STC;
-  int st1 = (on_heap) ? STBH : STB;
-
+                                  int n_casts, variable_t *soa) {
   // special case of single value
   if (n_casts == 1) {
-    if (conversion_needed(casts[0])) {
+    if (casts[0] & CONVERT_TO_INT64) {
+      // an int widened to the two values of int64
+      int halves[2] = {CONVERT_FROM_INT | CONVERT_TO_INT,
+                       CONVERT_FROM_INT | CONVERT_TO_INT};
+      add_instr(code, S2A, POP, INT2INT64, A2S, POPA, 0);
+      emit_code_store_value(code, on_heap, halves, 2, soa);
+      return;
+    }
+    if (casts[0] & CONVERT_FROM_INT64)
+      add_instr(code, S2A, POP, INT642INT, A2S, POPA, 0);
+    else if (conversion_needed(casts[0])) {
       int conv = (casts[0] & CONVERT_TO_FLOAT) ? INT2FLOAT : FLOAT2INT;
       add_instr(code, S2A, POP, conv, A2S, POPA, 0);
     }
-    add_instr(code, (casts[0] & CONVERT_TO_CHAR) ? st1 : st4, 0);
+    add_instr(code, store_instr(on_heap, cast_type(casts[0])), 0);
     return;
   }
 
   add_instr(code, S2A, 0);
   for (int i = 0, offs = 0; i < n_casts; i++) {
-    if (offs > 0) add_instr(code, PUSHC, offs, ADD_INT, 0);
+    if (soa && i > 0) {
+      emit_code_soa_column(code, soa, i);
+      add_instr(code, ADD_INT, 0);
+    } else if (!soa && offs > 0)
+      add_instr(code, PUSHC, offs, ADD_INT, 0);
     if (conversion_needed(casts[i])) {
       int conv = (casts[i] & CONVERT_TO_FLOAT) ? INT2FLOAT : FLOAT2INT;
       add_instr(code, S2A, POP, conv, A2S, POPA, 0);
     }
-    add_instr(code, (casts[i] & CONVERT_TO_CHAR) ? st1 : st4, 0);
+    add_instr(code, store_instr(on_heap, cast_type(casts[i])), 0);
     if (i < n_casts - 1) add_instr(code, A2S, 0);
-    if (casts[i] & CONVERT_TO_CHAR)
-      offs++;
-    else
-      offs += 4;
+    offs += basic_size(cast_type(casts[i]));
   }
   add_instr(code, POPA, 0);
 }
@@ -294,20 +531,39 @@ static void emit_code_store_value(code_block_t *code, int on_heap, int *casts,
  *
  */
 static void emit_code_cast_value(code_block_t *code, int *casts, int n_casts) {
+  if (n_casts == 1 && (casts[0] & CONVERT_TO_INT64)) {
+    add_instr(code, INT2INT64, 0);
+    return;
+  }
+  if (n_casts == 1 && (casts[0] & CONVERT_FROM_INT64)) {
+    add_instr(code, INT642INT, 0);
+    if (casts[0] & CONVERT_NARROW) add_instr(code, narrow_instr(casts[0]), 0);
+    return;
+  }
   int needed = 0;
   for (int i = 0; i < n_casts; i++)
-    if (conversion_needed(casts[i])) needed = 1;
+    if (conversion_needed(casts[i]) || (casts[i] & CONVERT_NARROW)) needed = 1;
   if (!needed) return;
   for (int i = 0; i < n_casts; i++) {
     if (conversion_needed(casts[i])) {
       int conv = (casts[i] & CONVERT_TO_FLOAT) ? INT2FLOAT : FLOAT2INT;
       add_instr(code, conv, 0);
     }
+    if (casts[i] & CONVERT_NARROW) add_instr(code, narrow_instr(casts[i]), 0);
     if (i < n_casts - 1) add_instr(code, S2A, POP, 0);
   }
   for (int i = 0; i < n_casts - 1; i++) add_instr(code, A2S, POPA, 0);
 }
 
+/* ----------------------------------------------------------------------------
+ * emit the value of an operand of an int64 operation (an int is widened)
+ */
+static void emit_code_int64_operand(code_block_t *code, ast_node_t *exn) {
+  emit_code_expression(code, exn, 0, 0);
+  if (!static_type_int64(exn->val.e->type->type))
+    add_instr(code, INT2INT64, 0);
+}
+
 /* ----------------------------------------------------------------------------
  * the stack contains value of type t, remove it
  *
@@ -335,6 +591,134 @@ static void emit_code_select_specifier(code_block_t *code,
   for (int i = 0; i < n; i++) add_instr(code, A2S, POPA, 0);
 }
 
+/* ----------------------------------------------------------------------------
+ * store the values on the stack to the parameters of a function (the first
+ * parameter on top); arrays are passed by their header
+ */
+static void emit_code_store_params(code_block_t *code, function_t *f) {
+  for (ast_node_t *p = f->params; p; p = p->next) {
+    variable_t *v = p->val.v;
+    if (v->num_dim == 0) {
+      emit_code_var_addr(code, v);
+      int *casts, n_casts;
+      static_type_compatible(v->base_type, v->base_type, &casts, &n_casts);
+      emit_code_store_value(code, 0, casts, n_casts, NULL);
+      if (casts) free(casts);
+    } else {
+      for (int i = 0; i < v->num_dim + 2; i++) {
+        add_instr(code, PUSHC, v->addr + 4 * i, 0);
+        if (v->scope->fn) add_instr(code, FBASE, 0);
+        add_instr(code, STC, 0);
+      }
+    }
+  }
+}
+
+/* ----------------------------------------------------------------------------
+ * generate code for the copy of a function inlined in a call (see
+ * inline_functions in optimize.h), with the arguments on the stack
+ *
+ * the variables of the copy get addresses after all variables of the caller
+ * (and of the copies being emitted), so they do not overlap any variable
+ * visible at the call; the returns leave the result on the stack without
+ * SETR (emit_code_items does not emit the code after them)
+ */
+static void emit_code_inlined(code_block_t *code, function_t *f) {
+  uint32_t end = ctx->frame_end, base = end;
+  for (ast_node_t *p = f->params; p; p = p->next)
+    base = assign_single_variable_address(base, p->val.v);
+  assign_scope_variable_addresses(base, f->root_scope);
+  ctx->frame_end =
+      variables_end(variables_end(end, f->params), f->root_scope->items);
+
+  add_instr(code, MEM_MARK, 0);
+  emit_code_store_params(code, f);
+  ctx->inlined++;
+  emit_code_items(code, f->root_scope->items);
+  ctx->inlined--;
+  add_instr(code, MEM_FREE, 0);
+  ctx->frame_end = end;
+}
+
+/* ----------------------------------------------------------------------------
+ * rows of arrays computed before a loop (see hoist_rows in optimize.h)
+ *
+ * `ROW` leaves the address of the row, the size of its last dimension and
+ * the header on the stack; they are stored to 12 bytes after the variables
+ * (and the slots of the enclosing loops), where `IDXR` of the elements in
+ * the loop finds them
+ */
+
+//! the first element of each row of the loop `s`
+typedef struct {
+  statement_t *s;
+  ast_node_t **elements;
+} row_elements_t;
+
+static void row_element(ast_node_t *node, void *data) {
+  row_elements_t *r = (row_elements_t *)data;
+  if (node->node_type != AST_NODE_EXPRESSION ||
+      node->val.e->variant != EXPR_ARRAY_ELEMENT)
+    return;
+  int k = node->val.e->val.v->row - r->s->row;
+  if (k >= 0 && k < r->s->n_rows && !r->elements[k]) r->elements[k] = node;
+}
+
+// compute the rows of the loop `node` (whose code is `cond` and the list
+// `body`) and keep their slots until emit_code_rows_end(), return 0 if there
+// are none; with `mark` the slots are allocated after a MEM_MARK
+static int emit_code_rows(code_block_t *code, ast_node_t *node,
+                          ast_node_t *cond, ast_node_t *body, int mark) {
+  statement_t *s = node->val.s;
+  uint32_t at = (ctx->frame_end + 3) & ~3U;
+  if (!s->n_rows || (at + 12 * s->n_rows) / 4 > 0xffff) return 0;
+  if (mark) add_instr(code, MEM_MARK, 0);
+  row_elements_t r = {s, (ast_node_t **)calloc(s->n_rows, sizeof(ast_node_t *))};
+  ir_for_nodes(cond, row_element, &r);
+  for (ast_node_t *p = body; p; p = p->next) ir_for_nodes(p, row_element, &r);
+
+  for (int k = 0; k < s->n_rows; k++) {
+    variable_t *v = r.elements[k]->val.e->val.v->var;
+    // indices i(n-1), ..., i1 below the header
+    for (int i = v->num_dim - 2; i >= 0; i--) {
+      ast_node_t *x = r.elements[k]->val.e->val.v->params;
+      for (int j = 0; j < i; j++) x = x->next;
+      emit_code_expression(code, x, 0, 0);
+    }
+    emit_code_var_addr(code, v);
+    add_instr(code, ROW,
+              v->num_dim | (soa_array(v) ? 4 : v->base_type->size) << 8, 0);
+    for (int i = 0; i < 3; i++) {
+      add_instr(code, PUSHC, at + 12 * k + 4 * i, 0);
+      if (ctx->fn) add_instr(code, FBASE, 0);
+      add_instr(code, STC, 0);
+    }
+  }
+  free(r.elements);
+
+  ctx->loops = (loop_rows_t *)realloc(ctx->loops,
+                                      (ctx->n_loops + 1) * sizeof(loop_rows_t));
+  ctx->loops[ctx->n_loops++] = (loop_rows_t){s->row, s->n_rows, at};
+  ctx->frame_end = at + 12 * s->n_rows;
+  return 1;
+}
+
+// the loop leaves the rows, `end` is the frame end before them
+static void emit_code_rows_end(int rows, uint32_t end) {
+  if (!rows) return;
+  ctx->n_loops--;
+  ctx->frame_end = end;
+}
+
+// the address of the slot of the row, -1 if it is not computed
+static int64_t row_slot(int row) {
+  for (int i = ctx->n_loops - 1; row && i >= 0; i--)
+    if (row >= ctx->loops[i].row &&
+        row < ctx->loops[i].row + ctx->loops[i].n_rows)
+      return ctx->loops[i].at + 12 * (row - ctx->loops[i].row);
+  return -1;
+}
+
 /* ----------------------------------------------------------------------------
  * generate code for an expression
  *
@@ -346,8 +730,8 @@ static void emit_code_select_specifier(code_block_t *code,
  *  - if clear=0, remove anything from stack
  */
 
-static void emit_code_expression(code_block_t *code, ast_node_t *exn, int addr,
-                                 int clear) {
+static void emit_code_expression_each(code_block_t *code, ast_node_t *exn,
+                                      int addr, int clear) {
   exn->emitted = 1;
   expression_t *ex = exn->val.e;
   switch (ex->variant) {
@@ -394,8 +778,12 @@ static void emit_code_expression(code_block_t *code, ast_node_t *exn, int addr,
         assert(p);
         assert(p->node_type == AST_NODE_EXPRESSION);
 
+        // an array (or a slice) of the same dimension for an array parameter
+        int nd = is_array_expression(p->val.e) ? p->val.e->val.v->var->num_dim
+                                               : 0;
         int *casts, n_casts;
-        if (inferred_type_compatible(dst->val.v->base_type, p->val.e->type,
+        if (nd == dst->val.v->num_dim &&
+            inferred_type_compatible(dst->val.v->base_type, p->val.e->type,
                                      &casts, &n_casts)) {
           emit_code_expression(code, p, 0, 0);
           emit_code_cast_value(code, casts, n_casts);
@@ -406,7 +794,16 @@ static void emit_code_expression(code_block_t *code, ast_node_t *exn, int addr,
         }
       }
 
-      if (!strcmp(ex->val.f->fn->name, "sqrt")) {
+      if (!ex->val.f->fn->builtin) {
+        if (!ex->val.f->fn->root_scope) {
+          error(&(exn->loc), "function was only declared without definition");
+          return;
+        }
+        if (ex->val.f->inlined)
+          emit_code_inlined(code, ex->val.f->inlined->val.f);
+        else
+          add_instr(code, CALL, ex->val.f->fn->n, 0);
+      } else if (!strcmp(ex->val.f->fn->name, "sqrt")) {
         add_instr(code, SQRT, 0);
       } else if (!strcmp(ex->val.f->fn->name, "sqrtf")) {
         add_instr(code, SQRTF, 0);
@@ -414,12 +811,10 @@ static void emit_code_expression(code_block_t *code, ast_node_t *exn, int addr,
         add_instr(code, LOG, 0);
       } else if (!strcmp(ex->val.f->fn->name, "logf")) {
         add_instr(code, LOGF, 0);
-      } else {
-        if (!ex->val.f->fn->root_scope) {
-          error(&(exn->loc), "function was only declared without definition");
-          return;
-        }
-        add_instr(code, CALL, ex->val.f->fn->n, 0);
+      } else if (!strcmp(ex->val.f->fn->name, "philox_rand")) {
+        add_instr(code, RAND, 0);
+      } else if (!strcmp(ex->val.f->fn->name, "philox_randf")) {
+        add_instr(code, RANDF, 0);
       }
       if (clear) emit_code_remove_type(code, ex->val.f->fn->out_type);
 
@@ -435,7 +830,7 @@ static void emit_code_expression(code_block_t *code, ast_node_t *exn, int addr,
         if (nd == 0) {
           uint8_t *layout,
               ts = static_type_layout(ex->val.v->var->base_type, &layout);
-          emit_code_load_value(code, 0, ts, layout);
+          emit_code_load_value(code, 0, ts, layout, NULL);
           free(layout);
         } else {
           // the value of an array is num_dim + 2 ints
@@ -457,8 +852,7 @@ static void emit_code_expression(code_block_t *code, ast_node_t *exn, int addr,
       ast_node_t *oexn = ex->val.c->ex;
       static_type_t *nt = ex->val.c->type;
 
-      if (oexn->val.e->variant == EXPR_VAR_NAME &&
-          oexn->val.e->val.v->var->num_dim > 0) {
+      if (is_array_expression(oexn->val.e)) {
         error(&(exn->loc), "cannot cast array");
         break;
       }
@@ -495,20 +889,38 @@ static void emit_code_expression(code_block_t *code, ast_node_t *exn, int addr,
         return;
       }
 
-      for (ast_node_t *x = ex->val.v->params; x; x = x->next) {
-        emit_code_expression(code, x, 0, clear);
-        if (!clear && n > 1) add_instr(code, S2A, POP, 0);
+      // stored by columns, the element is at its value 0 (4B in column 0)
+      variable_t *soa = soa_array(ex->val.v->var);
+      int size = soa ? 4 : ex->val.v->var->base_type->size;
+      int64_t at = clear ? -1 : row_slot(ex->val.v->row);
+      if (at >= 0) {
+        // the row is computed before the loop, only the last index is added
+        ast_node_t *x = ex->val.v->params;
+        while (x->next) x = x->next;
+        emit_code_expression(code, x, 0, 0);
+        add_instr(code, IDXR,
+                  (uint32_t)(at / 4) | (ctx->fn ? IDXR_FRAME : 0) |
+                      (ex->val.v->in_bounds ? IDXR_NO_CHECK : 0) |
+                      (uint32_t)size << 18,
+                  0);
+      } else {
+        for (ast_node_t *x = ex->val.v->params; x; x = x->next) {
+          emit_code_expression(code, x, 0, clear);
+          if (!clear && n > 1) add_instr(code, S2A, POP, 0);
+        }
+        if (!clear && n > 1)
+          for (int i = 0; i < n; i++) add_instr(code, A2S, POPA, 0);
+        if (!clear) {
+          emit_code_var_addr(code, ex->val.v->var);
+          add_instr(code, S2A, ex->val.v->in_bounds ? IDX_NC : IDX, n, PUSHC,
+                    size, MULT_INT, A2S, POPA, LDC, ADD_INT, 0);
+        }
       }
-      if (!clear && n > 1)
-        for (int i = 0; i < n; i++) add_instr(code, A2S, POPA, 0);
       if (!clear) {
-        emit_code_var_addr(code, ex->val.v->var);
-        add_instr(code, S2A, IDX, n, PUSHC, ex->val.v->var->base_type->size,
-                  MULT_INT, A2S, POPA, LDC, ADD_INT, 0);
         if (!addr) {
           uint8_t *layout,
               ts = static_type_layout(ex->val.v->var->base_type, &layout);
-          emit_code_load_value(code, 1, ts, layout);
+          emit_code_load_value(code, expr_on_heap(ex), ts, layout, soa);
           free(layout);
         }
       }
@@ -527,16 +939,34 @@ static void emit_code_expression(code_block_t *code, ast_node_t *exn, int addr,
       if (clear) add_instr(code, POP, 0);
     } break;
 
+    // --------------------------------------
+    case EXPR_SLICE: {
+      if (addr) {
+        error(&(exn->loc), "cannot take address of expression");
+        return;
+      }
+      variable_t *v = ex->val.v->var;
+      if (soa_array(v)) {
+        error(&(exn->loc), "cannot slice %s: stored by columns (-soa)",
+              v->name);
+        return;
+      }
+      // stack: addr, l, r
+      emit_code_expression(code, ex->val.v->params->next, 0, clear);
+      emit_code_expression(code, ex->val.v->params, 0, clear);
+      if (clear) break;
+      emit_code_var_addr(code, v);
+      add_instr(code, SLICE, v->num_dim | (v->base_type->size << 8), 0);
+    } break;
+
     // --------------------------------------
     case EXPR_BINARY:
       // no operation is allowed on arrays
-      if (ex->val.o->first->val.e->variant == EXPR_VAR_NAME &&
-          ex->val.o->first->val.e->val.v->var->num_dim > 0) {
+      if (is_array_expression(ex->val.o->first->val.e)) {
         error(&(ex->val.o->first->loc), "operation not permitted for arrays");
         return;
       }
-      if (ex->val.o->second->val.e->variant == EXPR_VAR_NAME &&
-          ex->val.o->second->val.e->val.v->var->num_dim > 0) {
+      if (is_array_expression(ex->val.o->second->val.e)) {
         error(&(ex->val.o->second->loc), "operation not permitted for arrays");
         return;
       }
@@ -547,14 +977,7 @@ static void emit_code_expression(code_block_t *code, ast_node_t *exn, int addr,
           error(&(exn->loc), "expression is not assignable");
           return;
         }
-        int load, store;
-        if (expr_on_heap(ex->val.o->first->val.e)) {
-          load = LDCH;
-          store = STCH;
-        } else {
-          load = LDC;
-          store = STC;
-        }
+        int onheap = expr_on_heap(ex->val.o->first->val.e);
         if (ex->val.o->oper != '=') {
           // combined assignment
 
@@ -563,8 +986,10 @@ static void emit_code_expression(code_block_t *code, ast_node_t *exn, int addr,
             error(&(exn->loc), "operation not supported on compound types");
             return;
           }
-          int t = static_type_basic(ex->type->type);
-          int t2 = static_type_basic(ex->val.o->second->val.e->type->type);
+          int lt = static_type_basic(ex->val.o->first->val.e->type->type);
+          int load = load_instr(onheap, lt), store = store_instr(onheap, lt);
+          int t = value_type(ex->type->type);
+          int t2 = value_type(ex->val.o->second->val.e->type->type);
 
           if ((t == TYPE_FLOAT || t2 == TYPE_FLOAT) &&
               ex->val.o->oper == TOK_MOD_ASSIGN) {
@@ -625,13 +1050,15 @@ static void emit_code_expression(code_block_t *code, ast_node_t *exn, int addr,
             emit_code_expression(code, r, 0, 0);
             emit_code_expression(code, l, 1, 0);
             if (!clear) add_instr(code, S2A, 0);
-            emit_code_store_value(code, expr_on_heap(l->val.e), casts, n_casts);
+            emit_code_store_value(code, expr_on_heap(l->val.e), casts, n_casts,
+                                  expr_soa_array(l->val.e));
             if (!clear) {
               add_instr(code, A2S, POPA, 0);
               if (!addr) {
                 uint8_t *layout;
                 int ts = inferred_type_layout(l->val.e->type, &layout);
-                emit_code_load_value(code, expr_on_heap(l->val.e), ts, layout);
+                emit_code_load_value(code, expr_on_heap(l->val.e), ts, layout,
+                                     expr_soa_array(l->val.e));
                 free(layout);
               }
             }
@@ -649,9 +1076,38 @@ static void emit_code_expression(code_block_t *code, ast_node_t *exn, int addr,
           error(&(exn->loc), "operation not supported on compound types");
           return;
         }
-        int t = static_type_basic(ex->type->type);
-        int t1 = static_type_basic(ex->val.o->first->val.e->type->type);
-        int t2 = static_type_basic(ex->val.o->second->val.e->type->type);
+        int t = value_type(ex->type->type);
+        int t1 = value_type(ex->val.o->first->val.e->type->type);
+        int t2 = value_type(ex->val.o->second->val.e->type->type);
+
+        if (t == TYPE_INT64) {
+          int op;
+          switch (ex->val.o->oper) {
+            case '+':
+              op = ADD_INT64;
+              break;
+            case '-':
+              op = SUB_INT64;
+              break;
+            case '*':
+              op = MULT_INT64;
+              break;
+            case '/':
+              op = DIV_INT64;
+              break;
+            case '%':
+              op = MOD_INT64;
+              break;
+            default:
+              error(&(exn->loc), "operation not supported on int64");
+              return;
+          }
+          emit_code_int64_operand(code, ex->val.o->second);
+          emit_code_int64_operand(code, ex->val.o->first);
+          add_instr(code, op, 0);
+          if (clear) add_instr(code, POP, POP, 0);
+          break;
+        }
 
         if (t == TYPE_FLOAT && ex->val.o->oper == '%') {
           error(&(exn->loc), "remainder not supported on floats");
@@ -737,10 +1193,37 @@ static void emit_code_expression(code_block_t *code, ast_node_t *exn, int addr,
           error(&(exn->loc), "operation not supported on compound types");
           return;
         }
-        int t = static_type_basic(ex->type->type);
+        int t = value_type(ex->type->type);
         assert(t == TYPE_INT);
-        int t1 = static_type_basic(ex->val.o->first->val.e->type->type);
-        int t2 = static_type_basic(ex->val.o->second->val.e->type->type);
+        int t1 = value_type(ex->val.o->first->val.e->type->type);
+        int t2 = value_type(ex->val.o->second->val.e->type->type);
+        if (t1 == TYPE_INT64 || t2 == TYPE_INT64) {
+          int op;
+          switch (ex->val.o->oper) {
+            case TOK_EQ:
+            case TOK_NEQ:
+              op = EQ_INT64;
+              break;
+            case TOK_LEQ:
+              op = LEQ_INT64;
+              break;
+            case TOK_GEQ:
+              op = GEQ_INT64;
+              break;
+            case '<':
+              op = LT_INT64;
+              break;
+            default:
+              op = GT_INT64;
+              break;
+          }
+          emit_code_int64_operand(code, ex->val.o->second);
+          emit_code_int64_operand(code, ex->val.o->first);
+          add_instr(code, op, 0);
+          if (ex->val.o->oper == TOK_NEQ) add_instr(code, NOT, 0);
+          if (clear) add_instr(code, POP, 0);
+          break;
+        }
         int conv = ((t1 == TYPE_FLOAT) || (t2 == TYPE_FLOAT));
         int op;
         switch (ex->val.o->oper) {
@@ -782,10 +1265,10 @@ static void emit_code_expression(code_block_t *code, ast_node_t *exn, int addr,
           error(&(exn->loc), "operation not supported on compound types");
           return;
         }
-        int t = static_type_basic(ex->type->type);
+        int t = value_type(ex->type->type);
         assert(t == TYPE_INT);
-        int t1 = static_type_basic(ex->val.o->first->val.e->type->type);
-        int t2 = static_type_basic(ex->val.o->second->val.e->type->type);
+        int t1 = value_type(ex->val.o->first->val.e->type->type);
+        int t2 = value_type(ex->val.o->second->val.e->type->type);
         if (t1 == TYPE_FLOAT && t2 == TYPE_FLOAT) {
           error(&(exn->loc), "logical operation needs integral type");
           return;
@@ -803,8 +1286,7 @@ static void emit_code_expression(code_block_t *code, ast_node_t *exn, int addr,
     // --------------------------------------
     case EXPR_PREFIX:
       // no operation is allowed on arrays
-      if (ex->val.o->first->val.e->variant == EXPR_VAR_NAME &&
-          ex->val.o->first->val.e->val.v->var->num_dim > 0) {
+      if (is_array_expression(ex->val.o->first->val.e)) {
         error(&(ex->val.o->first->loc), "operation not permitted for arrays");
         return;
       }
@@ -812,13 +1294,27 @@ static void emit_code_expression(code_block_t *code, ast_node_t *exn, int addr,
         error(&(exn->loc), "operation not supported on compound types");
         return;
       }
-      if (ex->val.o->oper == TOK_DEC || ex->val.o->oper == TOK_INC) {
+      if (value_type(ex->type->type) == TYPE_INT64) {
+        // ..........
+        // unary - of int64
+        if (ex->val.o->oper != '-') {
+          error(&(exn->loc), "operation not supported on int64");
+          return;
+        }
+        if (addr) {
+          error(&(exn->loc), "cannot take address of expression");
+          return;
+        }
+        emit_code_expression(code, ex->val.o->first, 0, 0);
+        add_instr(code, PUSHB, 0, INT2INT64, SUB_INT64, 0);
+        if (clear) add_instr(code, POP, POP, 0);
+      } else if (ex->val.o->oper == TOK_DEC || ex->val.o->oper == TOK_INC) {
         // ..........
         // inc dec
         int onheap = expr_on_heap(ex->val.o->first->val.e);
-        int load = onheap ? LDCH : LDC;
-        int store = onheap ? STCH : STC;
-        int type = static_type_basic(ex->type->type);
+        int load = load_instr(onheap, static_type_basic(ex->type->type));
+        int store = store_instr(onheap, static_type_basic(ex->type->type));
+        int type = value_type(ex->type->type);
         int op;
         if (ex->val.o->oper == TOK_DEC)
           op = (type == TYPE_FLOAT) ? SUB_FLOAT : SUB_INT;
@@ -838,14 +1334,12 @@ static void emit_code_expression(code_block_t *code, ast_node_t *exn, int addr,
           emit_code_expression(code, ex->val.o->first, 1, 0);
           add_instr(code, S2A, 0);
           int onheap = expr_on_heap(ex->val.o->first->val.e);
-          int load = onheap ? LDCH : LDC;
-          int store = onheap ? STCH : STC;
-          add_instr(code, load, 0);
+          add_instr(code, load_instr(onheap, static_type_basic(ex->type->type)),
+                    0);
         } else
           emit_code_expression(code, ex->val.o->first, 0, 0);
         add_instr(code, PUSHB, 0, 0);
-        if (static_type_basic(ex->val.o->first->val.e->type->type) ==
-            TYPE_FLOAT)
+        if (value_type(ex->val.o->first->val.e->type->type) == TYPE_FLOAT)
           add_instr(code, SUB_FLOAT, 0);
         else
           add_instr(code, SUB_INT, 0);
@@ -862,7 +1356,7 @@ static void emit_code_expression(code_block_t *code, ast_node_t *exn, int addr,
           error(&(exn->loc), "operation not supported on compound types");
           return;
         }
-        int t = static_type_basic(ex->type->type);
+        int t = value_type(ex->type->type);
         if (t != TYPE_INT) {
           error(&(exn->loc), "operation needs integral type");
           return;
@@ -874,8 +1368,7 @@ static void emit_code_expression(code_block_t *code, ast_node_t *exn, int addr,
     // --------------------------------------
     case EXPR_POSTFIX:
       // no operation is allowed on arrays
-      if (ex->val.o->first->val.e->variant == EXPR_VAR_NAME &&
-          ex->val.o->first->val.e->val.v->var->num_dim > 0) {
+      if (is_array_expression(ex->val.o->first->val.e)) {
         error(&(ex->val.o->first->loc), "operation not permitted for arrays");
         return;
       }
@@ -886,11 +1379,15 @@ static void emit_code_expression(code_block_t *code, ast_node_t *exn, int addr,
           error(&(exn->loc), "operation not supported on compound types");
           return;
         }
-        int type = static_type_basic(ex->type->type);
+        int type = value_type(ex->type->type);
+        if (type == TYPE_INT64) {
+          error(&(exn->loc), "operation not supported on int64");
+          return;
+        }
 
         int onheap = expr_on_heap(ex->val.o->first->val.e);
-        int load = onheap ? LDCH : LDC;
-        int store = onheap ? STCH : STC;
+        int load = load_instr(onheap, static_type_basic(ex->type->type));
+        int store = store_instr(onheap, static_type_basic(ex->type->type));
 
         int op;
         if (ex->val.o->oper == TOK_DEC)
@@ -915,7 +1412,7 @@ static void emit_code_expression(code_block_t *code, ast_node_t *exn, int addr,
           error(&(exn->loc), "operation not supported on compound types");
           return;
         }
-        int t = static_type_basic(ex->type->type);
+        int t = value_type(ex->type->type);
         if (t != TYPE_INT) {
           error(&(exn->loc), "operation needs integral type");
           return;
@@ -927,11 +1424,17 @@ static void emit_code_expression(code_block_t *code, ast_node_t *exn, int addr,
     // --------------------------------------
     case EXPR_SPECIFIER: {
       if (is_lval_expression(ex->val.s->ex->val.e)) {
+        variable_t *soa = expr_soa_array(ex);
         emit_code_expression(code, ex->val.s->ex, 1, 0);
-        add_instr(code, PUSHC, ex->val.s->memb->offset, ADD_INT, 0);
+        if (!soa)
+          add_instr(code, PUSHC, ex->val.s->memb->offset, ADD_INT, 0);
+        else if (member_column(ex->val.s->memb) > 0) {
+          emit_code_soa_column(code, soa, member_column(ex->val.s->memb));
+          add_instr(code, ADD_INT, 0);
+        }
         if (!addr) {
           uint8_t *layout, ts = inferred_type_layout(ex->type, &layout);
-          emit_code_load_value(code, expr_on_heap(ex), ts, layout);
+          emit_code_load_value(code, expr_on_heap(ex), ts, layout, soa);
           free(layout);
         }
       } else if (ex->val.s->ex->val.e->type->compound) {
@@ -953,15 +1456,21 @@ static void emit_code_expression(code_block_t *code, ast_node_t *exn, int addr,
         error(&(exn->loc), "can sort only based on numeric key");
         return;
       }
+      variable_t *soa = soa_array(ex->val.v->var);
       int t = static_type_basic(spec->type->type);
-      add_instr(code, PUSHB, t, 0);
+      add_instr(code, PUSHB, soa ? t | SORT_COLUMNS : t, 0);
 
+      // stored by columns, the key is given by its column
       int offs = 0;
       for (expression_t *p = spec; p->variant == EXPR_SPECIFIER;
            p = p->val.s->ex->val.e)
-        offs += p->val.s->memb->offset;
+        offs += soa ? 4 * member_column(p->val.s->memb)
+                    : p->val.s->memb->offset;
 
-      add_instr(code, PUSHC, offs, PUSHC, ex->val.v->var->base_type->size, 0);
+      add_instr(code, PUSHC, offs, PUSHC,
+                soa ? 4 * static_type_layout(soa->base_type, NULL)
+                    : ex->val.v->var->base_type->size,
+                0);
 
       emit_code_var_addr(code, ex->val.v->var);
       add_instr(code, SORT, 0);
@@ -969,6 +1478,37 @@ static void emit_code_expression(code_block_t *code, ast_node_t *exn, int addr,
   }
 }
 
+// a uniform value (optimize.h) is computed by one thread of the group and
+// copied to the others (see Uniform values in code.h)
+static void emit_code_expression(code_block_t *code, ast_node_t *exn, int addr,
+                                 int clear) {
+  if (!exn->val.e->uniform || addr || clear) {
+    emit_code_expression_each(code, exn, addr, clear);
+    return;
+  }
+  int pos = code->pos;
+  add_instr(code, UNIFORM, 0, 0);
+  emit_code_expression_each(code, exn, 0, 0);
+  set_jump_target(code, pos);
+}
+
+// a literal condition: only the taken branch is emitted (not at -O0)
+static int constant_condition(ast_node_t *cond, int32_t *val) {
+  return ctx->opt_level >= 1 && literal_int_value(cond, val);
+}
+
+static void emit_code_node(code_block_t *code, ast_node_t *node);
+
+// the else of an `if` (`branch` is its first branch), or the statements
+// `rest` in its place
+static void emit_code_else(code_block_t *code, ast_node_t *branch,
+                           ast_node_t *rest) {
+  if (rest)
+    emit_code_items(code, rest);
+  else
+    emit_code_node(code, branch->next);
+}
+
 /* ----------------------------------------------------------------------------
  * generate code for an AST node
  */
@@ -1003,7 +1543,10 @@ static void emit_code_node(code_block_t *code, ast_node_t *node) {
         add_instr(code, PUSHB, 1, 0);
         for (int i = 0; i < v->num_dim; i++)
           add_instr(code, A2S, POPA, MULT_INT, 0);
-        add_instr(code, PUSHC, v->base_type->size, MULT_INT, ALLOC, 0);
+        add_instr(code, PUSHC,
+                  soa_array(v) ? 4 * static_type_layout(v->base_type, NULL)
+                               : v->base_type->size,
+                  MULT_INT, ALLOC, 0);
         emit_code_var_addr(code, v);
         add_instr(code, STC, 0);
       }
@@ -1020,7 +1563,7 @@ static void emit_code_node(code_block_t *code, ast_node_t *node) {
                                        &casts, &n_casts)) {
             emit_code_expression(code, init, 0, 0);
             emit_code_var_addr(code, var);
-            emit_code_store_value(code, 0, casts, n_casts);
+            emit_code_store_value(code, 0, casts, n_casts, NULL);
             free(casts);
           } else
             error(&(node->loc),
@@ -1039,8 +1582,8 @@ static void emit_code_node(code_block_t *code, ast_node_t *node) {
           add_instr(code, PUSHB, 0, 0);
           emit_code_var_addr(code, node->val.v);
           if (offs > 0) add_instr(code, PUSHC, offs, ADD_INT, 0);
-          add_instr(code, (layout[i] == TYPE_CHAR) ? STB : STC, 0);
-          offs += (layout[i] == TYPE_CHAR) ? 1 : 4;
+          add_instr(code, store_instr(0, layout[i]), 0);
+          offs += basic_size(layout[i]);
         }
         free(layout);
       }
@@ -1059,52 +1602,108 @@ static void emit_code_node(code_block_t *code, ast_node_t *node) {
           ast_node_t *B = A->next;
           ast_node_t *C = B->next;
           ast_node_t *D = C->next;
-          if (B->val.e->type->compound ||
-              B->val.e->type->type != __type__int->val.t) {
+          if (!is_int(B)) {
             error(&(node->loc), "condition must be of integral type");
             return;
           }
           emit_code_node(code, A);
+          uint32_t frame_end = ctx->frame_end;
+          int rows = emit_code_rows(code, node, B, C, 0);
           int ret = code->pos;
+          int32_t cond;
+          if (constant_condition(B, &cond)) {
+            // constant condition: no SPLIT, loop while there are threads
+            if (cond) {
+              if (D) emit_code_node(code, D);
+              emit_code_node(code, C);
+              add_instr(code, JMP, ret - code->pos - 1, 0);
+            }
+            add_instr(code, MEM_FREE, 0);
+            emit_code_rows_end(rows, frame_end);
+            break;
+          }
           emit_code_expression(code, B, 0, 0);
+          if (node->val.s->uniform) {
+            // same condition in all threads: the group leaves the loop at once
+            int end = add_jmpz(code);
+            if (D) emit_code_node(code, D);
+            emit_code_node(code, C);
+            add_instr(code, JMP, ret - code->pos - 1, 0);
+            set_jump_target(code, end);
+            add_instr(code, MEM_FREE, 0);
+            emit_code_rows_end(rows, frame_end);
+            break;
+          }
           add_instr(code, SPLIT, JOIN, 0);
           if (D) emit_code_node(code, D);
           emit_code_node(code, C);
           add_instr(code, JMP, 9, JOIN_JMP, 9, 0);
           add_instr(code, JOIN_JMP, ret - code->pos - 1, MEM_FREE, 0);
+          emit_code_rows_end(rows, frame_end);
         } break;
         case STMT_WHILE: {
           if (!node->val.s->par[0] || !node->val.s->par[1]) return;
-          int ret = code->pos;
-          if (node->val.s->par[0]->val.e->type->compound ||
-              node->val.s->par[0]->val.e->type->type != __type__int->val.t) {
+          if (!is_int(node->val.s->par[0])) {
             error(&(node->loc), "condition must be of integral type");
             return;
           }
+          // the slots of the rows are freed after the loop
+          uint32_t frame_end = ctx->frame_end;
+          int rows = emit_code_rows(code, node, node->val.s->par[0],
+                                    node->val.s->par[1], 1);
+          int ret = code->pos;
+          int32_t cond;
+          if (constant_condition(node->val.s->par[0], &cond)) {
+            if (cond) {
+              emit_code_node(code, node->val.s->par[1]->val.sc->items);
+              add_instr(code, JMP, ret - code->pos - 1, 0);
+            }
+            if (rows) add_instr(code, MEM_FREE, 0);
+            emit_code_rows_end(rows, frame_end);
+            break;
+          }
           emit_code_expression(code, node->val.s->par[0], 0, 0);
+          if (node->val.s->uniform) {
+            int end = add_jmpz(code);
+            emit_code_node(code, node->val.s->par[1]->val.sc->items);
+            add_instr(code, JMP, ret - code->pos - 1, 0);
+            set_jump_target(code, end);
+            if (rows) add_instr(code, MEM_FREE, 0);
+            emit_code_rows_end(rows, frame_end);
+            break;
+          }
           add_instr(code, SPLIT, JOIN, 0);
           emit_code_node(code, node->val.s->par[1]->val.sc->items);
           add_instr(code, JMP, 9, JOIN_JMP, 9, 0);
           add_instr(code, JOIN_JMP, ret - code->pos - 1, 0);
+          if (rows) add_instr(code, MEM_FREE, 0);
+          emit_code_rows_end(rows, frame_end);
         }; break;
         case STMT_DO: {
           if (!node->val.s->par[0] || !node->val.s->par[1]) return;
           int ret = code->pos;
-          if (node->val.s->par[0]->val.e->type->compound ||
-              node->val.s->par[0]->val.e->type->type != __type__int->val.t) {
+          if (!is_int(node->val.s->par[0])) {
             error(&(node->loc), "condition must be of integral type");
             return;
           }
           emit_code_node(code, node->val.s->par[1]->val.sc->items);
+          int32_t cond;
+          if (constant_condition(node->val.s->par[0], &cond)) {
+            if (cond) add_instr(code, JMP, ret - code->pos - 1, 0);
+            break;
+          }
           emit_code_expression(code, node->val.s->par[0], 0, 0);
+          if (node->val.s->uniform) {
+            add_instr(code, JMPZ, 9, JMP, ret - code->pos - 6, 0);
+            break;
+          }
           add_instr(code, SPLIT, JOIN, 0);
           add_instr(code, JMP, 9, JOIN_JMP, 9, 0);
           add_instr(code, JOIN_JMP, ret - code->pos - 1, 0);
         }; break;
         case STMT_PARDO: {
           if (!node->val.s->par[0] || !node->val.s->par[1]) return;
-          if (node->val.s->par[1]->val.e->type->compound ||
-              node->val.s->par[1]->val.e->type->type != __type__int->val.t) {
+          if (!is_int(node->val.s->par[1])) {
             error(&(node->loc), "condition must be of integral type");
             return;
           }
@@ -1115,15 +1714,41 @@ static void emit_code_node(code_block_t *code, ast_node_t *node) {
           add_instr(code, JOIN, 0);
         } break;
         case STMT_COND: {
+          // the statements after the `if` may be its else (emit_code_items)
+          ast_node_t *rest = ctx->rest;
+          ctx->rest = NULL;
           if (!node->val.s->par[0] || !node->val.s->par[1]) return;
-          if (node->val.s->par[0]->val.e->type->compound ||
-              node->val.s->par[0]->val.e->type->type != __type__int->val.t) {
+          if (!is_int(node->val.s->par[0])) {
             error(&(node->loc), "condition must be of integral type");
             return;
           }
+          int32_t cond;
+          if (constant_condition(node->val.s->par[0], &cond)) {
+            // constant condition: emit only the taken branch
+            ast_node_t *branch = node->val.s->par[1]->val.sc->items;
+            if (cond)
+              emit_code_node(code, branch);
+            else
+              emit_code_else(code, branch, rest);
+            break;
+          }
           emit_code_expression(code, node->val.s->par[0], 0, 0);
+          if (node->val.s->uniform) {
+            ast_node_t *branch = node->val.s->par[1]->val.sc->items;
+            int end = add_jmpz(code);
+            emit_code_node(code, branch);
+            if (branch->next || rest) {
+              int skip = code->pos;
+              add_instr(code, JMP, 0, 0);
+              set_jump_target(code, end);
+              emit_code_else(code, branch, rest);
+              end = skip;
+            }
+            set_jump_target(code, end);
+            break;
+          }
           add_instr(code, SPLIT, 0);
-          emit_code_node(code, node->val.s->par[1]->val.sc->items->next);
+          emit_code_else(code, node->val.s->par[1]->val.sc->items, rest);
           add_instr(code, JOIN, 0);
           emit_code_node(code, node->val.s->par[1]->val.sc->items);
           add_instr(code, JOIN, 0);
@@ -1156,11 +1781,11 @@ static void emit_code_node(code_block_t *code, ast_node_t *node) {
                   node->val.s->ret_fn->out_type->name);
             return;
           }
-          add_instr(code, SETR, 0);
+          // an inlined function is left by not emitting the code after return
+          if (!ctx->inlined) add_instr(code, SETR, 0);
         } break;
         case STMT_BREAKPOINT: {
-          expression_t *ex = node->val.s->par[0]->val.e;
-          if (ex->type->compound || ex->type->type != __type__int->val.t) {
+          if (!is_int(node->val.s->par[0])) {
             error(&(node->loc),
                   "breakpoint condition must be of integral type");
             return;
@@ -1185,10 +1810,31 @@ static void emit_code_node(code_block_t *code, ast_node_t *node) {
  */
 static void emit_code_scope(code_block_t *code, scope_t *sc) {
   add_instr(code, MEM_MARK, 0);
-  for (ast_node_t *p = sc->items; p; p = p->next) emit_code_node(code, p);
+  emit_code_items(code, sc->items);
   add_instr(code, MEM_FREE, 0);
 }
 
+// the statements from p to the end of the list
+//
+// the code after a return is not reached (not dropped at -O0); in an inlined
+// function it has to be dropped, as no SETR stops the threads: after a
+// statement that always returns nothing is emitted, and the statements after
+// an `if` without else whose branch returns become its else
+static void emit_code_items(code_block_t *code, ast_node_t *p) {
+  for (; p; p = p->next) {
+    if (ctx->inlined && p->next && returns_early(p)) {
+      ctx->rest = p->next;
+      emit_code_node(code, p);
+      ctx->rest = NULL;
+      break;
+    }
+    emit_code_node(code, p);
+    if (ctx->inlined ? always_returns(p)
+                     : is_return(p) && ctx->opt_level >= 1)
+      break;
+  }
+}
+
 /* ----------------------------------------------------------------------------
  * used from emit_code_function to check if there is a return statement
  * within pardo - this is forbidden
@@ -1233,19 +1879,7 @@ static void emit_code_function(code_block_t *code, ast_node_t *fn) {
   // load parameters
   // on the stack are values
   DEBUG("emit_code_function %s (addr: %d)\n", fn->val.f->name, code->pos);
-  for (ast_node_t *p = fn->val.f->params; p; p = p->next) {
-    if (p->val.v->num_dim == 0) {
-      add_instr(code, PUSHC, p->val.v->addr, FBASE, 0);
-      int *casts, n_casts;
-      static_type_compatible(p->val.v->base_type, p->val.v->base_type, &casts,
-                             &n_casts);
-      emit_code_store_value(code, 0, casts, n_casts);
-      if (casts) free(casts);
-    } else {
-      for (int i = 0; i < p->val.v->num_dim + 2; i++)
-        add_instr(code, PUSHC, p->val.v->addr + 4 * i, FBASE, STC, 0);
-    }
-  }
+  emit_code_store_params(code, fn->val.f);
 
   // error for return within pardo
   for (ast_node_t *n = fn->val.f->root_scope->items; n; n = n->next)
@@ -1255,13 +1889,179 @@ static void emit_code_function(code_block_t *code, ast_node_t *fn) {
 
   emit_code_scope(code, fn->val.f->root_scope);
   add_instr(code, RETURN, 0);
-  fn->code_to = code->pos;
+  fn->code_to = code->pos - 1;
+}
+
+/* ----------------------------------------------------------------------------
+ * how the op_stack changes after calling the function (see code.h)
+ */
+static int32_t function_stack_change(function_t *f) {
+  int32_t out_size = 4 * static_type_layout(f->out_type, NULL);
+  for (ast_node_t *p = f->params; p; p = p->next)
+    if (p->val.v->num_dim == 0)
+      out_size -= 4 * static_type_layout(p->val.v->base_type, NULL);
+    else
+      out_size -= 4 * (2 + p->val.v->num_dim);
+  return out_size;
+}
+
+/* ----------------------------------------------------------------------------
+ * compute the maximal growth of op_stack and acc_stack (in bytes) in the code
+ * between from and to
+ *
+ * the code is scanned linearly: the branches between SPLIT and JOIN and the
+ * bodies of loops leave the stack as they found it, so the running depth is
+ * exact at the start of each statement; after SETR the rest of the group is
+ * inactive, and counting the return value once more only overestimates the
+ * depth (as does counting the value of an inlined function once per return)
+ *
+ * the result is the difference between the maximal and minimal depth, so it
+ * bounds also the stacks of threads created by FORK (which start empty at
+ * some point of the code)
+ */
+static void compute_stack_depth(code_block_t *code, int from, int to,
+                                function_t **fns, uint32_t *op_depth,
+                                uint32_t *acc_depth) {
+  int32_t op = 0, op_min = 0, op_max = 0, acc = 0, acc_min = 0, acc_max = 0;
+  for (int pc = from; pc < to;) {
+    uint8_t instr = code->data[pc++];
+    switch (instr) {
+      case PUSHC:
+      case LDL:
+      case LDG:
+        op += 4;
+        pc += 4;
+        break;
+      case STL:
+      case STG:
+        op -= 4;
+        pc += 4;
+        break;
+      case PUSHB:
+      case PUSHR:
+      case A2S:
+      case INT2INT64:
+        op += 4;
+        if (instr == PUSHB || instr == PUSHR) pc++;
+        break;
+      case IDX:
+      case IDX_NC:
+        op -= 4 * code->data[pc++];
+        break;
+      case IDXA:
+        op -= 4 * code->data[pc];
+        pc += 4;
+        break;
+      case ROW:
+        op += 4 * (3 - code->data[pc]);
+        pc += 4;
+        break;
+      case IDXR:
+        pc += 4;
+        break;
+      case SLICE:
+        op += 4 * code->data[pc] - 4;
+        pc += 4;
+        break;
+      case JMP:
+      case JOIN_JMP:
+      case UNIFORM:
+      case ALU3:
+      case ALUR:
+        pc += 4;
+        break;
+      case CALL:
+        op += function_stack_change(fns[lval(code->data + pc, uint32_t)]);
+        pc += 4;
+        break;
+      case BREAK:
+      case JMPZ:
+        op -= 4;
+        pc += 4;
+        break;
+      case SIZE:
+      case POP:
+      case SPLIT:
+      case ADD_INT:
+      case SUB_INT:
+      case MULT_INT:
+      case DIV_INT:
+      case MOD_INT:
+      case ADD_FLOAT:
+      case SUB_FLOAT:
+      case MULT_FLOAT:
+      case DIV_FLOAT:
+      case POW_INT:
+      case POW_FLOAT:
+      case OR:
+      case AND:
+      case BIT_OR:
+      case BIT_AND:
+      case BIT_XOR:
+      case EQ_INT:
+      case EQ_FLOAT:
+      case GT_INT:
+      case GT_FLOAT:
+      case GEQ_INT:
+      case GEQ_FLOAT:
+      case LT_INT:
+      case LT_FLOAT:
+      case LEQ_INT:
+      case LEQ_FLOAT:
+      case RAND:
+      case RANDF:
+      case INT642INT:
+        op -= 4;
+        break;
+      case STC:
+      case STB:
+      case STCH:
+      case STBH:
+      case STCH_NC:
+      case STBH_NC:
+      case STS:
+      case STSH:
+      case STSH_NC:
+      case FORK:
+      case ADD_INT64:
+      case SUB_INT64:
+      case MULT_INT64:
+      case DIV_INT64:
+      case MOD_INT64:
+        op -= 8;
+        break;
+      case EQ_INT64:
+      case GT_INT64:
+      case GEQ_INT64:
+      case LT_INT64:
+      case LEQ_INT64:
+        op -= 12;
+        break;
+      case SORT:
+        op -= 16;
+        break;
+      case S2A:
+        acc += 4;
+        break;
+      case POPA:
+        acc -= 4;
+        break;
+      default:
+        break;
+    }
+    if (op > op_max) op_max = op;
+    if (op < op_min) op_min = op;
+    if (acc > acc_max) acc_max = acc;
+    if (acc < acc_min) acc_min = acc;
+  }
+  *op_depth = op_max - op_min;
+  *acc_depth = acc_max - acc_min;
 }
 
 /* ----------------------------------------------------------------------------
  * write the input/output variables section of the binary file
  */
-static void write_io_variables(writer_t *out, int flag) {
+static void write_io_variables(writer_t *out, ast_t *ast, int flag) {
   int n = 0;
   for (ast_node_t *x = ast->root_scope->items; x; x = x->next)
     if (x->node_type == AST_NODE_VARIABLE && x->val.v->io_flag == flag) n++;
@@ -1280,11 +2080,346 @@ static void write_io_variables(writer_t *out, int flag) {
     }
 }
 
+/* ----------------------------------------------------------------------------
+ * generate the parts of the program
+ *
+ * once the addresses are assigned, the code of a function does not depend on
+ * the rest of the program: jumps are relative, and functions are called by
+ * their number; each part is generated from position 0 of its own block and
+ * optimized there (the code passes do not cross basic blocks)
+ */
+static void emit_part(codegen_ctx_t *part) {
+  if (part->code) return;  // taken from the cache
+  ctx = part;
+  ast_use(part->ast);  // the basic types for constant_condition()
+  part->code = code_block_t_new();
+  if (part->fn) {
+    function_t *f = part->fn->val.f;
+    part->frame_end =
+        variables_end(variables_end(0, f->params), f->root_scope->items);
+    f->addr = 0;
+    emit_code_function(part->code, part->fn);
+  } else {
+    part->frame_end = variables_end(0, part->ast->root_scope->items);
+    emit_code_scope(part->code, part->ast->root_scope);
+    add_instr(part->code, ENDVM, 0);
+  }
+  free(part->loops);
+  part->loops = NULL;
+  if (!part->was_error)
+    optimize_code(part->code, part->ast, part->fn, part->opt_level,
+                  part->regs);
+}
+
+#ifdef PARALLEL_CODEGEN
+typedef struct {
+  codegen_ctx_t *parts;
+  int n_parts, next;
+  pthread_mutex_t lock;
+} codegen_work_t;
+
+// generate parts until there are none left
+static void *emit_parts_worker(void *arg) {
+  codegen_work_t *w = (codegen_work_t *)arg;
+  for (;;) {
+    pthread_mutex_lock(&w->lock);
+    int i = w->next++;
+    pthread_mutex_unlock(&w->lock);
+    if (i >= w->n_parts) return NULL;
+    emit_part(&w->parts[i]);
+  }
+}
+#endif
+
+static void emit_parts(codegen_ctx_t *parts, int n_parts) {
+#ifdef PARALLEL_CODEGEN
+  int n_threads = codegen_threads;
+  if (n_threads <= 0) n_threads = sysconf(_SC_NPROCESSORS_ONLN);
+  if (n_threads > n_parts) n_threads = n_parts;
+  if (n_threads > 1) {
+    codegen_work_t w;
+    w.parts = parts;
+    w.n_parts = n_parts;
+    w.next = 0;
+    pthread_mutex_init(&w.lock, NULL);
+    // if a thread cannot be created, the others do its work
+    pthread_t *tids = (pthread_t *)malloc((n_threads - 1) * sizeof(pthread_t));
+    int started = 0;
+    while (started < n_threads - 1 &&
+           !pthread_create(&tids[started], NULL, emit_parts_worker, &w))
+      started++;
+    emit_parts_worker(&w);
+    for (int i = 0; i < started; i++) pthread_join(tids[i], NULL);
+    free(tids);
+    pthread_mutex_destroy(&w.lock);
+    return;
+  }
+#endif
+  for (int i = 0; i < n_parts; i++) emit_part(&parts[i]);
+}
+
+/* ----------------------------------------------------------------------------
+ * cache of the generated code of functions
+ *
+ * the key of a function is the hash of its AST (after the AST passes) with
+ * everything its code depends on: the addresses of the variables, the types,
+ * and the numbers and signatures of the called functions; the locations are
+ * not hashed, the code ranges of the nodes are kept with the code and restored
+ * in the new AST (for the debug info)
+ */
+typedef struct {
+  code_block_t *code;  //!< code of the function generated from position 0
+  int *ranges,         //!< code_from, code_to of the nodes (see ir_for_nodes)
+      n_ranges;
+  int used;  //!< the last compilation that used the entry
+} cached_code_t;
+
+struct _codegen_cache_t {
+  hash_table_t *entries;  //!< cached_code_t by the key of the function
+  int compilation;        //!< number of the current compilation
+};
+
+static void cached_code_delete(void *p) {
+  cached_code_t *c = (cached_code_t *)p;
+  code_block_t_delete(c->code);
+  free(c->ranges);
+  free(c);
+}
+
+CONSTRUCTOR(codegen_cache_t) {
+  ALLOC_VAR(r, codegen_cache_t)
+  r->entries = hash_table_t_new(64, cached_code_delete);
+  r->compilation = 0;
+  return r;
+}
+
+DESTRUCTOR(codegen_cache_t) {
+  if (r == NULL) return;
+  hash_table_t_delete(r->entries);
+  free(r);
+}
+
+#define hash_val(h, v) hash_bytes((h), &(v), sizeof(v))
+
+static uint64_t hash_name(uint64_t h, const char *s) {
+  return hash_bytes(h, s, strlen(s) + 1);
+}
+
+static uint64_t hash_type(uint64_t h, static_type_t *t) {
+  int null = (t == NULL);
+  h = hash_val(h, null);
+  if (null) return h;
+  h = hash_name(h, t->name);
+  h = hash_val(h, t->size);
+  for (static_type_member_t *m = t->members; m; m = m->next) {
+    h = hash_name(h, m->name);
+    h = hash_val(h, m->offset);
+    h = hash_type(h, m->type);
+  }
+  return h;
+}
+
+static uint64_t hash_inferred(uint64_t h, inferred_type_t *t) {
+  h = hash_val(h, t->compound);
+  if (!t->compound) return hash_type(h, t->type);
+  for (inferred_type_item_t *it = t->list; it; it = it->next)
+    h = hash_inferred(h, it->type);
+  return hash_val(h, t->compound);
+}
+
+static uint64_t hash_variable(uint64_t h, variable_t *v) {
+  int local = (v->scope && v->scope->fn);
+  h = hash_val(h, v->addr);
+  h = hash_val(h, v->num_dim);
+  h = hash_val(h, local);
+  return hash_type(h, v->base_type);
+}
+
+static uint64_t hash_function(uint64_t h, function_t *f) {
+  int defined = (f->root_scope != NULL);
+  h = hash_name(h, f->name);
+  h = hash_val(h, f->n);
+  h = hash_val(h, defined);
+  h = hash_type(h, f->out_type);
+  for (ast_node_t *p = f->params; p; p = p->next)
+    h = hash_variable(h, p->val.v);
+  return h;
+}
+
+static uint64_t hash_node(uint64_t h, ast_node_t *n);
+
+static uint64_t hash_list(uint64_t h, ast_node_t *list) {
+  int len = length(list);
+  h = hash_val(h, len);
+  for (; list; list = list->next) h = hash_node(h, list);
+  return h;
+}
+
+static uint64_t hash_expression(uint64_t h, expression_t *e) {
+  h = hash_val(h, e->variant);
+  h = hash_val(h, e->uniform);
+  h = hash_inferred(h, e->type);
+  switch (e->variant) {
+    case EXPR_EMPTY:
+    case EXPR_LITERAL: {
+      int n = 0;
+      if (e->val.l && !e->type->compound) n = e->type->type->size;
+      h = hash_val(h, n);
+      if (n) h = hash_bytes(h, e->val.l, n);
+    } break;
+    case EXPR_INITIALIZER:
+      h = hash_list(h, e->val.i);
+      break;
+    case EXPR_CALL:
+      h = hash_function(h, e->val.f->fn);
+      h = hash_list(h, e->val.f->params);
+      h = hash_list(h, e->val.f->inlined);
+      break;
+    case EXPR_ARRAY_ELEMENT:
+    case EXPR_VAR_NAME:
+    case EXPR_SIZEOF:
+    case EXPR_SORT:
+    case EXPR_SLICE:
+      h = hash_variable(h, e->val.v->var);
+      h = hash_val(h, e->val.v->in_bounds);
+      h = hash_val(h, e->val.v->exclusive);
+      h = hash_val(h, e->val.v->row);
+      h = hash_list(h, e->val.v->params);
+      break;
+    case EXPR_POSTFIX:
+    case EXPR_PREFIX:
+    case EXPR_BINARY:
+      h = hash_val(h, e->val.o->oper);
+      h = hash_list(h, e->val.o->first);
+      h = hash_list(h, e->val.o->second);
+      break;
+    case EXPR_CAST:
+      h = hash_type(h, e->val.c->type);
+      h = hash_list(h, e->val.c->ex);
+      break;
+    case EXPR_SPECIFIER:
+      h = hash_name(h, e->val.s->memb->name);
+      h = hash_val(h, e->val.s->memb->offset);
+      h = hash_type(h, e->val.s->memb->type);
+      h = hash_type(h, e->val.s->memb->parent);
+      h = hash_list(h, e->val.s->ex);
+      break;
+  }
+  return h;
+}
+
+static uint64_t hash_node(uint64_t h, ast_node_t *n) {
+  h = hash_val(h, n->node_type);
+  switch (n->node_type) {
+    case AST_NODE_VARIABLE: {
+      variable_t *v = n->val.v;
+      h = hash_variable(h, v);
+      h = hash_val(h, v->io_flag);
+      h = hash_val(h, v->need_init);
+      h = hash_list(h, v->initializer);
+      h = hash_list(h, v->ranges);
+    } break;
+    case AST_NODE_SCOPE:
+      h = hash_list(h, n->val.sc->items);
+      break;
+    case AST_NODE_FUNCTION:
+      h = hash_type(h, n->val.f->out_type);
+      h = hash_list(h, n->val.f->params);
+      if (n->val.f->root_scope) h = hash_list(h, n->val.f->root_scope->items);
+      break;
+    case AST_NODE_EXPRESSION:
+      h = hash_expression(h, n->val.e);
+      break;
+    case AST_NODE_STATEMENT: {
+      statement_t *s = n->val.s;
+      h = hash_val(h, s->variant);
+      h = hash_val(h, s->tag);
+      h = hash_val(h, s->uniform);
+      h = hash_val(h, s->row);
+      h = hash_val(h, s->n_rows);
+      if (s->variant == STMT_RETURN)
+        h = hash_type(h, s->ret_fn ? s->ret_fn->out_type : NULL);
+      h = hash_list(h, s->par[0]);
+      h = hash_list(h, s->par[1]);
+    } break;
+  }
+  return h;
+}
+
+typedef struct {
+  int *ranges, n, size;
+} ranges_t;
+
+static void get_range(ast_node_t *node, void *data) {
+  ranges_t *r = (ranges_t *)data;
+  if (r->n + 2 > r->size)
+    r->ranges = (int *)realloc(r->ranges, (r->size = 2 * r->size + 64) *
+                                              sizeof(int));
+  r->ranges[r->n++] = node->code_from;
+  r->ranges[r->n++] = node->code_to;
+}
+
+static void set_range(ast_node_t *node, void *data) {
+  ranges_t *r = (ranges_t *)data;
+  if (r->n + 2 <= r->size) {
+    node->code_from = r->ranges[r->n];
+    node->code_to = r->ranges[r->n + 1];
+  }
+  r->n += 2;
+}
+
+// take the code of the function from the cache; return 1 on a hit
+static int take_cached(codegen_cache_t *cache, codegen_ctx_t *part,
+                        uint64_t key) {
+  cached_code_t *c = (cached_code_t *)hash_get(cache->entries, key);
+  if (!c) return 0;
+  ranges_t r = {c->ranges, 0, c->n_ranges};
+  ir_for_nodes(part->fn, set_range, &r);
+  if (r.n != c->n_ranges) return 0;  // (cannot happen for equal keys)
+  c->used = cache->compilation;
+  part->fn->val.f->addr = 0;
+  part->code = code_block_t_new();
+  add_code_block(part->code, c->code);
+  return 1;
+}
+
+// keep the code of a function generated without errors
+static void keep_cached(codegen_cache_t *cache, codegen_ctx_t *part,
+                        uint64_t key) {
+  if (part->was_error || hash_get(cache->entries, key)) return;
+  ALLOC_VAR(c, cached_code_t)
+  ranges_t r = {NULL, 0, 0};
+  ir_for_nodes(part->fn, get_range, &r);
+  c->ranges = r.ranges;
+  c->n_ranges = r.n;
+  c->code = code_block_t_new();
+  add_code_block(c->code, part->code);
+  c->used = cache->compilation;
+  hash_put(cache->entries, key, c);
+}
+
+// remove the functions not used in the current compilation
+static void evict_cached(codegen_cache_t *cache) {
+  hash_table_t *old = cache->entries;
+  cache->entries = hash_table_t_new(64, cached_code_delete);
+  for (int i = 0; i < old->size; i++)
+    if (old->data[i]) {
+      cached_code_t *c = (cached_code_t *)old->data[i]->val;
+      if (c->used == cache->compilation)
+        hash_put(cache->entries, old->data[i]->key, c);
+      else
+        cached_code_delete(c);
+    }
+  old->data_delete = NULL;
+  hash_table_t_delete(old);
+}
+
 /* ----------------------------------------------------------------------------
  * main entry
  */
-int emit_code(ast_t *_ast, writer_t *out, int no_debug) {
-  ast = _ast;
+int emit_code(ast_t *ast, writer_t *out, int no_debug, int opt_level,
+              int soa, int regs) {
+  optimize_ast(ast, opt_level);
 
   // just for debugging: write all types
   DEBUG("types\n");
@@ -1334,17 +2469,78 @@ int emit_code(ast_t *_ast, writer_t *out, int no_debug) {
     if (p->node_type != AST_NODE_VARIABLE)
       base = assign_node_variable_addresses(base, p);
 
-  // main part - generate the code block
-  code_block_t *code = code_block_t_new();
-  emit_code_scope(code, ast->root_scope);
-  add_instr(code, ENDVM, 0);
-
-  // add code for functions at the end
+  // generate the main part and the functions, each into its own block
+  int n_parts = 1;
+  for (ast_node_t *fn = ast->functions; fn; fn = fn->next)
+    if (fn->val.f->root_scope) n_parts++;
+  codegen_ctx_t *parts =
+      (codegen_ctx_t *)calloc(n_parts, sizeof(codegen_ctx_t));
+  for (int i = 0; i < n_parts; i++) {
+    parts[i].ast = ast;
+    parts[i].opt_level = opt_level;
+    parts[i].soa = soa;
+    parts[i].regs = regs;
+  }
   for (ast_node_t *fn = ast->functions; fn; fn = fn->next)
-    if (fn->val.f->root_scope) {
-      fn->val.f->addr = code->pos;
-      emit_code_function(code, fn);
+    if (fn->val.f->root_scope) parts[fn->val.f->n + 1].fn = fn;
+
+  // reuse the code of unchanged functions
+  uint64_t *keys = NULL;
+  if (codegen_cache) {
+    codegen_cache->compilation++;
+    keys = (uint64_t *)malloc(n_parts * sizeof(uint64_t));
+    uint64_t h =
+        hash_val(hash_val(hash_val(HASH_INIT, opt_level), soa), regs);
+    for (int i = 1; i < n_parts; i++) {
+      keys[i] = hash_node(h, parts[i].fn);
+      take_cached(codegen_cache, &parts[i], keys[i]);
     }
+  }
+  emit_parts(parts, n_parts);
+  if (codegen_cache) {
+    for (int i = 1; i < n_parts; i++)
+      keep_cached(codegen_cache, &parts[i], keys[i]);
+    evict_cached(codegen_cache);
+    free(keys);
+  }
+
+  // concatenate the blocks: main part first, then the functions in order
+  code_block_t *code = code_block_t_new();
+  int was_error = 0, main_end = 0;
+  for (int i = 0; i < n_parts; i++) {
+    codegen_ctx_t *part = &parts[i];
+    if (part->fn) {
+      int *newpos = (int *)malloc((part->code->pos + 1) * sizeof(int));
+      for (int p = 0; p <= part->code->pos; p++) newpos[p] = code->pos + p;
+      ir_remap_node(part->fn, newpos);
+      free(newpos);
+    }
+    add_code_block(code, part->code);
+    if (!part->fn) main_end = code->pos;
+    code_block_t_delete(part->code);
+    flush_errors(part);
+    if (part->was_error) was_error = 1;
+  }
+  free(parts);
+
+  // compute the stack depths of the main scope and of each function
+  uint32_t main_op_depth = 0, main_acc_depth = 0;
+  if (!was_error) {
+    int n = 0;
+    for (ast_node_t *fn = ast->functions; fn; fn = fn->next)
+      if (fn->val.f->root_scope) n++;
+    function_t **fns = (function_t **)malloc((n + 1) * sizeof(function_t *));
+    for (ast_node_t *fn = ast->functions; fn; fn = fn->next)
+      if (fn->val.f->root_scope) fns[fn->val.f->n] = fn->val.f;
+
+    compute_stack_depth(code, 0, main_end, fns, &main_op_depth,
+                        &main_acc_depth);
+    for (ast_node_t *fn = ast->functions; fn; fn = fn->next)
+      if (fn->val.f->root_scope)
+        compute_stack_depth(code, fn->val.f->addr, fn->code_to + 1, fns,
+                            &(fn->val.f->op_depth), &(fn->val.f->acc_depth));
+    free(fns);
+  }
 
   // conpute the size of the memory used by global variables
   uint32_t global_size = 0;
@@ -1366,7 +2562,7 @@ int emit_code(ast_t *_ast, writer_t *out, int no_debug) {
     {
       section = SECTION_HEADER;
       out_raw(out, &section, 1);
-      int version = 1;
+      uint8_t version = CODE_VERSION | (regs ? CODE_REGISTERS : 0);
       out_raw(out, &version, 1);
       out_raw(out, &global_size, 4);
       uint8_t mm;
@@ -1381,18 +2577,20 @@ int emit_code(ast_t *_ast, writer_t *out, int no_debug) {
           mm = MEM_MODE_CREW;
       }
       out_raw(out, &mm, 1);
+      uint8_t layout = soa;
+      out_raw(out, &layout, 1);
     }
 
     {
       section = SECTION_INPUT;
       out_raw(out, &section, 1);
-      write_io_variables(out, IO_FLAG_IN);
+      write_io_variables(out, ast, IO_FLAG_IN);
     }
 
     {
       section = SECTION_OUTPUT;
       out_raw(out, &section, 1);
-      write_io_variables(out, IO_FLAG_OUT);
+      write_io_variables(out, ast, IO_FLAG_OUT);
     }
 
     {
@@ -1402,16 +2600,15 @@ int emit_code(ast_t *_ast, writer_t *out, int no_debug) {
       for (ast_node_t *fn = ast->functions; fn; fn = fn->next)
         if (fn->val.f->root_scope) n++;
       out_raw(out, &n, 4);
+      out_raw(out, &main_op_depth, 4);
+      out_raw(out, &main_acc_depth, 4);
       for (ast_node_t *fn = ast->functions; fn; fn = fn->next)
         if (fn->val.f->root_scope) {
           out_raw(out, &(fn->val.f->addr), 4);
-          int32_t out_size = fn->val.f->out_type->size;
-          for (ast_node_t *p = fn->val.f->params; p; p = p->next)
-            if (p->val.v->num_dim == 0)
-              out_size -= p->val.v->base_type->size;
-            else
-              out_size -= 4 * (2 + p->val.v->num_dim);
+          int32_t out_size = function_stack_change(fn->val.f);
           out_raw(out, &(out_size), 4);
+          out_raw(out, &(fn->val.f->op_depth), 4);
+          out_raw(out, &(fn->val.f->acc_depth), 4);
         }
     }
 
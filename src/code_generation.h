@@ -33,10 +33,48 @@ void add_instr(code_block_t *out, int code, ...);
 
 /**
  * this is the main interface (if `no_debug` is set, no debug info is written
- * to the binary)
+ * to the binary; `opt_level` selects the passes from optimize.h; if `soa` is
+ * set, the elements of arrays whose type has more than one basic value are
+ * stored by columns, see "Arrays of records" in code.h; if `regs` is set, the
+ * code is written in the register encoding, see "Register encoding" in code.h)
  *
  * uses the errors.h mechanism for announcing errors
  */
-int emit_code(ast_t *_ast, writer_t *out, int no_debug);
+int emit_code(ast_t *ast, writer_t *out, int no_debug, int opt_level,
+              int soa, int regs);
+
+/**
+ * @brief number of threads generating the code (set by `wtc -j n`)
+ *
+ * The main scope and the functions are generated independently, each into
+ * its own block, and concatenated; the result does not depend on the number
+ * of threads. 0 (default) uses one thread per processor, 1 generates
+ * everything in the calling thread. The web version is always single-threaded.
+ */
+extern int codegen_threads;
+
+/**
+ * @brief code of functions kept between compilations
+ *
+ * Functions are found by the hash of their AST with the addresses, types and
+ * called functions it refers to (not the locations: a function moved in the
+ * source is reused too). Only the functions of the last compilation are kept.
+ */
+typedef struct _codegen_cache_t codegen_cache_t;
+
+//! allocate an empty cache
+CONSTRUCTOR(codegen_cache_t);
+//! free the cache
+DESTRUCTOR(codegen_cache_t);
+
+/**
+ * @brief cache used by #emit_code (NULL by default)
+ *
+ * If set, the code of functions found in the cache is not generated again,
+ * and the code of the other functions is added to the cache. The binary is
+ * the same as without the cache. Used by the web interface, which compiles
+ * the program after every edit.
+ */
+extern codegen_cache_t *codegen_cache;
 
 #endif
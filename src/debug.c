@@ -276,47 +276,64 @@ DESTRUCTOR(debug_info_t) {
   free(r);
 }
 
-static const char **files =
-    NULL;  // an array of pointers to allcated names (in driver)
-static uint32_t n_files = 0;
-
-static int *code_source =
-    NULL;  // the index in items of the ast_node that generated this code
-static int *code_scope = NULL;
-static int code_size = 0;
-
-static ast_node_t **items = NULL;  // nodes that should be included in map
-static uint32_t n_items;
-
-static scope_t **scopes = NULL;  // scope map
-static uint32_t n_scopes;
-
-static ast_node_t **variables = NULL;
-static uint32_t n_variables;
-
-static void clear_globals() {
-  if (files) free(files);
-  files = NULL;
-  n_files = 0;
-  if (code_source) free(code_source);
-  code_source = NULL;
-  if (code_scope) free(code_scope);
-  code_scope = NULL;
-  code_size = 0;
-  if (items) free(items);
-  items = NULL;
-  n_items = 0;
-  if (scopes) free(scopes);
-  scopes = NULL;
-  n_scopes = 0;
-  if (variables) free(variables);
-  variables = NULL;
-  n_variables = 0;
+// the maps gathered from the ast for the debug section
+typedef struct {
+  const char **files;  // an array of pointers to allcated names (in driver)
+  uint32_t n_files;
+
+  int *code_source;  // the index in items of the ast_node that generated
+                     // this code
+  int *code_scope;
+  int code_size;
+
+  ast_node_t **items;  // nodes that should be included in map
+  uint32_t n_items;
+
+  scope_t **scopes;  // scope map
+  uint32_t n_scopes;
+
+  ast_node_t **variables;
+  uint32_t n_variables;
+
+  // positions (+1) of the objects in items, scopes, variables
+  hash_table_t *items_index, *scopes_index, *variables_index;
+} gather_t;
+
+static int find_index(hash_table_t *t, void *p) {
+  return (int)(intptr_t)hash_get(t, (uint64_t)(uintptr_t)p) - 1;
+}
+
+static void put_index(hash_table_t *t, void *p, int i) {
+  hash_put(t, (uint64_t)(uintptr_t)p, (void *)(intptr_t)(i + 1));
+}
+
+static void clear_gather(gather_t *g) {
+  if (g->files) free(g->files);
+  g->files = NULL;
+  g->n_files = 0;
+  if (g->code_source) free(g->code_source);
+  g->code_source = NULL;
+  if (g->code_scope) free(g->code_scope);
+  g->code_scope = NULL;
+  g->code_size = 0;
+  if (g->items) free(g->items);
+  g->items = NULL;
+  g->n_items = 0;
+  if (g->scopes) free(g->scopes);
+  g->scopes = NULL;
+  g->n_scopes = 0;
+  if (g->variables) free(g->variables);
+  g->variables = NULL;
+  g->n_variables = 0;
+  if (g->items_index) hash_table_t_delete(g->items_index);
+  if (g->scopes_index) hash_table_t_delete(g->scopes_index);
+  if (g->variables_index) hash_table_t_delete(g->variables_index);
+  g->items_index = g->scopes_index = g->variables_index = NULL;
 }
 
-static int find_file(const char *fname) {
-  for (int i = 0; i < n_files; i++)
-    if (!strcmp(fname, files[i])) return i;
+static int find_file(gather_t *g, const char *fname) {
+  for (int i = 0; i < g->n_files; i++)
+    if (!strcmp(fname, g->files[i])) return i;
   return -1;
 }
 
@@ -329,9 +346,9 @@ static void debug_print(ast_node_t *nd) {
     printf("%s:%d.%d\n", nd->loc.fn, nd->loc.fl, nd->loc.fc);
 }
 
-static void gather_scope(scope_t *sc);
+static void gather_scope(gather_t *g, scope_t *sc);
 
-static void gather_node(ast_node_t *nd) {
+static void gather_node(gather_t *g, ast_node_t *nd) {
   //debug_print(nd);
   switch (nd->node_type) {
     case AST_NODE_STATEMENT:
@@ -339,46 +356,42 @@ static void gather_node(ast_node_t *nd) {
         case STMT_COND:
         case STMT_WHILE:
         case STMT_DO:
-          gather_node(nd->val.s->par[1]);
+          gather_node(g, nd->val.s->par[1]);
           break;
         case STMT_FOR:
         case STMT_PARDO:
-          gather_node(nd->val.s->par[0]);
+          gather_node(g, nd->val.s->par[0]);
           break;
       }
 
       break;
     case AST_NODE_SCOPE:
-      gather_scope(nd->val.sc);
+      gather_scope(g, nd->val.sc);
       break;
     case AST_NODE_FUNCTION:
       for (ast_node_t *par = nd->val.f->params;par;par=par->next)
-        gather_node(par);
-      gather_scope(nd->val.f->root_scope);
+        gather_node(g, par);
+      gather_scope(g, nd->val.f->root_scope);
       break;
   }
 
   // store item to source map
   if (nd->loc.fn && nd->code_from >= 0 && nd->code_to >= 0) {
-    if (find_file(nd->loc.fn) == -1) {
-      n_files++;
-      files = realloc(files, n_files * sizeof(char *));
-      files[n_files - 1] = nd->loc.fn;
+    if (find_file(g, nd->loc.fn) == -1) {
+      g->n_files++;
+      g->files = realloc(g->files, g->n_files * sizeof(char *));
+      g->files[g->n_files - 1] = nd->loc.fn;
     }
-    int it = -1;
-    for (int i = 0; i < n_items; i++)
-      if (items[i] == nd) {
-        it = i;
-        break;
-      }
+    int it = find_index(g->items_index, nd);
     if (it == -1) {
-      n_items++;
-      items = realloc(items, n_items * sizeof(ast_node_t *));
-      items[n_items - 1] = nd;
-      it = n_items - 1;
+      g->n_items++;
+      g->items = realloc(g->items, g->n_items * sizeof(ast_node_t *));
+      g->items[g->n_items - 1] = nd;
+      it = g->n_items - 1;
+      put_index(g->items_index, nd, it);
     }
     for (int i = nd->code_from; i <= nd->code_to; i++)
-      if (code_source[i] == MAP_SENTINEL) code_source[i] = it;
+      if (g->code_source[i] == MAP_SENTINEL) g->code_source[i] = it;
   }
 
   // store scope to scope map
@@ -390,83 +403,81 @@ static void gather_node(ast_node_t *nd) {
     else
       sc = nd->val.f->root_scope;
 
-    int it = -1;
-    for (int i = 0; i < n_scopes; i++)
-      if (scopes[i] == sc) {
-        it = i;
-        break;
-      }
+    int it = find_index(g->scopes_index, sc);
     if (it == -1) {
-      n_scopes++;
-      scopes = realloc(scopes, n_scopes * sizeof(scope_t *));
-      scopes[n_scopes - 1] = sc;
-      it = n_scopes - 1;
+      g->n_scopes++;
+      g->scopes = realloc(g->scopes, g->n_scopes * sizeof(scope_t *));
+      g->scopes[g->n_scopes - 1] = sc;
+      it = g->n_scopes - 1;
+      put_index(g->scopes_index, sc, it);
     }
     if (nd->code_from >= 0)
       for (int i = nd->code_from; i <= nd->code_to; i++)
-        if (code_scope[i] == MAP_SENTINEL) code_scope[i] = it;
+        if (g->code_scope[i] == MAP_SENTINEL) g->code_scope[i] = it;
   }
 
   // store variables
   if (nd->node_type == AST_NODE_VARIABLE) {
-    int it = -1;
-    for (int i = 0; i < n_variables; i++)
-      if (variables[i] == nd) {
-        it = i;
-        break;
-      }
-    if (it == -1) {
-      n_variables++;
-      variables = realloc(variables, n_variables * sizeof(ast_node_t *));
-      variables[n_variables - 1] = nd;
+    if (find_index(g->variables_index, nd) == -1) {
+      g->n_variables++;
+      g->variables =
+          realloc(g->variables, g->n_variables * sizeof(ast_node_t *));
+      g->variables[g->n_variables - 1] = nd;
+      put_index(g->variables_index, nd, g->n_variables - 1);
     }
   }
 }
 
-static void gather_scope(scope_t *sc) {
+static void gather_scope(gather_t *g, scope_t *sc) {
   if (!sc) return;
-  for (ast_node_t *it = sc->items; it; it = it->next) gather_node(it);
+  for (ast_node_t *it = sc->items; it; it = it->next) gather_node(g, it);
 }
 
-static void emit_variable(writer_t *out, ast_t *ast, int j) {
-  out_raw(out, variables[j]->val.v->name,
-          strlen(variables[j]->val.v->name) + 1);
+static void emit_variable(gather_t *g, writer_t *out, ast_t *ast,
+                          int j) {
+  out_raw(out, g->variables[j]->val.v->name,
+          strlen(g->variables[j]->val.v->name) + 1);
   uint32_t type;
   for (ast_node_t *t = ast->types; t; t = t->next)
-    if (t->val.t == variables[j]->val.v->base_type) {
+    if (t->val.t == g->variables[j]->val.v->base_type) {
       type = t->val.t->id;
       break;
     }
 
   out_raw(out, &type, 4);
-  out_raw(out, &(variables[j]->val.v->num_dim), 4);
+  out_raw(out, &(g->variables[j]->val.v->num_dim), 4);
   
-  if (variables[j]->code_from<0) variables[j]->code_from=0;
-  out_raw(out, &(variables[j]->code_from), 4);
-  out_raw(out, &(variables[j]->val.v->addr), 4);
+  if (g->variables[j]->code_from<0) g->variables[j]->code_from=0;
+  out_raw(out, &(g->variables[j]->code_from), 4);
+  out_raw(out, &(g->variables[j]->val.v->addr), 4);
 }
 
 void emit_debug_section(writer_t *out, ast_t *ast, int _code_size) {
-  clear_globals();
-  n_scopes=1;
-  scopes=malloc(sizeof(scope_t*));
-  scopes[0]=ast->root_scope;
+  gather_t gather, *g = &gather;
+  memset(g, 0, sizeof(gather_t));
+  g->n_scopes=1;
+  g->scopes=malloc(sizeof(scope_t*));
+  g->scopes[0]=ast->root_scope;
+  g->items_index = hash_table_t_new(1024, NULL);
+  g->scopes_index = hash_table_t_new(1024, NULL);
+  g->variables_index = hash_table_t_new(1024, NULL);
+  put_index(g->scopes_index, ast->root_scope, 0);
   uint8_t section = SECTION_DEBUG;
   out_raw(out, &section, 1);
 
-  code_size = _code_size;
-  code_source = (int *)malloc(code_size * sizeof(int));
-  code_scope = (int *)malloc(code_size * sizeof(int));
-  for (int i = 0; i < code_size; i++) code_source[i] = MAP_SENTINEL;
-  for (int i = 0; i < code_size; i++) code_scope[i] = MAP_SENTINEL;
+  g->code_size = _code_size;
+  g->code_source = (int *)malloc(g->code_size * sizeof(int));
+  g->code_scope = (int *)malloc(g->code_size * sizeof(int));
+  for (int i = 0; i < g->code_size; i++) g->code_source[i] = MAP_SENTINEL;
+  for (int i = 0; i < g->code_size; i++) g->code_scope[i] = MAP_SENTINEL;
 
-  for (ast_node_t *fn = ast->functions; fn; fn = fn->next) gather_node(fn);
-  gather_scope(ast->root_scope);
+  for (ast_node_t *fn = ast->functions; fn; fn = fn->next) gather_node(g, fn);
+  gather_scope(g, ast->root_scope);
 
   // write file names
-  out_raw(out, &n_files, 4);
-  for (int i = 0; i < n_files; i++) {
-    out_raw(out, (char *)files[i], 1 + strlen(files[i]));
+  out_raw(out, &g->n_files, 4);
+  for (int i = 0; i < g->n_files; i++) {
+    out_raw(out, (char *)g->files[i], 1 + strlen(g->files[i]));
   }
 
   {
@@ -477,35 +488,34 @@ void emit_debug_section(writer_t *out, ast_t *ast, int _code_size) {
     out_raw(out, &n, 4);
     for (ast_node_t *fn = ast->functions; fn; fn = fn->next)
       if (fn->val.f->root_scope) {
-        uint32_t i;
-        for (i = 0; i < n_items; i++)
-          if (items[i] == fn) break;
-        out_raw(out, &i, 4);
+        int i = find_index(g->items_index, fn);
+        uint32_t id = (i == -1) ? g->n_items : i;
+        out_raw(out, &id, 4);
         out_raw(out, (char *)fn->val.f->name, 1 + strlen(fn->val.f->name));
       }
   }
 
   // write node info
-  out_raw(out, &n_items, 4);
-  for (int i = 0; i < n_items; i++) {
-    uint32_t fileid = (uint32_t)find_file(items[i]->loc.fn);
+  out_raw(out, &g->n_items, 4);
+  for (int i = 0; i < g->n_items; i++) {
+    uint32_t fileid = (uint32_t)find_file(g, g->items[i]->loc.fn);
     out_raw(out, &fileid, 4);
-    out_raw(out, &(items[i]->loc.fl), 4);
-    out_raw(out, &(items[i]->loc.fc), 4);
-    out_raw(out, &(items[i]->loc.ll), 4);
-    out_raw(out, &(items[i]->loc.lc), 4);
+    out_raw(out, &(g->items[i]->loc.fl), 4);
+    out_raw(out, &(g->items[i]->loc.fc), 4);
+    out_raw(out, &(g->items[i]->loc.ll), 4);
+    out_raw(out, &(g->items[i]->loc.lc), 4);
   }
 
   {
     // write source map
     uint32_t code_map_size = 0;
-    for (int i = 1; i < code_size; i++)
-      if (code_source[i - 1] != code_source[i]) code_map_size++;
+    for (int i = 1; i < g->code_size; i++)
+      if (g->code_source[i - 1] != g->code_source[i]) code_map_size++;
     out_raw(out, &code_map_size, 4);
-    for (int i = 1; i < code_size; i++)
-      if (code_source[i - 1] != code_source[i]) {
+    for (int i = 1; i < g->code_size; i++)
+      if (g->code_source[i - 1] != g->code_source[i]) {
         out_raw(out, &i, 4);
-        out_raw(out, &code_source[i], 4);
+        out_raw(out, &g->code_source[i], 4);
 
       }
   }
@@ -532,38 +542,49 @@ void emit_debug_section(writer_t *out, ast_t *ast, int _code_size) {
     // write scope map
     uint32_t scope_map_size = 0;
     
-    for (int i = 0; i < code_size; i++)
-      if (code_scope[i]==MAP_SENTINEL) code_scope[i]=0;
+    for (int i = 0; i < g->code_size; i++)
+      if (g->code_scope[i]==MAP_SENTINEL) g->code_scope[i]=0;
 
-    for (int i = 0; i < code_size; i++)
-      if (i==0||code_scope[i - 1] != code_scope[i]) scope_map_size++;
+    for (int i = 0; i < g->code_size; i++)
+      if (i==0||g->code_scope[i - 1] != g->code_scope[i]) scope_map_size++;
     out_raw(out, &scope_map_size, 4);
-    for (int i = 0; i < code_size; i++)
-      if (i==0||code_scope[i - 1] != code_scope[i]) {
+    for (int i = 0; i < g->code_size; i++)
+      if (i==0||g->code_scope[i - 1] != g->code_scope[i]) {
         out_raw(out, &i, 4);
-        out_raw(out, &code_scope[i], 4);
+        out_raw(out, &g->code_scope[i], 4);
       }
   }
 
   {
-    // write scopes
-    out_raw(out, &n_scopes, 4);
-    for (int i = 0; i < n_scopes; i++) {
+    // write g->scopes
+    // g->variables of each scope, in the order of gathering
+    uint32_t *nv = (uint32_t *)calloc(g->n_scopes, sizeof(uint32_t));
+    int *first = (int *)malloc(g->n_scopes * sizeof(int));
+    int *next = (int *)malloc((g->n_variables + 1) * sizeof(int));
+    for (int i = 0; i < g->n_scopes; i++) first[i] = -1;
+    for (int j = g->n_variables - 1; j >= 0; j--) {
+      int sc = find_index(g->scopes_index, g->variables[j]->val.v->scope);
+      if (sc == -1) continue;
+      nv[sc]++;
+      next[j] = first[sc];
+      first[sc] = j;
+    }
+
+    out_raw(out, &g->n_scopes, 4);
+    for (int i = 0; i < g->n_scopes; i++) {
       uint32_t parent = MAP_SENTINEL;
-      for (int j = 0; j < n_scopes; j++)
-        if (scopes[i]->parent == scopes[j]) {
-          parent = j;
-          break;
-        }
+      int j = g->scopes[i]->parent ? find_index(g->scopes_index, g->scopes[i]->parent)
+                                : -1;
+      if (j != -1) parent = j;
       out_raw(out, &parent, 4);
-      uint32_t nv = 0;
-      for (int j = 0; j < n_variables; j++)
-        if (variables[j]->val.v->scope == scopes[i]) nv++;
-      out_raw(out, &nv, 4);
-      for (int j = 0; j < n_variables; j++)
-        if (variables[j]->val.v->scope == scopes[i]) emit_variable(out, ast, j);
+      out_raw(out, &nv[i], 4);
+      for (j = first[i]; j != -1; j = next[j]) emit_variable(g, out, ast, j);
     }
+    free(nv);
+    free(first);
+    free(next);
   }
+  clear_gather(g);
 }
 
 
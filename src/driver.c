@@ -2,12 +2,11 @@
 
 #include <driver.h>
 #include <errors.h>
+#include <hash.h>
 #include <parser.h>
 #include <path.h>
 #include <scanner.h>
 
-extern int yycolumn;
-
 /**
  * @brief Invoke an error.
  * Called from #driver_set_file and #driver_push_file when someting went wrong.
@@ -30,8 +29,8 @@ static void driver_error_handler(const char *s, ...) {
 //! structure to store included files
 typedef struct _include_file_t {
   char *name;           //!< normalized name
-  char *content;        //!< content, if preloaded by #driver_set_file
-  FILE *f;              //!< if there is no content, open this file
+  char *content;        //!< content, preloaded by #driver_set_file or read
+  uint64_t hash;        //!< hash_text() of the content
   YY_BUFFER_STATE buf;  //!< if the parsing was interupted by inseting a new
                         //!< file, save the state here
   int lineno,           //!< current line
@@ -43,7 +42,7 @@ typedef struct _include_file_t {
 
 static CONSTRUCTOR(include_file_t, const char *name) {
   ALLOC_VAR(r, include_file_t)
-  r->f = NULL;
+  r->hash = 0;
   r->buf = NULL;
   r->lineno = 1;
   r->col = 1;
@@ -56,43 +55,53 @@ static CONSTRUCTOR(include_file_t, const char *name) {
   return r;
 }
 
+// the buffers are deleted when the parsing ends (see driver_parse)
 static DESTRUCTOR(include_file_t) {
   if (r == NULL) return;
   if (r->name) free(r->name);
   if (r->content) free(r->content);
-  if (r->f) fclose(r->f);
-  if (r->buf) yy_delete_buffer(r->buf);
   if (r->next) include_file_t_delete(r->next);
   free(r);
 }
 
-static include_file_t *files=NULL,  //!< the list of known included files
-    *current=NULL;                  //!< pointer to the list of included files
-
-writer_t *driver_error_writer = NULL;
-
 //! internal: Insert a new empty file
-static include_file_t *insert_file(const char *filename) {
+static include_file_t *insert_file(compiler_ctx_t *ctx, const char *filename) {
   include_file_t *file = include_file_t_new(filename);
-  if (files) file->next = files;
-  files = file;
+  if (ctx->files) file->next = ctx->files;
+  ctx->files = file;
   return file;
 }
 
 /* initialize the driver */
-void driver_init() {  files = current = NULL; }
+CONSTRUCTOR(compiler_ctx_t) {
+  ALLOC_VAR(r, compiler_ctx_t)
+  r->files = r->current = NULL;
+  r->ast = NULL;
+  r->scanner = NULL;
+  r->module_loader = NULL;
+  return r;
+}
+
+/* deallocat memory */
+DESTRUCTOR(compiler_ctx_t) {
+  if (r == NULL) return;
+  include_file_t_delete(r->files);
+  free(r);
+}
 
 /* preload / unload the given file */
-void driver_set_file(const char *filename, const char *content) {
+void driver_set_file(compiler_ctx_t *ctx, const char *filename,
+                     const char *content) {
   include_file_t *file;
-  for (file = files; file && strcmp(file->name, filename); file = file->next)
+  for (file = ctx->files; file && strcmp(file->name, filename);
+       file = file->next)
     ;
-  if (file && (file->f || file->buf)) {
+  if (file && file->buf) {
     driver_error_handler("declined to preload current file, skipping");
     return;
   }
   if (file == NULL)
-    file = insert_file(filename);
+    file = insert_file(ctx, filename);
   else if (file->content)
     free(file->content);
   if (content) {
@@ -123,31 +132,75 @@ static char *normalize_filename(include_file_t *prefix, const char *f) {
 }
 
 /* main parsing function */
-ast_t *driver_parse(const char *filename) {
+ast_t *driver_parse(compiler_ctx_t *ctx, const char *filename) {
   ast_t *ast = ast_t_new();
+  ctx->ast = ast;
+  yylex_init_extra(ctx, &ctx->scanner);
+  ast->scanner = ctx->scanner;
 
-  for (include_file_t *file = files; file; file = file->next)
+  for (include_file_t *file = ctx->files; file; file = file->next)
     file->included = 0;
 
   char *name = normalize_filename(NULL, filename);
-  driver_push_file(name, 1);
+  driver_push_file(ctx, name, 1);
   free(name);
 
-  yylineno = 1;
-  yycolumn = 1;
-  if (driver_current_file()) yyparse(ast);
+  if (driver_current_file(ctx)) {
+    yyset_lineno(1, ctx->scanner);
+    yyset_column(1, ctx->scanner);
+    yyparse(ast);
+  }
+
+  // the files still open if the parsing was stopped by an error
+  for (include_file_t *file = ctx->files; file; file = file->next) {
+    if (file->buf) yy_delete_buffer(file->buf, ctx->scanner);
+    file->buf = NULL;
+    file->included_from = NULL;
+  }
+  ctx->current = NULL;
+  yylex_destroy(ctx->scanner);
+  ctx->scanner = ast->scanner = NULL;
+  ctx->ast = NULL;
   return ast;
 }
 
+/* read the whole file */
+char *driver_read_file(const char *filename, long *len) {
+  FILE *f = fopen(filename, "rb");
+  if (!f) return NULL;
+  long size = 4096, n = 0;
+  char *r = (char *)malloc(size);
+  while (!feof(f) && !ferror(f)) {
+    if (n + 1 == size) r = (char *)realloc(r, size *= 2);
+    n += fread(r + n, 1, size - 1 - n, f);
+  }
+  if (ferror(f)) {
+    free(r);
+    fclose(f);
+    return NULL;
+  }
+  r[n] = 0;
+  fclose(f);
+  if (len) *len = n;
+  return r;
+}
+
+/* use precompiled modules of included files */
+void driver_register_module_loader(compiler_ctx_t *ctx,
+                                   driver_module_loader_t loader) {
+  ctx->module_loader = loader;
+}
+
 /* switch to a new file */
-void driver_push_file(const char *filename, int only_once) {
-  char *name = normalize_filename(current, filename);
+void driver_push_file(compiler_ctx_t *ctx, const char *filename,
+                      int only_once) {
+  char *name = normalize_filename(ctx->current, filename);
 
   include_file_t *file;
-  for (file = files; file && strcmp(file->name, name); file = file->next)
+  for (file = ctx->files; file && strcmp(file->name, name); file = file->next)
     ;
 
-  if (file == NULL) file = insert_file(name);
+  if (file == NULL) file = insert_file(ctx, name);
   if (file->included && only_once) {
     free(name);
     return;
@@ -160,40 +213,37 @@ void driver_push_file(const char *filename, int only_once) {
     return;
   }
 
-  if (file->content) {
-    file->buf = yy_scan_string(file->content);
-  } else {
-    file->f = fopen(name, "r");
-    if (file->f) {
-      file->buf = yy_create_buffer(file->f, YY_BUF_SIZE);
-      yy_switch_to_buffer(file->buf);
-    } else {
+  if (!file->content) {
+    file->content = driver_read_file(name, NULL);
+    if (!file->content) {
       driver_error_handler("cannot open file %s", name);
       free(name);
       return;
     }
   }
+  file->hash = hash_text(HASH_INIT, file->content);
+  if (ctx->module_loader && ctx->current &&
+      ctx->module_loader(ctx->ast, file->name, file->hash)) {
+    free(name);
+    return;
+  }
+  file->buf = yy_scan_string(file->content, ctx->scanner);
 
-  file->included_from = current;
-  current = file;
+  file->included_from = ctx->current;
+  ctx->current = file;
   free(name);
 }
 
 /* remove file from stack */
-int driver_pop_file() {
-  include_file_t *oldfile = current;
-  include_file_t *newfile = current->included_from;
-  current = newfile;
+int driver_pop_file(compiler_ctx_t *ctx) {
+  include_file_t *oldfile = ctx->current;
+  include_file_t *newfile = ctx->current->included_from;
+  ctx->current = newfile;
   if (oldfile) oldfile->included_from = NULL;
 
-  if (oldfile->f) {
-    fclose(oldfile->f);
-    oldfile->f = NULL;
-  }
-
-  if (newfile) yy_switch_to_buffer(newfile->buf);
+  if (newfile) yy_switch_to_buffer(newfile->buf, ctx->scanner);
 
-  yy_delete_buffer(oldfile->buf);
+  yy_delete_buffer(oldfile->buf, ctx->scanner);
   oldfile->buf = NULL;
 
   if (newfile == NULL)
@@ -202,29 +252,33 @@ int driver_pop_file() {
     return 1;
 }
 
-/* deallocat memory */
-void driver_destroy() { include_file_t_delete(files); }
+/* files of the last parse */
+void driver_visited_files(compiler_ctx_t *ctx, driver_file_callback_t callback,
+                          void *data) {
+  for (include_file_t *file = ctx->files; file; file = file->next)
+    if (file->included) callback(file->name, file->hash, data);
+}
 
 /* *********************** */
 /* various getters/setters */
-const char *driver_current_file() {
-  if (current == NULL) return NULL;
-  return current->name;
+const char *driver_current_file(compiler_ctx_t *ctx) {
+  if (ctx->current == NULL) return NULL;
+  return ctx->current->name;
 }
 
-int driver_current_line() {
-  if (current == NULL) return -1;
-  return current->lineno;
+int driver_current_line(compiler_ctx_t *ctx) {
+  if (ctx->current == NULL) return -1;
+  return ctx->current->lineno;
 }
 
-int driver_current_column() {
-  if (current == NULL) return -1;
-  return current->col;
+int driver_current_column(compiler_ctx_t *ctx) {
+  if (ctx->current == NULL) return -1;
+  return ctx->current->col;
 }
 
-void driver_set_current_pos(int l, int col) {
-  if (current) {
-    current->lineno = l;
-    current->col = col;
+void driver_set_current_pos(compiler_ctx_t *ctx, int l, int col) {
+  if (ctx->current) {
+    ctx->current->lineno = l;
+    ctx->current->col = col;
   }
 }
@@ -13,21 +13,51 @@
  * The filenames input to #driver_push_file and #driver_parse are normalized relative
  * to currently active path.
  *
+ * All the state of the driver and of the (reentrant) scanner is kept in a
+ * \ref compiler_ctx_t, so several programs can be compiled at once, each with
+ * its own context. A compilation in a thread should also use its own error log
+ * (see use_error_log() in errors.h).
+ *
  */
 #ifndef __DRIVER_H__
 #define __DRIVER_H__
 
 #include <ast.h>
 
+/**
+ * @brief Loader of precompiled included files (see module.h).
+ *
+ * Called when an included file is pushed, with the ast being parsed, the
+ * normalized name of the file and the hash of its content. If it returns 1,
+ * the file was loaded into the ast and is not parsed.
+ */
+typedef int (*driver_module_loader_t)(ast_t *ast, const char *name,
+                                      uint64_t hash);
+
+struct _include_file_t;
+
+//! state of the driver (one compilation at a time)
+typedef struct {
+  struct _include_file_t *files,  //!< the list of known included files
+      *current;                   //!< the file being scanned (a stack)
+  ast_t *ast;                     //!< the result of the running #driver_parse
+  void *scanner;  //!< the scanner (`yyscan_t`) of the running #driver_parse
+  driver_module_loader_t module_loader;  //!< none by default
+} compiler_ctx_t;
+
 //! Allocate memory and iitialize the driver
-void driver_init();
+CONSTRUCTOR(compiler_ctx_t);
+
+//! Deallocate all memory
+DESTRUCTOR(compiler_ctx_t);
 
 /**
  * @brief Preload contents of a file.
  * @note driver makes a local copy of both strings, caller should free 
  * the parameters
  */
-void driver_set_file(const char *filename, const char *content);
+void driver_set_file(compiler_ctx_t *ctx, const char *filename,
+                     const char *content);
 
 /**
  * @brief Parse file and return the result.
@@ -39,7 +69,7 @@ void driver_set_file(const char *filename, const char *content);
  * structure using #ast_t_delete
  *
  */
-ast_t *driver_parse(const char *filename);
+ast_t *driver_parse(compiler_ctx_t *ctx, const char *filename);
 
 /**
  * @brief Switch to a new file
@@ -49,24 +79,48 @@ ast_t *driver_parse(const char *filename);
  * @todo When in web mode, and the content of a file is not preloaded, it should
  * not try to open the file (there is no filesystem present)
  */
-void driver_push_file(const char *filename, int only_once);
+void driver_push_file(compiler_ctx_t *ctx, const char *filename,
+                      int only_once);
 
 /**
  * @brief Remove current file from the stack of included files.
  * Returns 0 if there are no more files, 1 otherwise.
  */
-int driver_pop_file();
+int driver_pop_file(compiler_ctx_t *ctx);
 
 //! Return the filename of the current file
-const char *driver_current_file();
+const char *driver_current_file(compiler_ctx_t *ctx);
 //! Currently scanned line in the current file
-int driver_current_line();
+int driver_current_line(compiler_ctx_t *ctx);
 //! Currently scanned column in the current line
-int driver_current_column();
+int driver_current_column(compiler_ctx_t *ctx);
 //! Set the stored position in the current file 
-void driver_set_current_pos(int l,int col);
+void driver_set_current_pos(compiler_ctx_t *ctx, int l, int col);
 
-//! Deallocate all memory
-void driver_destroy();
+/**
+ * @brief Read the whole file.
+ *
+ * Return the allocated content (terminated by 0, the caller should free it),
+ * or NULL if the file cannot be read. If `len` is not NULL, store the length.
+ */
+char *driver_read_file(const char *filename, long *len);
+
+//! Register the loader of precompiled files (none by default)
+void driver_register_module_loader(compiler_ctx_t *ctx,
+                                   driver_module_loader_t loader);
+
+//! called by #driver_visited_files for every file
+typedef void (*driver_file_callback_t)(const char *name, uint64_t hash,
+                                       void *data);
+
+/**
+ * @brief Files used by the last #driver_parse
+ *
+ * Calls `callback` for every file pushed by #driver_push_file, with its
+ * normalized name, and the hash of its content (hash_text() from hash.h;
+ * it does not depend on the line ends).
+ */
+void driver_visited_files(compiler_ctx_t *ctx, driver_file_callback_t callback,
+                          void *data);
 
 #endif
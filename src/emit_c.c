@@ -0,0 +1,1146 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <code.h>
+#include <debug.h>
+#include <emit_c.h>
+#include <errors.h>
+
+extern const char *const instr_names[];
+
+// what an instruction does, for grouping into runs
+#define KIND_PURE 0   // per-thread, only the stacks of the thread
+#define KIND_READ 1   // per-thread, reads memory
+#define KIND_WRITE 2  // per-thread, writes memory (or allocates the heap)
+#define KIND_GROUP 3  // executed by the whole group
+
+static int kind(uint8_t op) {
+  switch (op) {
+    case PUSHC: case PUSHB: case FBASE: case SWS: case POP: case A2S:
+    case POPA: case S2A: case SWA: case ADD_INT: case SUB_INT:
+    case MULT_INT: case DIV_INT: case MOD_INT: case ADD_FLOAT: case SUB_FLOAT:
+    case MULT_FLOAT: case DIV_FLOAT: case POW_INT: case POW_FLOAT: case NOT:
+    case OR: case AND: case BIT_OR: case BIT_AND: case BIT_XOR: case EQ_INT:
+    case EQ_FLOAT: case GT_INT: case GT_FLOAT: case GEQ_INT: case GEQ_FLOAT:
+    case LT_INT: case LT_FLOAT: case LEQ_INT: case LEQ_FLOAT: case FLOAT2INT:
+    case INT2FLOAT: case LAST_BIT: case LOGF: case LOG: case SQRT: case SQRTF:
+    case RAND: case RANDF: case ADD_INT64: case SUB_INT64: case MULT_INT64:
+    case DIV_INT64: case MOD_INT64: case EQ_INT64: case GT_INT64:
+    case GEQ_INT64: case LT_INT64: case LEQ_INT64: case INT2INT64:
+    case INT642INT: case UNIFORM: case INT2INT8: case INT2INT16:
+      return KIND_PURE;
+    case SIZE: case LDC: case LDB: case LDCH: case LDBH: case IDX: case LDL:
+    case LDG: case IDXA: case IDX_NC: case LDCH_NC: case LDBH_NC: case LDSB:
+    case LDSBH: case LDSBH_NC: case LDS: case LDSH: case LDSH_NC: case PUSHR:
+    case ROW: case IDXR:
+      return KIND_READ;
+    case STC: case STB: case STCH: case STBH: case STL: case STG: case STCH_NC:
+    case STBH_NC: case STS: case STSH: case STSH_NC: case ALLOC:
+      return KIND_WRITE;
+  }
+  return KIND_GROUP;
+}
+
+// if the instruction can stop the machine with an error
+static int can_fail(uint8_t *code, int pc, int mem_mode) {
+  switch (code[pc]) {
+    case SIZE: case IDX: case STC: case STB: case STCH: case STBH: case STL:
+    case STG: case STS: case STSH:
+      return 1;
+    case IDXA:
+      return !(lval(code + pc + 1, uint32_t) & IDXA_NO_CHECK) ||
+             mem_mode == MEM_MODE_EREW;
+    case ROW:
+      return 1;
+    case IDXR:
+      return !(lval(code + pc + 1, uint32_t) & IDXR_NO_CHECK) ||
+             mem_mode == MEM_MODE_EREW;
+    case LDC: case LDB: case LDCH: case LDBH: case LDL: case LDG: case LDSB:
+    case LDSBH: case LDS: case LDSH:
+      return mem_mode == MEM_MODE_EREW;
+  }
+  return 0;
+}
+
+// jump target of `JMP`, `JMPZ`, `JOIN_JMP` (relative to the parameter)
+#define target(code, pc) ((pc) + 1 + lval((code) + (pc) + 1, int32_t))
+
+// variables of run()
+#define USES_R 1      // result of step()
+#define USES_MU 2     // table of the memory checks
+#define USES_FB 4     // frame base
+
+/* ----------------------------------------------------------------------------
+ * a run of per-thread instructions
+ *
+ * the run is a sequence of loops over a block of the active threads: the
+ * first takes the values the run needs from the stacks of the threads, then
+ * the instructions are executed in up to three segments, and the last loop
+ * leaves the results on the stacks; between the loops, the values are kept in
+ * columns `c<id>`, one value per thread of the block
+ *
+ * the segments are the instructions before the first access to the memory,
+ * those from the first to the last access, and those after it; only the loop
+ * of the middle segment reaches the thread (get_addr()), the other two work
+ * on the columns alone
+ *
+ * within a segment, the values are in variables `v<id>`; `os` and `as` hold
+ * the ids of those the run pushed to the `op_stack` and the `acc_stack` and
+ * did not pop yet
+ */
+
+typedef struct {
+  int *ids, top, size;
+} ids_t;
+
+typedef struct {
+  writer_t *out;     // the body of the loop of the current segment
+  writer_t *seg[3];  // the bodies of the loops of the segments
+  writer_t *in;      // the body of the first loop
+  ids_t os, as;      // values on the stacks
+  int *cols, n_cols; // ids of the columns
+  int next;          // next id
+  int popped;        // values of the `acc_stack` popped by the run
+  int mem_mode;
+  int use_os, use_as, fb, check, th;  // used: stacks, frame base, checks,
+                                      // the thread in the middle segment
+} run_t;
+
+static void push_id(ids_t *s, int v) {
+  if (s->top == s->size) {
+    s->size = s->size ? 2 * s->size : 16;
+    s->ids = (int *)realloc(s->ids, s->size * sizeof(int));
+  }
+  s->ids[s->top++] = v;
+}
+
+static void push(run_t *r, int v) { push_id(&r->os, v); }
+
+// keep the value `v` in a column, return 0 if it already was
+static int column(run_t *r, int v) {
+  for (int i = 0; i < r->n_cols; i++)
+    if (r->cols[i] == v) return 0;
+  r->cols = (int *)realloc(r->cols, (r->n_cols + 1) * sizeof(int));
+  r->cols[r->n_cols++] = v;
+  return 1;
+}
+
+// `i`-th value on the stacks (the `op_stack` first)
+#define live(r, i) \
+  ((i) < (r)->os.top ? (r)->os.ids[i] : (r)->as.ids[(i) - (r)->os.top])
+
+// store the values on the stacks to their columns at the end of a segment
+static void save_live(run_t *r) {
+  for (int i = 0; i < r->os.top + r->as.top; i++)
+    if (column(r, live(r, i)))
+      out_text(r->out, "    c%d[k].u = v%d.u;\n", live(r, i), live(r, i));
+}
+
+// end the current segment, start the next one with the values on the stacks
+static void next_segment(run_t *r, int seg) {
+  save_live(r);
+  r->out = r->seg[seg];
+  for (int i = 0; i < r->os.top + r->as.top; i++) {
+    int seen = 0;
+    for (int j = 0; j < i; j++) seen |= (live(r, j) == live(r, i));
+    if (!seen)
+      out_text(r->out, "    wt_val_t v%d = {.u = c%d[k].u};\n", live(r, i),
+               live(r, i));
+  }
+}
+
+// a value the run takes from the stacks, `from` is the expression in the
+// first loop
+static int take(run_t *r, const char *from) {
+  int v = r->next++;
+  column(r, v);
+  out_text(r->in, "    c%d[k] = %s;\n", v, from);
+  out_text(r->out, "    wt_val_t v%d = {.u = c%d[k].u};\n", v, v);
+  return v;
+}
+
+static int pop(run_t *r) {
+  if (r->os.top > 0) return r->os.ids[--r->os.top];
+  r->use_os = 1;
+  return take(r, "POP(os)");
+}
+
+static int pop_acc(run_t *r) {
+  if (r->as.top > 0) return r->as.ids[--r->as.top];
+  r->use_as = 1;
+  char from[64];
+  sprintf(from, "lval(as->data + as->top - %d, wt_val_t)", 4 * ++r->popped);
+  return take(r, from);
+}
+
+// start the declaration of a new value on the stack
+static int value(run_t *r, const char *field) {
+  int v = r->next++;
+  out_text(r->out, "    wt_val_t v%d = {.%s = ", v, field);
+  push(r, v);
+  return v;
+}
+
+// `a,b,... -> x,...`
+static void binary(run_t *r, const char *field, const char *type,
+                   const char *op) {
+  int a = pop(r), b = pop(r);
+  value(r, field);
+  out_text(r->out, "v%d.%s %s v%d.%s};\n", a, type, op, b, type);
+}
+
+// `a,b,... -> x,...` on int64 values (see code.h): `x` is `format` applied to
+// `a`, `b` (int64_t), an int64 if `wide`, otherwise an int
+static void binary64(run_t *r, const char *format, int wide) {
+  int al = pop(r), ah = pop(r), bl = pop(r), bh = pop(r), x = r->next++;
+  char a[32], b[32];
+  sprintf(a, "I64(v%d, v%d)", ah, al);
+  sprintf(b, "I64(v%d, v%d)", bh, bl);
+  out_text(r->out, wide ? "    int64_t x%d = " : "    int32_t x%d = ", x);
+  out_text(r->out, format, a, b);
+  out_text(r->out, ";\n");
+  if (wide) {
+    value(r, "u");
+    out_text(r->out, "(uint64_t)x%d >> 32};\n", x);
+    value(r, "u");
+    out_text(r->out, "(uint32_t)x%d};\n", x);
+  } else {
+    value(r, "i");
+    out_text(r->out, "x%d};\n", x);
+  }
+}
+
+// `a,... -> x,...` where x is `format` applied to `a`
+static void unary(run_t *r, const char *field, const char *format) {
+  int a = pop(r);
+  value(r, field);
+  char name[16];
+  sprintf(name, "v%d", a);
+  out_text(r->out, format, name);
+  out_text(r->out, "};\n");
+}
+
+static void check_read(run_t *r, int p) {
+  if (r->mem_mode != MEM_MODE_EREW) return;
+  r->check = 1;
+  out_text(r->out, "    CHECK_READ(p%d);\n", p);
+}
+
+// `IDX`, `IDX_NC`, `IDXA`
+static void array_index(run_t *r, uint8_t *code, int pc) {
+  uint8_t op = code[pc];
+  int nd, check, size = 0;
+  if (op == IDXA) {
+    uint32_t d = lval(code + pc + 1, uint32_t);
+    nd = d & 0xff;
+    check = !(d & IDXA_NO_CHECK);
+    size = (d >> 8) & 0x7fffff;
+  } else {
+    nd = code[pc + 1];
+    check = (op == IDX);
+  }
+  int a = pop(r), x = r->next++;
+  r->th = 1;
+  if (check) {
+    out_text(r->out,
+             "    uint32_t n%d = lval(get_addr(th, v%d.u + 4, 4), uint32_t);\n",
+             x, a);
+    out_text(r->out,
+             "    if (n%d != %d)\n"
+             "      FAIL(-3, \"mismatch in dimensions %%d %%d (%%d)\", "
+             "%d, n%d, %d);\n",
+             x, nd, nd, x, pc);
+  }
+  out_text(r->out, "    uint32_t x%d = 0;\n", x);
+  for (int i = 0; i < nd; i++) {
+    int v = pop(r);
+    out_text(r->out,
+             "    uint32_t s%d_%d = lval(get_addr(th, v%d.u + %d, 4), "
+             "uint32_t);\n",
+             x, i, a, 4 * (i + 2));
+    if (check)
+      out_text(r->out,
+               "    if (v%d.u >= s%d_%d)\n"
+               "      FAIL(-2, \"range check error %%d (%%d).\", v%d.u, %d);\n",
+               v, x, i, a, pc);
+    out_text(r->out, "    x%d = x%d * s%d_%d + v%d.u;\n", x, x, x, i, v);
+  }
+  if (op == IDXA) {
+    out_text(r->out, "    void *p%d = get_addr(th, v%d.u, 4);\n", x, a);
+    value(r, "u");
+    out_text(r->out, "lval(p%d, uint32_t) + x%d * %d};\n", x, x, size);
+    check_read(r, x);
+  } else {
+    value(r, "u");
+    out_text(r->out, "x%d};\n", x);
+  }
+}
+
+// `ROW`: the address of the row, the size of the last dimension (or
+// IDXR_BAD), the header
+static void array_row(run_t *r, uint8_t *code, int pc) {
+  uint32_t d = lval(code + pc + 1, uint32_t);
+  int nd = d & 0xff, size = (d >> 8) & 0x7fffff;
+  int a = pop(r), x = r->next++;
+  r->th = 1;
+  out_text(r->out,
+           "    uint32_t n%d = lval(get_addr(th, v%d.u + 4, 4), uint32_t);\n",
+           x, a);
+  out_text(r->out,
+           "    if (n%d != %d)\n"
+           "      FAIL(-3, \"mismatch in dimensions %%d %%d (%%d)\", "
+           "%d, n%d, %d);\n",
+           x, nd, nd, x, pc);
+  out_text(r->out, "    uint32_t x%d = 0, l%d = 0;\n", x, x);
+  for (int i = 0; i < nd; i++) {
+    out_text(r->out,
+             "    uint32_t s%d_%d = lval(get_addr(th, v%d.u + %d, 4), "
+             "uint32_t);\n",
+             x, i, a, 4 * (i + 2));
+    if (i < nd - 1) {
+      int v = pop(r);
+      out_text(r->out,
+               "    if (v%d.u >= s%d_%d) l%d = %uU;\n"
+               "    x%d = x%d * s%d_%d + v%d.u;\n",
+               v, x, i, x, IDXR_BAD, x, x, x, i, v);
+    } else
+      out_text(r->out,
+               "    if (l%d == 0) l%d = s%d_%d;\n"
+               "    x%d = x%d * s%d_%d;\n",
+               x, x, x, i, x, x, x, i);
+  }
+  out_text(r->out, "    void *p%d = get_addr(th, v%d.u, 4);\n", x, a);
+  value(r, "u");
+  out_text(r->out, "v%d.u};\n", a);
+  value(r, "u");
+  out_text(r->out, "l%d};\n", x);
+  value(r, "u");
+  out_text(r->out, "lval(p%d, uint32_t) + x%d * %d};\n", x, x, size);
+  check_read(r, x);
+}
+
+// `IDXR`: the element of the row in the slot
+static void row_index(run_t *r, uint8_t *code, int pc) {
+  uint32_t x = lval(code + pc + 1, uint32_t);
+  int v = pop(r), p = r->next++;
+  r->th = 1;
+  if (x & IDXR_FRAME) r->fb = 1;
+  out_text(r->out, "    uint8_t *p%d = (uint8_t *)get_addr(th, %s%uU, 12);\n",
+           p, (x & IDXR_FRAME) ? "fb + " : "", 4 * (x & 0xffff));
+  if (!(x & IDXR_NO_CHECK))
+    out_text(r->out,
+             "    if ((lval(p%d + 4, uint32_t) & %uU) ||\n"
+             "        v%d.u >= lval(p%d + 4, uint32_t))\n"
+             "      FAIL(-2, \"range check error %%d (%%d).\", "
+             "lval(p%d + 8, uint32_t), %d);\n",
+             p, IDXR_BAD, v, p, p, pc);
+  value(r, "u");
+  out_text(r->out, "lval(p%d, uint32_t) + v%d.u * %u};\n", p, v, x >> 18);
+  check_read(r, p);
+}
+
+// address of a load or a store to `p<id>`, return the id
+static int address(run_t *r, uint8_t *code, int pc, int len) {
+  int p = r->next++;
+  switch (code[pc]) {
+    case LDL: case STL:
+      r->fb = r->th = 1;
+      out_text(r->out, "    void *p%d = get_addr(th, fb + %uU, 4);\n", p,
+               lval(code + pc + 1, uint32_t));
+      break;
+    case LDG: case STG:
+      r->th = 1;
+      out_text(r->out, "    void *p%d = get_addr(th, %uU, 4);\n", p,
+               lval(code + pc + 1, uint32_t));
+      break;
+    case LDCH: case LDBH: case STCH: case STBH: case LDCH_NC: case LDBH_NC:
+    case STCH_NC: case STBH_NC: case LDSBH: case LDSBH_NC: case LDSH:
+    case LDSH_NC: case STSH: case STSH_NC: {
+      int a = pop(r);
+      out_text(r->out, "    void *p%d = env->heap->data + v%d.u;\n", p, a);
+    } break;
+    default: {
+      int a = pop(r);
+      r->th = 1;
+      out_text(r->out, "    void *p%d = get_addr(th, v%d.u, %d);\n", p, a,
+               len);
+    }
+  }
+  return p;
+}
+
+// store `v` (popped) to `p`
+static void store(run_t *r, int p, const char *type, const char *cast,
+                  int check) {
+  int v = pop(r);
+  out_text(r->out, "    lval(p%d, %s) = %sv%d.i;\n", p, type, cast, v);
+  if (check) {
+    r->check = 1;
+    out_text(r->out, "    CHECK_WRITE(p%d, v%d.i);\n", p, v);
+  }
+}
+
+static void comment(writer_t *out, uint8_t *code, int pc) {
+  uint8_t op = code[pc];
+  out_text(out, "// %d: %s", pc, op <= IDXR ? instr_names[op] : "???");
+  if (instr_length(op) == 5)
+    out_text(out, " %d", lval(code + pc + 1, int32_t));
+  else if (instr_length(op) == 2)
+    out_text(out, " %d", code[pc + 1]);
+  out_text(out, "\n");
+}
+
+static void emit_op(run_t *r, uint8_t *code, int pc) {
+  uint8_t op = code[pc];
+  writer_t *o = r->out;
+  out_text(o, "    ");
+  comment(o, code, pc);
+  switch (op) {
+    case PUSHC:
+      value(r, "i");
+      out_text(o, "%d};\n", lval(code + pc + 1, int32_t));
+      break;
+    case PUSHB:
+      value(r, "u");
+      out_text(o, "%u};\n", code[pc + 1]);
+      break;
+    case PUSHR:
+      r->th = 1;
+      value(r, "i");
+      out_text(o, "th->reg[%u]};\n", code[pc + 1]);
+      break;
+    case FBASE:
+      r->fb = 1;
+      unary(r, "u", "%s.u + fb");
+      break;
+    case SIZE: {
+      int a = pop(r), d = pop(r);
+      r->th = 1;
+      out_text(o,
+               "    if (v%d.u >= lval(get_addr(th, v%d.u + 4, 4), uint32_t))\n"
+               "      FAIL(-2, \"bad array dimension\\n\");\n",
+               d, a);
+      value(r, "u");
+      out_text(o,
+               "lval(get_addr(th, v%d.u + 4 * (v%d.u + 2), 4), uint32_t)};\n",
+               a, d);
+    } break;
+    case LDC: case LDCH: case LDCH_NC: case LDL: case LDG: {
+      int p = address(r, code, pc, 4);
+      value(r, "u");
+      out_text(o, "lval(p%d, uint32_t)};\n", p);
+      if (op != LDCH_NC) check_read(r, p);
+    } break;
+    case LDB: case LDBH: case LDBH_NC: {
+      int p = address(r, code, pc, 1);
+      value(r, "i");
+      out_text(o, "lval(p%d, uint8_t)};\n", p);
+      if (op != LDBH_NC) check_read(r, p);
+    } break;
+    case LDSB: case LDSBH: case LDSBH_NC: {
+      int p = address(r, code, pc, 1);
+      value(r, "i");
+      out_text(o, "lval(p%d, int8_t)};\n", p);
+      if (op != LDSBH_NC) check_read(r, p);
+    } break;
+    case LDS: case LDSH: case LDSH_NC: {
+      int p = address(r, code, pc, 2);
+      value(r, "i");
+      out_text(o, "lval(p%d, int16_t)};\n", p);
+      if (op != LDSH_NC) check_read(r, p);
+    } break;
+    case STC: case STCH: case STCH_NC: case STL: case STG:
+      store(r, address(r, code, pc, 4), "int32_t", "", op != STCH_NC);
+      break;
+    case STB:
+      store(r, address(r, code, pc, 1), "uint8_t", "(uint8_t)", 1);
+      break;
+    case STBH: case STBH_NC:
+      store(r, address(r, code, pc, 1), "uint8_t", "(uint8_t)", op == STBH);
+      break;
+    case STS: case STSH: case STSH_NC:
+      store(r, address(r, code, pc, 2), "uint16_t", "(uint16_t)",
+            op != STSH_NC);
+      break;
+    case IDX: case IDX_NC: case IDXA:
+      array_index(r, code, pc);
+      break;
+    case ROW:
+      array_row(r, code, pc);
+      break;
+    case IDXR:
+      row_index(r, code, pc);
+      break;
+    case SWS: {
+      int a = pop(r), b = pop(r);
+      push(r, a);
+      push(r, b);
+    } break;
+    case POP:
+      if (r->os.top > 0)
+        r->os.top--;
+      else {
+        r->use_os = 1;
+        out_text(r->in, "    os->top -= 4;\n");
+      }
+      break;
+    case A2S: {
+      int a = pop_acc(r);
+      push_id(&r->as, a);
+      push(r, a);
+    } break;
+    case POPA:
+      if (r->as.top > 0)
+        r->as.top--;
+      else {
+        r->use_as = 1;
+        r->popped++;
+      }
+      break;
+    case S2A: {
+      int a = pop(r);
+      push(r, a);
+      push_id(&r->as, a);
+    } break;
+    case SWA: {
+      int a = pop_acc(r), b = pop_acc(r);
+      push_id(&r->as, a);
+      push_id(&r->as, b);
+    } break;
+    // integers wrap around as in the machine
+    case ADD_INT: binary(r, "u", "u", "+"); break;
+    case SUB_INT: binary(r, "u", "u", "-"); break;
+    case MULT_INT: binary(r, "u", "u", "*"); break;
+    case DIV_INT: binary(r, "i", "i", "/"); break;
+    case MOD_INT: binary(r, "i", "i", "%"); break;
+    case BIT_AND: binary(r, "i", "i", "&"); break;
+    case BIT_OR: binary(r, "i", "i", "|"); break;
+    case BIT_XOR: binary(r, "i", "i", "^"); break;
+    case ADD_FLOAT: binary(r, "f", "f", "+"); break;
+    case SUB_FLOAT: binary(r, "f", "f", "-"); break;
+    case MULT_FLOAT: binary(r, "f", "f", "*"); break;
+    case DIV_FLOAT: binary(r, "f", "f", "/"); break;
+    case OR: binary(r, "i", "i", "||"); break;
+    case AND: binary(r, "i", "i", "&&"); break;
+    case EQ_INT: binary(r, "i", "i", "=="); break;
+    case EQ_FLOAT: binary(r, "i", "f", "=="); break;
+    case GT_INT: binary(r, "i", "i", ">"); break;
+    case GT_FLOAT: binary(r, "i", "f", ">"); break;
+    case GEQ_INT: binary(r, "i", "i", ">="); break;
+    case GEQ_FLOAT: binary(r, "i", "f", ">="); break;
+    case LT_INT: binary(r, "i", "i", "<"); break;
+    case LT_FLOAT: binary(r, "i", "f", "<"); break;
+    case LEQ_INT: binary(r, "i", "i", "<="); break;
+    case LEQ_FLOAT: binary(r, "i", "f", "<="); break;
+    case POW_INT: {
+      int a = pop(r), b = pop(r);
+      value(r, "i");
+      out_text(o, "ipow(v%d.i, v%d.i)};\n", a, b);
+    } break;
+    case POW_FLOAT: {
+      int a = pop(r), b = pop(r);
+      value(r, "f");
+      out_text(o, "pow(v%d.f, v%d.f)};\n", a, b);
+    } break;
+    case NOT: unary(r, "i", "!%s.i"); break;
+    case INT2FLOAT: unary(r, "f", "%s.i"); break;
+    case FLOAT2INT: unary(r, "i", "%s.f"); break;
+    case INT2INT8: unary(r, "i", "(int8_t)%s.i"); break;
+    case INT2INT16: unary(r, "i", "(int16_t)%s.i"); break;
+    case LOGF: unary(r, "f", "logf(%s.f) / logf(2)"); break;
+    case LOG: unary(r, "i", "ilog2(%s.i)"); break;
+    case SQRTF: unary(r, "f", "sqrtf(%s.f)"); break;
+    case RAND: {
+      int a = pop(r), b = pop(r);
+      value(r, "i");
+      out_text(o, "philox(v%d.u, v%d.u) >> 1};\n", a, b);
+    } break;
+    case RANDF: {
+      int a = pop(r), b = pop(r);
+      value(r, "f");
+      out_text(o, "(philox(v%d.u, v%d.u) >> 8) * (1.0f / 16777216)};\n", a,
+               b);
+    } break;
+    case ADD_INT64:
+      binary64(r, "(int64_t)((uint64_t)%s + (uint64_t)%s)", 1);
+      break;
+    case SUB_INT64:
+      binary64(r, "(int64_t)((uint64_t)%s - (uint64_t)%s)", 1);
+      break;
+    case MULT_INT64:
+      binary64(r, "(int64_t)((uint64_t)%s * (uint64_t)%s)", 1);
+      break;
+    case DIV_INT64: binary64(r, "%s / %s", 1); break;
+    case MOD_INT64: binary64(r, "%s %% %s", 1); break;
+    case EQ_INT64: binary64(r, "%s == %s", 0); break;
+    case GT_INT64: binary64(r, "%s > %s", 0); break;
+    case GEQ_INT64: binary64(r, "%s >= %s", 0); break;
+    case LT_INT64: binary64(r, "%s < %s", 0); break;
+    case LEQ_INT64: binary64(r, "%s <= %s", 0); break;
+    // the low half of an int64 is the int
+    case INT2INT64: {
+      int a = pop(r);
+      value(r, "i");
+      out_text(o, "v%d.i < 0 ? -1 : 0};\n", a);
+      push(r, a);
+    } break;
+    case INT642INT: {
+      int a = pop(r);
+      pop(r);
+      push(r, a);
+    } break;
+    case SQRT: {
+      int a = pop(r), q = r->next++;
+      out_text(o,
+               "    int32_t q%d = isqrt(v%d.i);\n"
+               "    if (q%d * q%d != v%d.i) q%d++;\n",
+               q, a, q, q, a, q);
+      value(r, "i");
+      out_text(o, "q%d};\n", q);
+    } break;
+    case LAST_BIT: {
+      int a = pop(r), q = r->next++;
+      out_text(o,
+               "    int32_t q%d = v%d.i, c%d = 0;\n"
+               "    if (q%d != 0)\n"
+               "      while (q%d %% 2 == 0) {\n"
+               "        c%d++;\n"
+               "        q%d >>= 1;\n"
+               "      }\n",
+               q, a, q, q, q, q, q);
+      value(r, "i");
+      out_text(o, "c%d};\n", q);
+    } break;
+    case ALLOC: {
+      int c = pop(r);
+      value(r, "u");
+      out_text(o, "env->heap->top};\n");
+      out_text(o, "    stack_t_alloc(env->heap, v%d.u);\n", c);
+    } break;
+  }
+}
+
+// copy `src` to `out`, each line indented by two more spaces
+static void out_indented(writer_t *out, writer_t *src) {
+  for (char *l = src->str.base, *e = l + src->str.ptr; l < e;) {
+    char *n = memchr(l, '\n', e - l);
+    n = n ? n + 1 : e;
+    out_text(out, "  ");
+    out_raw(out, l, n - l);
+    l = n;
+  }
+}
+
+// the instructions [from,to) (n of them) executed by the loops over the
+// threads; return the flags of the variables of run() used (USES_...)
+static int emit_run(writer_t *out, uint8_t *code, int from, int to, int n,
+                     int mem_mode) {
+  run_t r;
+  memset(&r, 0, sizeof(run_t));
+  for (int i = 0; i < 3; i++) r.seg[i] = writer_t_new(WRITER_STRING);
+  r.out = r.seg[0];
+  r.in = writer_t_new(WRITER_STRING);
+  r.mem_mode = mem_mode;
+
+  // the first and the last access to the memory
+  int first = to, last = to;
+  for (int pc = from; pc < to; pc += instr_length(code[pc]))
+    if (kind(code[pc]) != KIND_PURE) {
+      if (first == to) first = pc;
+      last = pc;
+    }
+
+  int fail_pc = -1;
+  for (int pc = from; pc < to; pc += instr_length(code[pc])) {
+    if (pc == first) next_segment(&r, 1);
+    if (can_fail(code, pc, mem_mode)) fail_pc = pc;
+    emit_op(&r, code, pc);
+    if (pc == last && pc + instr_length(code[pc]) < to) next_segment(&r, 2);
+  }
+  save_live(&r);
+
+  if (n == 1)
+    out_text(out, "  if (env->a_thr > 0) {\n"
+                  "    env->W += env->a_thr;\n    env->T++;\n  }\n");
+  else if (n > 1)
+    out_text(out,
+             "  if (env->a_thr > 0) {\n"
+             "    env->W += %d * env->a_thr;\n    env->T += %d;\n  }\n",
+             n, n);
+  if (r.check) {
+    out_text(out, "  env->stored_pc = %d;\n", fail_pc);
+    out_text(out,
+             "  mu = WT_MEM_CHECK && env->a_thr > 1 ? "
+             "mem_check_table_new(env->a_thr) : NULL;\n");
+  }
+  if (r.fb) out_text(out, "  fb = env->frame->base;\n");
+  out_text(out,
+           "  for (int b = 0, na = active(env); b < na; b += WT_BLOCK) {\n"
+           "    int nb = na - b < WT_BLOCK ? na - b : WT_BLOCK;\n"
+           "    thread_t **thr = act + b;\n");
+  for (int i = 0; i < r.n_cols; i++)
+    out_text(out, "    wt_val_t c%d[WT_BLOCK];\n", r.cols[i]);
+  if (r.in->str.ptr > 0) {
+    out_text(out, "    for (int k = 0; k < nb; k++) {\n");
+    if (r.use_os) out_text(out, "      stack_t *os = thr[k]->op_stack;\n");
+    if (r.use_as) out_text(out, "      stack_t *as = thr[k]->acc_stack;\n");
+    out_indented(out, r.in);
+    out_text(out, "    }\n");
+  }
+  for (int i = 0; i < 3; i++) {
+    if (r.seg[i]->str.ptr == 0) continue;
+    out_text(out, "    for (int k = 0; k < nb; k++) {\n");
+    if (i == 1 && r.th) out_text(out, "      thread_t *th = thr[k];\n");
+    out_indented(out, r.seg[i]);
+    out_text(out, "    }\n");
+  }
+  if (r.os.top > 0 || r.as.top > 0 || r.popped > 0) {
+    out_text(out, "    for (int k = 0; k < nb; k++) {\n");
+    if (r.os.top > 0) {
+      out_text(out, "      stack_t *os = thr[k]->op_stack;\n");
+      for (int i = 0; i < r.os.top; i++)
+        out_text(out, "      PUSH(os, c%d[k]);\n", r.os.ids[i]);
+    }
+    if (r.as.top > 0 || r.popped > 0) {
+      out_text(out, "      stack_t *as = thr[k]->acc_stack;\n");
+      if (r.popped > 0) out_text(out, "      as->top -= %d;\n", 4 * r.popped);
+      for (int i = 0; i < r.as.top; i++)
+        out_text(out, "      PUSH(as, c%d[k]);\n", r.as.ids[i]);
+    }
+    out_text(out, "    }\n");
+  }
+  out_text(out, "  }\n");
+  if (r.check) out_text(out, "  if (mu) hash_table_t_delete(mu);\n");
+
+  for (int i = 0; i < 3; i++) writer_t_delete(r.seg[i]);
+  writer_t_delete(r.in);
+  free(r.os.ids);
+  free(r.as.ids);
+  free(r.cols);
+  return (r.check ? USES_MU : 0) | (r.fb ? USES_FB : 0);
+}
+
+/* ----------------------------------------------------------------------------
+ * the program
+ */
+
+static const char *prologue =
+    "// generated by wtc -emit-c (see emit_c.h in the WT* sources)\n"
+    "#include <math.h>\n"
+    "#include <stdio.h>\n"
+    "#include <stdlib.h>\n"
+    "#include <string.h>\n"
+    "\n"
+    "#include <code.h>\n"
+    "#include <errors.h>\n"
+    "#include <reader.h>\n"
+    "#include <vm.h>\n"
+    "\n"
+    "#ifndef WT_MEM_CHECK\n"
+    "#define WT_MEM_CHECK 1\n"
+    "#endif\n"
+    "#ifndef WT_BLOCK\n"
+    "#define WT_BLOCK 256\n"
+    "#endif\n"
+    "\n"
+    "// a value on the stacks\n"
+    "typedef union {\n"
+    "  int32_t i;\n"
+    "  uint32_t u;\n"
+    "  float f;\n"
+    "} wt_val_t;\n"
+    "\n"
+    "// the stacks are reserved in advance (see vm.h)\n"
+    "#define POP(s) ((s)->top -= 4, lval((s)->data + (s)->top, wt_val_t))\n"
+    "#define PUSH(s, v) \\\n"
+    "  (lval((s)->data + (s)->top, wt_val_t) = (v), (s)->top += 4)\n"
+    "#define FAIL(code, ...)   \\\n"
+    "  {                       \\\n"
+    "    throw(__VA_ARGS__);   \\\n"
+    "    env->state = VM_ERROR; \\\n"
+    "    return code;          \\\n"
+    "  }\n"
+    "#define CHECK_READ(p) \\\n"
+    "  if (mu && !check_read_mem(env, mu, p)) return -5\n"
+    "#define CHECK_WRITE(p, v) \\\n"
+    "  if (mu && !check_write_mem(env, mu, p, v)) return -5\n"
+    "// an int64 from its halves (see code.h)\n"
+    "#define I64(h, l) ((int64_t)((uint64_t)(h).u << 32 | (l).u))\n"
+    "\n"
+    "// the active threads of the group, the runs take them in blocks; the\n"
+    "// values of ALU3 computed by them\n"
+    "static thread_t **act = NULL;\n"
+    "static wt_val_t *vals = NULL;\n"
+    "static int act_size = 0;\n"
+    "\n"
+    "static inline int active(virtual_machine_t *env) {\n"
+    "  if (env->n_thr > act_size) {\n"
+    "    act_size = 2 * env->n_thr;\n"
+    "    act = (thread_t **)realloc(act, act_size * sizeof(thread_t *));\n"
+    "    vals = (wt_val_t *)realloc(vals, act_size * sizeof(wt_val_t));\n"
+    "  }\n"
+    "  int na = 0;\n"
+    "  for (int t = 0; t < env->n_thr; t++)\n"
+    "    if (!env->thr[t]->returned) act[na++] = env->thr[t];\n"
+    "  return na;\n"
+    "}\n"
+    "\n"
+    "// an instruction executed by the machine\n"
+    "static inline int step(virtual_machine_t *env, int pc) {\n"
+    "  env->pc = pc;\n"
+    "  return instruction(env, 0);\n"
+    "}\n"
+    "\n"
+    "// JMPZ: return 1 if the group jumps, 0 if not, or the error\n"
+    "static inline int jmpz(virtual_machine_t *env, int pc) {\n"
+    "  int32_t c = 0;\n"
+    "  if (env->a_thr > 0) {\n"
+    "    env->W++;\n"
+    "    env->T++;\n"
+    "    int first = 1;\n"
+    "    for (int t = 0; t < env->n_thr; t++)\n"
+    "      if (!env->thr[t]->returned) {\n"
+    "        int32_t a = POP(env->thr[t]->op_stack).i;\n"
+    "        if (first) {\n"
+    "          c = a;\n"
+    "          first = 0;\n"
+    "        } else if ((a == 0) != (c == 0))\n"
+    "          FAIL(-3, \"non-uniform condition (%d)\", pc);\n"
+    "      }\n"
+    "  }\n"
+    "  return c == 0;\n"
+    "}\n"
+    "\n";
+
+static const char *epilogue =
+    "static void error_handler(error_t *err) {\n"
+    "  fprintf(stderr, \"%s\\n\", err->msg->str.base);\n"
+    "}\n"
+    "\n"
+    "static void print_var_info(writer_t *w, virtual_machine_t *env,\n"
+    "                           input_layout_item_t *var) {\n"
+    "  if (env->debug_info)\n"
+    "    print_var_name(w, env, var->addr);\n"
+    "  else {\n"
+    "    out_text(w, \"%010u (%08x) \", var->addr, var->addr);\n"
+    "    if (var->num_dim > 0)\n"
+    "      out_text(w, \"(%d) \", var->num_dim);\n"
+    "    else\n"
+    "      out_text(w, \"    \");\n"
+    "    print_var_layout(w, var);\n"
+    "  }\n"
+    "}\n"
+    "\n"
+    "int main(int argc, char **argv) {\n"
+    "  int print_io = 0, wt_stat = 1;\n"
+    "  for (int i = 1; i < argc; i++)\n"
+    "    if (!strcmp(argv[i], \"-i\"))\n"
+    "      print_io = 1;\n"
+    "    else if (!strcmp(argv[i], \"-x\"))\n"
+    "      wt_stat = 0;\n"
+    "    else {\n"
+    "      printf(\"usage: %s [-h?ix]\\n\", argv[0]);\n"
+    "      printf(\"options:\\n\");\n"
+    "      printf(\"-h,-?     print this screen and exit\\n\");\n"
+    "      printf(\"-i        interactive mode (prints the expected input "
+    "format) \\n\");\n"
+    "      printf(\"-x        don't print W/T stats \\n\");\n"
+    "      exit(0);\n"
+    "    }\n"
+    "\n"
+    "  register_error_handler(&error_handler);\n"
+    "  vm_thread_ids = 0;\n"
+    "  virtual_machine_t *env = virtual_machine_t_new(image, sizeof(image));\n"
+    "  writer_t *w = writer_t_new(WRITER_FILE);\n"
+    "  w->f = stdout;\n"
+    "\n"
+    "  if (print_io) {\n"
+    "    print_types(w, env);\n"
+    "    out_text(w, \"input:\\n\");\n"
+    "    for (int i = 0; i < env->n_in_vars; i++) {\n"
+    "      print_var_info(w, env, &(env->in_vars[i]));\n"
+    "      out_text(w, \"\\n\");\n"
+    "    }\n"
+    "  }\n"
+    "  reader_t *r = reader_t_new(READER_FILE, stdin);\n"
+    "  if (read_input(r, env) != 0) exit(-1);\n"
+    "  reader_t_delete(r);\n"
+    "  int err = run(env);\n"
+    "  if (err == -1) {\n"
+    "    if (print_io) out_text(w, \"output\\n\");\n"
+    "    for (int i = 0; i < env->n_out_vars; i++) {\n"
+    "      if (print_io) {\n"
+    "        print_var_info(w, env, &(env->out_vars[i]));\n"
+    "        out_text(w, \" = \");\n"
+    "      }\n"
+    "      write_output(w, env, i);\n"
+    "    }\n"
+    "    if (wt_stat)\n"
+    "      out_text(w, \"W/T: %\" PRId64 \" %\" PRId64 \"\\n\", env->W, env->T);\n"
+    "    return 0;\n"
+    "  }\n"
+    "  exit(err);\n"
+    "}\n";
+
+// an operand of `ALU3`, `ALUR` in the loop over the threads: a register, a
+// constant, or a slot
+static void alu3_operand(writer_t *out, const char *name, uint32_t x,
+                         uint32_t v, int reg, int constant) {
+  if (reg)
+    out_text(out, "      wt_val_t %s = {.i = act[k]->reg[%u]};\n", name, v);
+  else if (constant)
+    out_text(out, "      wt_val_t %s = {.u = %uU};\n", name, v);
+  else
+    out_text(out,
+             "      wt_val_t %s = lval(get_addr(act[k], %s%uU, 4), "
+             "wt_val_t);\n",
+             name, (x & ALU3_FRAME) ? "fb + " : "", 4 * v);
+}
+
+// `ALU3` (see code.h): the values of all active threads are computed before
+// the first store; the operations as in emit_op(); `ALUR` computes them to
+// the registers of the threads
+static int emit_alu3(writer_t *out, uint8_t *code, int pc) {
+  static const char *const fields[] = {"u", "u", "i", "i", "i", "u",
+                                       "i", "i", "f", "f", "f", "f"};
+  static const char *const opers[] = {"+", "*", "&", "|", "^", "-",
+                                      "/", "%", "+", "-", "*", "/"};
+  uint8_t op = code[pc];
+  uint32_t x = lval(code + pc + 1, uint32_t), d = (x >> 8) & 0xff;
+  const char *f = fields[x & 0xf];
+  // the operands in slots
+  int slots = !(x & ALU3_AREG) || !(x & (ALU3_BREG | ALU3_CONST));
+  out_text(out,
+           "  if (env->a_thr > 0) {\n"
+           "    env->W += %d * env->a_thr;\n"
+           "    env->T += %d;\n"
+           "  }\n",
+           ALU3_COST(op, x), ALU3_COST(op, x));
+  if (op == ALU3)
+    out_text(out,
+             "  env->stored_pc = %d;\n"
+             "  mu = WT_MEM_CHECK && env->a_thr > 1 ? "
+             "mem_check_table_new(env->a_thr) : NULL;\n",
+             pc);
+  int uses_fb = (x & ALU3_FRAME) && (slots || op == ALU3);
+  if (uses_fb) out_text(out, "  fb = env->frame->base;\n");
+  out_text(out,
+           "  {\n"
+           "    int na = active(env);\n"
+           "    for (int k = 0; k < na; k++) {\n");
+  alu3_operand(out, "a", x, (x >> 16) & 0xff, x & ALU3_AREG, 0);
+  alu3_operand(out, "b", x, x >> 24, x & ALU3_BREG, x & ALU3_CONST);
+  if (op == ALUR) {
+    out_text(out,
+             "      wt_val_t v;\n"
+             "      v.%s = a.%s %s b.%s;\n"
+             "      act[k]->reg[%u] = v.i;\n"
+             "    }\n"
+             "  }\n",
+             f, f, opers[x & 0xf], f, d);
+    return uses_fb ? USES_FB : 0;
+  }
+  out_text(out,
+           "      vals[k].%s = a.%s %s b.%s;\n"
+           "    }\n"
+           "    for (int k = 0; k < na; k++) {\n"
+           "      void *p = get_addr(act[k], %s%uU, 4);\n"
+           "      lval(p, int32_t) = vals[k].i;\n"
+           "      CHECK_WRITE(p, vals[k].i);\n"
+           "    }\n"
+           "  }\n"
+           "  if (mu) hash_table_t_delete(mu);\n",
+           f, f, opers[x & 0xf], f, (x & ALU3_FRAME) ? "fb + " : "", 4 * d);
+  return USES_MU | (uses_fb ? USES_FB : 0);
+}
+
+// instructions executed by the whole group
+static int emit_group(writer_t *out, uint8_t *code, int pc, uint32_t *fnmap,
+                      int mem_mode) {
+  uint8_t op = code[pc];
+  // in EREW, the machine checks the reads of ALU3 as well
+  if ((op == ALU3 || op == ALUR) && mem_mode != MEM_MODE_EREW)
+    return emit_alu3(out, code, pc);
+  switch (op) {
+    case JMP:
+      out_text(out,
+               "  if (env->a_thr > 0) {\n"
+               "    env->W++;\n"
+               "    env->T++;\n"
+               "    goto L%d;\n"
+               "  }\n",
+               target(code, pc));
+      return 0;
+    case JMPZ:
+      out_text(out,
+               "  if ((r = jmpz(env, %d)) < 0) return r;\n"
+               "  if (r) goto L%d;\n",
+               pc, target(code, pc));
+      return USES_R;
+    case ENDVM:
+      out_text(out, "  env->state = VM_OK;\n  return -1;\n");
+      return 0;
+    default:
+      out_text(out, "  if ((r = step(env, %d)) < 0) return r;\n", pc);
+      if (op == CALL) {
+        uint32_t fn = fnmap[lval(code + pc + 1, uint32_t)];
+        out_text(out, "  if (env->pc == %u) goto L%u;\n", fn, fn);
+      } else if (op == JOIN_JMP)
+        out_text(out, "  goto L%d;\n", target(code, pc));
+      else if (op == RETURN)
+        out_text(out, "  goto dispatch;\n");
+      return USES_R;
+  }
+}
+
+int emit_c(writer_t *out, uint8_t *bin, int len) {
+  uint8_t *code = NULL;
+  int size = 0, mem_mode = MEM_MODE_CREW, version = 0;
+  uint32_t fcnt = 0, *fnmap = NULL;
+
+  for (int pos = 0; pos < len;) {
+    uint8_t section = bin[pos++];
+    switch (section) {
+      case SECTION_HEADER:
+        version = bin[pos] & ~CODE_REGISTERS;
+        mem_mode = bin[pos + 5];
+        pos += (version >= 5) ? 7 : 6;
+        break;
+      case SECTION_INPUT:
+      case SECTION_OUTPUT: {
+        uint32_t n = lval(bin + pos, uint32_t);
+        pos += 4;
+        for (uint32_t i = 0; i < n; i++) pos += 9 + bin[pos + 8];
+      } break;
+      case SECTION_FNMAP:
+        fcnt = lval(bin + pos, uint32_t);
+        pos += 12;
+        fnmap = (uint32_t *)malloc((fcnt + 1) * sizeof(uint32_t));
+        for (uint32_t i = 0; i < fcnt; i++, pos += 16)
+          fnmap[i] = lval(bin + pos, uint32_t);
+        break;
+      case SECTION_DEBUG:
+        debug_info_t_delete(debug_info_t_new(bin, &pos, len));
+        break;
+      case SECTION_CODE:
+        code = bin + pos;
+        size = len - pos;
+        pos = len;
+        break;
+      default:
+        pos = len;
+        version = 0;
+    }
+  }
+  if (version < 2 || !code || !fnmap) {
+    throw("emit-c: invalid binary");
+    free(fnmap);
+    return 1;
+  }
+
+  // instruction starts, the starts of runs, and the labels
+  uint8_t *start = (uint8_t *)calloc(size + 1, 1),
+          *leader = (uint8_t *)calloc(size + 1, 1),
+          *label = (uint8_t *)calloc(size + 1, 1);
+  int was_error = 0, dispatch = 0;
+  for (int pc = 0; pc < size; pc += instr_length(code[pc])) {
+    start[pc] = 1;
+    if (pc + instr_length(code[pc]) > size) was_error = 1;
+    if (code[pc] == RETURN) dispatch = 1;
+  }
+  for (uint32_t i = 0; i < fcnt; i++)
+    if (fnmap[i] >= size || !start[fnmap[i]])
+      was_error = 1;
+    else
+      leader[fnmap[i]] = 1;
+  leader[0] = 1;
+  // the return addresses are the labels of the dispatch after `RETURN`
+  for (int pc = 0; pc < size && !was_error; pc += instr_length(code[pc])) {
+    uint8_t op = code[pc];
+    int next = pc + instr_length(op);
+    if (kind(op) == KIND_GROUP) leader[next] = 1;
+    if (op == JMP || op == JMPZ || op == JOIN_JMP) {
+      int t = target(code, pc);
+      if (t < 0 || t >= size || !start[t])
+        was_error = 1;
+      else
+        leader[t] = label[t] = 1;
+    }
+    if (op == CALL) {
+      if (lval(code + pc + 1, uint32_t) >= fcnt)
+        was_error = 1;
+      else
+        label[fnmap[lval(code + pc + 1, uint32_t)]] = 1;
+      label[next] = dispatch;
+    }
+  }
+  if (was_error) {
+    throw("emit-c: invalid code");
+    free(start);
+    free(leader);
+    free(label);
+    free(fnmap);
+    return 1;
+  }
+
+  writer_t *body = writer_t_new(WRITER_STRING);
+  int uses = 0;
+  for (int pc = 0; pc < size;) {
+    if (label[pc]) out_text(body, "L%d:\n", pc);
+    uint8_t op = code[pc];
+    if (kind(op) == KIND_GROUP) {
+      out_text(body, "  ");
+      comment(body, code, pc);
+      uses |= emit_group(body, code, pc, fnmap, mem_mode);
+      pc += instr_length(op);
+      continue;
+    }
+
+    // extend the run while every thread sees the values the machine would
+    // see, and at most one instruction can fail
+    int end = pc, n = 0, reads = 0, writes = 0, fails = 0;
+    while (end < size && (end == pc || !leader[end])) {
+      int k = kind(code[end]), f = can_fail(code, end, mem_mode);
+      if (k == KIND_GROUP || (k == KIND_WRITE && (reads || writes)) ||
+          (k == KIND_READ && writes) || (f && fails))
+        break;
+      reads += (k == KIND_READ);
+      writes += (k == KIND_WRITE);
+      fails += f;
+      n += code[end] != UNIFORM && code[end] != PUSHR;
+      end += instr_length(code[end]);
+    }
+    uses |= emit_run(body, code, pc, end, n, mem_mode);
+    pc = end;
+  }
+
+  out_text(out, "%s", prologue);
+  out_text(out, "static uint8_t image[] = {");
+  for (int i = 0; i < len; i++)
+    out_text(out, "%s0x%02x,", (i % 16) ? " " : "\n    ", bin[i]);
+  out_text(out, "\n};\n\n");
+
+  out_text(out, "static int run(virtual_machine_t *env) {\n");
+  if (uses & USES_R) out_text(out, "  int r;\n");
+  if (uses & USES_MU) out_text(out, "  hash_table_t *mu;\n");
+  if (uses & USES_FB) out_text(out, "  uint32_t fb;\n");
+  out_text(out, "  env->state = VM_RUNNING;\n");
+  out_raw(out, body->str.base, body->str.ptr);
+  out_text(out, "  env->state = VM_OK;\n  return -1;\n");
+  if (dispatch) {
+    out_text(out, "dispatch:\n  switch (env->pc) {\n");
+    for (int pc = 0; pc < size; pc += instr_length(code[pc]))
+      if (code[pc] == CALL)
+        out_text(out, "    case %d:\n      goto L%d;\n", pc + 5, pc + 5);
+    out_text(out, "  }\n  FAIL(-3, \"bad return address %%d\", env->pc);\n");
+  }
+  out_text(out, "}\n\n%s", epilogue);
+
+  writer_t_delete(body);
+  free(start);
+  free(leader);
+  free(label);
+  free(fnmap);
+  return 0;
+}
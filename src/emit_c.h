@@ -0,0 +1,61 @@
+/**
+ * @file emit_c.h
+ * @brief translation of the binary to C (used by `wtc -emit-c`)
+ *
+ * The C source is a program with the same command line and the same text
+ * input and output as `wtrun` running the binary (without the trace `-t`).
+ * It is linked with the runtime library `libwtrt.a` (`make wtrt`, the machine
+ * from vm.h without the interpreter loop), e.g.
+ *
+ *     wtc -emit-c -o prog.c prog.wt
+ *     cc -O2 -I src prog.c _build/cli_tools/libwtrt.a -lm -o prog
+ *
+ * The binary is embedded in the program and loaded by the runtime, so the
+ * thread groups, the frames, the memory and the input/output variables are
+ * those of the machine. The code is translated instruction by instruction:
+ *
+ * - the straight-line per-thread instructions (see #instruction_t) are
+ *   grouped into runs. A run takes the active threads of the group in blocks
+ *   of `WT_BLOCK` (256 by default): the values it pops from the `op_stack`
+ *   and the `acc_stack` of the threads are copied into arrays indexed by the
+ *   thread, the instructions are executed by loops over those arrays, and
+ *   only what remains at the end is pushed back. The threads themselves are
+ *   reached only when copying the stacks and by the loop over the
+ *   instructions from the first to the last memory access (the memory of a
+ *   thread is found by get_addr()); the arithmetic before and after it works
+ *   on the arrays alone, so the C compiler can vectorize it. A run reads
+ *   memory, or writes memory once, but not both, so every thread sees the
+ *   values the machine would see, and it contains at most one instruction
+ *   that can fail, so the errors are those of the machine.
+ * - `UNIFORM` emits nothing: the value is computed in the loops over the
+ *   threads like any other, and is not counted in `W` and `T`.
+ * - `ALU3` is a loop computing the values of all active threads, followed by
+ *   a loop storing them (in EREW, where its loads are checked as well, it is
+ *   executed by instruction()); `ALUR` is one loop computing them to the
+ *   registers of the threads, and `PUSHR` is done in a run like a load, not
+ *   counted in `W` and `T`.
+ * - `JMP`, `JMPZ` and `ENDVM` are translated to jumps; the instructions that
+ *   change the groups or the frames (`FORK`, `SPLIT`, `JOIN`, `CALL`,
+ *   `RETURN`, ...), `RVA`, `SORT` and `SLICE` are executed by
+ *   instruction().
+ *
+ * `W` and `T` are counted as by the machine. The memory checks of the
+ * memory mode are done if the program is compiled with `WT_MEM_CHECK` set
+ * to 1 (the default); `-DWT_MEM_CHECK=0` leaves them out.
+ */
+#ifndef __EMIT_C_H__
+#define __EMIT_C_H__
+
+#include <inttypes.h>
+
+#include <writer.h>
+
+/**
+ * @brief write the C program of the binary `bin` of length `len`
+ *
+ * `bin` is the output of emit_code() from code_generation.h. Return 0 on
+ * success, otherwise emit an error (errors.h) and return 1.
+ */
+int emit_c(writer_t *out, uint8_t *bin, int len);
+
+#endif
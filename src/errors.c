@@ -3,11 +3,12 @@
 
 #include <stdlib.h>
 
-static error_t **log = NULL;  // internal error log
-static int n_err = 0,         // number of errors stored
-    logsize = 0;              // allocated space
+static error_log_t static_log = {NULL, 0, 0, NULL};  // internal error log
 
-static void (*error_handler)(error_t *) = NULL;  // registered error handler
+// the log of the calling thread, NULL for the static one
+static _Thread_local error_log_t *thread_log = NULL;
+
+#define LOG (thread_log ? thread_log : &static_log)
 
 CONSTRUCTOR(error_t) {
   ALLOC_VAR(r, error_t);
@@ -35,34 +36,59 @@ void append_error_vmsg(error_t *err, int len, const char *format,
   out_vtext(err->msg, len, format, args);
 }
 
+CONSTRUCTOR(error_log_t) {
+  ALLOC_VAR(r, error_log_t);
+  r->log = NULL;
+  r->n_err = 0;
+  r->size = 0;
+  r->handler = NULL;
+  return r;
+}
+
+DESTRUCTOR(error_log_t) {
+  if (r == NULL) return;
+  for (int i = 0; i < r->n_err; i++) error_t_delete(r->log[i]);
+  free(r->log);
+  free(r);
+}
+
+error_log_t *use_error_log(error_log_t *log) {
+  error_log_t *r = thread_log;
+  thread_log = log;
+  return r;
+}
+
 void register_error_handler(void (*handler)(error_t *)) {
-  error_handler = handler;
+  LOG->handler = handler;
 }
 
 void emit_error(error_t *err) {
-  if (n_err >= logsize) {
-    if (logsize < 8)
-      logsize = 8;
+  error_log_t *l = LOG;
+  if (l->n_err >= l->size) {
+    if (l->size < 8)
+      l->size = 8;
     else
-      logsize *= 2;
-    log = (error_t **)realloc(log, logsize * sizeof(error_t *));
+      l->size *= 2;
+    l->log = (error_t **)realloc(l->log, l->size * sizeof(error_t *));
   }
-  log[n_err++] = err;
-  if (error_handler) error_handler(err);
+  l->log[l->n_err++] = err;
+  if (l->handler) l->handler(err);
 }
 
 void clear_errors() {
-  for (int i = 0; i < n_err; i++) error_t_delete(log[i]);
-  n_err = 0;
+  error_log_t *l = LOG;
+  for (int i = 0; i < l->n_err; i++) error_t_delete(l->log[i]);
+  l->n_err = 0;
 }
 
 void delete_errors() {
   clear_errors();
-  free(log);
-  log = NULL;
-  logsize = 0;
+  error_log_t *l = LOG;
+  free(l->log);
+  l->log = NULL;
+  l->size = 0;
 }
 
-int errnum() { return n_err; }
-error_t *get_error(int i) { return log[i]; }
-const char *get_error_msg(int i) { return log[i]->msg->str.base; }
+int errnum() { return LOG->n_err; }
+error_t *get_error(int i) { return LOG->log[i]; }
+const char *get_error_msg(int i) { return LOG->log[i]->msg->str.base; }
@@ -4,9 +4,14 @@
  * @brief Unified error handling routines.
  *
  * Provide a type #error_t with the description of an error. Content can be added
- * using #append_error_msg and #append_error_vmsg. There is a static error log
- * in errors.c. Calling #emit_error appends the error to the log, and executes
- * a handler, if some was registered using #register_error_handler.
+ * using #append_error_msg and #append_error_vmsg. Calling #emit_error appends
+ * the error to the error log of the calling thread, and executes a handler of
+ * the log, if some was registered using #register_error_handler.
+ *
+ * The log of a thread is the static log in errors.c, unless the thread selected
+ * its own #error_log_t by #use_error_log (e.g. to compile several programs in
+ * parallel, each with its own log). All the functions below work with the log
+ * of the calling thread.
  *
  */
 #ifndef __ERRORS_H__
@@ -43,6 +48,27 @@ void append_error_msg(error_t *err, const char *format, ...);
  */
 void append_error_vmsg(error_t *err, int len, const char *format, va_list args);
 
+//! an error log
+typedef struct {
+  error_t **log;               //!< the errors (owned)
+  int n_err,                   //!< number of errors stored
+      size;                    //!< allocated space
+  void (*handler)(error_t *);  //!< registered error handler
+} error_log_t;
+
+//! Allocate an empty error log without a handler.
+CONSTRUCTOR(error_log_t);
+
+//! Free the log and all its errors.
+DESTRUCTOR(error_log_t);
+
+/**
+ * @brief Use `log` as the error log of the calling thread.
+ * With `NULL`, the thread uses the static log again. Return the log used so
+ * far (`NULL` for the static one).
+ */
+error_log_t *use_error_log(error_log_t *log);
+
 //! Register a function called within #emit_error.
 void register_error_handler(void (*handler)(error_t *));
 //! Insert error to the internal log, and call error_handler, if defined.
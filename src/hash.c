@@ -97,3 +97,16 @@ void hash_remove(hash_table_t *t, uint64_t key) {
     h = (h + 1) % t->size;
   }
 }
+
+uint64_t hash_bytes(uint64_t h, const void *data, size_t n) {
+  const uint8_t *p = (const uint8_t *)data;
+  for (size_t i = 0; i < n; i++) h = (h ^ p[i]) * UINT64_C(1099511628211);
+  return h;
+}
+
+uint64_t hash_text(uint64_t h, const char *s) {
+  for (; *s; s++)
+    if (s[0] != '\r' || s[1] != '\n')
+      h = (h ^ (uint8_t)*s) * UINT64_C(1099511628211);
+  return h;
+}
@@ -5,6 +5,7 @@
 #ifndef __HASH_H__
 #define __HASH_H__
 #include <inttypes.h>
+#include <stddef.h>
 
 //! handler to dispose of the data when the table is detoryed
 typedef void (*destructor_t)(void *);
@@ -38,4 +39,13 @@ void *hash_get(hash_table_t *t, uint64_t key);
 //! remove the value with `key` (if present)
 void hash_remove(hash_table_t *t,uint64_t key);
 
+//! initial value for #hash_bytes and #hash_text
+#define HASH_INIT UINT64_C(14695981039346656037)
+
+//! 64-bit FNV-1a hash of `n` bytes at `data`, continuing from the hash `h`
+uint64_t hash_bytes(uint64_t h, const void *data, size_t n);
+
+//! hash of the string `s` as #hash_bytes, with `\r\n` line ends read as `\n`
+uint64_t hash_text(uint64_t h, const char *s);
+
 #endif
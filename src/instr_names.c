@@ -68,5 +68,48 @@ const char* const instr_names[]={
 "SQRT",       
 "SQRTF",      
 "BREAK",      
+"LDL",        
+"STL",        
+"LDG",        
+"STG",        
+"IDXA",       
+"IDX_NC",     
+"LDCH_NC",    
+"LDBH_NC",    
+"STCH_NC",    
+"STBH_NC",    
+"JMPZ",       
+"LDSB",       
+"LDSBH",      
+"LDSBH_NC",   
+"LDS",        
+"STS",        
+"LDSH",       
+"STSH",       
+"LDSH_NC",    
+"STSH_NC",    
+"SLICE",      
+"RAND",       
+"RANDF",      
+"ADD_INT64",  
+"SUB_INT64",  
+"MULT_INT64", 
+"DIV_INT64",  
+"MOD_INT64",  
+"EQ_INT64",   
+"GT_INT64",   
+"GEQ_INT64",  
+"LT_INT64",   
+"LEQ_INT64",  
+"INT2INT64",  
+"INT642INT",  
+"UNIFORM",    
+"ALU3",       
+"INT2INT8",   
+"INT2INT16",  
+"ALUR",       
+"PUSHR",      
+"ROW",        
+"IDXR",       
 "???"
 };
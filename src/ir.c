@@ -0,0 +1,212 @@
+#include <stdlib.h>
+
+#include <code.h>
+#include <ir.h>
+
+// instructions with a relative jump target
+static int jump_op(int op) {
+  return op == JMP || op == JMPZ || op == JOIN_JMP || op == UNIFORM;
+}
+
+CONSTRUCTOR(ir_t, code_block_t *code, ast_t *ast, ast_node_t *fn) {
+  ALLOC_VAR(r, ir_t)
+  r->ast = ast;
+  r->fn = fn;
+  r->code_size = code->pos;
+  r->n = 0;
+  for (int pos = 0; pos < code->pos; pos += instr_length(code->data[pos]))
+    r->n++;
+  r->instr = (ir_instr_t *)malloc((r->n + 1) * sizeof(ir_instr_t));
+  r->leader = (uint8_t *)calloc(r->n + 1, 1);
+  r->at = (int *)malloc((code->pos + 1) * sizeof(int));
+
+  for (int i = 0, pos = 0; i < r->n; i++) {
+    int op = code->data[pos];
+    r->instr[i].op = op;
+    switch (instr_length(op)) {
+      case 5:
+        r->instr[i].arg = lval(code->data + pos + 1, int32_t);
+        break;
+      case 2:
+        r->instr[i].arg = code->data[pos + 1];
+        break;
+      default:
+        r->instr[i].arg = 0;
+    }
+    for (int k = 0; k < instr_length(op); k++) r->at[pos + k] = i;
+    pos += instr_length(op);
+  }
+  r->at[code->pos] = r->n;
+
+  // relative jumps to instruction indices; jump targets, return addresses
+  // and the entry start basic blocks
+  r->leader[0] = 1;
+  for (int i = 0, pos = 0; i < r->n; pos += instr_length(r->instr[i].op), i++)
+    if (jump_op(r->instr[i].op)) {
+      r->instr[i].arg = r->at[pos + 1 + r->instr[i].arg];
+      r->leader[r->instr[i].arg] = 1;
+    } else if (r->instr[i].op == CALL)
+      r->leader[i + 1] = 1;
+  return r;
+}
+
+DESTRUCTOR(ir_t) {
+  if (r == NULL) return;
+  free(r->instr);
+  free(r->leader);
+  free(r->at);
+  free(r);
+}
+
+void ir_compact(ir_t *ir) {
+  // new index of every instruction; deleted ones go to the next kept one
+  int *idx = (int *)malloc((ir->n + 1) * sizeof(int));
+  int m = 0;
+  for (int i = 0; i < ir->n; i++) {
+    idx[i] = m;
+    if (ir->instr[i].op != IR_DELETED) m++;
+  }
+  idx[ir->n] = m;
+  if (m == ir->n) {
+    free(idx);
+    return;
+  }
+
+  for (int i = 0; i < ir->n; i++)
+    if (jump_op(ir->instr[i].op))
+      ir->instr[i].arg = idx[ir->instr[i].arg];
+  uint8_t *leader = (uint8_t *)calloc(m + 1, 1);
+  for (int i = 0; i < ir->n; i++) {
+    if (ir->instr[i].op != IR_DELETED) ir->instr[idx[i]] = ir->instr[i];
+    if (ir->leader[i]) leader[idx[i]] = 1;
+  }
+  free(ir->leader);
+  ir->leader = leader;
+  for (int p = 0; p <= ir->code_size; p++) ir->at[p] = idx[ir->at[p]];
+  ir->n = m;
+  free(idx);
+}
+
+void ir_replace(ir_t *ir, ir_instr_t *instr, int n, int *idx) {
+  for (int i = 0; i < n; i++)
+    if (jump_op(instr[i].op)) instr[i].arg = idx[instr[i].arg];
+  uint8_t *leader = (uint8_t *)calloc(n + 1, 1);
+  for (int i = 0; i < ir->n; i++)
+    if (ir->leader[i]) leader[idx[i]] = 1;
+  free(ir->leader);
+  ir->leader = leader;
+  free(ir->instr);
+  ir->instr = instr;
+  for (int p = 0; p <= ir->code_size; p++) ir->at[p] = idx[ir->at[p]];
+  ir->n = n;
+}
+
+static void for_list(ast_node_t *list, ir_node_callback_t f, void *data) {
+  for (ast_node_t *p = list; p; p = p->next) ir_for_nodes(p, f, data);
+}
+
+void ir_for_nodes(ast_node_t *node, ir_node_callback_t f, void *data) {
+  if (!node) return;
+  f(node, data);
+  switch (node->node_type) {
+    case AST_NODE_VARIABLE:
+      for_list(node->val.v->ranges, f, data);
+      ir_for_nodes(node->val.v->initializer, f, data);
+      break;
+    case AST_NODE_SCOPE:
+      for_list(node->val.sc->items, f, data);
+      break;
+    case AST_NODE_FUNCTION:
+      for_list(node->val.f->params, f, data);
+      if (node->val.f->root_scope)
+        for_list(node->val.f->root_scope->items, f, data);
+      break;
+    case AST_NODE_STATEMENT:
+      ir_for_nodes(node->val.s->par[0], f, data);
+      ir_for_nodes(node->val.s->par[1], f, data);
+      break;
+    case AST_NODE_EXPRESSION: {
+      expression_t *ex = node->val.e;
+      if (!ex) break;
+      switch (ex->variant) {
+        case EXPR_INITIALIZER:
+          for_list(ex->val.i, f, data);
+          break;
+        case EXPR_CALL:
+          for_list(ex->val.f->params, f, data);
+          ir_for_nodes(ex->val.f->inlined, f, data);
+          break;
+        case EXPR_ARRAY_ELEMENT:
+        case EXPR_VAR_NAME:
+        case EXPR_SIZEOF:
+        case EXPR_SORT:
+        case EXPR_SLICE:
+          for_list(ex->val.v->params, f, data);
+          break;
+        case EXPR_CAST:
+          ir_for_nodes(ex->val.c->ex, f, data);
+          break;
+        case EXPR_SPECIFIER:
+          ir_for_nodes(ex->val.s->ex, f, data);
+          break;
+        case EXPR_PREFIX:
+        case EXPR_POSTFIX:
+        case EXPR_BINARY:
+          ir_for_nodes(ex->val.o->first, f, data);
+          ir_for_nodes(ex->val.o->second, f, data);
+          break;
+      }
+    } break;
+  }
+}
+
+// move the code range of one node
+static void remap(ast_node_t *node, void *data) {
+  int *newpos = (int *)data;
+  if (node->code_from >= 0 && node->code_to >= 0) {
+    int to = newpos[node->code_to + 1] - 1;
+    node->code_from = newpos[node->code_from];
+    node->code_to = to;
+  }
+  if (node->node_type == AST_NODE_FUNCTION && node->val.f->root_scope)
+    node->val.f->addr = newpos[node->val.f->addr];
+}
+
+void ir_remap_node(ast_node_t *node, int *newpos) {
+  ir_for_nodes(node, remap, newpos);
+}
+
+void ir_lower(ir_t *ir, code_block_t *code) {
+  ir_compact(ir);
+  int *pos = (int *)malloc((ir->n + 1) * sizeof(int));
+  code->pos = 0;
+  for (int i = 0; i < ir->n; i++) {
+    pos[i] = code->pos;
+    if (instr_length(ir->instr[i].op) > 1)
+      add_instr(code, ir->instr[i].op, ir->instr[i].arg, 0);
+    else
+      add_instr(code, ir->instr[i].op, 0);
+  }
+  pos[ir->n] = code->pos;
+
+  for (int i = 0; i < ir->n; i++)
+    if (jump_op(ir->instr[i].op))
+      lval(code->data + pos[i] + 1, int32_t) =
+          pos[ir->instr[i].arg] - (pos[i] + 1);
+
+  int *newpos = (int *)malloc((ir->code_size + 1) * sizeof(int));
+  for (int p = 0; p <= ir->code_size; p++) newpos[p] = pos[ir->at[p]];
+  if (ir->fn)
+    ir_remap_node(ir->fn, newpos);
+  else
+    for_list(ir->ast->root_scope->items, remap, newpos);
+
+  // the lowered code is the new reference for positions
+  ir->at = (int *)realloc(ir->at, (code->pos + 1) * sizeof(int));
+  for (int i = 0; i < ir->n; i++)
+    for (int p = pos[i]; p < pos[i + 1]; p++) ir->at[p] = i;
+  ir->at[code->pos] = ir->n;
+  ir->code_size = code->pos;
+  free(newpos);
+  free(pos);
+}
@@ -0,0 +1,101 @@
+/**
+ * @file ir.h
+ * @brief intermediate representation of the generated code
+ *
+ * The code block produced by the code generation is decoded into an array of
+ * instructions. Jumps refer to instructions instead of byte offsets, and all
+ * positions referenced from outside the code (function addresses, code ranges
+ * of the ast nodes used in the debug info) are tracked, so the optimization
+ * passes may freely replace and delete instructions. Lowering encodes the
+ * instructions back to a code block and moves all the positions.
+ *
+ * The thread-group structure is explicit in the instructions themselves
+ * (`FORK`/`JOIN` for pardo, `SPLIT`/`JOIN` for conditions and loops); an
+ * instruction that can be entered other than from the previous one (jump
+ * target, function entry, return address) is marked as a block leader.
+ */
+#ifndef __IR_H__
+#define __IR_H__
+
+#include <stdint.h>
+
+#include <ast.h>
+#include <code_generation.h>
+#include <utils.h>
+
+//! instruction removed by a pass
+#define IR_DELETED (-1)
+
+//! one instruction
+typedef struct {
+  int op;       //!< instruction (see code.h) or IR_DELETED
+  int32_t arg;  //!< parameter; for JMP, JMPZ, JOIN_JMP, UNIFORM index of the
+                //!< target
+} ir_instr_t;
+
+//! instructions of one part of the program
+typedef struct {
+  ir_instr_t *instr;  //!< instructions (owned)
+  int n;              //!< number of instructions
+  uint8_t *leader;    //!< 1 if the instruction starts a basic block (owned)
+
+  int code_size;  //!< size of the decoded code block
+  int *at;  //!< for each position of the decoded code (and its end) the index
+            //!< of the instruction it belongs to (owned)
+  ast_t *ast;  //!< ast the code was generated from (external)
+  ast_node_t *fn;  //!< the function of the code, NULL for the main scope
+} ir_t;
+
+/**
+ * @brief decode the code of one part of the program
+ *
+ * The main scope of `ast` (`fn` is NULL) and each function `fn` are generated
+ * separately from position 0 (see code_generation.c); jumps do not leave the
+ * part, and only the code ranges of its nodes are moved by #ir_lower.
+ */
+CONSTRUCTOR(ir_t, code_block_t *code, ast_t *ast, ast_node_t *fn);
+//! destructor
+DESTRUCTOR(ir_t);
+
+//! remove the deleted instructions
+void ir_compact(ir_t *ir);
+
+/**
+ * @brief replace all the instructions by `instr` (`n` of them, owned)
+ *
+ * Old instruction `i` moves to the new instruction `idx[i]` (`idx[ir->n]` is
+ * `n`); the targets of the jumps in `instr` are old indices. Jumps, block
+ * leaders and the positions of the decoded code are moved.
+ */
+void ir_replace(ir_t *ir, ir_instr_t *instr, int n, int *idx);
+
+/**
+ * @brief encode the instructions to `code`
+ *
+ * The content of `code` is replaced. Jump offsets, function addresses and
+ * code ranges of the ast nodes are moved to the new positions; a position of
+ * a deleted instruction moves to the next instruction that was kept.
+ */
+void ir_lower(ir_t *ir, code_block_t *code);
+
+//! called by #ir_for_nodes for every node
+typedef void (*ir_node_callback_t)(ast_node_t *node, void *data);
+
+/**
+ * @brief call `f` for the node and each node of its subtree
+ *
+ * The nodes are visited in preorder: variables with their ranges and
+ * initializer, scopes and functions with their items, statements and
+ * expressions with their operands, calls with their inlined function.
+ */
+void ir_for_nodes(ast_node_t *node, ir_node_callback_t f, void *data);
+
+/**
+ * @brief move the code ranges of the node and its subtree
+ *
+ * A range (and the address of a function) at position `p` moves to
+ * `newpos[p]`; `newpos` must cover the end of each range.
+ */
+void ir_remap_node(ast_node_t *node, int *newpos);
+
+#endif
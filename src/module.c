@@ -0,0 +1,679 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <cache.h>
+#include <driver.h>
+#include <errors.h>
+#include <module.h>
+#include <parser.h>
+#include <writer.h>
+
+#define MODULE_MAGIC "WTM"
+#define MODULE_VERSION 1
+
+// references: index in the tables of the module, or one of
+#define REF_NULL -1    // NULL pointer
+#define REF_EXTERN -2  // type or function defined outside, followed by name
+
+// computed when first needed (by any of the compiling threads, all get the
+// same value)
+static _Atomic uint64_t compiler_hash = 0;
+
+static uint64_t compiler() {
+  if (!compiler_hash) compiler_hash = cache_compiler_hash();
+  return compiler_hash;
+}
+
+char *module_name(const char *filename) {
+  int n = strlen(filename);
+  char *r = (char *)malloc(n + 5);
+  strcpy(r, filename);
+  if (n > 3 && !strcmp(r + n - 3, ".wt"))
+    strcat(r, "m");
+  else
+    strcat(r, ".wtm");
+  return r;
+}
+
+/* ----------------------------------------------------------------------------
+ * writing
+ *
+ * the types and functions of the module, and the scopes and variables in the
+ * order of their definitions, get indices (stored in `ids` as index + 1)
+ */
+
+typedef struct {
+  writer_t *out;
+  hash_table_t *ids;
+  int n_scopes, n_vars;
+  int error;  // a reference that cannot be stored
+} mwriter_t;
+
+static void put_int(mwriter_t *w, int32_t v) { out_raw(w->out, &v, sizeof(v)); }
+
+static void put_str(mwriter_t *w, const char *s) {
+  out_raw(w->out, (void *)s, strlen(s) + 1);
+}
+
+static int get_id(mwriter_t *w, void *p) {
+  return (int)(intptr_t)hash_get(w->ids, (uint64_t)(uintptr_t)p) - 1;
+}
+
+static void set_id(mwriter_t *w, void *p, int i) {
+  hash_put(w->ids, (uint64_t)(uintptr_t)p, (void *)(intptr_t)(i + 1));
+}
+
+static void put_loc(mwriter_t *w, YYLTYPE *loc) {
+  put_int(w, loc->fl);
+  put_int(w, loc->fc);
+  put_int(w, loc->ll);
+  put_int(w, loc->lc);
+  put_int(w, (loc->fn != NULL) | (loc->ln != NULL) << 1);
+}
+
+static void put_type(mwriter_t *w, static_type_t *t) {
+  if (!t) {
+    put_int(w, REF_NULL);
+    return;
+  }
+  int i = get_id(w, t);
+  put_int(w, i >= 0 ? i : REF_EXTERN);
+  if (i < 0) put_str(w, t->name);
+}
+
+static void put_function(mwriter_t *w, function_t *f) {
+  if (!f) {
+    put_int(w, REF_NULL);
+    return;
+  }
+  int i = get_id(w, f);
+  put_int(w, i >= 0 ? i : REF_EXTERN);
+  if (i < 0) put_str(w, f->name);
+}
+
+static void put_member(mwriter_t *w, static_type_member_t *m) {
+  put_type(w, m->parent);
+  int i = 0;
+  for (static_type_member_t *x = m->parent->members; x != m; x = x->next) i++;
+  put_int(w, i);
+}
+
+// variables and scopes must be defined in the module before they are used
+static void put_ref(mwriter_t *w, void *p) {
+  int i = p ? get_id(w, p) : REF_NULL;
+  if (p && i < 0) w->error = 1;
+  put_int(w, i);
+}
+
+static void put_inferred(mwriter_t *w, inferred_type_t *t) {
+  put_int(w, t->compound);
+  if (!t->compound) {
+    put_type(w, t->type);
+    return;
+  }
+  int n = 0;
+  for (inferred_type_item_t *it = t->list; it; it = it->next) n++;
+  put_int(w, n);
+  for (inferred_type_item_t *it = t->list; it; it = it->next)
+    put_inferred(w, it->type);
+}
+
+static void put_list(mwriter_t *w, ast_node_t *list);
+
+static void put_expression(mwriter_t *w, expression_t *e) {
+  put_int(w, e->variant);
+  put_inferred(w, e->type);
+  switch (e->variant) {
+    case EXPR_EMPTY:
+    case EXPR_LITERAL: {
+      int n = (e->val.l && !e->type->compound && e->type->type)
+                  ? e->type->type->size
+                  : 0;
+      put_int(w, n);
+      out_raw(w->out, e->val.l, n);
+    } break;
+    case EXPR_INITIALIZER:
+      put_list(w, e->val.i);
+      break;
+    case EXPR_CALL:
+      put_function(w, e->val.f->fn);
+      put_list(w, e->val.f->params);
+      break;
+    case EXPR_ARRAY_ELEMENT:
+    case EXPR_VAR_NAME:
+    case EXPR_SIZEOF:
+    case EXPR_SORT:
+    case EXPR_SLICE:
+      put_ref(w, e->val.v->var);
+      put_list(w, e->val.v->params);
+      put_int(w, e->val.v->in_bounds);
+      put_int(w, e->val.v->exclusive);
+      put_int(w, e->val.v->row);
+      break;
+    case EXPR_POSTFIX:
+    case EXPR_PREFIX:
+    case EXPR_BINARY:
+      put_int(w, e->val.o->oper);
+      put_list(w, e->val.o->first);
+      put_list(w, e->val.o->second);
+      break;
+    case EXPR_CAST:
+      put_type(w, e->val.c->type);
+      put_list(w, e->val.c->ex);
+      break;
+    case EXPR_SPECIFIER:
+      put_member(w, e->val.s->memb);
+      put_list(w, e->val.s->ex);
+      break;
+    default:
+      w->error = 1;
+  }
+}
+
+static void put_node(mwriter_t *w, ast_node_t *n) {
+  put_int(w, n->node_type);
+  put_loc(w, &n->loc);
+  switch (n->node_type) {
+    case AST_NODE_VARIABLE: {
+      variable_t *v = n->val.v;
+      set_id(w, v, w->n_vars++);
+      put_str(w, v->name);
+      put_int(w, v->io_flag);
+      put_type(w, v->base_type);
+      put_int(w, v->scope ? get_id(w, v->scope) : REF_NULL);
+      put_int(w, v->num_dim);
+      put_int(w, v->need_init);
+      put_list(w, v->initializer);
+      put_list(w, v->ranges);
+    } break;
+    case AST_NODE_SCOPE: {
+      scope_t *sc = n->val.sc;
+      set_id(w, sc, w->n_scopes++);
+      put_ref(w, sc->parent);
+      put_function(w, sc->fn);
+      put_list(w, sc->items);
+    } break;
+    case AST_NODE_EXPRESSION:
+      put_expression(w, n->val.e);
+      break;
+    case AST_NODE_STATEMENT: {
+      statement_t *s = n->val.s;
+      put_int(w, s->variant);
+      put_int(w, s->tag);
+      put_int(w, s->uniform);
+      put_int(w, s->row);
+      put_int(w, s->n_rows);
+      put_function(w, s->ret_fn);
+      put_list(w, s->par[0]);
+      put_list(w, s->par[1]);
+    } break;
+    default:  // types and functions are only at the top level
+      w->error = 1;
+  }
+}
+
+static void put_list(mwriter_t *w, ast_node_t *list) {
+  put_int(w, length(list));
+  for (ast_node_t *n = list; n; n = n->next) put_node(w, n);
+}
+
+typedef struct {
+  int n;
+  uint64_t hash;
+} visited_t;
+
+static void visit_file(const char *name, uint64_t hash, void *data) {
+  ((visited_t *)data)->n++;
+  ((visited_t *)data)->hash = hash;
+}
+
+int module_write(compiler_ctx_t *ctx, ast_t *ast, const char *filename) {
+  visited_t files = {0, 0};
+  driver_visited_files(ctx, visit_file, &files);
+  if (ast->error_occured) return 1;
+  if (files.n != 1) {
+    throw("module %s: a module cannot include other files", filename);
+    return 1;
+  }
+  if (ast->root_scope->items || ast->mem_mode != TOK_MODE_CREW) {
+    throw("module %s: a module can contain only types and functions",
+          filename);
+    return 1;
+  }
+
+  mwriter_t w;
+  w.out = writer_t_new(WRITER_STRING);
+  w.ids = hash_table_t_new(1024, NULL);
+  w.n_scopes = w.n_vars = 0;
+  w.error = 0;
+
+  // only the types and functions defined in the file have a location
+  int n_types = 0, n_fns = 0;
+  for (ast_node_t *t = ast->types; t; t = t->next)
+    if (t->loc.fn) set_id(&w, t->val.t, n_types++);
+  for (ast_node_t *f = ast->functions; f; f = f->next)
+    if (f->loc.fn) set_id(&w, f->val.f, n_fns++);
+
+  uint64_t comp = compiler();
+  out_raw(w.out, MODULE_MAGIC, 3);
+  uint8_t version = MODULE_VERSION;
+  out_raw(w.out, &version, 1);
+  out_raw(w.out, &comp, sizeof(comp));
+  out_raw(w.out, &files.hash, sizeof(files.hash));
+
+  put_int(&w, n_types);
+  for (ast_node_t *t = ast->types; t; t = t->next) {
+    if (!t->loc.fn) continue;
+    put_loc(&w, &t->loc);
+    put_str(&w, t->val.t->name);
+    put_int(&w, t->val.t->size);
+    int n = 0;
+    for (static_type_member_t *m = t->val.t->members; m; m = m->next) n++;
+    put_int(&w, n);
+    for (static_type_member_t *m = t->val.t->members; m; m = m->next) {
+      put_str(&w, m->name);
+      put_type(&w, m->type);
+      put_int(&w, m->offset);
+    }
+  }
+
+  put_int(&w, n_fns);
+  for (ast_node_t *f = ast->functions; f; f = f->next) {
+    if (!f->loc.fn) continue;
+    put_loc(&w, &f->loc);
+    put_str(&w, f->val.f->name);
+    put_type(&w, f->val.f->out_type);
+    put_int(&w, f->val.f->inline_hint);
+    put_int(&w, f->val.f->root_scope != NULL);
+  }
+  for (ast_node_t *f = ast->functions; f; f = f->next) {
+    if (!f->loc.fn) continue;
+    scope_t *sc = f->val.f->root_scope;
+    if (sc) set_id(&w, sc, w.n_scopes++);
+    put_list(&w, f->val.f->params);
+    if (sc) put_list(&w, sc->items);
+  }
+
+  char *mname = module_name(filename);
+  int r = 0;
+  FILE *out = NULL;
+  if (w.error) {
+    throw("module %s: the file cannot be precompiled", filename);
+    r = 1;
+  } else if (!(out = fopen(mname, "wb")) ||
+             fwrite(w.out->str.base, 1, w.out->str.ptr, out) !=
+                 (size_t)w.out->str.ptr) {
+    throw("module %s: cannot write %s", filename, mname);
+    r = 1;
+  }
+  if (out && fclose(out)) r = 1;
+  if (r) remove(mname);
+
+  free(mname);
+  hash_table_t_delete(w.ids);
+  writer_t_delete(w.out);
+  return r;
+}
+
+/* ----------------------------------------------------------------------------
+ * loading
+ *
+ * all nodes are created in the ast (its arena); on an error the loading stops
+ * and the nodes read so far are not used
+ */
+
+typedef struct {
+  uint8_t *in;
+  long pos, len;
+  int error;  // corrupted module or a name that cannot be resolved
+  ast_t *ast;
+  const char *fn;  // file name for the locations
+  ast_node_t **types, **fns;
+  int n_types, n_fns;
+  variable_t **vars;
+  scope_t **scopes;
+  int n_vars, n_scopes;
+} mreader_t;
+
+static int32_t get_int(mreader_t *r) {
+  int32_t v = 0;
+  if (r->error || r->pos + (long)sizeof(v) > r->len) {
+    r->error = 1;
+    return 0;
+  }
+  memcpy(&v, r->in + r->pos, sizeof(v));
+  r->pos += sizeof(v);
+  return v;
+}
+
+// pointer to the string in the input (the constructors copy the names)
+static char *get_str(mreader_t *r) {
+  if (r->error) return NULL;
+  uint8_t *end = memchr(r->in + r->pos, 0, r->len - r->pos);
+  if (!end) {
+    r->error = 1;
+    return NULL;
+  }
+  char *s = (char *)r->in + r->pos;
+  r->pos = end - r->in + 1;
+  return s;
+}
+
+static void get_loc(mreader_t *r, YYLTYPE *loc) {
+  loc->fl = get_int(r);
+  loc->fc = get_int(r);
+  loc->ll = get_int(r);
+  loc->lc = get_int(r);
+  int f = get_int(r);
+  loc->fn = (f & 1) ? (char *)r->fn : NULL;
+  loc->ln = (f & 2) ? (char *)r->fn : NULL;
+}
+
+static static_type_t *get_type(mreader_t *r) {
+  int i = get_int(r);
+  if (i == REF_NULL) return NULL;
+  if (i == REF_EXTERN) {
+    char *name = get_str(r);
+    ast_node_t *t = name ? ast_find_type(r->ast, name) : NULL;
+    if (t) return t->val.t;
+  } else if (i >= 0 && i < r->n_types)
+    return r->types[i]->val.t;
+  r->error = 1;
+  return NULL;
+}
+
+static function_t *get_function(mreader_t *r) {
+  int i = get_int(r);
+  if (i == REF_NULL) return NULL;
+  if (i == REF_EXTERN) {
+    char *name = get_str(r);
+    ast_node_t *f = NULL;
+    if (name && ident_role(r->ast, name, &f) == IDENT_FUNCTION)
+      return f->val.f;
+  } else if (i >= 0 && i < r->n_fns)
+    return r->fns[i]->val.f;
+  r->error = 1;
+  return NULL;
+}
+
+static static_type_member_t *get_member(mreader_t *r) {
+  static_type_t *t = get_type(r);
+  int i = get_int(r);
+  static_type_member_t *m = t ? t->members : NULL;
+  for (; m && i > 0; i--) m = m->next;
+  if (!m) r->error = 1;
+  return m;
+}
+
+static variable_t *get_variable(mreader_t *r) {
+  int i = get_int(r);
+  if (i == REF_NULL) return NULL;
+  if (i >= 0 && i < r->n_vars) return r->vars[i];
+  r->error = 1;
+  return NULL;
+}
+
+static scope_t *get_scope(mreader_t *r) {
+  int i = get_int(r);
+  if (i == REF_NULL) return NULL;
+  if (i >= 0 && i < r->n_scopes) return r->scopes[i];
+  r->error = 1;
+  return NULL;
+}
+
+static void add_scope(mreader_t *r, scope_t *sc) {
+  r->scopes =
+      (scope_t **)realloc(r->scopes, (r->n_scopes + 1) * sizeof(scope_t *));
+  r->scopes[r->n_scopes++] = sc;
+}
+
+static inferred_type_t *get_inferred(mreader_t *r) {
+  inferred_type_t *t = inferred_type_t_new();
+  t->compound = get_int(r);
+  if (!t->compound) {
+    t->type = get_type(r);
+    return t;
+  }
+  int n = get_int(r);
+  inferred_type_item_t *last = NULL;
+  t->list = NULL;
+  for (int i = 0; i < n && !r->error; i++) {
+    inferred_type_item_t *it = inferred_type_item_t_new(get_inferred(r));
+    append_last(inferred_type_item_t, &t->list, last, it);
+  }
+  return t;
+}
+
+static ast_node_t *get_list(mreader_t *r);
+
+static void get_expression(mreader_t *r, ast_node_t *n) {
+  // the node was created as EXPR_EMPTY, the constructor needs no operands
+  expression_t *e = n->val.e = expression_t_new(get_int(r));
+  e->type = get_inferred(r);
+  switch (e->variant) {
+    case EXPR_EMPTY:
+    case EXPR_LITERAL: {
+      int len = get_int(r);
+      if (len < 0 || r->pos + len > r->len) r->error = 1;
+      if (r->error || !len) break;
+      e->val.l = (uint8_t *)ast_alloc(len);
+      memcpy(e->val.l, r->in + r->pos, len);
+      r->pos += len;
+    } break;
+    case EXPR_INITIALIZER:
+      e->val.i = get_list(r);
+      break;
+    case EXPR_CALL:
+      e->val.f->fn = get_function(r);
+      e->val.f->params = get_list(r);
+      break;
+    case EXPR_ARRAY_ELEMENT:
+    case EXPR_VAR_NAME:
+    case EXPR_SIZEOF:
+    case EXPR_SORT:
+    case EXPR_SLICE:
+      e->val.v->var = get_variable(r);
+      e->val.v->params = get_list(r);
+      e->val.v->in_bounds = get_int(r);
+      e->val.v->exclusive = get_int(r);
+      e->val.v->row = get_int(r);
+      break;
+    case EXPR_POSTFIX:
+    case EXPR_PREFIX:
+    case EXPR_BINARY:
+      e->val.o->oper = get_int(r);
+      e->val.o->first = get_list(r);
+      e->val.o->second = get_list(r);
+      break;
+    case EXPR_CAST:
+      e->val.c->type = get_type(r);
+      e->val.c->ex = get_list(r);
+      break;
+    case EXPR_SPECIFIER:
+      e->val.s->memb = get_member(r);
+      e->val.s->ex = get_list(r);
+      break;
+    default:
+      r->error = 1;
+  }
+}
+
+static ast_node_t *get_node(mreader_t *r) {
+  int node_type = get_int(r);
+  YYLTYPE loc;
+  get_loc(r, &loc);
+  if (r->error) return NULL;
+  ast_node_t *n = NULL;
+  switch (node_type) {
+    case AST_NODE_VARIABLE: {
+      char *name = get_str(r);
+      if (!name) break;
+      n = ast_node_t_new(&loc, AST_NODE_VARIABLE, name);
+      variable_t *v = n->val.v;
+      r->vars = (variable_t **)realloc(r->vars,
+                                       (r->n_vars + 1) * sizeof(variable_t *));
+      r->vars[r->n_vars++] = v;
+      v->io_flag = get_int(r);
+      v->base_type = get_type(r);
+      v->scope = get_scope(r);
+      v->num_dim = get_int(r);
+      v->need_init = get_int(r);
+      v->initializer = get_list(r);
+      v->ranges = get_list(r);
+    } break;
+    case AST_NODE_SCOPE: {
+      n = ast_node_t_new(&loc, AST_NODE_SCOPE, NULL);
+      scope_t *sc = n->val.sc;
+      add_scope(r, sc);
+      sc->parent = get_scope(r);
+      sc->fn = get_function(r);
+      sc->items = get_list(r);
+    } break;
+    case AST_NODE_EXPRESSION:
+      n = ast_node_t_new(&loc, AST_NODE_EXPRESSION, EXPR_EMPTY);
+      get_expression(r, n);
+      break;
+    case AST_NODE_STATEMENT: {
+      n = ast_node_t_new(&loc, AST_NODE_STATEMENT, get_int(r));
+      statement_t *s = n->val.s;
+      s->tag = get_int(r);
+      s->uniform = get_int(r);
+      s->row = get_int(r);
+      s->n_rows = get_int(r);
+      s->ret_fn = get_function(r);
+      s->par[0] = get_list(r);
+      s->par[1] = get_list(r);
+    } break;
+  }
+  if (!n) r->error = 1;
+  return n;
+}
+
+static ast_node_t *get_list(mreader_t *r) {
+  int n = get_int(r);
+  ast_node_t *list = NULL, *last = NULL;
+  for (int i = 0; i < n && !r->error; i++) {
+    ast_node_t *x = get_node(r);
+    if (x) append_last(ast_node_t, &list, last, x);
+  }
+  return list;
+}
+
+// is the name free in the ast (otherwise the file is parsed to report errors)
+static int name_free(ast_t *ast, char *name) {
+  return name && !ast_find_type(ast, name) &&
+         ident_role(ast, name, NULL) == IDENT_FREE;
+}
+
+// header: magic, version, hash of the compiler, hash of the source
+#define HEADER_SIZE (4 + 2 * sizeof(uint64_t))
+
+// read the module after the header (the hash of the source is checked)
+static void read_module(mreader_t *r) {
+  uint64_t comp;
+  memcpy(&comp, r->in + 4, sizeof(comp));
+  if (memcmp(r->in, MODULE_MAGIC, 3) || r->in[3] != MODULE_VERSION ||
+      comp != compiler()) {
+    r->error = 1;
+    return;
+  }
+  r->pos = HEADER_SIZE;
+
+  int n = get_int(r);
+  for (int i = 0; i < n && !r->error; i++) {
+    YYLTYPE loc;
+    get_loc(r, &loc);
+    char *name = get_str(r);
+    if (!name_free(r->ast, name)) {
+      r->error = 1;
+      break;
+    }
+    ast_node_t *t = ast_node_t_new(&loc, AST_NODE_STATIC_TYPE, name);
+    t->val.t->size = get_int(r);
+    int n_members = get_int(r);
+    static_type_member_t *last = NULL;
+    for (int j = 0; j < n_members && !r->error; j++) {
+      char *mname = get_str(r);
+      if (!mname) break;
+      static_type_member_t *m = static_type_member_t_new(mname, get_type(r));
+      m->offset = get_int(r);
+      m->parent = t->val.t;
+      append_last(static_type_member_t, &t->val.t->members, last, m);
+    }
+    r->types =
+        (ast_node_t **)realloc(r->types, (i + 1) * sizeof(ast_node_t *));
+    r->types[r->n_types++] = t;
+  }
+
+  n = get_int(r);
+  int *has_body = (int *)malloc((n > 0 ? n : 1) * sizeof(int));
+  for (int i = 0; i < n && !r->error; i++) {
+    YYLTYPE loc;
+    get_loc(r, &loc);
+    char *name = get_str(r);
+    if (!name_free(r->ast, name)) {
+      r->error = 1;
+      break;
+    }
+    ast_node_t *f = ast_node_t_new(&loc, AST_NODE_FUNCTION, name);
+    f->val.f->out_type = get_type(r);
+    f->val.f->inline_hint = get_int(r);
+    has_body[i] = get_int(r);
+    r->fns = (ast_node_t **)realloc(r->fns, (i + 1) * sizeof(ast_node_t *));
+    r->fns[r->n_fns++] = f;
+  }
+  for (int i = 0; i < r->n_fns && !r->error; i++) {
+    function_t *f = r->fns[i]->val.f;
+    if (has_body[i]) {
+      f->root_scope = scope_t_new();
+      f->root_scope->parent = r->ast->root_scope;
+      f->root_scope->fn = f;
+      add_scope(r, f->root_scope);
+    }
+    f->params = get_list(r);
+    if (has_body[i]) f->root_scope->items = get_list(r);
+  }
+  free(has_body);
+  if (r->pos != r->len) r->error = 1;
+}
+
+int module_load(ast_t *ast, const char *name, uint64_t hash) {
+  if (ast->current_scope != ast->root_scope) return 0;
+  char *mname = module_name(name);
+  mreader_t r;
+  r.in = (uint8_t *)driver_read_file(mname, &r.len);
+  free(mname);
+  if (!r.in) return 0;
+
+  uint64_t h = 0;
+  if (r.len >= (long)HEADER_SIZE)
+    memcpy(&h, r.in + 4 + sizeof(uint64_t), sizeof(h));
+  if (h != hash) {
+    free(r.in);
+    return 0;
+  }
+
+  r.pos = 0;
+  r.error = 0;
+  r.ast = ast;
+  r.fn = name;
+  r.types = r.fns = NULL;
+  r.n_types = r.n_fns = 0;
+  r.vars = NULL;
+  r.scopes = NULL;
+  r.n_vars = r.n_scopes = 0;
+  read_module(&r);
+
+  if (!r.error) {
+    for (int i = 0; i < r.n_types; i++) ast_append_type(ast, r.types[i]);
+    for (int i = 0; i < r.n_fns; i++) ast_append_function(ast, r.fns[i]);
+  }
+
+  free(r.types);
+  free(r.fns);
+  free(r.vars);
+  free(r.scopes);
+  free(r.in);
+  return !r.error;
+}
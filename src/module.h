@@ -0,0 +1,47 @@
+/**
+ * @file module.h
+ * @brief precompiled modules of included files (used by `wtc`)
+ *
+ * A library file that contains only type definitions and functions (and
+ * includes no other file) can be precompiled by `wtc -module file.wt` to
+ * `file.wtm`. The module is the parsed and typed AST of the file: its types,
+ * and its functions with their signatures and bodies. When the file is
+ * included, the driver loads the module instead of parsing the file, if the
+ * module was made by the same compiler (see cache_compiler_hash()) from the
+ * current content of the file.
+ *
+ * References to the types and functions defined outside the module (the basic
+ * types and the built-in functions) are stored by name. A module is not used,
+ * and the file is parsed, if any of its names is already defined, or if it is
+ * not included in the global scope.
+ */
+#ifndef __MODULE_H__
+#define __MODULE_H__
+
+#include <ast.h>
+#include <driver.h>
+
+//! name of the module of a source file (allocated)
+char *module_name(const char *filename);
+
+/**
+ * @brief write the module of a parsed file
+ *
+ * `ast` is the result of #driver_parse of the file `filename` in `ctx` (the
+ * file must be the only file visited). Return 0 on success, otherwise emit an
+ * error (errors.h) and return 1.
+ */
+int module_write(compiler_ctx_t *ctx, ast_t *ast, const char *filename);
+
+/**
+ * @brief load the module of an included file
+ *
+ * A loader for #driver_register_module_loader: if the module of the file
+ * `name` exists and is up to date (`hash` is the hash of the content of the
+ * file), append its types and functions to `ast`. The locations of the nodes
+ * refer to `name`. Return 1 if the module was loaded, 0 if the file has to be
+ * parsed.
+ */
+int module_load(ast_t *ast, const char *name, uint64_t hash);
+
+#endif
@@ -0,0 +1,2404 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <code.h>
+#include <errors.h>
+#include <ir.h>
+#include <optimize.h>
+#include <parser.h>
+
+/* ----------------------------------------------------------------------------
+ * helpers
+ */
+
+// TYPE_INT or TYPE_FLOAT for an expression of basic numeric type, -1 otherwise
+static int numeric_type(expression_t *ex) {
+  if (ex->type->compound || !ex->type->type) return -1;
+  ast_t *ast = ast_current();
+  if (ex->type->type == ast->type_int->val.t) return TYPE_INT;
+  if (ex->type->type == ast->type_float->val.t) return TYPE_FLOAT;
+  return -1;
+}
+
+// as numeric_type, or TYPE_CHAR for a char (an int 0..255 on the stack)
+static int literal_type(expression_t *ex) {
+  int t = numeric_type(ex);
+  if (t == -1 && !ex->type->compound && ex->type->type &&
+      ex->type->type == ast_current()->type_char->val.t)
+    return TYPE_CHAR;
+  return t;
+}
+
+// value of a literal converted to type t (as INT2FLOAT does)
+typedef union {
+  int32_t i;
+  float f;
+} value_t;
+
+static int literal_value(ast_node_t *node, int t, value_t *v) {
+  expression_t *ex = node->val.e;
+  if (ex->variant != EXPR_LITERAL || !ex->val.l) return 0;
+  int lt = literal_type(ex);
+  if (lt == -1) return 0;
+  if (lt != TYPE_FLOAT) {
+    int32_t i = (lt == TYPE_CHAR) ? lval(ex->val.l, uint8_t)
+                                  : lval(ex->val.l, int32_t);
+    if (t == TYPE_FLOAT)
+      v->f = i;
+    else
+      v->i = i;
+  } else {
+    if (t == TYPE_INT) return 0;  // implicit float -> int is never generated
+    v->f = lval(ex->val.l, float);
+  }
+  return 1;
+}
+
+int literal_int_value(ast_node_t *node, int32_t *val) {
+  value_t v;
+  if (!node || node->node_type != AST_NODE_EXPRESSION) return 0;
+  if (numeric_type(node->val.e) != TYPE_INT) return 0;
+  if (!literal_value(node, TYPE_INT, &v)) return 0;
+  *val = v.i;
+  return 1;
+}
+
+int is_return(ast_node_t *node) {
+  return node->node_type == AST_NODE_STATEMENT &&
+         node->val.s->variant == STMT_RETURN;
+}
+
+// free the variant specific data of an expression, keep the type
+static void clear_expression(expression_t *ex) {
+  switch (ex->variant) {
+    case EXPR_POSTFIX:
+    case EXPR_PREFIX:
+    case EXPR_BINARY:
+      ast_node_t_delete(ex->val.o->first);
+      ast_node_t_delete(ex->val.o->second);
+      ast_free(ex->val.o);
+      break;
+    case EXPR_CAST:
+      ast_node_t_delete(ex->val.c->ex);
+      ast_free(ex->val.c);
+      break;
+  }
+}
+
+// turn the expression into a literal (of its current type) with value v
+static void make_literal(expression_t *ex, value_t v) {
+  clear_expression(ex);
+  ex->variant = EXPR_LITERAL;
+  ex->val.l = ast_alloc(4);
+  lval(ex->val.l, value_t) = v;
+}
+
+// replace the expression of node by the expression of its operand
+static void replace_by_operand(ast_node_t *node, ast_node_t *operand) {
+  expression_t *ex = node->val.e;
+  node->val.e = operand->val.e;
+  operand->val.e = NULL;
+  clear_expression(ex);
+  inferred_type_t_delete(ex->type);
+  ast_free(ex);
+}
+
+// int32 arithmetic with wrap-around (as on the target)
+#define WRAP(a, op, b) ((int32_t)((uint32_t)(a)op(uint32_t)(b)))
+
+static int32_t fold_ipow(int32_t base, int32_t exp) {
+  int32_t result = 1;
+  while (exp) {
+    if (exp & 1) result = WRAP(result, *, base);
+    exp /= 2;
+    base = WRAP(base, *, base);
+  }
+  return result;
+}
+
+/* ----------------------------------------------------------------------------
+ * folding of operators; return 1 if the result is in r
+ *
+ * `a` is the first and `b` the second operand, both already converted to the
+ * type `t` of the operation
+ */
+static int fold_numeric(int oper, int t, value_t a, value_t b, value_t *r) {
+  if (t == TYPE_INT) switch (oper) {
+      case '+':
+        r->i = WRAP(a.i, +, b.i);
+        return 1;
+      case '-':
+        r->i = WRAP(a.i, -, b.i);
+        return 1;
+      case '*':
+        r->i = WRAP(a.i, *, b.i);
+        return 1;
+      case '^':
+        r->i = fold_ipow(a.i, b.i);
+        return 1;
+      case '/':
+      case '%':
+        // keep the runtime error
+        if (b.i == 0 || (a.i == INT32_MIN && b.i == -1)) return 0;
+        r->i = (oper == '/') ? a.i / b.i : a.i % b.i;
+        return 1;
+      case '|':
+        r->i = a.i | b.i;
+        return 1;
+      case '&':
+        r->i = a.i & b.i;
+        return 1;
+      case '~':
+        r->i = a.i ^ b.i;
+        return 1;
+    }
+  else
+    switch (oper) {
+      case '+':
+        r->f = a.f + b.f;
+        return 1;
+      case '-':
+        r->f = a.f - b.f;
+        return 1;
+      case '*':
+        r->f = a.f * b.f;
+        return 1;
+      case '/':
+        r->f = a.f / b.f;
+        return 1;
+      case '^':
+        r->f = pow(a.f, b.f);
+        return 1;
+    }
+  return 0;
+}
+
+static int fold_comparison(int oper, int t, value_t a, value_t b,
+                           value_t *r) {
+#define CMP(op) ((t == TYPE_INT) ? (a.i op b.i) : (a.f op b.f))
+  switch (oper) {
+    case TOK_EQ:
+      r->i = CMP(==);
+      return 1;
+    case TOK_NEQ:
+      r->i = !CMP(==);
+      return 1;
+    case TOK_LEQ:
+      r->i = CMP(<=);
+      return 1;
+    case TOK_GEQ:
+      r->i = CMP(>=);
+      return 1;
+    case '<':
+      r->i = CMP(<);
+      return 1;
+    case '>':
+      r->i = CMP(>);
+      return 1;
+  }
+#undef CMP
+  return 0;
+}
+
+// is the operand a literal with given value (in the type t of the operation)
+static int is_identity(ast_node_t *node, int t, int val) {
+  value_t v;
+  if (!literal_value(node, t, &v)) return 0;
+  return (t == TYPE_INT) ? v.i == val : v.f == (float)val;
+}
+
+/* ----------------------------------------------------------------------------
+ * expressions
+ */
+static void fold_node(ast_node_t *node);
+
+static void fold_list(ast_node_t *list) {
+  for (ast_node_t *p = list; p; p = p->next) fold_node(p);
+}
+
+static void fold_binary(ast_node_t *node) {
+  expression_t *ex = node->val.e;
+  ast_node_t *first = ex->val.o->first, *second = ex->val.o->second;
+  int oper = ex->val.o->oper;
+  if (assign_oper(oper)) return;
+
+  int t = numeric_type(ex), t1 = literal_type(first->val.e),
+      t2 = literal_type(second->val.e);
+  if (t == -1 || t1 == -1 || t2 == -1) return;
+
+  // type of the operation (comparisons are done in float if any operand is)
+  int ot = t;
+  if (comparison_oper(oper))
+    ot = (t1 == TYPE_FLOAT || t2 == TYPE_FLOAT) ? TYPE_FLOAT : TYPE_INT;
+  if ((oper == TOK_AND || oper == TOK_OR) &&
+      (t1 != TYPE_INT || t2 != TYPE_INT))
+    return;
+
+  value_t a, b, r;
+  if (literal_value(first, ot, &a) && literal_value(second, ot, &b)) {
+    int ok = 0;
+    if (numeric_oper(oper))
+      ok = fold_numeric(oper, ot, a, b, &r);
+    else if (comparison_oper(oper))
+      ok = fold_comparison(oper, ot, a, b, &r);
+    else if (oper == TOK_AND) {
+      r.i = a.i && b.i;
+      ok = 1;
+    } else if (oper == TOK_OR) {
+      r.i = a.i || b.i;
+      ok = 1;
+    }
+    if (ok) make_literal(ex, r);
+    return;
+  }
+
+  // algebraic identities; the remaining operand must have the type of the
+  // result, so that no conversion is lost
+  if (!numeric_oper(oper)) return;
+  if (t1 == t) {
+    if ((oper == '-' || oper == '*' || oper == '/') &&
+        is_identity(second, t, oper == '-' ? 0 : 1)) {
+      replace_by_operand(node, first);
+      return;
+    }
+    if (t == TYPE_INT && (oper == '+' || oper == '|' || oper == '~') &&
+        is_identity(second, t, 0)) {
+      replace_by_operand(node, first);
+      return;
+    }
+  }
+  if (t2 == t) {
+    if (oper == '*' && is_identity(first, t, 1)) {
+      replace_by_operand(node, second);
+      return;
+    }
+    if (t == TYPE_INT && (oper == '+' || oper == '|' || oper == '~') &&
+        is_identity(first, t, 0)) {
+      replace_by_operand(node, second);
+      return;
+    }
+  }
+}
+
+static void fold_unary(ast_node_t *node) {
+  expression_t *ex = node->val.e;
+  int oper = ex->val.o->oper;
+  int t = numeric_type(ex);
+  value_t a, r;
+  if (t == -1 || numeric_type(ex->val.o->first->val.e) != t) return;
+  if (!literal_value(ex->val.o->first, t, &a)) return;
+  if (ex->variant == EXPR_PREFIX && oper == '-') {
+    // the machine computes 0-a
+    if (t == TYPE_INT)
+      r.i = WRAP(0, -, a.i);
+    else
+      r.f = 0.0f - a.f;
+  } else if (ex->variant == EXPR_PREFIX && oper == '!' && t == TYPE_INT)
+    r.i = !a.i;
+  else
+    return;
+  make_literal(ex, r);
+}
+
+static void fold_cast(ast_node_t *node) {
+  expression_t *ex = node->val.e;
+  ast_node_t *oexn = ex->val.c->ex;
+  int t = literal_type(ex), t1 = literal_type(oexn->val.e);
+  if (t == -1 || t1 == -1 || oexn->val.e->variant != EXPR_LITERAL) return;
+  value_t a, r;
+  if (!literal_value(oexn, t1, &a)) return;
+  if ((t == TYPE_FLOAT) == (t1 == TYPE_FLOAT))
+    r = a;
+  else if (t == TYPE_FLOAT)
+    r.f = a.i;
+  else
+    r.i = a.f;
+  // a char literal is one byte; the cast itself does not truncate
+  if (t == TYPE_CHAR && (r.i < 0 || r.i > 255)) return;
+  make_literal(ex, r);
+}
+
+static void fold_expression(ast_node_t *node) {
+  expression_t *ex = node->val.e;
+  if (!ex) return;
+  switch (ex->variant) {
+    case EXPR_INITIALIZER:
+      fold_list(ex->val.i);
+      break;
+    case EXPR_CALL:
+      fold_list(ex->val.f->params);
+      break;
+    case EXPR_ARRAY_ELEMENT:
+    case EXPR_VAR_NAME:
+    case EXPR_SIZEOF:
+    case EXPR_SORT:
+    case EXPR_SLICE:
+      fold_list(ex->val.v->params);
+      break;
+    case EXPR_CAST:
+      fold_node(ex->val.c->ex);
+      fold_cast(node);
+      break;
+    case EXPR_SPECIFIER:
+      fold_node(ex->val.s->ex);
+      break;
+    case EXPR_PREFIX:
+    case EXPR_POSTFIX:
+      fold_node(ex->val.o->first);
+      fold_unary(node);
+      break;
+    case EXPR_BINARY:
+      fold_node(ex->val.o->first);
+      fold_node(ex->val.o->second);
+      fold_binary(node);
+      break;
+  }
+}
+
+/* ----------------------------------------------------------------------------
+ * walk the ast
+ */
+static void fold_node(ast_node_t *node) {
+  if (!node) return;
+  switch (node->node_type) {
+    case AST_NODE_VARIABLE:
+      fold_list(node->val.v->ranges);
+      fold_node(node->val.v->initializer);
+      break;
+    case AST_NODE_SCOPE:
+      fold_list(node->val.sc->items);
+      break;
+    case AST_NODE_FUNCTION:
+      if (node->val.f->root_scope) fold_list(node->val.f->root_scope->items);
+      break;
+    case AST_NODE_EXPRESSION:
+      fold_expression(node);
+      break;
+    case AST_NODE_STATEMENT:
+      fold_node(node->val.s->par[0]);
+      fold_node(node->val.s->par[1]);
+      break;
+  }
+}
+
+void fold_constants(ast_t *ast) {
+  fold_list(ast->root_scope->items);
+  fold_list(ast->functions);
+}
+
+/* ----------------------------------------------------------------------------
+ * removal of functions that are never called
+ *
+ * walk the code reachable from the root scope and mark called functions
+ * (the id `n` is used as the mark, the code generation assigns the ids
+ * afterwards); the walk skips exactly the code the code generation does not
+ * emit: untaken branches of constant conditions and items after `return`
+ *
+ * an inlined call reaches the calls in the copy of the function instead of
+ * the function; a function called only through its copies is removed (the
+ * copies still refer to it, the objects of the ast are kept in its arena)
+ */
+static void mark_node(ast_node_t *node, ast_node_t ***queue, int *n_queue);
+
+static void mark_list(ast_node_t *list, ast_node_t ***queue, int *n_queue) {
+  for (ast_node_t *p = list; p; p = p->next) {
+    mark_node(p, queue, n_queue);
+    if (is_return(p)) break;
+  }
+}
+
+static void mark_node(ast_node_t *node, ast_node_t ***queue, int *n_queue) {
+  if (!node) return;
+  switch (node->node_type) {
+    case AST_NODE_VARIABLE:
+      mark_list(node->val.v->ranges, queue, n_queue);
+      mark_node(node->val.v->initializer, queue, n_queue);
+      break;
+    case AST_NODE_SCOPE:
+      mark_list(node->val.sc->items, queue, n_queue);
+      break;
+    case AST_NODE_STATEMENT: {
+      statement_t *s = node->val.s;
+      int32_t cond;
+      if ((s->variant == STMT_COND || s->variant == STMT_WHILE) &&
+          s->par[1] && literal_int_value(s->par[0], &cond)) {
+        if (s->variant == STMT_COND)
+          mark_node(cond ? s->par[1]->val.sc->items
+                         : s->par[1]->val.sc->items->next,
+                    queue, n_queue);
+        else if (cond)
+          mark_node(s->par[1], queue, n_queue);
+        break;
+      }
+      mark_node(s->par[0], queue, n_queue);
+      mark_node(s->par[1], queue, n_queue);
+    } break;
+    case AST_NODE_EXPRESSION: {
+      expression_t *ex = node->val.e;
+      if (!ex) break;
+      switch (ex->variant) {
+        case EXPR_INITIALIZER:
+          mark_list(ex->val.i, queue, n_queue);
+          break;
+        case EXPR_CALL: {
+          function_t *f = ex->val.f->fn;
+          if (ex->val.f->inlined)
+            mark_list(ex->val.f->inlined->val.f->root_scope->items, queue,
+                      n_queue);
+          else if (f->root_scope && !f->n) {
+            f->n = 1;
+            *queue = (ast_node_t **)realloc(
+                *queue, (*n_queue + 1) * sizeof(ast_node_t *));
+            (*queue)[(*n_queue)++] = node;
+          }
+          mark_list(ex->val.f->params, queue, n_queue);
+        } break;
+        case EXPR_ARRAY_ELEMENT:
+        case EXPR_VAR_NAME:
+        case EXPR_SIZEOF:
+        case EXPR_SORT:
+        case EXPR_SLICE:
+          mark_list(ex->val.v->params, queue, n_queue);
+          break;
+        case EXPR_CAST:
+          mark_node(ex->val.c->ex, queue, n_queue);
+          break;
+        case EXPR_SPECIFIER:
+          mark_node(ex->val.s->ex, queue, n_queue);
+          break;
+        case EXPR_PREFIX:
+        case EXPR_POSTFIX:
+        case EXPR_BINARY:
+          mark_node(ex->val.o->first, queue, n_queue);
+          mark_node(ex->val.o->second, queue, n_queue);
+          break;
+      }
+    } break;
+  }
+}
+
+void remove_unused_functions(ast_t *ast) {
+  for (ast_node_t *fn = ast->functions; fn; fn = fn->next) fn->val.f->n = 0;
+
+  // queue of calls to the newly reached functions
+  ast_node_t **queue = NULL;
+  int n_queue = 0;
+  mark_list(ast->root_scope->items, &queue, &n_queue);
+  for (int i = 0; i < n_queue; i++)
+    mark_list(queue[i]->val.e->val.f->fn->root_scope->items, &queue,
+              &n_queue);
+  free(queue);
+
+  // unlink and delete the functions with body that were not reached
+  ast_node_t **prev = &(ast->functions);
+  while (*prev) {
+    ast_node_t *fn = *prev;
+    if (fn->val.f->root_scope && !fn->val.f->n) {
+      *prev = fn->next;
+      fn->next = NULL;
+      ast_node_t_delete(fn);
+    } else
+      prev = &(fn->next);
+  }
+}
+
+/* ----------------------------------------------------------------------------
+ * inlining
+ *
+ * a function whose body is a single `return e;`, the parameters and the
+ * result are `int` or `float`, and `e` has no side effects and no calls, is
+ * inlined as an expression: the call is replaced by a copy of `e` with the
+ * parameters replaced by copies of the arguments
+ *
+ * the arguments must have the types of the parameters and no side effects;
+ * an argument that is not a literal or a variable is only substituted for a
+ * parameter used exactly once, so no work is duplicated or dropped
+ *
+ * other functions are inlined as a copy of the whole function kept in the
+ * call (expr_function_t.inlined), whose scopes belong to the caller; the code
+ * generation gives its parameters and variables addresses in the frame of
+ * the caller and emits its body instead of CALL; without SETR, every return
+ * has to end the code its threads run: it ends a branch of the body (an `if`
+ * without else whose branch returns takes the statements after it as the
+ * else), it is not in a loop or pardo, and a function with a result returns
+ * on every path
+ *
+ * a call of a function whose copy is being inlined (or of the function being
+ * compiled) is recursive and stays a call; an `inline` function that is not
+ * inlined is reported by a warning
+ */
+int inline_limit = 16;
+
+//! 1 if the expression has no side effects and calls no functions; count its
+//! nodes to `size` and the uses of the parameters of `fn` to `uses`
+static int pure_expression(ast_node_t *node, function_t *fn, int *size,
+                           int *uses) {
+  if (!node) return 1;
+  expression_t *ex = node->val.e;
+  (*size)++;
+  switch (ex->variant) {
+    case EXPR_LITERAL:
+      return !ex->type->compound;
+    case EXPR_VAR_NAME:
+    case EXPR_ARRAY_ELEMENT:
+    case EXPR_SIZEOF: {
+      if (fn && ex->val.v->var->scope == fn->root_scope) {
+        if (ex->variant != EXPR_VAR_NAME) return 0;
+        int i = 0;
+        for (ast_node_t *p = fn->params; p; p = p->next, i++)
+          if (p->val.v == ex->val.v->var) uses[i]++;
+      }
+      for (ast_node_t *p = ex->val.v->params; p; p = p->next)
+        if (!pure_expression(p, fn, size, uses)) return 0;
+      return 1;
+    }
+    case EXPR_CAST:
+      return pure_expression(ex->val.c->ex, fn, size, uses);
+    case EXPR_SPECIFIER:
+      return pure_expression(ex->val.s->ex, fn, size, uses);
+    case EXPR_PREFIX:
+    case EXPR_POSTFIX:
+    case EXPR_BINARY:
+      if (assign_oper(ex->val.o->oper) || ex->val.o->oper == TOK_INC ||
+          ex->val.o->oper == TOK_DEC)
+        return 0;
+      return pure_expression(ex->val.o->first, fn, size, uses) &&
+             pure_expression(ex->val.o->second, fn, size, uses);
+  }
+  return 0;
+}
+
+// the returned expression if fn can be inlined, NULL otherwise
+static ast_node_t *inline_body(function_t *fn, int **uses) {
+  scope_t *sc = fn->root_scope;
+  if (!sc || !sc->items || sc->items->next || !is_return(sc->items)) return NULL;
+  ast_node_t *e = sc->items->val.s->par[0];
+  if (!e || numeric_type(e->val.e) == -1 ||
+      e->val.e->type->type != fn->out_type)
+    return NULL;
+  int np = 0;
+  ast_t *ast = ast_current();
+  for (ast_node_t *p = fn->params; p; p = p->next, np++)
+    if (p->val.v->num_dim != 0 ||
+        (p->val.v->base_type != ast->type_int->val.t &&
+         p->val.v->base_type != ast->type_float->val.t))
+      return NULL;
+
+  int size = 0;
+  *uses = (int *)calloc(np + 1, sizeof(int));
+  if (!pure_expression(e, fn, &size, *uses) ||
+      (size > inline_limit && !fn->inline_hint)) {
+    free(*uses);
+    return NULL;
+  }
+  return e;
+}
+
+static int trivial_argument(ast_node_t *arg) {
+  return arg->val.e->variant == EXPR_LITERAL ||
+         (arg->val.e->variant == EXPR_VAR_NAME &&
+          arg->val.e->val.v->var->num_dim == 0);
+}
+
+/* ----------------------------------------------------------------------------
+ * copies of expressions and functions
+ */
+
+//! what is copied: variables from `params` are replaced by the corresponding
+//! expressions from `args`; the variables and scopes in `copies` (NULL if
+//! none) by their copies, and the copied scopes belong to `fn`
+typedef struct {
+  ast_node_t *params, *args;
+  hash_table_t *copies;
+  function_t *fn;
+} copy_t;
+
+// the copy of a variable or a scope (itself if it is not copied)
+static void *copied(copy_t *c, void *p) {
+  void *r = c->copies ? hash_get(c->copies, (uint64_t)(uintptr_t)p) : NULL;
+  return r ? r : p;
+}
+
+static void add_copy(copy_t *c, void *p, void *copy) {
+  hash_put(c->copies, (uint64_t)(uintptr_t)p, copy);
+}
+
+static ast_node_t *copy_node(ast_node_t *node, copy_t *c);
+
+static ast_node_t *copy_list(ast_node_t *list, copy_t *c) {
+  ast_node_t *r = NULL, *last = NULL;
+  for (ast_node_t *p = list; p; p = p->next) {
+    ast_node_t *cp = copy_node(p, c);
+    append_last(ast_node_t, &r, last, cp);
+  }
+  return r;
+}
+
+// deep copy of an expression
+static ast_node_t *copy_expression(ast_node_t *node, copy_t *c) {
+  expression_t *ex = node->val.e;
+  if (ex->variant == EXPR_VAR_NAME)
+    for (ast_node_t *p = c->params, *a = c->args; p; p = p->next, a = a->next)
+      if (p->val.v == ex->val.v->var) {
+        copy_t plain = {NULL, NULL, NULL, NULL};
+        return copy_expression(a, &plain);
+      }
+
+  ast_node_t *r = ast_node_t_new(&(node->loc), AST_NODE_EXPRESSION, EXPR_EMPTY);
+  expression_t_delete(r->val.e);
+  expression_t *cp = r->val.e = expression_t_new(ex->variant);
+  inferred_type_t_delete(cp->type);
+  cp->type = inferred_type_copy(ex->type);
+  switch (ex->variant) {
+    case EXPR_LITERAL: {
+      int n = ex->type->type->size;
+      cp->val.l = ast_alloc(n);
+      memcpy(cp->val.l, ex->val.l, n);
+    } break;
+    case EXPR_INITIALIZER:
+      cp->val.i = copy_list(ex->val.i, c);
+      break;
+    case EXPR_CALL:
+      cp->val.f->fn = ex->val.f->fn;
+      cp->val.f->params = copy_list(ex->val.f->params, c);
+      cp->val.f->inlined = copy_node(ex->val.f->inlined, c);
+      break;
+    case EXPR_VAR_NAME:
+    case EXPR_ARRAY_ELEMENT:
+    case EXPR_SIZEOF:
+    case EXPR_SORT:
+    case EXPR_SLICE:
+      cp->val.v->var = (variable_t *)copied(c, ex->val.v->var);
+      cp->val.v->params = copy_list(ex->val.v->params, c);
+      break;
+    case EXPR_CAST:
+      cp->val.c->type = ex->val.c->type;
+      cp->val.c->ex = copy_node(ex->val.c->ex, c);
+      break;
+    case EXPR_SPECIFIER:
+      cp->val.s->memb = ex->val.s->memb;
+      cp->val.s->ex = copy_node(ex->val.s->ex, c);
+      break;
+    case EXPR_PREFIX:
+    case EXPR_POSTFIX:
+    case EXPR_BINARY:
+      cp->val.o->oper = ex->val.o->oper;
+      cp->val.o->first = copy_node(ex->val.o->first, c);
+      cp->val.o->second = copy_node(ex->val.o->second, c);
+      break;
+  }
+  return r;
+}
+
+// deep copy of a function; its root scope gets the parent of the original
+static ast_node_t *copy_function(YYLTYPE *loc, function_t *f, copy_t *c) {
+  ast_node_t *r = ast_node_t_new(loc, AST_NODE_FUNCTION, f->name);
+  r->val.f->out_type = f->out_type;
+  r->val.f->inline_hint = f->inline_hint;
+  scope_t *sc = r->val.f->root_scope = scope_t_new();
+  sc->parent = f->root_scope->parent;
+  sc->fn = c->fn;
+  add_copy(c, f->root_scope, sc);
+  r->val.f->params = copy_list(f->params, c);
+  sc->items = copy_list(f->root_scope->items, c);
+  return r;
+}
+
+static ast_node_t *copy_node(ast_node_t *node, copy_t *c) {
+  if (!node) return NULL;
+  ast_node_t *r = NULL;
+  switch (node->node_type) {
+    case AST_NODE_VARIABLE: {
+      variable_t *v = node->val.v;
+      r = ast_node_t_new(&(node->loc), AST_NODE_VARIABLE, v->name);
+      variable_t *cv = r->val.v;
+      cv->io_flag = v->io_flag;
+      cv->base_type = v->base_type;
+      cv->scope = (scope_t *)copied(c, v->scope);
+      cv->num_dim = v->num_dim;
+      cv->need_init = v->need_init;
+      add_copy(c, v, cv);
+      cv->ranges = copy_list(v->ranges, c);
+      cv->initializer = copy_node(v->initializer, c);
+    } break;
+    case AST_NODE_SCOPE: {
+      scope_t *sc = node->val.sc;
+      r = ast_node_t_new(&(node->loc), AST_NODE_SCOPE, copied(c, sc->parent));
+      r->val.sc->fn = c->fn;
+      add_copy(c, sc, r->val.sc);
+      r->val.sc->items = copy_list(sc->items, c);
+    } break;
+    case AST_NODE_FUNCTION:
+      r = copy_function(&(node->loc), node->val.f, c);
+      break;
+    case AST_NODE_STATEMENT: {
+      statement_t *s = node->val.s;
+      r = ast_node_t_new(&(node->loc), AST_NODE_STATEMENT, s->variant);
+      r->val.s->tag = s->tag;
+      r->val.s->ret_fn = s->ret_fn;
+      for (int i = 0; i < 2; i++) r->val.s->par[i] = copy_node(s->par[i], c);
+    } break;
+    case AST_NODE_EXPRESSION:
+      r = copy_expression(node, c);
+      break;
+  }
+  return r;
+}
+
+/* ----------------------------------------------------------------------------
+ * returns of the inlined functions
+ */
+
+// 1 if there is a return among the statements of the node (the returns of
+// the functions inlined in its expressions do not count)
+static int has_return(ast_node_t *node) {
+  if (!node) return 0;
+  if (node->node_type == AST_NODE_SCOPE) {
+    for (ast_node_t *p = node->val.sc->items; p; p = p->next)
+      if (has_return(p)) return 1;
+    return 0;
+  }
+  return node->node_type == AST_NODE_STATEMENT &&
+         (node->val.s->variant == STMT_RETURN ||
+          has_return(node->val.s->par[0]) || has_return(node->val.s->par[1]));
+}
+
+int always_returns(ast_node_t *node) {
+  if (!node) return 0;
+  if (node->node_type == AST_NODE_SCOPE) {
+    for (ast_node_t *p = node->val.sc->items; p; p = p->next)
+      if (always_returns(p)) return 1;
+    return 0;
+  }
+  if (is_return(node)) return 1;
+  if (node->node_type != AST_NODE_STATEMENT ||
+      node->val.s->variant != STMT_COND || !node->val.s->par[1])
+    return 0;
+  ast_node_t *branch = node->val.s->par[1]->val.sc->items;
+  return always_returns(branch) && always_returns(branch->next);
+}
+
+int returns_early(ast_node_t *node) {
+  if (!node || node->node_type != AST_NODE_STATEMENT ||
+      node->val.s->variant != STMT_COND || !node->val.s->par[1])
+    return 0;
+  // without else, the parser leaves an empty expression in its place
+  ast_node_t *branch = node->val.s->par[1]->val.sc->items;
+  ast_node_t *els = branch->next;
+  return always_returns(branch) &&
+         (!els || (els->node_type == AST_NODE_EXPRESSION &&
+                   els->val.e->variant == EXPR_EMPTY));
+}
+
+static const char *inlinable_returns(ast_node_t *list, int result);
+
+// the same for a node that always returns
+static const char *inlinable_branch(ast_node_t *node, int result) {
+  if (node->node_type == AST_NODE_SCOPE)
+    return inlinable_returns(node->val.sc->items, result);
+  if (is_return(node)) return NULL;
+  ast_node_t *branch = node->val.s->par[1]->val.sc->items;
+  const char *why = inlinable_branch(branch, result);
+  return why ? why : inlinable_branch(branch->next, result);
+}
+
+// NULL if the code generation can emit the statements of the list (the rest
+// of a body) without SETR, otherwise why not; `result`: the function returns
+// a value
+static const char *inlinable_returns(ast_node_t *list, int result) {
+  for (ast_node_t *p = list; p; p = p->next) {
+    if (!has_return(p)) continue;
+    if (returns_early(p)) {
+      // the rest of the list is its else
+      const char *why =
+          inlinable_branch(p->val.s->par[1]->val.sc->items, result);
+      if (why) return why;
+      continue;
+    }
+    if (!always_returns(p))
+      return "some return is in a loop or not at the end of a branch";
+    return inlinable_branch(p, result);
+  }
+  return result ? "some path ends without a return" : NULL;
+}
+
+/* ----------------------------------------------------------------------------
+ * inlining of the calls
+ */
+
+//! the function being compiled (NULL for the main scope), the functions being
+//! inlined into it, and the `inline` functions already reported
+typedef struct {
+  function_t *caller;
+  function_t **stack;
+  int depth;
+  function_t **warned;
+  int n_warned;
+} inline_ctx_t;
+
+static void push_function(function_t ***list, int *n, function_t *f) {
+  *list = (function_t **)realloc(*list, (*n + 1) * sizeof(function_t *));
+  (*list)[(*n)++] = f;
+}
+
+// warn (once) that an `inline` function is not inlined
+static void not_inlined(ast_node_t *node, const char *why, inline_ctx_t *ic) {
+  function_t *fn = node->val.e->val.f->fn;
+  if (!fn->inline_hint) return;
+  for (int i = 0; i < ic->n_warned; i++)
+    if (ic->warned[i] == fn) return;
+  push_function(&(ic->warned), &(ic->n_warned), fn);
+  throw("%s %d %d: warning: inline function '%s' is not inlined: %s",
+        node->loc.fn, node->loc.fl, node->loc.fc, fn->name, why);
+}
+
+static void count_node(ast_node_t *node, void *data) { (*(int *)data)++; }
+
+// replace the call in node by the returned expression if possible
+static int inline_expression(ast_node_t *node) {
+  function_t *fn = node->val.e->val.f->fn;
+  ast_node_t *args = node->val.e->val.f->params;
+  int *uses;
+  ast_node_t *body = inline_body(fn, &uses);
+  if (!body) return 0;
+
+  int ok = 1, i = 0;
+  for (ast_node_t *p = fn->params, *a = args; p && ok;
+       p = p->next, a = a->next, i++) {
+    int size = 0, u[1];
+    ok = a && numeric_type(a->val.e) != -1 &&
+         a->val.e->type->type == p->val.v->base_type &&
+         pure_expression(a, NULL, &size, u) &&
+         (uses[i] == 1 || trivial_argument(a));
+  }
+  free(uses);
+  if (!ok) return 0;
+
+  copy_t c = {fn->params, args, NULL, NULL};
+  ast_node_t *cp = copy_expression(body, &c);
+  expression_t_delete(node->val.e);
+  node->val.e = cp->val.e;
+  cp->val.e = NULL;
+  ast_node_t_delete(cp);
+  return 1;
+}
+
+static void inline_list(ast_node_t *list, inline_ctx_t *ic);
+
+// inline the call in node as an expression, or as a copy of the function
+static void inline_call(ast_node_t *node, inline_ctx_t *ic) {
+  if (inline_expression(node)) return;
+  expr_function_t *call = node->val.e->val.f;
+  function_t *fn = call->fn;
+  const char *why = NULL;
+  for (int i = 0; i < ic->depth && !why; i++)
+    if (ic->stack[i] == fn) why = "it is recursive";
+  if (!why)
+    why = inlinable_returns(fn->root_scope->items,
+                            fn->out_type != ast_current()->type_void->val.t);
+  if (why) {
+    not_inlined(node, why, ic);
+    return;
+  }
+  int size = 0;
+  for (ast_node_t *p = fn->root_scope->items; p; p = p->next)
+    ir_for_nodes(p, count_node, &size);
+  if (size > inline_limit && !fn->inline_hint) return;
+
+  copy_t c = {NULL, NULL, hash_table_t_new(64, NULL), ic->caller};
+  call->inlined = copy_function(&(node->loc), fn, &c);
+  hash_table_t_delete(c.copies);
+
+  // the calls in the copy, with fn on the stack
+  push_function(&(ic->stack), &(ic->depth), fn);
+  inline_list(call->inlined->val.f->root_scope->items, ic);
+  ic->depth--;
+}
+
+static void inline_node(ast_node_t *node, inline_ctx_t *ic);
+
+static void inline_list(ast_node_t *list, inline_ctx_t *ic) {
+  for (ast_node_t *p = list; p; p = p->next) inline_node(p, ic);
+}
+
+static void inline_node(ast_node_t *node, inline_ctx_t *ic) {
+  if (!node) return;
+  switch (node->node_type) {
+    case AST_NODE_VARIABLE:
+      inline_list(node->val.v->ranges, ic);
+      inline_node(node->val.v->initializer, ic);
+      break;
+    case AST_NODE_SCOPE:
+      inline_list(node->val.sc->items, ic);
+      break;
+    case AST_NODE_STATEMENT:
+      inline_node(node->val.s->par[0], ic);
+      inline_node(node->val.s->par[1], ic);
+      break;
+    case AST_NODE_EXPRESSION: {
+      expression_t *ex = node->val.e;
+      switch (ex->variant) {
+        case EXPR_INITIALIZER:
+          inline_list(ex->val.i, ic);
+          break;
+        case EXPR_CALL:
+          // a copy made earlier is already inlined in its own function
+          inline_list(ex->val.f->params, ic);
+          if (ex->val.f->fn->root_scope && !ex->val.f->inlined)
+            inline_call(node, ic);
+          break;
+        case EXPR_ARRAY_ELEMENT:
+        case EXPR_VAR_NAME:
+        case EXPR_SIZEOF:
+        case EXPR_SORT:
+        case EXPR_SLICE:
+          inline_list(ex->val.v->params, ic);
+          break;
+        case EXPR_CAST:
+          inline_node(ex->val.c->ex, ic);
+          break;
+        case EXPR_SPECIFIER:
+          inline_node(ex->val.s->ex, ic);
+          break;
+        case EXPR_PREFIX:
+        case EXPR_POSTFIX:
+        case EXPR_BINARY:
+          inline_node(ex->val.o->first, ic);
+          inline_node(ex->val.o->second, ic);
+          break;
+      }
+    } break;
+  }
+}
+
+void inline_functions(ast_t *ast) {
+  inline_ctx_t ic = {NULL, NULL, 0, NULL, 0};
+  inline_list(ast->root_scope->items, &ic);
+  for (ast_node_t *fn = ast->functions; fn; fn = fn->next) {
+    if (!fn->val.f->root_scope) continue;
+    ic.caller = fn->val.f;
+    push_function(&(ic.stack), &(ic.depth), fn->val.f);
+    inline_list(fn->val.f->root_scope->items, &ic);
+    ic.depth--;
+  }
+  free(ic.stack);
+  free(ic.warned);
+}
+
+/* ----------------------------------------------------------------------------
+ * fusion of adjacent pardo statements
+ *
+ * `pardo (i : e) S1; pardo (j : e) S2;` becomes `pardo (i : e) { S1; S2[j/i] }`:
+ * the threads run in lockstep and all of them finish S1 before any of them
+ * starts S2, so the order of memory accesses is kept
+ *
+ * e must be the same expression in both statements and S1 must not change its
+ * value, nor the driving variable i
+ */
+
+//! variable read by the range expression
+typedef struct {
+  variable_t *var;
+  int elements;  //!< 1 if an element of the array is read
+} range_var_t;
+
+// structural equality of side effect free expressions; collect the variables
+static int same_expression(ast_node_t *a, ast_node_t *b, range_var_t **vars,
+                           int *n_vars) {
+  if (!a || !b) return a == b;
+  expression_t *x = a->val.e, *y = b->val.e;
+  if (x->variant != y->variant || !inferred_type_equal(x->type, y->type))
+    return 0;
+  switch (x->variant) {
+    case EXPR_LITERAL:
+      return !x->type->compound &&
+             !memcmp(x->val.l, y->val.l, x->type->type->size);
+    case EXPR_VAR_NAME:
+    case EXPR_ARRAY_ELEMENT:
+    case EXPR_SIZEOF: {
+      if (x->val.v->var != y->val.v->var) return 0;
+      *vars = (range_var_t *)realloc(*vars, (*n_vars + 1) * sizeof(range_var_t));
+      (*vars)[*n_vars].var = x->val.v->var;
+      (*vars)[(*n_vars)++].elements = x->variant == EXPR_ARRAY_ELEMENT;
+      ast_node_t *p = x->val.v->params, *q = y->val.v->params;
+      for (; p && q; p = p->next, q = q->next)
+        if (!same_expression(p, q, vars, n_vars)) return 0;
+      return p == q;
+    }
+    case EXPR_CAST:
+      return x->val.c->type == y->val.c->type &&
+             same_expression(x->val.c->ex, y->val.c->ex, vars, n_vars);
+    case EXPR_PREFIX:
+    case EXPR_POSTFIX:
+    case EXPR_BINARY:
+      return x->val.o->oper == y->val.o->oper && !assign_oper(x->val.o->oper) &&
+             x->val.o->oper != TOK_INC && x->val.o->oper != TOK_DEC &&
+             same_expression(x->val.o->first, y->val.o->first, vars, n_vars) &&
+             same_expression(x->val.o->second, y->val.o->second, vars, n_vars);
+  }
+  return 0;
+}
+
+// 1 if the expression (target of an assignment) may change a variable from
+// vars; `whole` is set if not only an element of an array is changed
+static int writes_target(ast_node_t *node, range_var_t *vars, int n_vars,
+                         int whole) {
+  expression_t *ex = node->val.e;
+  switch (ex->variant) {
+    case EXPR_SPECIFIER:
+      return writes_target(ex->val.s->ex, vars, n_vars, whole);
+    case EXPR_VAR_NAME:
+    case EXPR_ARRAY_ELEMENT:
+    case EXPR_SORT:
+      if (ex->variant != EXPR_VAR_NAME) whole = 0;
+      for (int i = 0; i < n_vars; i++)
+        if (vars[i].var == ex->val.v->var && (whole || vars[i].elements))
+          return 1;
+      return 0;
+  }
+  return 1;
+}
+
+// 1 if the code may change a variable from vars
+static int writes_vars(ast_node_t *node, range_var_t *vars, int n_vars) {
+  for (; node; node = node->next) switch (node->node_type) {
+      case AST_NODE_VARIABLE:
+        if (writes_vars(node->val.v->ranges, vars, n_vars) ||
+            writes_vars(node->val.v->initializer, vars, n_vars))
+          return 1;
+        break;
+      case AST_NODE_SCOPE:
+        if (writes_vars(node->val.sc->items, vars, n_vars)) return 1;
+        break;
+      case AST_NODE_STATEMENT:
+        if (writes_vars(node->val.s->par[0], vars, n_vars) ||
+            writes_vars(node->val.s->par[1], vars, n_vars))
+          return 1;
+        break;
+      case AST_NODE_EXPRESSION: {
+        expression_t *ex = node->val.e;
+        switch (ex->variant) {
+          case EXPR_INITIALIZER:
+            if (writes_vars(ex->val.i, vars, n_vars)) return 1;
+            break;
+          case EXPR_CALL:
+            // functions may change global variables (vars[0] is the driving
+            // variable, local to the statement)
+            if (ex->val.f->fn->root_scope && n_vars > 1) return 1;
+            if (writes_vars(ex->val.f->params, vars, n_vars)) return 1;
+            break;
+          case EXPR_SORT:
+            if (writes_target(node, vars, n_vars, 0)) return 1;
+            // fall through
+          case EXPR_ARRAY_ELEMENT:
+          case EXPR_VAR_NAME:
+          case EXPR_SIZEOF:
+          case EXPR_SLICE:
+            if (writes_vars(ex->val.v->params, vars, n_vars)) return 1;
+            break;
+          case EXPR_CAST:
+            if (writes_vars(ex->val.c->ex, vars, n_vars)) return 1;
+            break;
+          case EXPR_SPECIFIER:
+            if (writes_vars(ex->val.s->ex, vars, n_vars)) return 1;
+            break;
+          case EXPR_PREFIX:
+          case EXPR_POSTFIX:
+          case EXPR_BINARY:
+            if ((assign_oper(ex->val.o->oper) || ex->val.o->oper == TOK_INC ||
+                 ex->val.o->oper == TOK_DEC) &&
+                writes_target(ex->val.o->first, vars, n_vars, 1))
+              return 1;
+            if (writes_vars(ex->val.o->first, vars, n_vars) ||
+                writes_vars(ex->val.o->second, vars, n_vars))
+              return 1;
+            break;
+        }
+      } break;
+    }
+  return 0;
+}
+
+// move code from scope `from` to scope `to`, use variable `v` instead of `w`
+static void move_to_scope(ast_node_t *node, scope_t *from, scope_t *to,
+                          variable_t *w, variable_t *v) {
+  for (; node; node = node->next) switch (node->node_type) {
+      case AST_NODE_VARIABLE:
+        if (node->val.v->scope == from) node->val.v->scope = to;
+        move_to_scope(node->val.v->ranges, from, to, w, v);
+        move_to_scope(node->val.v->initializer, from, to, w, v);
+        break;
+      case AST_NODE_SCOPE:
+        if (node->val.sc->parent == from) node->val.sc->parent = to;
+        move_to_scope(node->val.sc->items, from, to, w, v);
+        break;
+      case AST_NODE_STATEMENT:
+        move_to_scope(node->val.s->par[0], from, to, w, v);
+        move_to_scope(node->val.s->par[1], from, to, w, v);
+        break;
+      case AST_NODE_EXPRESSION: {
+        expression_t *ex = node->val.e;
+        switch (ex->variant) {
+          case EXPR_INITIALIZER:
+            move_to_scope(ex->val.i, from, to, w, v);
+            break;
+          case EXPR_CALL:
+            move_to_scope(ex->val.f->params, from, to, w, v);
+            break;
+          case EXPR_ARRAY_ELEMENT:
+          case EXPR_VAR_NAME:
+          case EXPR_SIZEOF:
+          case EXPR_SORT:
+          case EXPR_SLICE:
+            if (ex->val.v->var == w) ex->val.v->var = v;
+            move_to_scope(ex->val.v->params, from, to, w, v);
+            break;
+          case EXPR_CAST:
+            move_to_scope(ex->val.c->ex, from, to, w, v);
+            break;
+          case EXPR_SPECIFIER:
+            move_to_scope(ex->val.s->ex, from, to, w, v);
+            break;
+          case EXPR_PREFIX:
+          case EXPR_POSTFIX:
+          case EXPR_BINARY:
+            move_to_scope(ex->val.o->first, from, to, w, v);
+            move_to_scope(ex->val.o->second, from, to, w, v);
+            break;
+        }
+      } break;
+    }
+}
+
+static int is_pardo(ast_node_t *node) {
+  return node && node->node_type == AST_NODE_STATEMENT &&
+         node->val.s->variant == STMT_PARDO && node->val.s->par[0] &&
+         node->val.s->par[1];
+}
+
+// try to merge node->next into the pardo statement node
+static int fuse_pardo(ast_node_t *node) {
+  ast_node_t *next = node->next;
+  if (!is_pardo(node) || !is_pardo(next)) return 0;
+  scope_t *sc = node->val.s->par[0]->val.sc,
+          *sc_next = next->val.s->par[0]->val.sc;
+
+  range_var_t *vars = (range_var_t *)malloc(sizeof(range_var_t));
+  int n_vars = 1;
+  vars[0].var = sc->items->val.v;
+  vars[0].elements = 0;
+  int ok = same_expression(node->val.s->par[1], next->val.s->par[1], &vars,
+                           &n_vars) &&
+           !writes_vars(sc->items->next, vars, n_vars);
+  free(vars);
+  if (!ok) return 0;
+
+  ast_node_t *body = sc_next->items->next;
+  sc_next->items->next = NULL;
+  move_to_scope(body, sc_next, sc, sc_next->items->val.v, sc->items->val.v);
+  append(ast_node_t, &(sc->items), body);
+  node->next = next->next;
+  next->next = NULL;
+  ast_node_t_delete(next);
+  return 1;
+}
+
+static void fuse_node(ast_node_t *node);
+
+static void fuse_list(ast_node_t *list) {
+  for (ast_node_t *p = list; p; p = p->next) {
+    while (fuse_pardo(p))
+      ;
+    fuse_node(p);
+  }
+}
+
+static void fuse_node(ast_node_t *node) {
+  switch (node->node_type) {
+    case AST_NODE_SCOPE:
+      fuse_list(node->val.sc->items);
+      break;
+    case AST_NODE_FUNCTION:
+      if (node->val.f->root_scope) fuse_list(node->val.f->root_scope->items);
+      break;
+    case AST_NODE_STATEMENT:
+      if (node->val.s->par[0]) fuse_node(node->val.s->par[0]);
+      if (node->val.s->par[1]) fuse_node(node->val.s->par[1]);
+      break;
+  }
+}
+
+void fuse_pardos(ast_t *ast) {
+  fuse_list(ast->root_scope->items);
+  fuse_list(ast->functions);
+}
+
+/* ----------------------------------------------------------------------------
+ * static bounds checks
+ *
+ * in the body S of `pardo (i : a.size(d)) S` and of
+ * `for (int i = c; i < a.size(d); i++) S` (c >= 0 literal), 0 <= i < a.size(d)
+ * holds if S does not change i (the header of a does not change); an access
+ * `a[i1,...,in]` where each ik is bounded by the size of a in dimension k is
+ * marked in_bounds and the code generation omits its range checks
+ */
+
+//! 0 <= var < size of arr in dimension dim
+typedef struct {
+  variable_t *var, *arr;
+  int dim;
+} bound_t;
+
+// if the node is `a.size(d)` with literal d, set arr and dim
+static int size_expression(ast_node_t *node, variable_t **arr, int *dim) {
+  if (!node || node->node_type != AST_NODE_EXPRESSION ||
+      node->val.e->variant != EXPR_SIZEOF)
+    return 0;
+  int32_t d;
+  if (!literal_int_value(node->val.e->val.v->params, &d) || d < 0 ||
+      d >= node->val.e->val.v->var->num_dim)
+    return 0;
+  *arr = node->val.e->val.v->var;
+  *dim = d;
+  return 1;
+}
+
+// 1 if the node is `v` (an int variable)
+static int is_variable(ast_node_t *node, variable_t *v) {
+  return node && node->node_type == AST_NODE_EXPRESSION &&
+         node->val.e->variant == EXPR_VAR_NAME && node->val.e->val.v->var == v;
+}
+
+// 1 if the code does not change the variable v (local to the statement)
+static int keeps_variable(ast_node_t *node, variable_t *v) {
+  range_var_t var = {v, 0};
+  return !writes_vars(node, &var, 1);
+}
+
+// if `for` statement node bounds its variable in the body, fill the bound
+static int for_bound(ast_node_t *node, bound_t *b) {
+  ast_node_t *A = node->val.s->par[0]->val.sc->items;
+  ast_node_t *B = A ? A->next : NULL, *C = B ? B->next : NULL;
+  if (!C || A->node_type != AST_NODE_VARIABLE) return 0;
+
+  // int i = c
+  variable_t *v = A->val.v;
+  ast_node_t *init = v->initializer ? v->initializer->val.e->val.i : NULL;
+  int32_t c;
+  if (v->num_dim > 0 || v->base_type != ast_current()->type_int->val.t ||
+      !init || init->next || !literal_int_value(init, &c) || c < 0)
+    return 0;
+
+  // i < a.size(d)
+  expression_t *cond = B->val.e;
+  if (B->node_type != AST_NODE_EXPRESSION || cond->variant != EXPR_BINARY ||
+      cond->val.o->oper != '<' || !is_variable(cond->val.o->first, v) ||
+      !size_expression(cond->val.o->second, &b->arr, &b->dim))
+    return 0;
+
+  // i++, ++i or i += 1
+  if (C->node_type != AST_NODE_EXPRESSION) return 0;
+  expression_t *step = C->val.e;
+  int32_t one;
+  int inc = (step->variant == EXPR_POSTFIX || step->variant == EXPR_PREFIX) &&
+            step->val.o->oper == TOK_INC;
+  int add = step->variant == EXPR_BINARY &&
+            step->val.o->oper == TOK_PLUS_ASSIGN &&
+            literal_int_value(step->val.o->second, &one) && one == 1;
+  if (!(inc || add) || !is_variable(step->val.o->first, v)) return 0;
+
+  b->var = v;
+  return C->next == NULL || keeps_variable(C->next, v);
+}
+
+static int indices_in_bounds(expr_variable_t *ev, bound_t *bounds,
+                             int n_bounds) {
+  int k = 0;
+  for (ast_node_t *p = ev->params; p; p = p->next, k++) {
+    if (p->val.e->variant != EXPR_VAR_NAME) return 0;
+    int found = 0;
+    for (int i = 0; i < n_bounds && !found; i++)
+      found = bounds[i].var == p->val.e->val.v->var &&
+              bounds[i].arr == ev->var && bounds[i].dim == k;
+    if (!found) return 0;
+  }
+  return k == ev->var->num_dim;
+}
+
+static void bounds_list(ast_node_t *list, bound_t **bounds, int *n_bounds);
+
+static void bounds_node(ast_node_t *node, bound_t **bounds, int *n_bounds) {
+  switch (node->node_type) {
+    case AST_NODE_VARIABLE:
+      bounds_list(node->val.v->ranges, bounds, n_bounds);
+      bounds_list(node->val.v->initializer, bounds, n_bounds);
+      break;
+    case AST_NODE_SCOPE:
+      bounds_list(node->val.sc->items, bounds, n_bounds);
+      break;
+    case AST_NODE_FUNCTION:
+      if (node->val.f->root_scope)
+        bounds_list(node->val.f->root_scope->items, bounds, n_bounds);
+      break;
+    case AST_NODE_STATEMENT: {
+      statement_t *s = node->val.s;
+      bound_t b;
+      int bounded = 0;
+      if (s->variant == STMT_PARDO && is_pardo(node)) {
+        b.var = s->par[0]->val.sc->items->val.v;
+        bounded = size_expression(s->par[1], &b.arr, &b.dim) &&
+                  keeps_variable(s->par[0]->val.sc->items->next, b.var);
+      } else if (s->variant == STMT_FOR && s->par[0])
+        bounded = for_bound(node, &b);
+      if (s->par[1]) bounds_node(s->par[1], bounds, n_bounds);
+      if (!s->par[0]) break;
+      if (!bounded) {
+        bounds_node(s->par[0], bounds, n_bounds);
+        break;
+      }
+      *bounds = (bound_t *)realloc(*bounds, (*n_bounds + 1) * sizeof(bound_t));
+      (*bounds)[(*n_bounds)++] = b;
+      bounds_node(s->par[0], bounds, n_bounds);
+      (*n_bounds)--;
+    } break;
+    case AST_NODE_EXPRESSION: {
+      expression_t *ex = node->val.e;
+      switch (ex->variant) {
+        case EXPR_INITIALIZER:
+          bounds_list(ex->val.i, bounds, n_bounds);
+          break;
+        case EXPR_CALL:
+          bounds_list(ex->val.f->params, bounds, n_bounds);
+          bounds_list(ex->val.f->inlined, bounds, n_bounds);
+          break;
+        case EXPR_ARRAY_ELEMENT:
+          ex->val.v->in_bounds =
+              indices_in_bounds(ex->val.v, *bounds, *n_bounds);
+          // fall through
+        case EXPR_VAR_NAME:
+        case EXPR_SIZEOF:
+        case EXPR_SORT:
+        case EXPR_SLICE:
+          bounds_list(ex->val.v->params, bounds, n_bounds);
+          break;
+        case EXPR_CAST:
+          bounds_list(ex->val.c->ex, bounds, n_bounds);
+          break;
+        case EXPR_SPECIFIER:
+          bounds_list(ex->val.s->ex, bounds, n_bounds);
+          break;
+        case EXPR_PREFIX:
+        case EXPR_POSTFIX:
+        case EXPR_BINARY:
+          bounds_list(ex->val.o->first, bounds, n_bounds);
+          bounds_list(ex->val.o->second, bounds, n_bounds);
+          break;
+      }
+    } break;
+  }
+}
+
+static void bounds_list(ast_node_t *list, bound_t **bounds, int *n_bounds) {
+  for (ast_node_t *p = list; p; p = p->next) bounds_node(p, bounds, n_bounds);
+}
+
+void check_bounds(ast_t *ast) {
+  bound_t *bounds = NULL;
+  int n_bounds = 0;
+  bounds_list(ast->root_scope->items, &bounds, &n_bounds);
+  bounds_list(ast->functions, &bounds, &n_bounds);
+  free(bounds);
+}
+
+/* ----------------------------------------------------------------------------
+ * exclusive accesses
+ *
+ * a pardo in the root scope outside any other pardo is started by a single
+ * thread, so its threads have distinct values of the driving variable i (if
+ * the body does not change it); an element of an array indexed by i in some
+ * dimension is at a different address for each of them (the other indices are
+ * in range), so the threads executing one instruction never access the same
+ * element; in a nested pardo the value of i repeats
+ */
+
+static void exclusive_list(ast_node_t *list, variable_t *var, int in_pardo);
+
+static void exclusive_node(ast_node_t *node, variable_t *var, int in_pardo) {
+  switch (node->node_type) {
+    case AST_NODE_VARIABLE:
+      exclusive_list(node->val.v->ranges, var, in_pardo);
+      exclusive_list(node->val.v->initializer, var, in_pardo);
+      break;
+    case AST_NODE_SCOPE:
+      exclusive_list(node->val.sc->items, var, in_pardo);
+      break;
+    case AST_NODE_STATEMENT: {
+      statement_t *s = node->val.s;
+      if (s->par[1]) exclusive_node(s->par[1], var, in_pardo);
+      if (!s->par[0]) break;
+      if (s->variant == STMT_PARDO && is_pardo(node)) {
+        variable_t *i = s->par[0]->val.sc->items->val.v;
+        if (in_pardo || !keeps_variable(s->par[0]->val.sc->items->next, i))
+          i = NULL;
+        exclusive_node(s->par[0], i, 1);
+      } else
+        exclusive_node(s->par[0], var, in_pardo);
+    } break;
+    case AST_NODE_EXPRESSION: {
+      expression_t *ex = node->val.e;
+      switch (ex->variant) {
+        case EXPR_INITIALIZER:
+          exclusive_list(ex->val.i, var, in_pardo);
+          break;
+        case EXPR_CALL:
+          exclusive_list(ex->val.f->params, var, in_pardo);
+          break;
+        case EXPR_ARRAY_ELEMENT:
+          for (ast_node_t *p = ex->val.v->params; var && p; p = p->next)
+            if (is_variable(p, var)) ex->val.v->exclusive = 1;
+          // fall through
+        case EXPR_VAR_NAME:
+        case EXPR_SIZEOF:
+        case EXPR_SORT:
+        case EXPR_SLICE:
+          exclusive_list(ex->val.v->params, var, in_pardo);
+          break;
+        case EXPR_CAST:
+          exclusive_list(ex->val.c->ex, var, in_pardo);
+          break;
+        case EXPR_SPECIFIER:
+          exclusive_list(ex->val.s->ex, var, in_pardo);
+          break;
+        case EXPR_PREFIX:
+        case EXPR_POSTFIX:
+        case EXPR_BINARY:
+          exclusive_list(ex->val.o->first, var, in_pardo);
+          exclusive_list(ex->val.o->second, var, in_pardo);
+          break;
+      }
+    } break;
+  }
+}
+
+static void exclusive_list(ast_node_t *list, variable_t *var, int in_pardo) {
+  for (ast_node_t *p = list; p; p = p->next) exclusive_node(p, var, in_pardo);
+}
+
+void check_exclusive(ast_t *ast) {
+  // functions may be called from a pardo: their accesses stay checked
+  exclusive_list(ast->root_scope->items, NULL, 0);
+}
+
+/* ----------------------------------------------------------------------------
+ * uniform conditions
+ *
+ * the threads of a group execute each statement together, so a condition
+ * that evaluates to the same value in all of them can be tested by `JMPZ`
+ * instead of splitting the group; a value is the same in all threads if it
+ * is built from literals and from uniform variables by operators without side
+ * effects, where uniform variables are:
+ *   - variables of the root scope outside any pardo (all threads read them
+ *     from the memory of the main thread)
+ *   - scalar variables initialized by a uniform expression and not changed
+ *     later in their scope
+ *   - the variable `k` of `for (k = u; c; s)` where `s` sets `k` to a uniform
+ *     value (`k++`, `k--`, `k += u`, ...), the body does not change it and
+ *     `c` is uniform (with SPLIT, also the threads that left the loop test
+ *     `c` again, with their last value of `k`)
+ * the root scope outside any pardo is run by the main thread alone, so all
+ * its conditions are uniform
+ */
+
+static int in_vars(variable_t *v, variable_t **vars, int n_vars) {
+  for (int i = 0; i < n_vars; i++)
+    if (vars[i] == v) return 1;
+  return 0;
+}
+
+static void add_var(variable_t *v, variable_t ***vars, int *n_vars) {
+  *vars = (variable_t **)realloc(*vars, (*n_vars + 1) * sizeof(variable_t *));
+  (*vars)[(*n_vars)++] = v;
+}
+
+static int uniform_expression(ast_node_t *node, variable_t **vars,
+                              int n_vars) {
+  if (!node || node->node_type != AST_NODE_EXPRESSION) return 0;
+  expression_t *ex = node->val.e;
+  switch (ex->variant) {
+    case EXPR_LITERAL:
+      return 1;
+    case EXPR_VAR_NAME:
+    case EXPR_ARRAY_ELEMENT:
+    case EXPR_SIZEOF:
+      if (!in_vars(ex->val.v->var, vars, n_vars)) return 0;
+      for (ast_node_t *p = ex->val.v->params; p; p = p->next)
+        if (!uniform_expression(p, vars, n_vars)) return 0;
+      return 1;
+    case EXPR_CAST:
+      return uniform_expression(ex->val.c->ex, vars, n_vars);
+    case EXPR_SPECIFIER:
+      return uniform_expression(ex->val.s->ex, vars, n_vars);
+    case EXPR_PREFIX:
+    case EXPR_POSTFIX:
+    case EXPR_BINARY:
+      if (assign_oper(ex->val.o->oper) || ex->val.o->oper == TOK_INC ||
+          ex->val.o->oper == TOK_DEC)
+        return 0;
+      return (!ex->val.o->first ||
+              uniform_expression(ex->val.o->first, vars, n_vars)) &&
+             (!ex->val.o->second ||
+              uniform_expression(ex->val.o->second, vars, n_vars));
+  }
+  return 0;
+}
+
+// 1 if the scalar variable is initialized by a uniform expression
+static int uniform_initializer(variable_t *v, variable_t **vars, int n_vars) {
+  ast_node_t *init = v->initializer ? v->initializer->val.e->val.i : NULL;
+  return v->num_dim == 0 && init && !init->next &&
+         uniform_expression(init, vars, n_vars);
+}
+
+// 1 if the step of a `for` statement sets v to a uniform value
+static int uniform_step(ast_node_t *node, variable_t *v, variable_t **vars,
+                        int n_vars) {
+  if (node->node_type != AST_NODE_EXPRESSION) return 0;
+  expression_t *ex = node->val.e;
+  if (ex->variant == EXPR_PREFIX || ex->variant == EXPR_POSTFIX)
+    return (ex->val.o->oper == TOK_INC || ex->val.o->oper == TOK_DEC) &&
+           is_variable(ex->val.o->first, v);
+  return ex->variant == EXPR_BINARY && assign_oper(ex->val.o->oper) &&
+         is_variable(ex->val.o->first, v) &&
+         uniform_expression(ex->val.o->second, vars, n_vars);
+}
+
+// 1 if the condition of the `for` statement node is uniform; then adds its
+// variable to vars if it is uniform
+static int for_uniform(ast_node_t *node, variable_t ***vars, int *n_vars) {
+  ast_node_t *A = node->val.s->par[0]->val.sc->items;
+  ast_node_t *B = A ? A->next : NULL, *C = B ? B->next : NULL;
+  if (!C) return 0;
+  int n = *n_vars;
+  if (A->node_type == AST_NODE_VARIABLE &&
+      uniform_initializer(A->val.v, *vars, *n_vars)) {
+    variable_t *v = A->val.v;
+    add_var(v, vars, n_vars);
+    if (!uniform_step(C, v, *vars, *n_vars) ||
+        (C->next && !keeps_variable(C->next, v)))
+      (*n_vars)--;
+  }
+  if (uniform_expression(B, *vars, *n_vars)) return 1;
+  *n_vars = n;
+  return 0;
+}
+
+static void uniform_values(ast_node_t *node, variable_t **vars, int n_vars);
+
+static void uniform_values_list(ast_node_t *list, variable_t **vars,
+                                int n_vars) {
+  for (ast_node_t *p = list; p; p = p->next) uniform_values(p, vars, n_vars);
+}
+
+// the expressions computing the address of the lvalue node
+static void uniform_address(ast_node_t *node, variable_t **vars, int n_vars) {
+  if (!node || node->node_type != AST_NODE_EXPRESSION) return;
+  expression_t *ex = node->val.e;
+  if (ex->variant == EXPR_VAR_NAME || ex->variant == EXPR_ARRAY_ELEMENT)
+    uniform_values_list(ex->val.v->params, vars, n_vars);
+  else if (ex->variant == EXPR_SPECIFIER)
+    uniform_address(ex->val.s->ex, vars, n_vars);
+  else
+    uniform_values(node, vars, n_vars);
+}
+
+// set `uniform` in the largest uniform subexpressions of the node, except
+// bare literals, which are pushed as fast as their copies
+static void uniform_values(ast_node_t *node, variable_t **vars, int n_vars) {
+  if (!node || node->node_type != AST_NODE_EXPRESSION) return;
+  expression_t *ex = node->val.e;
+  if (ex->variant != EXPR_LITERAL && uniform_expression(node, vars, n_vars)) {
+    ex->uniform = 1;
+    return;
+  }
+  switch (ex->variant) {
+    case EXPR_INITIALIZER:
+      uniform_values_list(ex->val.i, vars, n_vars);
+      break;
+    case EXPR_CALL:
+      uniform_values_list(ex->val.f->params, vars, n_vars);
+      break;
+    case EXPR_VAR_NAME:
+    case EXPR_ARRAY_ELEMENT:
+    case EXPR_SIZEOF:
+    case EXPR_SLICE:
+      uniform_values_list(ex->val.v->params, vars, n_vars);
+      break;
+    case EXPR_CAST:
+      uniform_values(ex->val.c->ex, vars, n_vars);
+      break;
+    case EXPR_SPECIFIER:
+      uniform_values(ex->val.s->ex, vars, n_vars);
+      break;
+    case EXPR_PREFIX:
+    case EXPR_POSTFIX:
+    case EXPR_BINARY:
+      if (assign_oper(ex->val.o->oper) || ex->val.o->oper == TOK_INC ||
+          ex->val.o->oper == TOK_DEC)
+        uniform_address(ex->val.o->first, vars, n_vars);
+      else
+        uniform_values(ex->val.o->first, vars, n_vars);
+      uniform_values(ex->val.o->second, vars, n_vars);
+      break;
+  }
+}
+
+static void uniform_list(ast_node_t *list, variable_t ***vars, int *n_vars,
+                         int single, int values);
+
+// `single` is set in the code run by the main thread alone; `values` if the
+// uniform values in the code run by more threads are to be marked
+static void uniform_node(ast_node_t *node, variable_t ***vars, int *n_vars,
+                         int single, int values) {
+  int mark = values && !single;
+  switch (node->node_type) {
+    case AST_NODE_VARIABLE:
+      if (mark) {
+        uniform_values(node->val.v->initializer, *vars, *n_vars);
+        uniform_values_list(node->val.v->ranges, *vars, *n_vars);
+      }
+      if (single || (uniform_initializer(node->val.v, *vars, *n_vars) &&
+                     keeps_variable(node->next, node->val.v)))
+        add_var(node->val.v, vars, n_vars);
+      break;
+    case AST_NODE_EXPRESSION:
+      if (mark) uniform_values(node, *vars, *n_vars);
+      break;
+    case AST_NODE_SCOPE:
+      uniform_list(node->val.sc->items, vars, n_vars, single, values);
+      break;
+    case AST_NODE_FUNCTION:
+      if (node->val.f->root_scope)
+        uniform_list(node->val.f->root_scope->items, vars, n_vars, 0, values);
+      break;
+    case AST_NODE_STATEMENT: {
+      statement_t *s = node->val.s;
+      switch (s->variant) {
+        case STMT_PARDO:
+          if (!is_pardo(node)) break;
+          if (mark) uniform_values(s->par[1], *vars, *n_vars);
+          uniform_node(s->par[0], vars, n_vars, 0, values);
+          break;
+        case STMT_FOR: {
+          if (!s->par[0]) break;
+          ast_node_t *A = s->par[0]->val.sc->items;
+          ast_node_t *B = A ? A->next : NULL, *C = B ? B->next : NULL;
+          if (single) {
+            if (A && A->node_type == AST_NODE_VARIABLE)
+              add_var(A->val.v, vars, n_vars);
+            s->uniform = 1;
+          } else {
+            if (mark && A) {
+              if (A->node_type == AST_NODE_VARIABLE)
+                uniform_values(A->val.v->initializer, *vars, *n_vars);
+              else
+                uniform_values(A, *vars, *n_vars);
+            }
+            s->uniform = for_uniform(node, vars, n_vars);
+            if (mark && C) {
+              uniform_values(B, *vars, *n_vars);
+              uniform_values(C, *vars, *n_vars);
+            }
+          }
+          if (C) uniform_list(C->next, vars, n_vars, single, values);
+        } break;
+        case STMT_WHILE:
+        case STMT_DO:
+        case STMT_COND:
+          if (!s->par[0] || !s->par[1]) break;
+          s->uniform = single || uniform_expression(s->par[0], *vars, *n_vars);
+          if (mark) uniform_values(s->par[0], *vars, *n_vars);
+          uniform_node(s->par[1], vars, n_vars, single, values);
+          break;
+        case STMT_RETURN:
+          if (mark) uniform_values(s->par[0], *vars, *n_vars);
+          break;
+      }
+    } break;
+  }
+}
+
+static void uniform_list(ast_node_t *list, variable_t ***vars, int *n_vars,
+                         int single, int values) {
+  for (ast_node_t *p = list; p; p = p->next)
+    uniform_node(p, vars, n_vars, single, values);
+}
+
+void check_uniform(ast_t *ast) {
+  // the variables of the root scope are collected before the functions
+  // using them are analysed; in EREW, every thread has to read the memory
+  // itself for the conflicts to be found
+  variable_t **vars = NULL;
+  int n_vars = 0, values = ast->mem_mode != TOK_MODE_EREW;
+  uniform_list(ast->root_scope->items, &vars, &n_vars, 1, values);
+  uniform_list(ast->functions, &vars, &n_vars, 0, values);
+  free(vars);
+}
+
+/* ----------------------------------------------------------------------------
+ * rows of arrays hoisted out of loops
+ *
+ * in `a[i1,...,in]` (n >= 2) inside a `for` or `while` loop, the header of a
+ * and the indices i1..i(n-1) do not change in the loop if a and the variables
+ * of the indices are declared outside it and not changed in it (nor by a
+ * called function); the address of the row a[i1,...,i(n-1),0] is then
+ * computed once before the loop (`ROW`) and the access adds the last index
+ * (`IDXR`); the indices must not fail, so only literals and int variables
+ * combined by `+`, `-` and `*` are hoisted
+ *
+ * the rows are kept after all variables, so a loop with a pardo gets none:
+ * the memory of its threads would start above the variables of the body
+ */
+
+//! nodes of a loop: the variables declared in it, the elements to hoist
+typedef struct {
+  variable_t **vars;
+  int n_vars;
+  ast_node_t **elements;
+  int n_elements;
+  int pardo;  //!< the loop contains a pardo
+} loop_nodes_t;
+
+static void loop_node(ast_node_t *node, void *data) {
+  loop_nodes_t *l = (loop_nodes_t *)data;
+  if (node->node_type == AST_NODE_STATEMENT &&
+      node->val.s->variant == STMT_PARDO)
+    l->pardo = 1;
+  else if (node->node_type == AST_NODE_VARIABLE) {
+    l->vars = (variable_t **)realloc(l->vars,
+                                     (l->n_vars + 1) * sizeof(variable_t *));
+    l->vars[l->n_vars++] = node->val.v;
+  } else if (node->node_type == AST_NODE_EXPRESSION &&
+             node->val.e->variant == EXPR_ARRAY_ELEMENT &&
+             !node->val.e->val.v->row &&
+             node->val.e->val.v->var->num_dim >= 2 &&
+             node->val.e->val.v->var->base_type->size < (1 << 14)) {
+    l->elements = (ast_node_t **)realloc(
+        l->elements, (l->n_elements + 1) * sizeof(ast_node_t *));
+    l->elements[l->n_elements++] = node;
+  }
+}
+
+// an index that cannot fail; collect its variables
+static int row_index(ast_node_t *node, range_var_t **vars, int *n_vars) {
+  expression_t *ex = node->val.e;
+  if (numeric_type(ex) != TYPE_INT) return 0;
+  switch (ex->variant) {
+    case EXPR_LITERAL:
+      return 1;
+    case EXPR_VAR_NAME:
+      if (ex->val.v->var->num_dim) return 0;
+      *vars = (range_var_t *)realloc(*vars, (*n_vars + 1) * sizeof(range_var_t));
+      (*vars)[*n_vars].var = ex->val.v->var;
+      (*vars)[(*n_vars)++].elements = 0;
+      return 1;
+    case EXPR_BINARY:
+      return (ex->val.o->oper == '+' || ex->val.o->oper == '-' ||
+              ex->val.o->oper == '*') &&
+             row_index(ex->val.o->first, vars, n_vars) &&
+             row_index(ex->val.o->second, vars, n_vars);
+  }
+  return 0;
+}
+
+// 1 if the element can take its row from before the loop, whose code is the
+// lists `cond` and `body`
+static int invariant_row(ast_node_t *element, ast_node_t *cond,
+                         ast_node_t *body, loop_nodes_t *l) {
+  expr_variable_t *ev = element->val.e->val.v;
+  // vars[0] is the array, only its header matters
+  range_var_t *vars = (range_var_t *)malloc(sizeof(range_var_t));
+  int n_vars = 1, r = 1;
+  vars[0].var = ev->var;
+  vars[0].elements = 0;
+  for (ast_node_t *p = ev->params; r && p->next; p = p->next)
+    r = row_index(p, &vars, &n_vars);
+  for (int i = 0; r && i < n_vars; i++)
+    for (int j = 0; r && j < l->n_vars; j++)
+      if (vars[i].var == l->vars[j]) r = 0;
+  if (r && (writes_vars(cond, vars, n_vars) || writes_vars(body, vars, n_vars)))
+    r = 0;
+  free(vars);
+  return r;
+}
+
+// the same array and the same indices but the last
+static int same_row(expr_variable_t *a, expr_variable_t *b) {
+  if (a->var != b->var) return 0;
+  range_var_t *vars = NULL;
+  int n_vars = 0, r = 1;
+  ast_node_t *p = a->params, *q = b->params;
+  for (; r && p->next; p = p->next, q = q->next)
+    r = same_expression(p, q, &vars, &n_vars);
+  free(vars);
+  return r;
+}
+
+static void hoist_loop(ast_node_t *node, void *data) {
+  int *rows = (int *)data;
+  if (node->node_type != AST_NODE_STATEMENT) return;
+  statement_t *s = node->val.s;
+  ast_node_t *cond, *body;
+  if (s->variant == STMT_FOR && s->par[0]) {
+    // the condition, the step and the body are one list
+    cond = s->par[0]->val.sc->items ? s->par[0]->val.sc->items->next : NULL;
+    body = NULL;
+  } else if (s->variant == STMT_WHILE && s->par[0] && s->par[1]) {
+    cond = s->par[0];
+    body = s->par[1];
+  } else
+    return;
+  int32_t val;
+  if (!cond || literal_int_value(cond, &val)) return;
+
+  loop_nodes_t l = {NULL, 0, NULL, 0, 0};
+  for (ast_node_t *p = cond; p; p = p->next) ir_for_nodes(p, loop_node, &l);
+  ir_for_nodes(body, loop_node, &l);
+  for (int i = 0; !l.pardo && i < l.n_elements; i++) {
+    expr_variable_t *ev = l.elements[i]->val.e->val.v;
+    if (!invariant_row(l.elements[i], cond, body, &l)) continue;
+    // the earlier elements have a row of this loop or none
+    for (int j = 0; j < i && !ev->row; j++) {
+      expr_variable_t *prev = l.elements[j]->val.e->val.v;
+      if (prev->row && same_row(prev, ev)) ev->row = prev->row;
+    }
+    if (!ev->row) {
+      if (!s->n_rows) s->row = *rows;
+      ev->row = (*rows)++;
+      s->n_rows++;
+    }
+  }
+  free(l.vars);
+  free(l.elements);
+}
+
+void hoist_rows(ast_t *ast) {
+  // the rows are numbered from 1 in the main scope and in each function
+  if (ast->mem_mode == TOK_MODE_EREW) return;
+  int rows = 1;
+  for (ast_node_t *p = ast->root_scope->items; p; p = p->next)
+    ir_for_nodes(p, hoist_loop, &rows);
+  for (ast_node_t *p = ast->functions; p; p = p->next) {
+    rows = 1;
+    ir_for_nodes(p, hoist_loop, &rows);
+  }
+}
+
+/* ----------------------------------------------------------------------------
+ * peephole optimization of the generated code
+ *
+ * each rule marks instructions to be deleted or replaced; rules only apply
+ * within a basic block: no instruction in the middle of a rule can be
+ * entered by a jump
+ */
+static int is_const(ir_instr_t *in) {
+  return in->op == PUSHC || in->op == PUSHB;
+}
+
+static void set_const(ir_instr_t *in, int32_t val) {
+  in->op = (val >= 0 && val < 256) ? PUSHB : PUSHC;
+  in->arg = val;
+}
+
+// instructions that neither use the acc_stack nor the control flow
+static int plain_op(int op) {
+  switch (op) {
+    case S2A:
+    case A2S:
+    case POPA:
+    case RVA:
+    case SWA:
+    case JMP:
+    case JMPZ:
+    case JOIN_JMP:
+    case UNIFORM:
+    case JOIN:
+    case SPLIT:
+    case FORK:
+    case CALL:
+    case RETURN:
+    case SETR:
+    case BREAK:
+    case ENDVM:
+    case MEM_MARK:
+    case MEM_FREE:
+    case SORT:
+      return 0;
+  }
+  return 1;
+}
+
+// instructions that only transform the top of op_stack
+static int unary_op(int op) {
+  switch (op) {
+    case FBASE:
+    case LDC:
+    case LDB:
+    case LDCH:
+    case LDBH:
+    case LDCH_NC:
+    case LDBH_NC:
+    case LDSB:
+    case LDSBH:
+    case LDSBH_NC:
+    case LDS:
+    case LDSH:
+    case LDSH_NC:
+    case NOT:
+    case FLOAT2INT:
+    case INT2FLOAT:
+    case LAST_BIT:
+    case LOGF:
+    case LOG:
+    case SQRT:
+    case SQRTF:
+    case INT2INT8:
+    case INT2INT16:
+      return 1;
+  }
+  return 0;
+}
+
+// try the rules at instruction i; in are the original instructions, out the
+// replacements; return 1 if some rule applied
+static int peephole_rule(ir_instr_t *in, ir_instr_t *out, int i,
+                         int n, uint8_t *leader) {
+  // length of the straight code starting at i (at most 32 instructions)
+  int len = 1;
+  while (len < 32 && i + len < n && !leader[i + len] &&
+         out[i + len].op == in[i + len].op &&
+         out[i + len].arg == in[i + len].arg)
+    len++;
+#define OP(k) (in[i + (k)].op)
+
+  // PUSHC a, PUSHC b, ADD_INT/SUB_INT/MULT_INT -> PUSHC (b op a)
+  if (len >= 3 && is_const(&in[i]) && is_const(&in[i + 1]) &&
+      (OP(2) == ADD_INT || OP(2) == SUB_INT || OP(2) == MULT_INT)) {
+    int32_t a = in[i + 1].arg, b = in[i].arg, r;
+    if (OP(2) == ADD_INT)
+      r = WRAP(a, +, b);
+    else if (OP(2) == SUB_INT)
+      r = WRAP(a, -, b);
+    else
+      r = WRAP(a, *, b);
+    set_const(&out[i], r);
+    out[i + 1].op = out[i + 2].op = IR_DELETED;
+    return 1;
+  }
+
+  // PUSHC c, INT2INT8/INT2INT16 -> PUSHC (truncated c)
+  if (len >= 2 && is_const(&in[i]) &&
+      (OP(1) == INT2INT8 || OP(1) == INT2INT16)) {
+    set_const(&out[i], OP(1) == INT2INT8 ? (int8_t)in[i].arg
+                                          : (int16_t)in[i].arg);
+    out[i + 1].op = IR_DELETED;
+    return 1;
+  }
+
+  // PUSHC 0, ADD_INT or PUSHC 1, MULT_INT or PUSHC c, POP -> nothing
+  if (len >= 2 && is_const(&in[i]) &&
+      ((in[i].arg == 0 && OP(1) == ADD_INT) ||
+       (in[i].arg == 1 && OP(1) == MULT_INT) || OP(1) == POP)) {
+    out[i].op = out[i + 1].op = IR_DELETED;
+    return 1;
+  }
+
+  // S2A, POP, A2S, POPA  or  A2S, POPA, S2A, POP  or MEM_MARK, MEM_FREE
+  // -> nothing
+  if ((len >= 4 && OP(0) == S2A && OP(1) == POP && OP(2) == A2S &&
+       OP(3) == POPA) ||
+      (len >= 4 && OP(0) == A2S && OP(1) == POPA && OP(2) == S2A &&
+       OP(3) == POP)) {
+    for (int k = 0; k < 4; k++) out[i + k].op = IR_DELETED;
+    return 1;
+  }
+  if (len >= 2 && OP(0) == MEM_MARK && OP(1) == MEM_FREE) {
+    out[i].op = out[i + 1].op = IR_DELETED;
+    return 1;
+  }
+
+  // S2A, POP, x, A2S, POPA -> SWS, x, SWS  (x changes only the top)
+  if (len >= 5 && OP(0) == S2A && OP(1) == POP && unary_op(OP(2)) &&
+      OP(3) == A2S && OP(4) == POPA) {
+    out[i].op = SWS;
+    out[i + 1].op = IR_DELETED;
+    out[i + 3].op = SWS;
+    out[i + 4].op = IR_DELETED;
+    return 1;
+  }
+
+  // PUSHC c, S2A, ...., A2S, POPA -> PUSHC c, ...., PUSHC c
+  if (len >= 4 && is_const(&in[i]) && OP(1) == S2A) {
+    int k = 2;
+    while (k + 1 < len && plain_op(OP(k))) k++;
+    if (k + 1 < len && OP(k) == A2S && OP(k + 1) == POPA) {
+      out[i + 1].op = IR_DELETED;
+      out[i + k] = in[i];
+      out[i + k + 1].op = IR_DELETED;
+      return 1;
+    }
+  }
+
+  // short constants
+  if (OP(0) == PUSHC && in[i].arg >= 0 && in[i].arg < 256) {
+    set_const(&out[i], in[i].arg);
+    return 1;
+  }
+#undef OP
+  return 0;
+}
+
+static int peephole(ir_t *ir) {
+  ir_instr_t *in = ir->instr;
+  ir_instr_t *out = (ir_instr_t *)malloc((ir->n + 1) * sizeof(ir_instr_t));
+  for (int i = 0; i < ir->n; i++) out[i] = in[i];
+
+  int changed = 0;
+  for (int i = 0; i < ir->n; i++)
+    if (out[i].op == in[i].op && out[i].arg == in[i].arg &&
+        peephole_rule(in, out, i, ir->n, ir->leader))
+      changed = 1;
+
+  ir->instr = out;
+  free(in);
+  ir_compact(ir);
+  return changed;
+}
+
+/* ----------------------------------------------------------------------------
+ * variables at constant addresses as registers: `PUSHC a, FBASE, LDC` becomes
+ * `LDL a`, `PUSHC a, LDC` becomes `LDG a`, and the same for stores
+ */
+static int fuse_memory_access(ir_t *ir) {
+  ir_instr_t *in = ir->instr;
+  int changed = 0;
+  for (int i = 0; i + 1 < ir->n; i++) {
+    if (!is_const(&in[i]) || ir->leader[i + 1]) continue;
+    int frame = in[i + 1].op == FBASE, k = i + 1 + frame;
+    if (k >= ir->n || ir->leader[k]) continue;
+    int op;
+    if (in[k].op == LDC)
+      op = frame ? LDL : LDG;
+    else if (in[k].op == STC)
+      op = frame ? STL : STG;
+    else
+      continue;
+    in[i].op = op;
+    for (int j = i + 1; j <= k; j++) in[j].op = IR_DELETED;
+    changed = 1;
+    i = k;
+  }
+  ir_compact(ir);
+  return changed;
+}
+
+/* ----------------------------------------------------------------------------
+ * three-operand arithmetic on frame slots: `LDL b, LDL a, op, STL d` becomes
+ * `ALU3` (see Frame slots in code.h), the same with `LDG`, `STG`; `b` may
+ * also be a `PUSHB` constant, and for commutative operations `a`
+ */
+
+// the slot of a load or a store at a 4B-aligned address below 1KB, or -1
+static int slot(ir_instr_t *in, int load, int frame) {
+  if (in->op != (load ? (frame ? LDL : LDG) : (frame ? STL : STG))) return -1;
+  return (in->arg >= 0 && in->arg < 1024 && in->arg % 4 == 0) ? in->arg / 4
+                                                              : -1;
+}
+
+static int fuse_alu3(ir_t *ir) {
+  static const uint8_t ops[] = ALU3_OPS;
+  ir_instr_t *in = ir->instr;
+  int changed = 0;
+  for (int i = 0; i + 3 < ir->n; i++) {
+    if (ir->leader[i + 1] || ir->leader[i + 2] || ir->leader[i + 3]) continue;
+    int k = 0;
+    while (k < (int)sizeof(ops) && ops[k] != in[i + 2].op) k++;
+    if (k == sizeof(ops)) continue;
+    int frame = in[i + 3].op == STL;
+    int d = slot(&in[i + 3], 0, frame), a = slot(&in[i + 1], 1, frame),
+        b = slot(&in[i], 1, frame), flags = frame ? ALU3_FRAME : 0;
+    if (b < 0 && in[i].op == PUSHB) {
+      b = in[i].arg;
+      flags |= ALU3_CONST;
+    } else if (a < 0 && in[i + 1].op == PUSHB && k < ALU3_COMMUTATIVE &&
+               b >= 0) {
+      // a commutative operation with the constant on top
+      a = b;
+      b = in[i + 1].arg;
+      flags |= ALU3_CONST;
+    }
+    if (d < 0 || a < 0 || b < 0) continue;
+    in[i].op = ALU3;
+    in[i].arg = (int32_t)((uint32_t)b << 24 | a << 16 | d << 8 | flags | k);
+    for (int j = i + 1; j <= i + 3; j++) in[j].op = IR_DELETED;
+    changed = 1;
+    i += 3;
+  }
+  ir_compact(ir);
+  return changed;
+}
+
+/* ----------------------------------------------------------------------------
+ * array elements: the header of an array does not change, so the address
+ * computation of an element `S2A, IDX n, PUSHC s, MULT_INT, A2S, POPA, LDC,
+ * ADD_INT` (as emitted by the code generation) becomes `IDXA (s << 8 | n)`;
+ * with `IDX_NC` the flag IDXA_NO_CHECK is added
+ */
+static int fuse_array_access(ir_t *ir) {
+  static const int seq[] = {S2A,  IDX, PUSHC, MULT_INT,
+                            A2S, POPA, LDC,   ADD_INT};
+  const int len = sizeof(seq) / sizeof(seq[0]);
+  ir_instr_t *in = ir->instr;
+  int changed = 0;
+  for (int i = 0; i + len <= ir->n; i++) {
+    int k = 0;
+    while (k < len &&
+           (in[i + k].op == seq[k] || (k == 1 && in[i + k].op == IDX_NC)) &&
+           (k == 0 || !ir->leader[i + k]))
+      k++;
+    if (k < len || in[i + 2].arg <= 0 || in[i + 2].arg >= (1 << 23)) continue;
+    uint32_t d = (in[i + 2].arg << 8) | in[i + 1].arg;
+    if (in[i + 1].op == IDX_NC) d |= IDXA_NO_CHECK;
+    in[i].op = IDXA;
+    in[i].arg = (int32_t)d;
+    for (int j = 1; j < len; j++) in[i + j].op = IR_DELETED;
+    changed = 1;
+    i += len - 1;
+  }
+  ir_compact(ir);
+  return changed;
+}
+
+/* ----------------------------------------------------------------------------
+ * registers (see Register encoding in code.h): the values the stack code
+ * keeps on the op stack between the loads of slots and the arithmetic on
+ * them are kept in registers
+ *
+ * a basic block is read with a model of the top of the op stack: a load of a
+ * slot (`LDL`, `LDG`) or a `PUSHB` is not emitted, the value becomes an
+ * operand in the model; an operation of ALU3_OPS on two operands of the model
+ * is emitted as `ALUR` to a free register, which is the new operand, and a
+ * store of the register just computed turns the `ALUR` into `ALU3`; any other
+ * instruction takes its operands from the stack, so the operands of the model
+ * are pushed first (`LDL`, `LDG`, `PUSHB`, `PUSHR`), in their order; before a
+ * store, the loads not emitted yet are pushed, so they read the old value
+ *
+ * each instruction counts in W as the stack code it replaces, so W and T do
+ * not change
+ */
+
+// an operand in the model of the stack
+typedef struct {
+  enum { OPND_SLOT, OPND_CONST, OPND_REG } kind;
+  int frame;  // a slot relative to the frame base (`LDL`)
+  int v;      // the slot (address / 4), the constant, or the register
+} operand_t;
+
+typedef struct {
+  ir_instr_t *out;  // the code emitted so far
+  int n_out;
+  operand_t *top;  // the model, from the bottom (the stack below is real)
+  int n_top;
+  uint8_t busy[NUM_REGISTERS];
+  int alur;  // the last instruction emitted if it is an `ALUR`, or -1
+} registers_t;
+
+static void emit_instr(registers_t *s, int op, int32_t arg) {
+  s->out[s->n_out].op = op;
+  s->out[s->n_out].arg = arg;
+  s->n_out++;
+  s->alur = -1;
+}
+
+// push the `n` operands at the bottom of the model to the stack
+static void push_operands(registers_t *s, int n) {
+  for (int i = 0; i < n; i++) {
+    operand_t *o = &s->top[i];
+    if (o->kind == OPND_SLOT)
+      emit_instr(s, o->frame ? LDL : LDG, 4 * o->v);
+    else if (o->kind == OPND_CONST)
+      emit_instr(s, PUSHB, o->v);
+    else {
+      emit_instr(s, PUSHR, o->v);
+      s->busy[o->v] = 0;
+    }
+  }
+  s->n_top -= n;
+  memmove(s->top, s->top + n, s->n_top * sizeof(operand_t));
+}
+
+// push the loads of slots (and the operands below them) before a store
+static void push_loads(registers_t *s, int n) {
+  int k = n;
+  while (k > 0 && s->top[k - 1].kind != OPND_SLOT) k--;
+  push_operands(s, k);
+}
+
+// the slot of a load or a store (as in fuse_alu3), or -1
+static int reg_slot(ir_instr_t *in) {
+  if (in->op != LDL && in->op != LDG && in->op != STL && in->op != STG)
+    return -1;
+  return slot(in, in->op == LDL || in->op == LDG,
+              in->op == LDL || in->op == STL);
+}
+
+// the operation `k` of ALU3_OPS on the two operands on the top of the
+// model, to a new register; 0 if it cannot be encoded
+static int emit_alur(registers_t *s, int k) {
+  operand_t a = s->top[s->n_top - 1], b = s->top[s->n_top - 2];
+  if (a.kind == OPND_CONST) {
+    if (k >= ALU3_COMMUTATIVE || b.kind == OPND_CONST) return 0;
+    operand_t t = a;
+    a = b;
+    b = t;
+  }
+  if (a.kind == OPND_SLOT && b.kind == OPND_SLOT && a.frame != b.frame)
+    return 0;
+  int frame = (a.kind == OPND_SLOT)   ? a.frame
+              : (b.kind == OPND_SLOT) ? b.frame
+                                      : 0;
+  if (a.kind == OPND_REG) s->busy[a.v] = 0;
+  if (b.kind == OPND_REG) s->busy[b.v] = 0;
+  int d = 0;
+  while (d < NUM_REGISTERS && s->busy[d]) d++;
+  if (d == NUM_REGISTERS) {
+    if (a.kind == OPND_REG) s->busy[a.v] = 1;
+    if (b.kind == OPND_REG) s->busy[b.v] = 1;
+    return 0;
+  }
+  uint32_t x = k | (frame ? ALU3_FRAME : 0) |
+               (a.kind == OPND_REG ? ALU3_AREG : 0) |
+               (b.kind == OPND_REG ? ALU3_BREG : 0) |
+               (b.kind == OPND_CONST ? ALU3_CONST : 0);
+  emit_instr(s, ALUR, (int32_t)((uint32_t)b.v << 24 | a.v << 16 | d << 8 | x));
+  s->alur = s->n_out - 1;
+  s->busy[d] = 1;
+  s->n_top -= 2;
+  s->top[s->n_top].kind = OPND_REG;
+  s->top[s->n_top].v = d;
+  s->n_top++;
+  return 1;
+}
+
+// the store `in` of the register on the top of the model computed by the
+// last `ALUR`, which becomes `ALU3`; 0 if it cannot be encoded
+static int fold_store(registers_t *s, ir_instr_t *in) {
+  int d = reg_slot(in), frame = (in->op == STL);
+  if (d < 0 || s->alur < 0 || s->n_top == 0 ||
+      s->top[s->n_top - 1].kind != OPND_REG)
+    return 0;
+  for (int i = 0; i < s->n_top - 1; i++)
+    if (s->top[i].kind == OPND_SLOT) return 0;
+  ir_instr_t *alur = &s->out[s->alur];
+  uint32_t x = alur->arg;
+  // the slot operands are in the same memory as the store
+  int slots = !(x & ALU3_AREG) || (!(x & ALU3_BREG) && !(x & ALU3_CONST));
+  if (slots && !(x & ALU3_FRAME) != !frame) return 0;
+  s->busy[(x >> 8) & 0xff] = 0;
+  x = (x & ~(0xffU << 8 | ALU3_FRAME)) | (uint32_t)d << 8 |
+      (frame ? ALU3_FRAME : 0);
+  alur->op = ALU3;
+  alur->arg = (int32_t)x;
+  s->alur = -1;
+  s->n_top--;
+  return 1;
+}
+
+static void allocate_registers(ir_t *ir) {
+  static const uint8_t ops[] = ALU3_OPS;
+  registers_t s;
+  memset(&s, 0, sizeof(s));
+  // each instruction emits at most itself and the operands of the model
+  s.out = (ir_instr_t *)malloc((2 * ir->n + 1) * sizeof(ir_instr_t));
+  s.top = (operand_t *)malloc((ir->n + 1) * sizeof(operand_t));
+  int *idx = (int *)malloc((ir->n + 1) * sizeof(int));
+
+  for (int i = 0; i < ir->n; i++) {
+    ir_instr_t *in = &ir->instr[i];
+    if (ir->leader[i]) {
+      push_operands(&s, s.n_top);
+      s.alur = -1;
+    }
+    idx[i] = s.n_out;
+    int k = 0;
+    while (k < (int)sizeof(ops) && ops[k] != in->op) k++;
+    if ((in->op == LDL || in->op == LDG) && reg_slot(in) >= 0) {
+      s.top[s.n_top].kind = OPND_SLOT;
+      s.top[s.n_top].frame = (in->op == LDL);
+      s.top[s.n_top++].v = reg_slot(in);
+    } else if (in->op == PUSHB) {
+      s.top[s.n_top].kind = OPND_CONST;
+      s.top[s.n_top++].v = in->arg;
+    } else if (!(k < (int)sizeof(ops) && s.n_top >= 2 && emit_alur(&s, k)) &&
+               !((in->op == STL || in->op == STG) && fold_store(&s, in))) {
+      // ALU3 writes memory, the other instructions use the stack
+      if (in->op == ALU3)
+        push_loads(&s, s.n_top);
+      else
+        push_operands(&s, s.n_top);
+      emit_instr(&s, in->op, in->arg);
+    }
+  }
+  push_operands(&s, s.n_top);
+  idx[ir->n] = s.n_out;
+  ir_replace(ir, s.out, s.n_out, idx);
+  free(s.top);
+  free(idx);
+}
+
+/* ----------------------------------------------------------------------------
+ * pass manager
+ */
+
+//! pass over the ast
+typedef struct {
+  int level;  //!< minimal optimization level the pass is run at
+  void (*run)(ast_t *ast);
+} ast_pass_t;
+
+//! pass over the generated code; returns 1 if it changed the code
+typedef struct {
+  int level;  //!< minimal optimization level the pass is run at
+  int (*run)(ir_t *ir);
+} code_pass_t;
+
+static const ast_pass_t ast_passes[] = {
+    {1, fold_constants},          {2, inline_functions},
+    {2, fold_constants},          {2, fuse_pardos},
+    {1, remove_unused_functions}, {1, check_bounds},
+    {1, check_exclusive},         {1, check_uniform},
+    {1, hoist_rows},              {0, NULL}};
+
+static const code_pass_t code_passes[] = {
+    {1, fuse_array_access}, {1, peephole}, {1, fuse_memory_access},
+    {1, fuse_alu3},         {0, NULL}};
+
+void optimize_ast(ast_t *ast, int level) {
+  for (int i = 0; ast_passes[i].run; i++)
+    if (level >= ast_passes[i].level) ast_passes[i].run(ast);
+}
+
+void optimize_code(code_block_t *code, ast_t *ast, ast_node_t *fn, int level,
+                   int regs) {
+  ir_t *ir = ir_t_new(code, ast, fn);
+  // run the passes as long as some of them changes the code
+  for (int changed = 1; changed;) {
+    changed = 0;
+    for (int i = 0; code_passes[i].run; i++)
+      if (level >= code_passes[i].level && code_passes[i].run(ir))
+        changed = 1;
+  }
+  if (regs) allocate_registers(ir);
+  ir_lower(ir, code);
+  ir_t_delete(ir);
+}
@@ -0,0 +1,208 @@
+/**
+ * @file optimize.h
+ * @brief optimizing transformations of the AST and of the generated code
+ *
+ * The passes work in place on a correctly parsed ast_t (and the code block
+ * generated from it). They do not change the observable behaviour of the
+ * program, only remove work from the generated code. Which passes run is
+ * given by the optimization level (`wtc -O0`, `-O1`, `-O2`).
+ */
+#ifndef __OPTIMIZE_H__
+#define __OPTIMIZE_H__
+
+#include <ast.h>
+#include <code_generation.h>
+
+/**
+ * @brief fold constant subexpressions
+ *
+ * Expressions over `int` and `float` literals (arithmetic, comparisons,
+ * logical operators and casts) are replaced by literals computed in the same
+ * way as the virtual machine would compute them; so are comparisons of `char`
+ * literals and casts from and to `char` (a cast to `char` only if the value
+ * fits in it). Identity operations (`x+0`, `x-0`, `x*1`, `x/1`, ...) are
+ * replaced by their operand.
+ *
+ * Constant conditions of `if`, `while`, `do` and `for` are left as literals;
+ * at level 1 and above the code generation uses them to emit only the taken
+ * branch, without `SPLIT`.
+ */
+void fold_constants(ast_t *ast);
+
+//! if `node` is an integral literal, return 1 and store its value to `val`
+int literal_int_value(ast_node_t *node, int32_t *val);
+
+//! 1 if the node is a `return` statement; the rest of its scope is not
+//! emitted at level 1 and above
+int is_return(ast_node_t *node);
+
+/**
+ * @brief remove functions that are never called
+ *
+ * Functions not reachable by calls from the root scope (ignoring the code that
+ * is not emitted) are unlinked from `ast->functions` and deleted, so they get
+ * no code, no entry in the FNMAP and no debug info.
+ */
+void remove_unused_functions(ast_t *ast);
+
+/**
+ * @brief inline calls of small functions
+ *
+ * A function whose body is a single `return e;` with `e` free of side effects
+ * and calls, and with `int` or `float` parameters and result, is inlined if
+ * `e` has at most #inline_limit nodes or the function is declared `inline`.
+ * Arguments must have the types of the parameters and no side effects; an
+ * argument other than a literal or a variable is only substituted for a
+ * parameter used exactly once.
+ *
+ * Other functions of at most #inline_limit nodes (or declared `inline`) get a
+ * copy in the call (`inlined` of expr_function_t), if each of their returns
+ * ends a branch of the body: it is not in a loop or pardo, and the statements
+ * after it in its scope are not reached, or follow an `if` without else whose
+ * branch returns (they are its else, see returns_early()). A function with a
+ * result must return on every path. The code generation emits the copy
+ * instead of `CALL`: the parameters and variables get addresses in the frame
+ * of the caller after all of its variables, the arguments are stored to the
+ * parameters, and each return leaves its value on the stack and ends the
+ * code of its threads (no `SETR`). Calls in the copy are inlined in the same
+ * way, except calls of the functions being inlined or compiled (recursion).
+ *
+ * A function declared `inline` that cannot be inlined gets a warning (once).
+ */
+void inline_functions(ast_t *ast);
+
+//! 1 if every path through the statement ends by a `return`
+int always_returns(ast_node_t *node);
+
+//! 1 if the node is an `if` without else whose branch always returns; in an
+//! inlined function, the statements after it are emitted as its else
+int returns_early(ast_node_t *node);
+
+//! size limit (number of expression nodes) of functions inlined without the
+//! `inline` keyword (set by `wtc -inline n`)
+extern int inline_limit;
+
+/**
+ * @brief fuse adjacent pardo statements over the same range
+ *
+ * `pardo (i : e) S1; pardo (j : e) S2;` becomes one pardo with S1 followed by
+ * S2 (using `i` instead of `j`). The threads run in lockstep, so all of them
+ * finish S1 before S2 starts. The range expressions must be structurally
+ * equal and free of side effects, and S1 must not change the variables they
+ * read (nor call a function if they read any) or the driving variable.
+ */
+void fuse_pardos(ast_t *ast);
+
+/**
+ * @brief mark array accesses that cannot fail the range check
+ *
+ * In the body of `pardo (i : a.size(d))` and of
+ * `for (int i = c; i < a.size(d); i++)` (`c` a non-negative literal, the step
+ * may also be `++i` or `i += 1`) that does not change `i`, the value of `i` is
+ * a valid index of `a` in dimension `d`. An element `a[i1,...,in]` where
+ * every `ik` is such a variable for dimension `k` of `a` gets `in_bounds` set,
+ * and the code generation emits `IDX_NC` instead of `IDX` (see code.h).
+ * Other accesses keep the checks.
+ */
+void check_bounds(ast_t *ast);
+
+/**
+ * @brief mark array accesses that cannot conflict between threads
+ *
+ * A pardo in the root scope that is not nested in another pardo is started
+ * by one thread, so its threads have distinct values of the driving variable
+ * `i` (if the body does not change `i`). An element `a[...,i,...]` accessed in
+ * the body (outside nested pardos) is then at a different address for every
+ * thread executing the instruction; it gets `exclusive` set, and the code
+ * generation loads and stores it by the `_NC` variants of `LDCH`, `LDBH`,
+ * `STCH`, `STBH` that skip the EREW/CREW check (see code.h). All other
+ * accesses stay checked.
+ */
+void check_exclusive(ast_t *ast);
+
+/**
+ * @brief mark conditions and values that are the same in all threads
+ *
+ * The condition of an `if`, `while`, `do` or `for` statement gets `uniform`
+ * set if it is built from literals and uniform variables by operators without
+ * side effects. Uniform are the variables of the root scope outside pardo
+ * (read by all threads from the memory of the main thread), scalar variables
+ * with a uniform initializer that are not changed later in their scope, and
+ * the variable of a `for` loop with a uniform initializer and condition,
+ * changed only by the step to a uniform value (`k++`, `k += u`, ...). All
+ * conditions of the root scope outside pardo are uniform, as the main thread
+ * runs them alone. The code generation tests a uniform condition by `JMPZ`
+ * instead of `SPLIT` and `JOIN` (see code.h).
+ *
+ * In the code run by more threads (pardo bodies and functions), the largest
+ * uniform subexpressions other than bare literals get `uniform` set (except
+ * in the EREW mode); the code generation lets one thread compute them for
+ * the group by `UNIFORM` (see Uniform values in code.h).
+ */
+void check_uniform(ast_t *ast);
+
+/**
+ * @brief hoist the rows of array elements out of loops
+ *
+ * In a `for` or `while` loop (other than one with a literal condition or
+ * containing a pardo, whose threads would get memory above the rows), an
+ * element `a[i1,...,in]` (`n >= 2`) whose array and the variables of
+ * `i1`..`i(n-1)` are declared outside the loop and not changed in it (nor by
+ * a called function, if there are any variables) gets `row` set, numbered
+ * from `row` of the loop; the indices must be `int` literals and variables
+ * combined by `+`, `-` and `*`, which cannot fail. Elements of the same row
+ * share the number. The code generation computes the rows before the loop by
+ * `ROW` and the elements by `IDXR` from the last index (see code.h). Loops
+ * are visited from the outermost, so a row is hoisted as far as it can be.
+ * Not done in the EREW mode, where every access reads the header.
+ */
+void hoist_rows(ast_t *ast);
+
+/**
+ * @brief run the passes over the ast enabled at the optimization `level`
+ *
+ * level | passes
+ * ------|------------------------------------------------
+ *   0   | none
+ *   1   | fold_constants(), remove_unused_functions(), check_bounds(), check_exclusive(), check_uniform(), hoist_rows()
+ *   2   | as 1, and inline_functions(), fold_constants(), fuse_pardos() before remove_unused_functions()
+ */
+void optimize_ast(ast_t *ast, int level);
+
+/**
+ * @brief run the passes over the generated code enabled at `level`
+ *
+ * `code` is one part of the program: the main scope of `ast` (`fn` is NULL)
+ * or the function `fn` (see #ir_t_new). The passes only change basic blocks,
+ * so the parts are optimized separately. The code is decoded to the ir.h
+ * representation, the passes are repeated while some of them changes the
+ * code, and the result is lowered back to `code`. The code ranges of the ast
+ * nodes of the part are updated.
+ *
+ * level | passes
+ * ------|------------------------------------------------
+ *   0   | none
+ *   1   | fusing of array accesses, peephole, fusing of memory accesses and arithmetic
+ *   2   | as 1
+ *
+ * The peephole pass removes no-op sequences (`PUSHC c, POP`, `S2A, POP, A2S,
+ * POPA`, `MEM_MARK, MEM_FREE`, ...), folds arithmetic on two constants and
+ * truncations of a constant, and replaces moving a value through the acc_stack
+ * by `SWS` or by pushing the constant again. The fusing replaces loads and
+ * stores of variables at constant addresses by `LDL`, `STL`, `LDG`, `STG` (see
+ * code.h), and an operation on two such variables (or a variable and a small
+ * constant) stored to a third by `ALU3`. Array headers do not change after the
+ * array is created, so the address computation of an array element (header
+ * reads, dimension and range checks, row-major offset, scaling and the base
+ * address) is one `IDXA` instruction.
+ *
+ * With `regs`, the code is then written in the register encoding (see code.h):
+ * within a basic block, the loads of slots and small constants are kept as
+ * operands of the arithmetic, which computes to registers (`ALUR`) or to a
+ * slot (`ALU3`), and `PUSHR` moves a register to the stack for the other
+ * instructions. Only the loads of slots from level 1 become operands.
+ */
+void optimize_code(code_block_t *code, ast_t *ast, ast_node_t *fn, int level,
+                   int regs);
+
+#endif
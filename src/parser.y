@@ -21,8 +21,10 @@
 
 %code provides {
    #define YY_DECL \
-       int yylex(YYSTYPE * yylval_param, YYLTYPE * yylloc_param, ast_t* ast)
+       int yylex_r(YYSTYPE * yylval_param, YYLTYPE * yylloc_param, \
+                   void *yyscanner)
    YY_DECL;
+   int yylex(YYSTYPE * yylval_param, YYLTYPE * yylloc_param, ast_t* ast);
   void yyerror (YYLTYPE *yylloc, ast_t *, char const *, ...);
   #include <parser_utils.c>
 
@@ -53,7 +55,7 @@
 %token <string_val>       STRING_LITERAL IDENT 
 %token <static_type_val>  TYPENAME
 
-%token TYPE INPUT OUTPUT IF ELSE FOR WHILE PARDO DO RETURN SIZE DIM SORT MODE_CREW MODE_EREW MODE_CCRCW
+%token TYPE INPUT OUTPUT IF ELSE FOR WHILE PARDO DO RETURN SIZE DIM SORT MODE_CREW MODE_EREW MODE_CCRCW INLINE
 
 %token < > EQ "=="
 %token < > NEQ "!="
@@ -375,6 +377,9 @@ static_variable_declarator: IDENT
       it is possible to have separate declaration    
   
       <output_type> <function_name> ( <param_1> , .... , <param_n> ) ;
+
+      the keyword `inline` before the definition asks for inlining the calls
+      regardless of the size (with -O2, see optimize.h)
   
   */
 
@@ -395,7 +400,7 @@ function_declaration
       maybe_scope_item_list '}'
          {
            ast->current_scope=$<ast_node_val>3->val.sc->parent;
-           free($<ast_node_val>3);
+           ast_free($<ast_node_val>3);
          }
 
 
@@ -406,6 +411,13 @@ open_function:
         $2=NULL;
       }
     |
+    INLINE type_decl IDENT '(' parameter_declarator_list ')'
+      {
+        $$=define_function(ast,&@$,$2,$3,&@3,$5);
+        $3=NULL;
+        if ($$) $$->val.f->inline_hint=1;
+      }
+    |
     error ')' {$$=NULL;}
     ;
 
@@ -724,6 +736,12 @@ expr_primary:
         }
         $1=NULL;
       }
+    |
+    IDENT '[' expr_assign ':' expr_assign ']'
+      {
+        $$=expression_slice(ast,&@$,$1,$3,$5);
+        $1=NULL;
+      }
     | 
     SORT '(' IDENT ',' specifier_list ')' {
       $$ = expression_sort(ast,&@$,$3,$5);
@@ -771,24 +789,24 @@ expr_literal:
     INT_LITERAL
       {
         $$=ast_node_t_new(&@$, AST_NODE_EXPRESSION, EXPR_LITERAL);
-        $$->val.e->type->type = __type__int->val.t;
-        $$->val.e->val.l = malloc(sizeof(int));
+        $$->val.e->type->type = ast->type_int->val.t;
+        $$->val.e->val.l = ast_alloc(sizeof(int));
         *((int *)($$->val.e->val.l)) = $1;
       }
     |
     FLOAT_LITERAL 
       {
         $$=ast_node_t_new(&@$, AST_NODE_EXPRESSION, EXPR_LITERAL);
-        $$->val.e->type->type = __type__float->val.t;
-        $$->val.e->val.l = malloc(sizeof(float));
+        $$->val.e->type->type = ast->type_float->val.t;
+        $$->val.e->val.l = ast_alloc(sizeof(float));
         *((float *)($$->val.e->val.l)) = $1;
       }
     | 
     CHAR_LITERAL 
       {
         $$=ast_node_t_new(&@$, AST_NODE_EXPRESSION, EXPR_LITERAL);
-        $$->val.e->type->type = __type__char->val.t;
-        $$->val.e->val.l = malloc(1);
+        $$->val.e->type->type = ast->type_char->val.t;
+        $$->val.e->val.l = ast_alloc(1);
         *((char *)($$->val.e->val.l)) = $1;
       }
     ;
@@ -805,15 +823,15 @@ initializer_list
                     for(int i=strlen($1)-1;i>=0;--i) {
                         ast_node_t *tmp =
                               ast_node_t_new(NULL, AST_NODE_EXPRESSION, EXPR_LITERAL);
-                        tmp->val.e->type->type = __type__char->val.t;
-                        tmp->val.e->val.l = malloc(1);
+                        tmp->val.e->type->type = ast->type_char->val.t;
+                        tmp->val.e->val.l = ast_alloc(1);
                         *(char *)(tmp->val.e->val.l) = $1[i];
                         tmp->next=$$->val.e->val.i;
                         $$->val.e->val.i=tmp;
 
-                        ALLOC_VAR(t,inferred_type_t);
+                        inferred_type_t *t = inferred_type_t_new();
                         t->compound=0;
-                        t->type=__type__char->val.t;
+                        t->type=ast->type_char->val.t;
 
                         inferred_type_item_t *tt= inferred_type_item_t_new(t);
                         tt->next=$$->val.e->type->list;
@@ -825,7 +843,7 @@ initializer_list
                     $$=$1;
                     inferred_type_append($$->val.e->type,$3->val.e->type);
                     append(ast_node_t,&($$->val.e->val.i),$3->val.e->val.i);
-                    free($3);
+                    ast_free($3);
                   }
                 | error ',' initializer_item {$$=$3;}
                 ;
@@ -844,7 +862,7 @@ initializer_item
       { 
         inferred_type_item_t *t =inferred_type_item_t_new($2->val.e->type);
         
-        ALLOC_VAR(nt,inferred_type_t);
+        inferred_type_t *nt = inferred_type_t_new();
 
         $2->val.e->type = nt;
         $2->val.e->type->compound = 1;
@@ -883,7 +901,7 @@ stmt_scope
             {
               $$=$<ast_node_val>2;
               ast->current_scope=$$->val.sc->parent;
-              append(ast_node_t,&ast->current_scope->items,$$);
+              scope_append(ast,ast->current_scope,$$);
             }
   
             | '{' '}' {$$=NULL;}
@@ -897,7 +915,7 @@ scope_item
 stmt_expr 
          : expr ';' 
          {
-            append(ast_node_t,&ast->current_scope->items,$1);
+            scope_append(ast,ast->current_scope,$1);
          }
     ;
 
@@ -912,14 +930,14 @@ stmt_cond
           }
           stmt maybe_else {
             ast->current_scope=ast->current_scope->parent;
-            append(ast_node_t,&ast->current_scope->items,$<ast_node_val>5);
+            scope_append(ast,ast->current_scope,$<ast_node_val>5);
           }
          ;
 
 maybe_else 
           : %empty  
             {
-                append(ast_node_t,&ast->current_scope->items,
+                scope_append(ast,ast->current_scope,
                       ast_node_t_new(&@$,AST_NODE_EXPRESSION,EXPR_EMPTY));
             }
           | ELSE stmt ;
@@ -935,7 +953,7 @@ stmt_iter
           }
           stmt {
             ast->current_scope=ast->current_scope->parent;
-            append(ast_node_t,&ast->current_scope->items,$<ast_node_val>5);
+            scope_append(ast,ast->current_scope,$<ast_node_val>5);
           }
          | DO 
           {
@@ -948,7 +966,7 @@ stmt_iter
           {
             $<ast_node_val>2->val.s->par[0]=$6;
             ast->current_scope=ast->current_scope->parent;
-            append(ast_node_t,&ast->current_scope->items,$<ast_node_val>2);
+            scope_append(ast,ast->current_scope,$<ast_node_val>2);
           }
          |  FOR '('  
             {
@@ -960,7 +978,7 @@ stmt_iter
               ast_node_t *n =ast_node_t_new(&@$,AST_NODE_STATEMENT,STMT_FOR);
               ast->current_scope=$<ast_node_val>3->val.sc->parent;
               n->val.s->par[0]=$<ast_node_val>3;
-              append(ast_node_t,&ast->current_scope->items,n);
+              scope_append(ast,ast->current_scope,n);
             }
          | PARDO '(' IDENT ':'
             {
@@ -968,7 +986,7 @@ stmt_iter
               ast->current_scope=$<ast_node_val>$->val.sc;
 
               ast_node_t *v = init_variable(ast,&@3,$3);
-              v->val.v->base_type=__type__int->val.t;
+              v->val.v->base_type=ast->type_int->val.t;
               append_variables(ast,v);
               $3=NULL;
             } 
@@ -978,7 +996,7 @@ stmt_iter
               ast->current_scope=$<ast_node_val>5->val.sc->parent;
               n->val.s->par[0]=$<ast_node_val>5;
               n->val.s->par[1]=$6;
-              append(ast_node_t,&ast->current_scope->items,n);
+              scope_append(ast,ast->current_scope,n);
             }
          ;
 
@@ -987,11 +1005,11 @@ for_stmt: ';' | stmt;
 for_specifier
              : first_for_item expr ';' maybe_expr ')'
                 {
-                  append(ast_node_t,&ast->current_scope->items,$2);
+                  scope_append(ast,ast->current_scope,$2);
                   if ($4) {
-                    append(ast_node_t,&ast->current_scope->items,$4);
+                    scope_append(ast,ast->current_scope,$4);
                   } else {
-                    append(ast_node_t,&ast->current_scope->items,
+                    scope_append(ast,ast->current_scope,
                         ast_node_t_new(&@$,AST_NODE_EXPRESSION,EXPR_EMPTY));
                   }
                 }
@@ -1003,7 +1021,7 @@ first_for_item
               | variable_declaration  
               | ';' 
                 {
-                  append(ast_node_t,&ast->current_scope->items,
+                  scope_append(ast,ast->current_scope,
                     ast_node_t_new(&@$,AST_NODE_EXPRESSION,EXPR_EMPTY)
                   );
                 }  
@@ -1014,7 +1032,7 @@ stmt_jump
           {
             ast_node_t * n=ast_node_t_new(&@$,AST_NODE_STATEMENT,STMT_RETURN);
             n->val.s->par[0]=$2;
-            append(ast_node_t,&ast->current_scope->items,n);
+            scope_append(ast,ast->current_scope,n);
             n->val.s->ret_fn=ast->current_scope->fn;
           }
           |
@@ -1022,14 +1040,14 @@ stmt_jump
             ast_node_t * n=ast_node_t_new(&@$,AST_NODE_STATEMENT,STMT_BREAKPOINT);
             n->val.s->tag=$1;
             n->val.s->par[0]=expression_int_val(1);
-            append(ast_node_t,&ast->current_scope->items,n);
+            scope_append(ast,ast->current_scope,n);
           }
           |
           BREAKPOINT '(' expr ')' {
             ast_node_t * n=ast_node_t_new(&@$,AST_NODE_STATEMENT,STMT_BREAKPOINT);
             n->val.s->tag=$1;
             n->val.s->par[0]=$3;
-            append(ast_node_t,&ast->current_scope->items,n);
+            scope_append(ast,ast->current_scope,n);
           }
          ;
 
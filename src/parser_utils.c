@@ -9,7 +9,7 @@
 
 void ignore(); //!< don't fret about unused values
 
-//! add basic types as global constants
+//! add basic types as constants of the ast
 void add_basic_types(ast_t *ast);
 
 //! add built-in functions into ast_t
@@ -58,6 +58,10 @@ ast_node_t *expression_sizeof(ast_t *ast, YYLTYPE *loc, char *name,
 //! set the dimensions of an array variable
 ast_node_t *array_dimensions(ast_t *ast, YYLTYPE *loc, char *name);
 
+//! parse slice expression
+ast_node_t *expression_slice(ast_t *ast, YYLTYPE *loc, char *name,
+                             ast_node_t *l, ast_node_t *r);
+
 //! set the list of array indices
 int add_expression_array_parameters(ast_node_t *ve, ast_node_t *p);
 
@@ -82,29 +86,30 @@ int fix_expression_type(ast_t *ast, YYLTYPE *loc, ast_node_t *node);
 void ignore(void *i) {}  
 
 #define ADD_STATIC_TYPEDEF(typename, nbytes)                         \
-  __type__##typename =                                               \
+  ast->type_##typename =                                             \
       ast_node_t_new(NULL, AST_NODE_STATIC_TYPE, strdup(#typename)); \
-  __type__##typename->val.t->size = nbytes;                          \
-  append(ast_node_t, &ast->types, __type__##typename);
-
-ast_node_t *__type__int = NULL, *__type__float = NULL, *__type__void = NULL,
-           *__type__char = NULL;
+  ast->type_##typename->val.t->size = nbytes;                        \
+  ast_append_type(ast, ast->type_##typename);
 
-// add basic types as global constants
+// add basic types as constants of the ast
 void add_basic_types(ast_t *ast) {
   ADD_STATIC_TYPEDEF(int, 4)
   ADD_STATIC_TYPEDEF(float, 4)
   ADD_STATIC_TYPEDEF(void, 0)
   ADD_STATIC_TYPEDEF(char, 1)
+  ADD_STATIC_TYPEDEF(int8, 1)
+  ADD_STATIC_TYPEDEF(int16, 2)
+  ADD_STATIC_TYPEDEF(int64, 8)
 }
 
 #define NEW_BUILTIN_FUNCTION(name, outtype)            \
   fn = ast_node_t_new(NULL, AST_NODE_FUNCTION, #name); \
-  fn->val.f->out_type = __type__##outtype->val.t;
+  fn->val.f->out_type = ast->type_##outtype->val.t;    \
+  fn->val.f->builtin = 1;
 
 #define BUILTIN_PARAM(name, typename)                 \
   p = ast_node_t_new(NULL, AST_NODE_VARIABLE, #name); \
-  p->val.v->base_type = __type__##typename->val.t;    \
+  p->val.v->base_type = ast->type_##typename->val.t;  \
   append(ast_node_t, &fn->val.f->params, p);
 
 // add built-in functions into ast_t
@@ -113,19 +118,29 @@ void add_builtin_functions(ast_t *ast) {
 
   NEW_BUILTIN_FUNCTION(sqrtf, float)
   BUILTIN_PARAM(x, float)
-  append(ast_node_t, &ast->functions, fn);
+  ast_append_function(ast, fn);
 
   NEW_BUILTIN_FUNCTION(sqrt, int)
   BUILTIN_PARAM(x, int)
-  append(ast_node_t, &ast->functions, fn);
+  ast_append_function(ast, fn);
 
   NEW_BUILTIN_FUNCTION(logf, float)
   BUILTIN_PARAM(x, float)
-  append(ast_node_t, &ast->functions, fn);
+  ast_append_function(ast, fn);
 
   NEW_BUILTIN_FUNCTION(log, int)
   BUILTIN_PARAM(x, int)
-  append(ast_node_t, &ast->functions, fn);
+  ast_append_function(ast, fn);
+
+  NEW_BUILTIN_FUNCTION(philox_rand, int)
+  BUILTIN_PARAM(seed, int)
+  BUILTIN_PARAM(counter, int)
+  ast_append_function(ast, fn);
+
+  NEW_BUILTIN_FUNCTION(philox_randf, float)
+  BUILTIN_PARAM(seed, int)
+  BUILTIN_PARAM(counter, int)
+  ast_append_function(ast, fn);
 }
 
 // parse a typedef
@@ -168,7 +183,7 @@ void make_typedef(ast_t *ast, YYLTYPE *rloc, char *ident, YYLTYPE *iloc,
     return;
   }
 
-  append(ast_node_t, &ast->types, nt);
+  ast_append_type(ast, nt);
   free(ident);
 }
 
@@ -187,7 +202,7 @@ void append_variables(ast_t *ast, ast_node_t *list) {
               v->val.v->name);
       ast_node_t_delete(v);
     } else {
-      append(ast_node_t, &ast->current_scope->items, v);
+      scope_append(ast, ast->current_scope, v);
       v->val.v->scope = ast->current_scope;
     }
   }
@@ -197,8 +212,8 @@ void append_variables(ast_t *ast, ast_node_t *list) {
 // create an expression literal of specified integer value
 ast_node_t *expression_int_val(int val) {
   ast_node_t *zero = ast_node_t_new(NULL, AST_NODE_EXPRESSION, EXPR_LITERAL);
-  zero->val.e->type->type = __type__int->val.t;
-  zero->val.e->val.l = malloc(sizeof(int));
+  zero->val.e->type->type = ast_current()->type_int->val.t;
+  zero->val.e->val.l = ast_alloc(sizeof(int));
   *(int *)(zero->val.e->val.l) = val;
   return zero;
 }
@@ -281,6 +296,10 @@ ast_node_t *define_function(ast_t *ast, YYLTYPE *loc, static_type_t *type,
   if (role == IDENT_FUNCTION) {
     // check parameters
     function_t *f = fn->val.f;
+    if (f->builtin) {
+      yyerror(nameloc, ast, "redefinition of built-in function %s", name);
+      __define_function_abort__
+    }
     if (f->root_scope) {
       yyerror(nameloc, ast, "redefinition of function %s", name);
       __define_function_abort__
@@ -322,7 +341,7 @@ ast_node_t *define_function(ast_t *ast, YYLTYPE *loc, static_type_t *type,
     fn = ast_node_t_new(loc, AST_NODE_FUNCTION, name);
     fn->val.f->params = params;
     fn->val.f->out_type = type;
-    append(ast_node_t, &ast->functions, fn);
+    ast_append_function(ast, fn);
   }
 
   return fn;
@@ -401,7 +420,7 @@ ast_node_t *expression_sizeof(ast_t *ast, YYLTYPE *loc, char *name,
   }
 
   ast_node_t *res = ast_node_t_new(loc, AST_NODE_EXPRESSION, EXPR_SIZEOF);
-  res->val.e->type->type = __type__int->val.t;
+  res->val.e->type->type = ast->type_int->val.t;
   res->val.e->val.v->params = (dim) ? dim : expression_int_val(0);
   res->val.e->val.v->var = var;
   free(name);
@@ -429,6 +448,51 @@ ast_node_t *array_dimensions(ast_t *ast, YYLTYPE *loc, char *name) {
   return res;
 }
 
+// parse slice expression: elements l,...,r-1 of the array in the first
+// dimension
+ast_node_t *expression_slice(ast_t *ast, YYLTYPE *loc, char *name,
+                             ast_node_t *l, ast_node_t *r) {
+  ast_node_t *vn;
+  if (!l || !r) {
+    free(name);
+    ast_node_t_delete(l);
+    ast_node_t_delete(r);
+    return NULL;
+  }
+  int role = ident_role(ast, name, &vn);
+  if (!(role & IDENT_VAR)) {
+    yyerror(loc, ast, "%s is not a variable", name);
+    free(name);
+    ast_node_t_delete(l);
+    ast_node_t_delete(r);
+    return NULL;
+  }
+  variable_t *var = vn->val.v;
+  if (var->num_dim == 0) {
+    yyerror(loc, ast, "%s is not an array", name);
+    free(name);
+    ast_node_t_delete(l);
+    ast_node_t_delete(r);
+    return NULL;
+  }
+
+  if (!expr_int(l->val.e) || !expr_int(r->val.e)) {
+    yyerror(loc, ast, "non integral slice bound");
+    free(name);
+    ast_node_t_delete(l);
+    ast_node_t_delete(r);
+    return NULL;
+  }
+
+  ast_node_t *res = ast_node_t_new(loc, AST_NODE_EXPRESSION, EXPR_SLICE);
+  res->val.e->type->type = var->base_type;
+  res->val.e->val.v->params = l;
+  append(ast_node_t, &(res->val.e->val.v->params), r);
+  res->val.e->val.v->var = var;
+  free(name);
+  return res;
+}
+
 // set the list of array indices
 int add_expression_array_parameters(ast_node_t *ve, ast_node_t *p) {
   ve->val.e->variant = EXPR_ARRAY_ELEMENT;
@@ -513,38 +577,58 @@ int fix_expression_type(ast_t *ast, YYLTYPE *loc, ast_node_t *node) {
 
     if ((e->val.o->oper == TOK_EQ || e->val.o->oper == TOK_NEQ) && equal &&
         !e->val.o->first->val.e->type->compound) {
-      e->type->type = __type__int->val.t;
+      e->type->type = ast->type_int->val.t;
     } else if (e->val.o->oper == '=' && equal) {
       inferred_type_t_delete(e->type);
       e->type = inferred_type_copy(e->val.o->first->val.e->type);
     } else {
       // only implicit type conversion is int->float
+      // (int8 and int16 are used as int)
       int fi = 1, ff = 1, si = 1, sf = 1;
 
       if (e->val.o->first->val.e->type->compound)
         fi = ff = 0;
       else {
-        if (e->val.o->first->val.e->type->type != __type__int->val.t) fi = 0;
-        if (e->val.o->first->val.e->type->type != __type__float->val.t) ff = 0;
+        if (!static_type_int(e->val.o->first->val.e->type->type)) fi = 0;
+        if (e->val.o->first->val.e->type->type != ast->type_float->val.t) ff = 0;
       }
 
       if (e->val.o->second->val.e->type->compound)
         si = sf = 0;
       else {
-        if (e->val.o->second->val.e->type->type != __type__int->val.t) si = 0;
-        if (e->val.o->second->val.e->type->type != __type__float->val.t) sf = 0;
+        if (!static_type_int(e->val.o->second->val.e->type->type)) si = 0;
+        if (e->val.o->second->val.e->type->type != ast->type_float->val.t) sf = 0;
       }
 
-      if (fi && si)
-        e->type->type = __type__int->val.t;
+      // int64 with an int type: int64 arithmetic (see code.h)
+      int fl = !fi && !ff && !e->val.o->first->val.e->type->compound &&
+               static_type_int64(e->val.o->first->val.e->type->type);
+      int sl = !si && !sf && !e->val.o->second->val.e->type->compound &&
+               static_type_int64(e->val.o->second->val.e->type->type);
+
+      if ((fl || sl) && (fi || fl) && (si || sl)) {
+        if (e->val.o->oper == '=')
+          e->type->type = e->val.o->first->val.e->type->type;
+        else if (comparison_oper(e->val.o->oper))
+          e->type->type = ast->type_int->val.t;
+        else if (e->val.o->oper == '+' || e->val.o->oper == '-' ||
+                 e->val.o->oper == '*' || e->val.o->oper == '/' ||
+                 e->val.o->oper == '%')
+          e->type->type = ast->type_int64->val.t;
+        else {
+          yyerror(loc, ast, "operation not supported on int64");
+          return 0;
+        }
+      } else if (fi && si)
+        e->type->type = ast->type_int->val.t;
       else if ((fi || ff) && (si || sf)) {
         if (assign_oper(e->val.o->oper) && fi)
-          e->type->type = __type__int->val.t;
+          e->type->type = ast->type_int->val.t;
         else if (comparison_oper(e->val.o->oper) || e->val.o->oper == TOK_AND ||
                  e->val.o->oper == TOK_OR) {
-          e->type->type = __type__int->val.t;
+          e->type->type = ast->type_int->val.t;
         } else
-          e->type->type = __type__float->val.t;
+          e->type->type = ast->type_float->val.t;
       } else {
         yyerror(loc, ast, "type check error");
         return 0;
@@ -557,6 +641,11 @@ int fix_expression_type(ast_t *ast, YYLTYPE *loc, ast_node_t *node) {
     if (e->val.o->first) {
       inferred_type_t_delete(e->type);
       e->type = inferred_type_copy(e->val.o->first->val.e->type);
+      // (-x of an int8 may not fit in int8: the result is int)
+      if (!e->type->compound && e->type->type &&
+          (e->type->type == ast->type_int8->val.t ||
+           e->type->type == ast->type_int16->val.t))
+        e->type->type = ast->type_int->val.t;
     }
   }
   return 1;
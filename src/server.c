@@ -0,0 +1,170 @@
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <driver.h>
+#include <errors.h>
+#include <server.h>
+
+// read exactly n bytes; return 0 on success
+static int read_all(int fd, char *buf, long n) {
+  while (n > 0) {
+    ssize_t k = read(fd, buf, n);
+    if (k <= 0) return 1;
+    buf += k;
+    n -= k;
+  }
+  return 0;
+}
+
+static int write_all(int fd, const char *buf, long n) {
+  while (n > 0) {
+    ssize_t k = write(fd, buf, n);
+    if (k <= 0) return 1;
+    buf += k;
+    n -= k;
+  }
+  return 0;
+}
+
+// read a line (without the newline) byte by byte, not to read past the request
+static int read_line(int fd, char *buf, int size) {
+  for (int n = 0; n < size - 1; n++) {
+    if (read(fd, buf + n, 1) != 1) return 1;
+    if (buf[n] == '\n') {
+      buf[n] = 0;
+      return 0;
+    }
+  }
+  return 1;
+}
+
+// read an item; return the allocated, zero-terminated bytes or NULL
+static char *read_item(int fd) {
+  char line[32];
+  if (read_line(fd, line, sizeof(line))) return NULL;
+  long n = atol(line);
+  if (n < 0) return NULL;
+  char *r = (char *)malloc(n + 1);
+  if (read_all(fd, r, n)) {
+    free(r);
+    return NULL;
+  }
+  r[n] = 0;
+  return r;
+}
+
+static void out_item(writer_t *w, const char *s, int n) {
+  out_text(w, "%d\n", n);
+  out_raw(w, (void *)s, n);
+}
+
+// read one request from `in`, compile it and answer to `out`; return 0 on
+// success, 1 if there is no (complete) request
+static int handle_request(compiler_ctx_t *ctx, int in, int out,
+                          server_compile_t compile) {
+  char line[64];
+  int argc, nfiles;
+  if (read_line(in, line, sizeof(line)) ||
+      sscanf(line, "wtc %d %d", &argc, &nfiles) != 2 || argc < 0 || nfiles < 0)
+    return 1;
+
+  char **argv = (char **)malloc((argc + 2) * sizeof(char *));
+  argv[0] = "wtc";
+  for (int i = 1; i <= argc; i++)
+    if (!(argv[i] = read_item(in))) return 1;
+  argv[argc + 1] = NULL;
+
+  clear_errors();
+  register_error_handler(NULL);
+  for (int i = 0; i < nfiles; i++) {
+    char *name = read_item(in), *content = name ? read_item(in) : NULL;
+    if (!content) return 1;
+    driver_set_file(ctx, name, content);
+    free(name);
+    free(content);
+  }
+
+  writer_t *bin = writer_t_new(WRITER_STRING);
+  int status = compile(ctx, argc + 1, argv, bin);
+
+  writer_t *ans = writer_t_new(WRITER_STRING);
+  out_text(ans, "%d %d %d\n", status, errnum(), bin->str.ptr);
+  for (int i = 0; i < errnum(); i++)
+    out_item(ans, get_error_msg(i), strlen(get_error_msg(i)));
+  out_raw(ans, bin->str.base, bin->str.ptr);
+  int r = write_all(out, ans->str.base, ans->str.ptr);
+
+  writer_t_delete(ans);
+  writer_t_delete(bin);
+  for (int i = 1; i <= argc; i++) free(argv[i]);
+  free(argv);
+  return r;
+}
+
+// answer requests from stdin in order
+static int serve_stdio(compiler_ctx_t *ctx, server_compile_t compile) {
+  int in = dup(0), out = dup(1);
+  // stray output of the compiler must not get into the answers
+  int null = open("/dev/null", O_RDWR);
+  dup2(null, 0);
+  dup2(null, 1);
+  close(null);
+
+  for (;;) {
+    fflush(NULL);
+    pid_t pid = fork();
+    if (pid == 0) _exit(handle_request(ctx, in, out, compile));
+    int status;
+    if (pid < 0 || waitpid(pid, &status, 0) != pid || !WIFEXITED(status) ||
+        WEXITSTATUS(status))
+      break;
+  }
+  close(in);
+  close(out);
+  return 0;
+}
+
+int server_run(compiler_ctx_t *ctx, const char *path,
+               server_compile_t compile) {
+  if (!strcmp(path, "-")) return serve_stdio(ctx, compile);
+
+  struct sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  if (strlen(path) >= sizeof(addr.sun_path)) {
+    throw("server error: socket name too long (%s)", path);
+    return 1;
+  }
+  strcpy(addr.sun_path, path);
+
+  int s = socket(AF_UNIX, SOCK_STREAM, 0);
+  unlink(path);
+  if (s < 0 || bind(s, (struct sockaddr *)&addr, sizeof(addr)) ||
+      listen(s, 16)) {
+    throw("server error: cannot listen on %s", path);
+    if (s >= 0) close(s);
+    return 1;
+  }
+
+  // the children are not waited for
+  signal(SIGCHLD, SIG_IGN);
+  signal(SIGPIPE, SIG_IGN);
+  for (;;) {
+    int c = accept(s, NULL, NULL);
+    if (c < 0) continue;
+    fflush(NULL);
+    pid_t pid = fork();
+    if (pid == 0) {
+      close(s);
+      _exit(handle_request(ctx, c, c, compile));
+    }
+    close(c);
+  }
+}
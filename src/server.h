@@ -0,0 +1,57 @@
+/**
+ * @file server.h
+ * @brief resident compile server (used by `wtc -server`)
+ *
+ * The server keeps the driver with the preloaded library files (see
+ * #driver_set_file) and answers compile requests read from a local Unix
+ * socket, or from stdin with the answers written to stdout (socket `-`).
+ *
+ * Every request is handled in a child process forked from the server, so
+ * each request starts from the preloaded state (the files it sends do not
+ * stay in the server) and has its own error log (errors.h). Requests on the
+ * socket (one per connection) are compiled concurrently; requests on stdin
+ * are answered in order.
+ *
+ * A request is a header line followed by length-prefixed items; an item is
+ * its length in bytes on a line, and the bytes:
+ *
+ *     wtc <argc> <nfiles>\n
+ *     <argc> items: the command line arguments (options and the input file)
+ *     <nfiles> pairs of items: the name and the content of a source file
+ *
+ * The files of the request are set by #driver_set_file before parsing, other
+ * files are read by the server. The answer is
+ *
+ *     <status> <nerrors> <length>\n
+ *     <nerrors> items: the messages of the error log
+ *     <length> bytes of the output (the binary)
+ *
+ * where the status is the exit code the command line compiler would return.
+ */
+#ifndef __SERVER_H__
+#define __SERVER_H__
+
+#include <driver.h>
+#include <writer.h>
+
+/**
+ * @brief compile a request
+ *
+ * `argv[0]` is the program name, the other arguments come from the request.
+ * `ctx` is the driver with the files of the request. Write the output to `out`
+ * and return the status.
+ */
+typedef int (*server_compile_t)(compiler_ctx_t *ctx, int argc, char **argv,
+                                writer_t *out);
+
+/**
+ * @brief serve requests on the socket `path` (`-` for stdin/stdout)
+ *
+ * `ctx` is the driver with the preloaded files. Runs until stdin is closed, or
+ * forever on a socket. Return 1 (and emit an error) if the socket cannot be
+ * opened.
+ */
+int server_run(compiler_ctx_t *ctx, const char *path,
+               server_compile_t compile);
+
+#endif
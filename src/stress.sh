@@ -0,0 +1,33 @@
+#!/bin/sh
+# Stress benchmark of the compiler front-end.
+#
+# usage: stress.sh wtc [log] [statements] [functions]
+#
+# Generates a program with many functions and a long root scope (every
+# statement declares a variable and reads the previous one), compiles it by
+# `wtc` and prints the compile time. The result is also appended to `log`.
+
+WTC=${1:?usage: stress.sh wtc [log] [statements] [functions]}
+LOG=${2:-/dev/null}
+N=${3:-100000}
+F=${4:-5000}
+
+DIR=$(mktemp -d)
+trap 'rm -rf "$DIR"' EXIT
+
+awk -v n="$N" -v f="$F" 'BEGIN {
+  for (k = 0; k < f; k++) {
+    printf "int g%d(int x) {\n  int y = x + %d;\n  return y * 2;\n}\n", k, k
+  }
+  print "int v0 = 0;"
+  for (k = 1; k < n; k++)
+    printf "int v%d = v%d + g%d(%d);\n", k, k - 1, k % f, k
+}' > "$DIR/stress.wt"
+
+START=$(date +%s.%N)
+"$WTC" "$DIR/stress.wt" -o "$DIR/stress.out" || exit 1
+END=$(date +%s.%N)
+
+T=$(echo "$START $END" | awk '{ printf "%.2f", $2 - $1 }')
+echo "statements: $N functions: $F compile time: ${T}s"
+echo "$(date '+%Y-%m-%d %H:%M') $N $F $T" >> "$LOG"
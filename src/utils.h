@@ -32,6 +32,26 @@
     }                                                               \
   }
 
+/**
+ * @brief append to a list with a pointer to its last element
+ *
+ * `last` is the last element of the list (or NULL if not known) and is moved
+ * to the new last element, so that appending does not walk the list.
+ */
+#define append_last(type, list, last, value)                        \
+  if (value) {                                                      \
+    if (!(*(list)))                                                 \
+      *(list) = (value);                                            \
+    else {                                                          \
+      if (!(last))                                                  \
+        for ((last) = *(list); (last)->next; (last) = (last)->next) \
+          ;                                                         \
+      (last)->next = (value);                                       \
+    }                                                               \
+    for ((last) = (value); (last)->next; (last) = (last)->next)     \
+      ;                                                             \
+  }
+
 //! iterate a list
 #define list_for(var, type, list)        \
   for (type *__tmp__ = list; __tmp__;) { \
@@ -14,6 +14,7 @@ static int ___pc___;
 
 static int _tid = 1;
 static hash_table_t *_tid2thread = NULL;
+int vm_thread_ids = 1;
 int vm_print_colors = 0;
 
 extern const char *const instr_names[];
@@ -43,11 +44,22 @@ static int sort_compare(const void *a, const void *b) {
       if (x - y < 1e-15) return -1;
       return 0;
     } break;
-    case TYPE_CHAR: {
+    case TYPE_CHAR:
+    case TYPE_INT8: {
       int8_t x = *(int8_t *)(A);
       int8_t y = *(int8_t *)(B);
       return x - y;
     } break;
+    case TYPE_INT16: {
+      int16_t x = *(int16_t *)(A);
+      int16_t y = *(int16_t *)(B);
+      return x - y;
+    } break;
+    case TYPE_INT64: {
+      int64_t x = lval(A, int64_t);
+      int64_t y = lval(B, int64_t);
+      return (x > y) - (x < y);
+    } break;
   };
   return 0;
 }
@@ -62,6 +74,17 @@ int ipow(int base, int exp) {
   return result;
 }
 
+uint32_t philox(uint32_t s, uint32_t c) {
+  uint32_t x0 = c, x1 = 0;
+  for (int i = 0; i < 10; i++) {
+    uint64_t p = (uint64_t)0xD256D193U * x0;
+    x0 = (uint32_t)(p >> 32) ^ s ^ x1;
+    x1 = (uint32_t)p;
+    s += 0x9E3779B9U;
+  }
+  return x0;
+}
+
 // ceiling log_2
 int ilog2(int n) {
   int pw = 0, res = -1;
@@ -127,6 +150,12 @@ void stack_t_alloc(stack_t *s, uint32_t len) {
   s->top += len;
 }
 
+void stack_t_reserve(stack_t *s, uint32_t len) {
+  if (s->size - s->top > len) return;
+  while (s->size - s->top <= len) s->size *= 2;
+  s->data = (uint8_t *)realloc(s->data, s->size);
+}
+
 void stack_t_pop(stack_t *s, void *data, uint32_t len) {
   memcpy(data, (void *)(s->data + s->top - len), len);
   s->top -= len;
@@ -142,9 +171,12 @@ CONSTRUCTOR(thread_t) {
   r->refcnt = 1;
   r->returned = 0;
   r->bp_hit = 0;
+  memset(r->reg, 0, sizeof(r->reg));
   r->tid = _tid++;
-  if (!_tid2thread) _tid2thread = hash_table_t_new(64, NULL);
-  hash_put(_tid2thread, r->tid, r);
+  if (vm_thread_ids) {
+    if (!_tid2thread) _tid2thread = hash_table_t_new(64, NULL);
+    hash_put(_tid2thread, r->tid, r);
+  }
   return r;
 }
 
@@ -166,8 +198,7 @@ DESTRUCTOR(thread_t) {
   if (r == NULL) return;
   r->refcnt--;
   if (r->refcnt <= 0) {
-    if (!_tid2thread) _tid2thread = hash_table_t_new(64, NULL);
-    hash_remove(_tid2thread, r->tid);
+    if (_tid2thread) hash_remove(_tid2thread, r->tid);
     stack_t_delete(r->op_stack);
     stack_t_delete(r->acc_stack);
     stack_t_delete(r->mem);
@@ -179,6 +210,7 @@ CONSTRUCTOR(frame_t, uint32_t base) {
   ALLOC_VAR(r, frame_t)
 
   r->base = base;
+  r->op_depth = r->acc_depth = 0;
   r->heap_mark = stack_t_new();
   r->mem_mark = stack_t_new();
   return r;
@@ -206,6 +238,12 @@ CONSTRUCTOR(virtual_machine_t, uint8_t *in, int len) {
   r->state = VM_READY;
   r->mem_mode = MEM_MODE_CREW;
   r->debug_info = NULL;
+  r->version = 0;
+  r->registers = 0;
+  r->soa = 0;
+  r->presized = 0;
+  r->fcnt = 0;
+  r->fnmap = NULL;
 
   r->heap = stack_t_new();
   r->threads = stack_t_new();
@@ -234,11 +272,13 @@ CONSTRUCTOR(virtual_machine_t, uint8_t *in, int len) {
     switch (section) {
       case SECTION_HEADER: {
         // printf(">> section header\n");
-        uint8_t version;
-        GET(uint8_t, version, 1)
+        GET(uint8_t, r->version, 1)
+        r->registers = (r->version & CODE_REGISTERS) != 0;
+        r->version &= ~CODE_REGISTERS;
         GET(uint32_t, r->global_size, 4)
         stack_t_alloc(main_thread->mem, r->global_size);
         GET(uint8_t, r->mem_mode, 1)
+        if (r->version >= 5) GET(uint8_t, r->soa, 1)
       } break;
       case SECTION_INPUT:
         // printf(">> section input\n");
@@ -252,6 +292,8 @@ CONSTRUCTOR(virtual_machine_t, uint8_t *in, int len) {
           r->in_vars[i].elems = (uint8_t *)malloc(r->in_vars[i].n_elems);
           for (int j = 0; j < r->in_vars[i].n_elems; j++)
             GET(uint8_t, r->in_vars[i].elems[j], 1);
+          r->in_vars[i].soa = r->soa && r->in_vars[i].num_dim > 0 &&
+                              r->in_vars[i].n_elems > 1;
         }
         break;
       case SECTION_OUTPUT:
@@ -266,11 +308,20 @@ CONSTRUCTOR(virtual_machine_t, uint8_t *in, int len) {
           r->out_vars[i].elems = (uint8_t *)malloc(r->out_vars[i].n_elems);
           for (int j = 0; j < r->out_vars[i].n_elems; j++)
             GET(uint8_t, r->out_vars[i].elems[j], 1);
+          r->out_vars[i].soa = r->soa && r->out_vars[i].num_dim > 0 &&
+                               r->out_vars[i].n_elems > 1;
         }
         break;
       case SECTION_FNMAP: {
         // printf(">> section fnmap\n");
         GET(uint32_t, r->fcnt, 4);
+        if (r->version >= 2) {
+          GET(uint32_t, tf->op_depth, 4);
+          GET(uint32_t, tf->acc_depth, 4);
+          stack_t_reserve(main_thread->op_stack, tf->op_depth);
+          stack_t_reserve(main_thread->acc_stack, tf->acc_depth);
+          r->presized = 1;
+        }
         if (r->fcnt > 0)
           r->fnmap = (fnmap_t *)malloc(r->fcnt * sizeof(fnmap_t));
         else
@@ -278,6 +329,11 @@ CONSTRUCTOR(virtual_machine_t, uint8_t *in, int len) {
         for (uint32_t i = 0; i < r->fcnt; i++) {
           GET(uint32_t, r->fnmap[i].addr, 4);
           GET(int32_t, r->fnmap[i].out_size, 4);
+          r->fnmap[i].op_depth = r->fnmap[i].acc_depth = 0;
+          if (r->version >= 2) {
+            GET(uint32_t, r->fnmap[i].op_depth, 4);
+            GET(uint32_t, r->fnmap[i].acc_depth, 4);
+          }
         }
 
       } break;
@@ -351,8 +407,12 @@ static mem_check_value_t *mem_check_value_t_new(uint8_t _access,
 
 static void mem_check_value_deleter(void *a) { free((mem_check_value_t *)a); }
 
-static int check_read_mem(virtual_machine_t *env, hash_table_t *mem_used,
-                          void *addr) {
+hash_table_t *mem_check_table_new(int size) {
+  return hash_table_t_new(size, mem_check_value_deleter);
+}
+
+int check_read_mem(virtual_machine_t *env, hash_table_t *mem_used,
+                   void *addr) {
   if (env->mem_mode == MEM_MODE_EREW) {
     uint64_t key = (uint64_t)addr;
     if (hash_get(mem_used, key)) {
@@ -365,14 +425,14 @@ static int check_read_mem(virtual_machine_t *env, hash_table_t *mem_used,
   return 1;
 }
 
-static int check_write_mem(virtual_machine_t *env, hash_table_t *mem_used,
-                           void *addr, int32_t value) {
+int check_write_mem(virtual_machine_t *env, hash_table_t *mem_used,
+                    void *addr, int32_t value) {
   uint64_t key = (uint64_t)addr;
   mem_check_value_t *data = hash_get(mem_used, key);
   if (data &&
       (env->mem_mode != MEM_MODE_CCRCW || data->value_written != value)) {
     printf("%x %d %d\n", env->mem_mode, data->value_written, value);
-    throw("write memory access violation (%d).", ___pc___);
+    throw("write memory access violation (%d).", env->stored_pc);
     env->state = VM_ERROR;
     return 0;
   }
@@ -380,10 +440,37 @@ static int check_write_mem(virtual_machine_t *env, hash_table_t *mem_used,
   return 1;
 }
 
+// push to op_stack or acc_stack; if the stacks were reserved in advance from
+// the FNMAP depths, skip the size check
+static inline void vm_push(virtual_machine_t *env, stack_t *s, void *data,
+                           uint32_t len) {
+  if (env->presized) {
+    memcpy((void *)(s->data + s->top), data, len);
+    s->top += len;
+  } else
+    stack_t_push(s, data, len);
+}
+
 #define _PUSH(var, len) \
-  stack_t_push(env->thr[t]->op_stack, (void *)(&(var)), len)
+  vm_push(env, env->thr[t]->op_stack, (void *)(&(var)), len)
 #define _POP(var, len) stack_t_pop(env->thr[t]->op_stack, (void *)(&(var)), len)
 
+// an int64 on the stack is two values, the low half on top (see code.h)
+#define _POP64(var)                              \
+  {                                              \
+    uint32_t lo_, hi_;                           \
+    _POP(lo_, 4);                                \
+    _POP(hi_, 4);                                \
+    var = (int64_t)((uint64_t)hi_ << 32 | lo_); \
+  }
+#define _PUSH64(var)                             \
+  {                                              \
+    uint32_t lo_ = (uint64_t)(var);              \
+    uint32_t hi_ = (uint64_t)(var) >> 32;        \
+    _PUSH(hi_, 4);                               \
+    _PUSH(lo_, 4);                               \
+  }
+
 void *get_addr(thread_t *thr, uint32_t addr, uint32_t len) {
   if (thr->mem_base + thr->mem->top <= len ||
       addr + len > thr->mem_base + thr->mem->top)
@@ -421,6 +508,138 @@ static void perform_join(virtual_machine_t *env) {
     if (!env->thr[t]->returned) env->a_thr++;
 }
 
+static const uint8_t alu3_ops[] = ALU3_OPS;
+
+// the operation of `ALU3` on the 4B values a, b (see code.h)
+static int32_t alu3_value(int op, int32_t a, int32_t b) {
+  float fa, fb;
+  memcpy(&fa, &a, 4);
+  memcpy(&fb, &b, 4);
+  switch (op) {
+    case ADD_INT:
+      return (int32_t)((uint32_t)a + (uint32_t)b);
+    case SUB_INT:
+      return (int32_t)((uint32_t)a - (uint32_t)b);
+    case MULT_INT:
+      return (int32_t)((uint32_t)a * (uint32_t)b);
+    case BIT_AND:
+      return a & b;
+    case BIT_OR:
+      return a | b;
+    case BIT_XOR:
+      return a ^ b;
+    case DIV_INT:
+      return a / b;
+    case MOD_INT:
+      return a % b;
+    case ADD_FLOAT:
+      fa += fb;
+      break;
+    case SUB_FLOAT:
+      fa -= fb;
+      break;
+    case MULT_FLOAT:
+      fa *= fb;
+      break;
+    case DIV_FLOAT:
+      fa /= fb;
+      break;
+  }
+  memcpy(&a, &fa, 4);
+  return a;
+}
+
+// an operand `v` of `ALU3` or `ALUR` as text: a register, a constant, or the
+// address of a slot
+static char *alu3_operand(char *buf, uint32_t x, uint32_t v, int reg,
+                          int constant) {
+  if (reg) return buf + sprintf(buf, " r%u", v);
+  if (constant) return buf + sprintf(buf, " #%u", v);
+  return buf + sprintf(buf, " %s%u", (x & ALU3_FRAME) ? "fb+" : "", 4 * v);
+}
+
+// the parameter of `IDXR` as text: "a s" with the address of the slot
+static void idxr_text(char *buf, uint32_t x) {
+  sprintf(buf, "%s%u %u%s", (x & IDXR_FRAME) ? "fb+" : "", 4 * (x & 0xffff),
+          x >> 18, (x & IDXR_NO_CHECK) ? " nc" : "");
+}
+
+// the operands of `ALU3` (`ALUR` if `to_reg`) as text: "op d a b"
+static void alu3_text(char *buf, uint32_t x, int to_reg) {
+  buf += sprintf(buf, "%s", instr_names[alu3_ops[x & 0xf]]);
+  buf = alu3_operand(buf, x, (x >> 8) & 0xff, to_reg, 0);
+  buf = alu3_operand(buf, x, (x >> 16) & 0xff, x & ALU3_AREG, 0);
+  alu3_operand(buf, x, x >> 24, x & ALU3_BREG, x & ALU3_CONST);
+}
+
+// `ALU3`: as `LDL b` (or `PUSHB b`), `LDL a`, `op`, `STL d` in all active
+// threads, with the checks of each, but without the op stack; in the
+// register encoding, `a` and `b` may be registers, and with `to_reg`
+// (`ALUR`), `d` is a register
+static int alu3(virtual_machine_t *env, int to_reg) {
+  uint32_t x = lval(env->code + env->pc, uint32_t);
+  uint32_t base = (x & ALU3_FRAME) ? env->frame->base : 0;
+  uint32_t rd = (x >> 8) & 0xff, ra = (x >> 16) & 0xff, rb = x >> 24;
+  uint32_t d = base + 4 * rd, a = base + 4 * ra, b = base + 4 * rb;
+  int areg = (x & ALU3_AREG) != 0, breg = (x & ALU3_BREG) != 0;
+  if ((to_reg || areg || breg) && !env->registers) {
+    throw("register instruction in the stack encoding (%d)", ___pc___);
+    env->state = VM_ERROR;
+    return -3;
+  }
+  if ((to_reg && rd >= NUM_REGISTERS) || (areg && ra >= NUM_REGISTERS) ||
+      (breg && rb >= NUM_REGISTERS)) {
+    throw("bad register (%d)", ___pc___);
+    env->state = VM_ERROR;
+    return -3;
+  }
+  int op = alu3_ops[x & 0xf], res = 0;
+  int erew = env->mem_mode == MEM_MODE_EREW;
+  hash_table_t *used_a = erew ? mem_check_table_new(env->a_thr) : NULL,
+               *used_b = erew ? mem_check_table_new(env->a_thr) : NULL,
+               *used_d = to_reg ? NULL : mem_check_table_new(env->a_thr);
+  int32_t *val = (int32_t *)malloc(env->n_thr * sizeof(int32_t));
+
+  // all values are computed before the first store, as by the fused code
+  for (int t = 0; t < env->n_thr && res == 0; t++)
+    if (!env->thr[t]->returned) {
+      thread_t *th = env->thr[t];
+      int32_t va, vb = rb;
+      void *addr;
+      if (breg)
+        vb = th->reg[rb];
+      else if (!(x & ALU3_CONST)) {
+        addr = get_addr(th, b, 4);
+        vb = lval(addr, int32_t);
+        if (erew && !check_read_mem(env, used_b, addr)) res = -5;
+      }
+      if (areg)
+        va = th->reg[ra];
+      else {
+        addr = get_addr(th, a, 4);
+        va = lval(addr, int32_t);
+        if (res == 0 && erew && !check_read_mem(env, used_a, addr)) res = -5;
+      }
+      if (res == 0) val[t] = alu3_value(op, va, vb);
+    }
+  for (int t = 0; t < env->n_thr && res == 0; t++)
+    if (!env->thr[t]->returned) {
+      if (to_reg) {
+        env->thr[t]->reg[rd] = val[t];
+        continue;
+      }
+      void *addr = get_addr(env->thr[t], d, 4);
+      lval(addr, int32_t) = val[t];
+      if (!check_write_mem(env, used_d, addr, val[t])) res = -5;
+    }
+
+  free(val);
+  if (used_a) hash_table_t_delete(used_a);
+  if (used_b) hash_table_t_delete(used_b);
+  if (used_d) hash_table_t_delete(used_d);
+  return res;
+}
+
 int execute(virtual_machine_t *env, int limit, int trace_on, int stop_on_bp) {
   while (1) {
     uint8_t opcode = lval(env->code + env->pc, uint8_t);
@@ -443,15 +662,47 @@ int execute(virtual_machine_t *env, int limit, int trace_on, int stop_on_bp) {
       switch (opcode) {
         case PUSHC:
         case JMP:
+        case JMPZ:
         case JOIN_JMP:
+        case UNIFORM:
           printf(" %d", lval(&env->code[env->pc + 1], int32_t));
           break;
         case CALL:
         case BREAK:
+        case LDL:
+        case STL:
+        case LDG:
+        case STG:
           printf(" %d", lval(&env->code[env->pc + 1], uint32_t));
           break;
+        case ALU3:
+        case ALUR: {
+          char buf[64];
+          alu3_text(buf, lval(&env->code[env->pc + 1], uint32_t),
+                    opcode == ALUR);
+          printf(" %s", buf);
+        } break;
+        case SLICE:
+          printf(" %d %d", lval(&env->code[env->pc + 1], uint32_t) & 0xff,
+                 lval(&env->code[env->pc + 1], uint32_t) >> 8);
+          break;
+        case IDXA:
+        case ROW:
+          printf(" %d %d%s", lval(&env->code[env->pc + 1], uint32_t) & 0xff,
+                 (lval(&env->code[env->pc + 1], uint32_t) >> 8) & 0x7fffff,
+                 (lval(&env->code[env->pc + 1], uint32_t) & IDXA_NO_CHECK)
+                     ? " nc"
+                     : "");
+          break;
+        case IDXR: {
+          char buf[64];
+          idxr_text(buf, lval(&env->code[env->pc + 1], uint32_t));
+          printf(" %s", buf);
+        } break;
         case PUSHB:
         case IDX:
+        case IDX_NC:
+        case PUSHR:
           printf(" %d", lval(&env->code[env->pc + 1], uint8_t));
           break;
         case ENDVM:
@@ -480,7 +731,7 @@ int execute(virtual_machine_t *env, int limit, int trace_on, int stop_on_bp) {
             printf("%d ", env->thr[t]->op_stack->data[i]);
           printf("]\n");
         }
-        printf("W=%d T=%d\n\n", env->W, env->T);
+        printf("W=%" PRId64 " T=%" PRId64 "\n\n", env->W, env->T);
       } else
         printf("\n");
     }
@@ -542,6 +793,8 @@ int instruction(virtual_machine_t *env, int stop_on_bp) {
             */
             for (int j = 0; j < n; j++) {
               thread_t *nt = clone_thread(env->thr[t]);
+              stack_t_reserve(nt->op_stack, env->frame->op_depth);
+              stack_t_reserve(nt->acc_stack, env->frame->acc_depth);
               lval(get_addr(nt, a, 4), int32_t) = j;
               stack_t_push(grp, (void *)(&nt), sizeof(thread_t *));
             }
@@ -627,6 +880,32 @@ int instruction(virtual_machine_t *env, int stop_on_bp) {
         env->pc += 4;
       break;
 
+    case JMPZ: {  // jump if the condition (same in all threads) is zero
+      int32_t c = 0;
+      if (env->a_thr > 0) {
+        env->W++;
+        env->T++;
+        int first = 1;
+        for (int t = 0; t < env->n_thr; t++)
+          if (!env->thr[t]->returned) {
+            int32_t a;
+            _POP(a, 4);
+            if (first) {
+              c = a;
+              first = 0;
+            } else if ((a == 0) != (c == 0)) {
+              throw("non-uniform condition (%d)", ___pc___);
+              env->state = VM_ERROR;
+              return -3;
+            }
+          }
+      }
+      if (c == 0)
+        env->pc += lval(env->code + env->pc, int32_t);
+      else
+        env->pc += 4;
+    } break;
+
     case CALL:
       if (env->a_thr > 0) {
         env->W++;
@@ -653,9 +932,15 @@ int instruction(virtual_machine_t *env, int stop_on_bp) {
 
         stack_t_push(env->frames, (void *)&nf, sizeof(frame_t *));
         env->frame = nf;
-        nf->op_stack_end =
-            env->thr[0]->op_stack->top +
-            env->fnmap[lval(env->code + env->pc, uint32_t)].out_size;
+        fnmap_t *callee = &(env->fnmap[lval(env->code + env->pc, uint32_t)]);
+        nf->op_stack_end = env->thr[0]->op_stack->top + callee->out_size;
+        nf->op_depth = callee->op_depth;
+        nf->acc_depth = callee->acc_depth;
+        if (env->presized)
+          for (int t = 0; t < env->n_thr; t++) {
+            stack_t_reserve(env->thr[t]->op_stack, callee->op_depth);
+            stack_t_reserve(env->thr[t]->acc_stack, callee->acc_depth);
+          }
 
         // jump
         env->pc = env->fnmap[lval(env->code + env->pc, uint32_t)].addr;
@@ -663,6 +948,55 @@ int instruction(virtual_machine_t *env, int stop_on_bp) {
         env->pc += 4;
       break;
 
+    case ALU3:
+    case ALUR:
+      if (env->a_thr > 0) {
+        int cost = ALU3_COST(opcode, lval(env->code + env->pc, uint32_t));
+        env->W += cost * env->a_thr;
+        env->T += cost;
+        int res = alu3(env, opcode == ALUR);
+        if (res < 0) return res;
+      }
+      env->pc += 4;
+      break;
+
+    case PUSHR: {  // not counted in W and T (see Register encoding)
+      uint8_t r = lval(env->code + env->pc, uint8_t);
+      if (!env->registers || r >= NUM_REGISTERS) {
+        throw("bad register (%d)", ___pc___);
+        env->state = VM_ERROR;
+        return -3;
+      }
+      for (int t = 0; t < env->n_thr; t++)
+        if (!env->thr[t]->returned) _PUSH(env->thr[t]->reg[r], 4);
+      env->pc++;
+    } break;
+
+    case UNIFORM: {  // the same values in all threads: computed by the first
+      uint32_t end = env->pc + lval(env->code + env->pc, int32_t);
+      env->pc += 4;
+      if (env->a_thr <= 1) break;
+      thread_t **thr = env->thr;
+      int n_thr = env->n_thr, a_thr = env->a_thr, f = 0;
+      while (thr[f]->returned) f++;
+      stack_t *s = thr[f]->op_stack;
+      uint32_t top = s->top;
+      int64_t W = env->W;
+      env->thr = thr + f;
+      env->n_thr = env->a_thr = 1;
+      int res = 0;
+      while (env->pc < end && res == 0) res = instruction(env, stop_on_bp);
+      env->thr = thr;
+      env->n_thr = n_thr;
+      env->a_thr = a_thr;
+      if (res != 0) return res;
+      // counted as if all active threads computed the values
+      env->W += (env->W - W) * (a_thr - 1);
+      for (int t = f + 1; t < n_thr; t++)
+        if (!thr[t]->returned)
+          stack_t_push(thr[t]->op_stack, s->data + top, s->top - top);
+    } break;
+
     case BREAK: {
       int hits = 0;
       for (int t = 0; t < env->n_thr; t++)
@@ -717,8 +1051,7 @@ int instruction(virtual_machine_t *env, int stop_on_bp) {
         env->T++;
       }
 
-      hash_table_t *mem_used =
-          hash_table_t_new(env->a_thr, mem_check_value_deleter);
+      hash_table_t *mem_used = mem_check_table_new(env->a_thr);
 
       for (int t = 0; t < env->n_thr; t++)
         if (!env->thr[t]->returned) switch (opcode) {
@@ -757,7 +1090,7 @@ int instruction(virtual_machine_t *env, int stop_on_bp) {
               uint32_t a;
               _POP(a, 4);
               void *addr = get_addr(env->thr[t], a, 4);
-              stack_t_push(env->thr[t]->op_stack, addr, 4);
+              vm_push(env, env->thr[t]->op_stack, addr, 4);
               if (!check_read_mem(env, mem_used, addr)) return -5;
             } break;
 
@@ -770,6 +1103,24 @@ int instruction(virtual_machine_t *env, int stop_on_bp) {
               if (!check_read_mem(env, mem_used, addr)) return -5;
             } break;
 
+            case LDSB: {
+              uint32_t a;
+              _POP(a, 4);
+              void *addr = get_addr(env->thr[t], a, 1);
+              int32_t w = lval(addr, int8_t);
+              _PUSH(w, 4);
+              if (!check_read_mem(env, mem_used, addr)) return -5;
+            } break;
+
+            case LDS: {
+              uint32_t a;
+              _POP(a, 4);
+              void *addr = get_addr(env->thr[t], a, 2);
+              int32_t w = lval(addr, int16_t);
+              _PUSH(w, 4);
+              if (!check_read_mem(env, mem_used, addr)) return -5;
+            } break;
+
             case STC: {
               uint32_t a;
               int32_t v;
@@ -780,6 +1131,26 @@ int instruction(virtual_machine_t *env, int stop_on_bp) {
               if (!check_write_mem(env, mem_used, addr, v)) return -5;
             } break;
 
+            case LDL:
+            case LDG: {
+              uint32_t a = lval(env->code + env->pc, uint32_t);
+              if (opcode == LDL) a += env->frame->base;
+              void *addr = get_addr(env->thr[t], a, 4);
+              vm_push(env, env->thr[t]->op_stack, addr, 4);
+              if (!check_read_mem(env, mem_used, addr)) return -5;
+            } break;
+
+            case STL:
+            case STG: {
+              uint32_t a = lval(env->code + env->pc, uint32_t);
+              int32_t v;
+              if (opcode == STL) a += env->frame->base;
+              _POP(v, 4);
+              void *addr = get_addr(env->thr[t], a, 4);
+              lval(addr, int32_t) = v;
+              if (!check_write_mem(env, mem_used, addr, v)) return -5;
+            } break;
+
             case STB: {
               uint32_t a;
               int32_t v;
@@ -790,34 +1161,73 @@ int instruction(virtual_machine_t *env, int stop_on_bp) {
               if (!check_write_mem(env, mem_used, addr, v)) return -5;
             } break;
 
-            case LDCH: {
+            case STS: {
+              uint32_t a;
+              int32_t v;
+              _POP(a, 4);
+              _POP(v, 4);
+              void *addr = get_addr(env->thr[t], a, 2);
+              lval(addr, uint16_t) = (uint16_t)v;
+              if (!check_write_mem(env, mem_used, addr, v)) return -5;
+            } break;
+
+            case LDCH:
+            case LDCH_NC: {
               uint32_t a;
               _POP(a, 4);
               void *addr = (void *)(env->heap->data + a);
-              stack_t_push(env->thr[t]->op_stack, addr, 4);
-              if (!check_read_mem(env, mem_used, addr)) return -5;
+              vm_push(env, env->thr[t]->op_stack, addr, 4);
+              if (opcode == LDCH && !check_read_mem(env, mem_used, addr))
+                return -5;
             } break;
 
-            case LDBH: {
+            case LDBH:
+            case LDBH_NC: {
               uint32_t a;
               _POP(a, 4);
               void *addr = (void *)(env->heap->data + a);
               int32_t w = lval(addr, uint8_t);
               _PUSH(w, 4);
-              if (!check_read_mem(env, mem_used, addr)) return -5;
+              if (opcode == LDBH && !check_read_mem(env, mem_used, addr))
+                return -5;
+            } break;
+
+            case LDSBH:
+            case LDSBH_NC: {
+              uint32_t a;
+              _POP(a, 4);
+              void *addr = (void *)(env->heap->data + a);
+              int32_t w = lval(addr, int8_t);
+              _PUSH(w, 4);
+              if (opcode == LDSBH && !check_read_mem(env, mem_used, addr))
+                return -5;
+            } break;
+
+            case LDSH:
+            case LDSH_NC: {
+              uint32_t a;
+              _POP(a, 4);
+              void *addr = (void *)(env->heap->data + a);
+              int32_t w = lval(addr, int16_t);
+              _PUSH(w, 4);
+              if (opcode == LDSH && !check_read_mem(env, mem_used, addr))
+                return -5;
             } break;
 
-            case STCH: {
+            case STCH:
+            case STCH_NC: {
               uint32_t a;
               int32_t v;
               _POP(a, 4);
               _POP(v, 4);
               void *addr = (void *)(env->heap->data + a);
               lval(addr, int32_t) = v;
-              if (!check_write_mem(env, mem_used, addr, v)) return -5;
+              if (opcode == STCH && !check_write_mem(env, mem_used, addr, v))
+                return -5;
             } break;
 
-            case STBH: {
+            case STBH:
+            case STBH_NC: {
               uint32_t a;
               int32_t v;
               uint8_t w;
@@ -825,19 +1235,36 @@ int instruction(virtual_machine_t *env, int stop_on_bp) {
               _POP(v, 4);
               w = v;
               void *addr = (void *)(env->heap->data + a);
-              lval(addr, int32_t) = w;
-              if (!check_write_mem(env, mem_used, addr, v)) return -5;
+              lval(addr, uint8_t) = w;
+              if (opcode == STBH && !check_write_mem(env, mem_used, addr, v))
+                return -5;
+            } break;
+
+            case STSH:
+            case STSH_NC: {
+              uint32_t a;
+              int32_t v;
+              _POP(a, 4);
+              _POP(v, 4);
+              void *addr = (void *)(env->heap->data + a);
+              lval(addr, uint16_t) = (uint16_t)v;
+              if (opcode == STSH && !check_write_mem(env, mem_used, addr, v))
+                return -5;
             } break;
 
-            case IDX: {
+            case IDX:
+            case IDX_NC: {
               uint8_t nd = lval(&env->code[env->pc], uint8_t);
               uint32_t addr;
               _POP(addr, 4);
-              uint32_t nd2 = lval(get_addr(env->thr[t], addr + 4, 4), uint32_t);
-              if (nd != nd2) {
-                throw("mismatch in dimensions %d %d (%d)", nd, nd2, ___pc___);
-                env->state = VM_ERROR;
-                return -3;
+              if (opcode == IDX) {
+                uint32_t nd2 =
+                    lval(get_addr(env->thr[t], addr + 4, 4), uint32_t);
+                if (nd != nd2) {
+                  throw("mismatch in dimensions %d %d (%d)", nd, nd2, ___pc___);
+                  env->state = VM_ERROR;
+                  return -3;
+                }
               }
 
               for (int i = 0; i < nd; i++) {
@@ -846,7 +1273,7 @@ int instruction(virtual_machine_t *env, int stop_on_bp) {
                 uint32_t v;
                 _POP(v, 4);
                 env->arr_offs[i] = v;
-                if (v >= env->arr_sizes[i]) {
+                if (opcode == IDX && v >= env->arr_sizes[i]) {
                   throw("range check error %d (%d).", addr, ___pc___);
                   env->state = VM_ERROR;
                   return -2;
@@ -858,6 +1285,126 @@ int instruction(virtual_machine_t *env, int stop_on_bp) {
               _PUSH(res, 4);
             } break;
 
+            case IDXA: {
+              uint32_t d = lval(env->code + env->pc, uint32_t);
+              uint8_t nd = d & 0xff;
+              int check = !(d & IDXA_NO_CHECK);
+              uint32_t addr;
+              _POP(addr, 4);
+              if (check) {
+                uint32_t nd2 =
+                    lval(get_addr(env->thr[t], addr + 4, 4), uint32_t);
+                if (nd != nd2) {
+                  throw("mismatch in dimensions %d %d (%d)", nd, nd2, ___pc___);
+                  env->state = VM_ERROR;
+                  return -3;
+                }
+              }
+
+              uint32_t res = 0;
+              for (int i = 0; i < nd; i++) {
+                uint32_t size = lval(
+                    get_addr(env->thr[t], addr + 4 * (i + 2), 4), uint32_t);
+                uint32_t v;
+                _POP(v, 4);
+                if (check && v >= size) {
+                  throw("range check error %d (%d).", addr, ___pc___);
+                  env->state = VM_ERROR;
+                  return -2;
+                }
+                res = res * size + v;
+              }
+              void *base = get_addr(env->thr[t], addr, 4);
+              res = lval(base, uint32_t) + res * ((d >> 8) & 0x7fffff);
+              _PUSH(res, 4);
+              if (!check_read_mem(env, mem_used, base)) return -5;
+            } break;
+
+            case ROW: {  // as IDXA with the last index 0, checked by IDXR
+              uint32_t d = lval(env->code + env->pc, uint32_t);
+              uint8_t nd = d & 0xff;
+              uint32_t addr;
+              _POP(addr, 4);
+              uint32_t nd2 = lval(get_addr(env->thr[t], addr + 4, 4), uint32_t);
+              if (nd != nd2) {
+                throw("mismatch in dimensions %d %d (%d)", nd, nd2, ___pc___);
+                env->state = VM_ERROR;
+                return -3;
+              }
+
+              uint32_t res = 0, lim = 0;
+              for (int i = 0; i < nd; i++) {
+                uint32_t size = lval(
+                    get_addr(env->thr[t], addr + 4 * (i + 2), 4), uint32_t);
+                uint32_t v = 0;
+                if (i < nd - 1) _POP(v, 4);
+                if (i < nd - 1 && v >= size) lim = IDXR_BAD;
+                if (i == nd - 1 && lim == 0) lim = size;
+                res = res * size + v;
+              }
+              void *base = get_addr(env->thr[t], addr, 4);
+              res = lval(base, uint32_t) + res * ((d >> 8) & 0x7fffff);
+              _PUSH(addr, 4);
+              _PUSH(lim, 4);
+              _PUSH(res, 4);
+              if (!check_read_mem(env, mem_used, base)) return -5;
+            } break;
+
+            case IDXR: {
+              uint32_t x = lval(env->code + env->pc, uint32_t);
+              uint32_t a = 4 * (x & 0xffff), v;
+              if (x & IDXR_FRAME) a += env->frame->base;
+              _POP(v, 4);
+              uint8_t *row = (uint8_t *)get_addr(env->thr[t], a, 12);
+              if (!(x & IDXR_NO_CHECK)) {
+                uint32_t lim = lval(row + 4, uint32_t);
+                if ((lim & IDXR_BAD) || v >= lim) {
+                  throw("range check error %d (%d).", lval(row + 8, uint32_t),
+                        ___pc___);
+                  env->state = VM_ERROR;
+                  return -2;
+                }
+              }
+              uint32_t res = lval(row, uint32_t) + v * (x >> 18);
+              _PUSH(res, 4);
+              if (!check_read_mem(env, mem_used, row)) return -5;
+            } break;
+
+            case SLICE: {
+              uint32_t d = lval(env->code + env->pc, uint32_t);
+              uint8_t nd = d & 0xff;
+              uint32_t addr, l, r;
+              _POP(addr, 4);
+              _POP(l, 4);
+              _POP(r, 4);
+              uint32_t nd2 = lval(get_addr(env->thr[t], addr + 4, 4), uint32_t);
+              if (nd != nd2) {
+                throw("mismatch in dimensions %d %d (%d)", nd, nd2, ___pc___);
+                env->state = VM_ERROR;
+                return -3;
+              }
+              uint32_t size = 1;
+              for (int i = nd - 1; i > 0; i--) {
+                uint32_t s = lval(
+                    get_addr(env->thr[t], addr + 4 * (i + 2), 4), uint32_t);
+                size *= s;
+                _PUSH(s, 4);
+              }
+              uint32_t n = lval(get_addr(env->thr[t], addr + 8, 4), uint32_t);
+              if (l > r || r > n) {
+                throw("range check error %d (%d).", addr, ___pc___);
+                env->state = VM_ERROR;
+                return -2;
+              }
+              n = r - l;
+              _PUSH(n, 4);
+              _PUSH(nd2, 4);
+              void *base = get_addr(env->thr[t], addr, 4);
+              uint32_t b = lval(base, uint32_t) + l * size * (d >> 8);
+              _PUSH(b, 4);
+              if (!check_read_mem(env, mem_used, base)) return -5;
+            } break;
+
             case SWS: {
               int32_t a, b;
               _POP(a, 4);
@@ -881,7 +1428,7 @@ int instruction(virtual_machine_t *env, int stop_on_bp) {
             } break;
 
             case S2A:
-              stack_t_push(env->thr[t]->acc_stack,
+              vm_push(env, env->thr[t]->acc_stack,
                            (void *)(&STACK_TOP(env->thr[t]->op_stack, int32_t)),
                            4);
               break;
@@ -1184,6 +1731,119 @@ int instruction(virtual_machine_t *env, int stop_on_bp) {
               _PUSH(a, 4);
             } break;
 
+            case RAND: {
+              uint32_t s, c;
+              _POP(s, 4);
+              _POP(c, 4);
+              int32_t x = philox(s, c) >> 1;
+              _PUSH(x, 4);
+            } break;
+
+            case RANDF: {
+              uint32_t s, c;
+              _POP(s, 4);
+              _POP(c, 4);
+              float x = (philox(s, c) >> 8) * (1.0f / 16777216);
+              _PUSH(x, 4);
+            } break;
+
+            case ADD_INT64: {
+              int64_t a, b;
+              _POP64(a);
+              _POP64(b);
+              a = (uint64_t)a + (uint64_t)b;
+              _PUSH64(a);
+            } break;
+
+            case SUB_INT64: {
+              int64_t a, b;
+              _POP64(a);
+              _POP64(b);
+              a = (uint64_t)a - (uint64_t)b;
+              _PUSH64(a);
+            } break;
+
+            case MULT_INT64: {
+              int64_t a, b;
+              _POP64(a);
+              _POP64(b);
+              a = (uint64_t)a * (uint64_t)b;
+              _PUSH64(a);
+            } break;
+
+            case DIV_INT64: {
+              int64_t a, b;
+              _POP64(a);
+              _POP64(b);
+              a /= b;
+              _PUSH64(a);
+            } break;
+
+            case MOD_INT64: {
+              int64_t a, b;
+              _POP64(a);
+              _POP64(b);
+              a %= b;
+              _PUSH64(a);
+            } break;
+
+            case EQ_INT64:
+            case GT_INT64:
+            case GEQ_INT64:
+            case LT_INT64:
+            case LEQ_INT64: {
+              int64_t a, b;
+              int32_t x;
+              _POP64(a);
+              _POP64(b);
+              switch (opcode) {
+                case EQ_INT64:
+                  x = (a == b);
+                  break;
+                case GT_INT64:
+                  x = (a > b);
+                  break;
+                case GEQ_INT64:
+                  x = (a >= b);
+                  break;
+                case LT_INT64:
+                  x = (a < b);
+                  break;
+                default:
+                  x = (a <= b);
+                  break;
+              }
+              _PUSH(x, 4);
+            } break;
+
+            case INT2INT64: {
+              int32_t a;
+              _POP(a, 4);
+              int64_t x = a;
+              _PUSH64(x);
+            } break;
+
+            case INT642INT: {
+              int64_t x;
+              _POP64(x);
+              int32_t a = (int32_t)x;
+              _PUSH(a, 4);
+            } break;
+
+            case INT2INT8: {
+              int32_t a;
+              _POP(a, 4);
+              a = (int8_t)a;
+              _PUSH(a, 4);
+            } break;
+
+            case INT2INT16: {
+              int32_t a;
+              _POP(a, 4);
+              a = (int16_t)a;
+              _PUSH(a, 4);
+            } break;
+
             case SORT: {
               uint32_t a, size, offs, type;
               _POP(a, 4);
@@ -1191,12 +1851,25 @@ int instruction(virtual_machine_t *env, int stop_on_bp) {
               _POP(offs, 4);
               _POP(type, 4);
               sort_param.offs = offs;
-              sort_param.type = type;
+              sort_param.type = type & ~SORT_COLUMNS;
               uint32_t n = lval(get_addr(env->thr[t], a + 8, 4), uint32_t);
               uint32_t addr = lval(get_addr(env->thr[t], a, 4), uint32_t);
               void *base = (void *)(env->heap->data + addr);
               if (!check_write_mem(env, mem_used, base, 1)) return -5;
-              qsort(base, n, size, sort_compare);
+              if (type & SORT_COLUMNS) {
+                // sort the records gathered from the columns, and put back
+                uint32_t *col = (uint32_t *)base, m = size / 4;
+                uint32_t *rec = (uint32_t *)malloc((uint64_t)n * size + 1);
+                for (uint32_t k = 0; k < m; k++)
+                  for (uint32_t i = 0; i < n; i++)
+                    rec[(uint64_t)i * m + k] = col[(uint64_t)k * n + i];
+                qsort(rec, n, size, sort_compare);
+                for (uint32_t k = 0; k < m; k++)
+                  for (uint32_t i = 0; i < n; i++)
+                    col[(uint64_t)k * n + i] = rec[(uint64_t)i * m + k];
+                free(rec);
+              } else
+                qsort(base, n, size, sort_compare);
             } break;
 
             default:
@@ -1209,10 +1882,19 @@ int instruction(virtual_machine_t *env, int stop_on_bp) {
     }  // end case per-thread instruction
       switch (opcode) {
         case PUSHC:
+        case LDL:
+        case STL:
+        case LDG:
+        case STG:
+        case IDXA:
+        case SLICE:
+        case ROW:
+        case IDXR:
           env->pc += 4;
           break;
         case PUSHB:
         case IDX:
+        case IDX_NC:
           env->pc++;
           break;
       }
@@ -1220,6 +1902,8 @@ int instruction(virtual_machine_t *env, int stop_on_bp) {
 
   return 0;
 }
+#undef _PUSH64
+#undef _POP64
 #undef _PUSH
 #undef _POP
 
@@ -1274,6 +1958,16 @@ void print_var_layout(writer_t *w, input_layout_item_t *it) {
       case TYPE_CHAR:
         out_text(w, "char ");
         break;
+      case TYPE_INT8:
+        out_text(w, "int8 ");
+        break;
+      case TYPE_INT16:
+        out_text(w, "int16 ");
+        break;
+      case TYPE_INT64:
+        out_text(w, "int64 ");
+        j++;  // both halves
+        break;
     }
 }
 
@@ -1295,6 +1989,30 @@ void print_io_vars(writer_t *w, virtual_machine_t *env, int n,
   }
 }
 
+// size in bytes of a value of the basic type (#type_descriptor_t)
+static int value_size(int type) {
+  switch (type) {
+    case TYPE_CHAR:
+    case TYPE_INT8:
+      return 1;
+    case TYPE_INT16:
+      return 2;
+    default:
+      return 4;
+  }
+}
+
+// number of values in the input / output of `var` (an int64 is one number)
+static int count_values(input_layout_item_t *var) {
+  int n = var->n_elems;
+  for (int i = 0; i < var->n_elems; i++)
+    if (var->elems[i] == TYPE_INT64) {
+      n--;
+      i++;
+    }
+  return n;
+}
+
 int count_size(input_layout_item_t *var) {
   int n = 0;
   for (int i = 0; i < var->n_elems; i++) switch (var->elems[i]) {
@@ -1305,6 +2023,13 @@ int count_size(input_layout_item_t *var) {
         n += 4;
         break;
       case TYPE_CHAR:
+      case TYPE_INT8:
+        n += 1;
+        break;
+      case TYPE_INT16:
+        n += 2;
+        break;
+      case TYPE_INT64:
         n += 4;
         break;
     }
@@ -1325,17 +2050,50 @@ void print_code(writer_t *w, uint8_t *code, int size) {
     switch (instr) {
       case PUSHC:
       case JMP:
+      case JMPZ:
       case JOIN_JMP:
+      case UNIFORM:
         out_text(w, " %d", lval(&code[i + 1], int32_t));
         i += 4;
         break;
       case CALL:
       case BREAK:
+      case LDL:
+      case STL:
+      case LDG:
+      case STG:
         out_text(w, " %d", lval(&code[i + 1], uint32_t));
         i += 4;
         break;
+      case IDXA:
+      case ROW:
+        out_text(w, " %d %d%s", lval(&code[i + 1], uint32_t) & 0xff,
+                 (lval(&code[i + 1], uint32_t) >> 8) & 0x7fffff,
+                 (lval(&code[i + 1], uint32_t) & IDXA_NO_CHECK) ? " nc" : "");
+        i += 4;
+        break;
+      case IDXR: {
+        char buf[64];
+        idxr_text(buf, lval(&code[i + 1], uint32_t));
+        out_text(w, " %s", buf);
+        i += 4;
+      } break;
+      case SLICE:
+        out_text(w, " %d %d", lval(&code[i + 1], uint32_t) & 0xff,
+                 lval(&code[i + 1], uint32_t) >> 8);
+        i += 4;
+        break;
+      case ALU3:
+      case ALUR: {
+        char buf[64];
+        alu3_text(buf, lval(&code[i + 1], uint32_t), instr == ALUR);
+        out_text(w, " %s", buf);
+        i += 4;
+      } break;
       case PUSHB:
       case IDX:
+      case IDX_NC:
+      case PUSHR:
         out_text(w, " %d", lval(&code[i + 1], uint8_t));
         i += 1;
         break;
@@ -1344,11 +2102,28 @@ void print_code(writer_t *w, uint8_t *code, int size) {
   }
 }
 
+/* copy the values of element `i` of the array of `n` elements stored by
+ * columns at `data` to the record `rec` laid out as by read_var (`to_rec`),
+ * or back
+ */
+static void soa_element(uint8_t *data, input_layout_item_t *var, int n, int i,
+                        uint8_t *rec, int to_rec) {
+  for (int k = 0, offs = 0; k < var->n_elems; k++) {
+    int s = value_size(var->elems[k]);
+    uint8_t *col = data + 4 * ((uint64_t)k * n + i);
+    if (to_rec)
+      memcpy(rec + offs, col, s);
+    else
+      memcpy(col, rec + offs, s);
+    offs += s;
+  }
+}
+
 int read_var(reader_t *r, uint8_t *base, input_layout_item_t *var) {
   int offs = 0;
   int res;
 
-  if (var->n_elems > 1)
+  if (count_values(var) > 1)
     for (char c = '0'; c != '{';) {
       in_text(r, res, "%c", &c);
       if (res != 1) {
@@ -1388,9 +2163,34 @@ int read_var(reader_t *r, uint8_t *base, input_layout_item_t *var) {
         lval(base + offs, uint8_t) = x;
         offs += 1;
       } break;
+      case TYPE_INT8:
+      case TYPE_INT16: {
+        int32_t x;
+        in_text(r, res, "%d", &x);
+        if (res != 1) {
+          throw("wrong input");
+          return -1;
+        }
+        if (var->elems[i] == TYPE_INT8)
+          lval(base + offs, int8_t) = x;
+        else
+          lval(base + offs, int16_t) = x;
+        offs += value_size(var->elems[i]);
+      } break;
+      case TYPE_INT64: {
+        int64_t x;
+        in_text(r, res, "%" SCNd64, &x);
+        if (res != 1) {
+          throw("wrong input");
+          return -1;
+        }
+        lval(base + offs, int64_t) = x;
+        offs += 8;
+        i++;  // both halves
+      } break;
     }
 
-  if (var->n_elems > 1)
+  if (count_values(var) > 1)
     for (char c = '0'; c != '}';) {
       in_text(r, res, "%c", &c);
       if (res != 1) {
@@ -1476,8 +2276,10 @@ int read_input(reader_t *r, virtual_machine_t *env) {
       int n_elem = 1;
       for (int i = 0; i < var->num_dim; i++) n_elem *= sizes[i];
 
+      // stored by columns, every value takes 4B
       uint32_t base = env->heap->top;
-      stack_t_alloc(env->heap, n_elem * elem_size);
+      stack_t_alloc(env->heap,
+                    n_elem * (var->soa ? 4 * var->n_elems : elem_size));
 
       lval(get_addr(tt, env->in_vars[i].addr, 4), uint32_t) = base;
       lval(get_addr(tt, env->in_vars[i].addr + 4, 4), uint32_t) = var->num_dim;
@@ -1486,12 +2288,17 @@ int read_input(reader_t *r, virtual_machine_t *env) {
             (uint32_t)(sizes[j]);
 
       reader_t *rw = reader_t_new(READER_STRING, w->str.base);
-      for (int j = 0; j < n_elem; j++)
-        if (read_var(rw, env->heap->data + base + j * elem_size, var) != 0) {
+      uint8_t rec[elem_size];
+      for (int j = 0; j < n_elem; j++) {
+        uint8_t *dst = var->soa ? rec : env->heap->data + base + j * elem_size;
+        if (read_var(rw, dst, var) != 0) {
           writer_t_delete(w);
           reader_t_delete(rw);
           return -1;
         }
+        if (var->soa)
+          soa_element(env->heap->data + base, var, n_elem, j, rec, 0);
+      }
 
       reader_t_delete(rw);
       writer_t_delete(w);
@@ -1504,7 +2311,7 @@ int read_input(reader_t *r, virtual_machine_t *env) {
 
 void print_var(writer_t *w, uint8_t *addr, input_layout_item_t *var) {
   int offs = 0;
-  if (var->n_elems > 1) out_text(w, "{ ");
+  if (count_values(var) > 1) out_text(w, "{ ");
   for (int i = 0; i < var->n_elems; i++) {
     if (i > 0) out_text(w, " ");
     switch (var->elems[i]) {
@@ -1523,11 +2330,27 @@ void print_var(writer_t *w, uint8_t *addr, input_layout_item_t *var) {
         out_text(w, "%c", x);
         offs += 1;
       } break;
+      case TYPE_INT8: {
+        int8_t x = lval(addr + offs, int8_t);
+        out_text(w, "%d", x);
+        offs += 1;
+      } break;
+      case TYPE_INT16: {
+        int16_t x = lval(addr + offs, int16_t);
+        out_text(w, "%d", x);
+        offs += 2;
+      } break;
+      case TYPE_INT64: {
+        int64_t x = lval(addr + offs, int64_t);
+        out_text(w, "%" PRId64, x);
+        offs += 8;
+        i++;  // both halves
+      } break;
       default:
         out_text(w, "????");
     }
   }
-  if (var->n_elems > 1) out_text(w, " }");
+  if (count_values(var) > 1) out_text(w, " }");
   // out_text(w," ;");
 }
 
@@ -1535,10 +2358,16 @@ void print_array(writer_t *w, virtual_machine_t *env, input_layout_item_t *var,
                  int nd, int *sizes, uint32_t base, int from_dim, int offs) {
   out_text(w, "[");
   if (from_dim == nd - 1) {
-    int s = count_size(var);
+    int s = count_size(var), n = 1;
+    for (int i = 0; i < nd; i++) n *= sizes[i];
+    uint8_t rec[s];
     for (int i = 0; i < sizes[nd - 1]; i++) {
       if (i > 0) out_text(w, " ");
-      print_var(w, env->heap->data + (base + (offs + i) * s), var);
+      if (var->soa) {
+        soa_element(env->heap->data + base, var, n, offs + i, rec, 1);
+        print_var(w, rec, var);
+      } else
+        print_var(w, env->heap->data + (base + (offs + i) * s), var);
     }
   } else {
     int o = 0;
@@ -1577,13 +2406,26 @@ void write_output(writer_t *w, virtual_machine_t *env, int i) {
 void dump_header(writer_t *w, virtual_machine_t *env) {
   out_text(w, "data segment:       %d B\n", env->global_size);
   out_text(w, "memory mode:        %s\n", mode_name(env->mem_mode));
+  if (env->version >= 5)
+    out_text(w, "array layout:       %s\n", env->soa ? "columns" : "records");
+  if (env->version >= 13)
+    out_text(w, "code encoding:      %s\n",
+             env->registers ? "registers" : "stack");
+  if (env->version >= 2)
+    out_text(w, "main stack depth:   %u/%u B\n",
+             STACK(env->frames, frame_t *)[0]->op_depth,
+             STACK(env->frames, frame_t *)[0]->acc_depth);
   out_text(w, "input variables:\n");
   print_io_vars(w, env, env->n_in_vars, env->in_vars);
   out_text(w, "output variables:\n");
   print_io_vars(w, env, env->n_out_vars, env->out_vars);
   out_text(w, "function addresses:\n");
   for (uint32_t i = 0; i < env->fcnt; i++) {
-    out_text(w, "%03d %010u (%08x)", i, env->fnmap[i], env->fnmap[i]);
+    out_text(w, "%03d %010u (%08x)", i, env->fnmap[i].addr,
+             env->fnmap[i].addr);
+    if (env->version >= 2)
+      out_text(w, " stack %u/%u", env->fnmap[i].op_depth,
+               env->fnmap[i].acc_depth);
     if (env->debug_info) {
       out_text(w, " %s (%s:%d.%d)", env->debug_info->fn_names[i],
                env->debug_info
@@ -1646,7 +2488,15 @@ void include_layout_type(input_layout_item_t *it, virtual_machine_t *env,
       it->elems[it->n_elems - 1] = TYPE_FLOAT;
     else if (!strcmp(t->name, "char"))
       it->elems[it->n_elems - 1] = TYPE_CHAR;
-    else
+    else if (!strcmp(t->name, "int8"))
+      it->elems[it->n_elems - 1] = TYPE_INT8;
+    else if (!strcmp(t->name, "int16"))
+      it->elems[it->n_elems - 1] = TYPE_INT16;
+    else if (!strcmp(t->name, "int64")) {
+      // two values (see code.h)
+      it->elems = realloc(it->elems, ++it->n_elems);
+      it->elems[it->n_elems - 2] = it->elems[it->n_elems - 1] = TYPE_INT64;
+    } else
       exit(123);
   } else
     for (int m = 0; m < t->n_members; m++)
@@ -1660,5 +2510,6 @@ input_layout_item_t get_layout(variable_info_t *var, virtual_machine_t *env) {
   r.n_elems = 0;
   r.elems = NULL;
   include_layout_type(&r, env, var->type);
+  r.soa = env->soa && r.num_dim > 0 && r.n_elems > 1;
   return r;
 }
@@ -9,6 +9,7 @@
 
 #include <code.h>
 #include <debug.h>
+#include <hash.h>
 #include <reader.h>
 #include <utils.h>
 #include <writer.h>
@@ -20,6 +21,7 @@ typedef struct {
   uint32_t n_elems;  //!< number of elements in the basic type
   uint8_t
       *elems;  //!< descriptions of elements of basic type (#type_descriptor_t)
+  uint8_t soa;  //!< the array is stored by columns (see code.h)
 } input_layout_item_t;
 
 //! growing stack of values
@@ -38,6 +40,8 @@ DESTRUCTOR(stack_t);
 void stack_t_push(stack_t *s, void *data, uint32_t len);
 //! just push empty space
 void stack_t_alloc(stack_t *s, uint32_t len);
+//! make sure that `len` more bytes can be pushed without reallocation
+void stack_t_reserve(stack_t *s, uint32_t len);
 //! low level pop
 void stack_t_pop(stack_t *s, void *data, uint32_t len);
 
@@ -60,6 +64,7 @@ typedef struct _thread_t {
   int returned;  //!< flag if return was called within a function
   int bp_hit;    //<! if the breakpoint was currently hit
   uint64_t tid;  //<! id of the thread (unique id assigned in constructor)
+  int32_t reg[NUM_REGISTERS];  //!< registers (register encoding, see code.h)
 } thread_t;
 
 //! constructor
@@ -74,6 +79,10 @@ void *get_addr(thread_t *thr, uint32_t addr, uint32_t len);
 //! find thread by id
 thread_t *get_thread(uint64_t tid);
 
+//! keep the threads by id for #get_thread (default 1, set before the threads
+//! are created)
+extern int vm_thread_ids;
+
 //! create a child copy
 thread_t *clone_thread(thread_t *src);
 
@@ -86,6 +95,8 @@ typedef struct {
   //! where the operand stack should end after the call, i.e.
   //! after removing from stack the parameters, and inserting the return value
   int op_stack_end;    
+  uint32_t op_depth,  //!< stack depth reserved for threads forked in frame
+      acc_depth;      //!< acc depth reserved for threads forked in frame
 } frame_t;
 
 //! constructor
@@ -97,6 +108,8 @@ DESTRUCTOR(frame_t);
 typedef struct {
   uint32_t addr; //!< address in the code
   int32_t out_size; //!< size of the output value
+  uint32_t op_depth, //!< max. growth of `op_stack` in the function
+           acc_depth; //!< max. growth of `acc_stack` in the function
 } fnmap_t;
 
 //! virtual machine
@@ -106,6 +119,12 @@ typedef struct {
   uint32_t n_in_vars,  //!< number of input variables
            n_out_vars, //!< number of output variables
            global_size; //!< size of the global variables (allocated at start)
+  uint8_t version; //!< version byte of the binary (without CODE_REGISTERS)
+  uint8_t registers; //!< the code is in the register encoding (version 13)
+  uint8_t soa; //!< arrays of records are stored by columns (version 5)
+  //! stacks are reserved from the FNMAP depths at `CALL` and `FORK`, and
+  //! pushes need not be checked (version 2 and later)
+  int presized;
   uint32_t fcnt; //!< number of functions
   fnmap_t *fnmap; //!< starting addresses and return value sizes of fuctions
 
@@ -116,7 +135,7 @@ typedef struct {
   stack_t *threads;  //!< stack of stack of thread_t*
   stack_t *frames;   //!< stack of frame_t *
 
-  int W, T; //!< keep track of work and time
+  int64_t W, T; //!< keep track of work and time
   int pc, //!< pc
       stored_pc, //!< pc of the last operation 
       virtual_grps, //!< empty groups of threads at the top of thread stack
@@ -203,4 +222,36 @@ void dump_header(writer_t *w, virtual_machine_t *env);
 
 //! return the memory mode in human readable form
 char *mode_name(int mode);
+
+//----------------------------
+// support for the programs translated to C (see emit_c.h)
+
+//! table of the addresses accessed by one instruction (for the memory checks)
+hash_table_t *mem_check_table_new(int size);
+/**
+ * @brief memory check of a read
+ *
+ * in EREW mode, fail (and emit an error) if the address was already accessed
+ * by the instruction; return 0 on failure
+ */
+int check_read_mem(virtual_machine_t *env, hash_table_t *mem_used,
+                   void *addr);
+/**
+ * @brief memory check of a write
+ *
+ * fail if the address was already accessed by the instruction (in cCRCW mode,
+ * unless the same value was written); the error reports `env->stored_pc`
+ */
+int check_write_mem(virtual_machine_t *env, hash_table_t *mem_used,
+                    void *addr, int32_t value);
+
+//! integer power (`POW_INT`)
+int ipow(int base, int exp);
+//! ceiling of log_2 (`LOG`)
+int ilog2(int n);
+//! integer square root (rounded down)
+unsigned long isqrt(unsigned long x);
+//! Philox-2x32-10: the first word of the block of counter `(c, 0)` with key
+//! `s` (`RAND`, `RANDF`)
+uint32_t philox(uint32_t s, uint32_t c);
 #endif
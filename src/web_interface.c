@@ -20,6 +20,7 @@ static writer_t *code = NULL;
 static writer_t *outw = NULL;
 static virtual_machine_t *env = NULL;
 static char *src_name = NULL;
+static uint64_t src_hash = 0;  // hash of the name and text of the code
 
 /*
  * return code:
@@ -220,12 +221,21 @@ int web_stop() {
   return 1;
 }
 
-int web_W() { return (env) ? env->W : 0; }
-int web_T() { return (env) ? env->T : 0; }
+// a double keeps the 64-bit counters exact up to 2^53 in JavaScript
+double web_W() { return (env) ? env->W : 0; }
+double web_T() { return (env) ? env->T : 0; }
 
 // return 1 if error occured
 int web_compile(char *name, char *text) {
   delete_errors();
+  // the code of unchanged functions is reused from the previous compilation
+  if (!codegen_cache) codegen_cache = codegen_cache_t_new();
+  uint64_t hash = hash_text(hash_text(HASH_INIT, name), text);
+  if (src_name && code && hash == src_hash) {
+    __web_state = WEB_VM_READY;
+    return 0;
+  }
+
   if (src_name) {
     free(src_name);
     src_name = NULL;
@@ -236,16 +246,17 @@ int web_compile(char *name, char *text) {
 
   code = writer_t_new(WRITER_STRING);
 
-  driver_init();
-  driver_set_file(name, text);
-  ast = driver_parse(name);
+  compiler_ctx_t *ctx = compiler_ctx_t_new();
+  driver_set_file(ctx, name, text);
+  ast = driver_parse(ctx, name);
 
-  if (!ast->error_occured) ast->error_occured = emit_code(ast, code, 0);
+  if (!ast->error_occured) ast->error_occured = emit_code(ast, code, 0, 1, 0, 0);
 
-  driver_destroy();
+  compiler_ctx_t_delete(ctx);
   if (!ast->error_occured) {
     __web_state = WEB_VM_READY;
     src_name = strdup(name);
+    src_hash = hash;
   }
   return ast->error_occured;
 }
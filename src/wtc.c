@@ -5,10 +5,28 @@
  * Command line compiler. Supported options:
  *      option   | meaning
  *  -------------|-------------
- *   -o file     | write output to file (default is a.out)
+ *   -o file     | write output to file (default is a.out, a.c with -emit-c)
  *   -x          | don't write debug info
+ *   -O0,-O1,-O2 | optimization level (default -O1, see optimize.h)
+ *   -inline n   | inline functions up to size n with -O2 (default 16)
+ *   -j n        | generate code in n threads (default: one per processor)
+ *   -cache dir  | use the cache of compiled programs in dir (see cache.h)
+ *   -cache-size n | size limit of the cache in MB (default 256)
+ *   -no-cache   | do not use the cache
+ *   -module     | precompile the library file to file.wtm (see module.h)
+ *   -server s   | serve compile requests on the socket s (see server.h)
+ *   -emit-c     | write the program translated to C (see emit_c.h)
+ *   -soa        | store arrays of records by columns (see code.h)
+ *   -regs       | write the code in the register encoding (see code.h)
  *   -D          | print intermediate AST instead of code
  *
+ * The cache directory can also be given by the `WTC_CACHE` environment
+ * variable.
+ *
+ * With `-server socket`, the other file arguments are library files preloaded
+ * into the driver, and the options are the defaults of the requests. The
+ * requests are compiled without the cache.
+ *
  * @deprecated The -D option uses ast_debug_print.h which is terribly outdated
  * and incoplete. Not intended for use.
  */
@@ -18,28 +36,61 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include <cache.h>
 #include <code_generation.h>
 #include <driver.h>
+#include <emit_c.h>
 #include <errors.h>
+#include <hash.h>
+#include <module.h>
+#include <optimize.h>
+#include <server.h>
 #include <writer.h>
 
 // extern int yydebug;
 #include <ast_debug_print.h>
 
 char *outf,  //!< name of output file
-    *inf;    //!< name of input file
+    *inf,    //!< name of input file
+    *cache_dir = NULL,  //!< directory of the cache, NULL if not used
+    *server = NULL,     //!< socket of the -server option
+    **preload = NULL;   //!< library files preloaded by the server
+
+int n_preload = 0;  //!< number of preloaded files
 
 int ast_debug = 0,  //!< flag: -D option enabled
     no_debug  = 0,  //!< flag: -x option enabled
-    outf_spec = 0;  //!< flag: -o option enabled
+    outf_spec = 0,  //!< flag: -o option enabled
+    opt_level = 1,  //!< optimization level set by -O
+    no_cache  = 0,  //!< flag: -no-cache option enabled
+    module    = 0,  //!< flag: -module option enabled
+    c_source  = 0,  //!< flag: -emit-c option enabled
+    soa       = 0,  //!< flag: -soa option enabled
+    regs      = 0;  //!< flag: -regs option enabled
 
 //! Print usage options.
 void print_help(int argc, char **argv) {
-  printf("usage: %s [-h][-?][-D][-o file] file\n", argv[0]);
+  printf(
+      "usage: %s [-h][-?][-D][-x][-O level][-inline n][-j n][-cache dir]"
+      "[-cache-size n][-no-cache][-module][-emit-c][-soa][-regs][-o file] "
+      "file\n"
+      "       %s [options] -server socket [library files]\n",
+      argv[0], argv[0]);
   printf("options:\n");
   printf("-h,-?         print this screen and exit\n");
   printf("-o file       write output to file \n");
   printf("-x            don't write debug info \n");
+  printf("-O0,-O1,-O2   optimization level (default -O1) \n");
+  printf("-inline n     inline functions up to size n with -O2 (default 16) \n");
+  printf("-j n          code generation threads (default: one per processor)\n");
+  printf("-cache dir    cache compiled programs in dir (default $WTC_CACHE)\n");
+  printf("-cache-size n size limit of the cache in MB (default 256)\n");
+  printf("-no-cache     do not use the cache\n");
+  printf("-module       precompile the library file to file.wtm\n");
+  printf("-server s     serve compile requests on socket s (- for stdin)\n");
+  printf("-emit-c       write the program translated to C\n");
+  printf("-soa          store arrays of records by columns\n");
+  printf("-regs         write the code in the register encoding\n");
   printf("-D            print intermediate AST instead of code \n");
   exit(0);
 }
@@ -61,6 +112,57 @@ void parse_options(int argc, char **argv) {
       ast_debug = 1;
     } else if (!strcmp(argv[i], "-x")) {
       no_debug = 1;
+    } else if (!strcmp(argv[i], "-O0") || !strcmp(argv[i], "-O1") ||
+               !strcmp(argv[i], "-O2")) {
+      opt_level = argv[i][2] - '0';
+    } else if (!strcmp(argv[i], "-inline")) {
+      if (++i < argc)
+        inline_limit = atoi(argv[i]);
+      else {
+        print_help(argc, argv);
+        exit(1);
+      }
+    } else if (!strcmp(argv[i], "-j")) {
+      if (++i < argc)
+        codegen_threads = atoi(argv[i]);
+      else {
+        print_help(argc, argv);
+        exit(1);
+      }
+    } else if (!strcmp(argv[i], "-cache")) {
+      if (++i < argc)
+        cache_dir = argv[i];
+      else {
+        print_help(argc, argv);
+        exit(1);
+      }
+    } else if (!strcmp(argv[i], "-cache-size")) {
+      if (++i < argc)
+        cache_limit = (uint64_t)atoi(argv[i]) << 20;
+      else {
+        print_help(argc, argv);
+        exit(1);
+      }
+    } else if (!strcmp(argv[i], "-no-cache")) {
+      no_cache = 1;
+    } else if (!strcmp(argv[i], "-module")) {
+      module = 1;
+    } else if (!strcmp(argv[i], "-emit-c")) {
+      c_source = 1;
+    } else if (!strcmp(argv[i], "-soa")) {
+      soa = 1;
+    } else if (!strcmp(argv[i], "-regs")) {
+      regs = 1;
+    } else if (!strcmp(argv[i], "-server")) {
+      if (++i < argc)
+        server = argv[i];
+      else {
+        print_help(argc, argv);
+        exit(1);
+      }
+    } else if (server) {
+      if (!preload) preload = (char **)malloc(argc * sizeof(char *));
+      preload[n_preload++] = argv[i];
     } else
       inf = argv[i];
 }
@@ -70,6 +172,71 @@ void error_handler(error_t *err) {
   fprintf(stderr, "%s\n", err->msg->str.base);
 }
 
+//! Compile the parsed program to `out`, return 1 if there were errors.
+int compile(ast_t *r, writer_t *out) {
+  int was_error = 0;
+  if (r->error_occured) {
+    was_error = 1;
+    error_t *err = error_t_new();
+    append_error_msg(err, "there were errors");
+    emit_error(err);
+  } else if (ast_debug)
+    ast_debug_print(r, out);
+  else {
+    // with -emit-c, the binary is translated
+    writer_t *bin = c_source ? writer_t_new(WRITER_STRING) : out;
+    was_error = emit_code(r, bin, no_debug, opt_level, soa, regs);
+    if (c_source) {
+      if (!was_error)
+        was_error = emit_c(out, (uint8_t *)bin->str.base, bin->str.ptr);
+      writer_t_delete(bin);
+    }
+    if (was_error) {
+      error_t *err = error_t_new();
+      append_error_msg(err, "there were errors");
+      emit_error(err);
+    }
+  }
+  return was_error;
+}
+
+//! Compile a request of the server (in its own process, see server.h).
+int compile_request(compiler_ctx_t *ctx, int argc, char **argv,
+                    writer_t *out) {
+  server = NULL;
+  inf = NULL;
+  parse_options(argc, argv);
+  if (!inf) {
+    throw("no input file");
+    return 1;
+  }
+  ast_t *r = driver_parse(ctx, inf);
+  int was_error = module ? module_write(ctx, r, inf) : compile(r, out);
+  ast_t_delete(r);
+  return was_error;
+}
+
+//! Preload the library files and run the server.
+int run_server() {
+  compiler_ctx_t *ctx = compiler_ctx_t_new();
+  driver_register_module_loader(ctx, module_load);
+  int was_error = 0;
+  for (int i = 0; i < n_preload; i++) {
+    char *content = driver_read_file(preload[i], NULL);
+    if (content) {
+      driver_set_file(ctx, preload[i], content);
+      free(content);
+    } else {
+      throw("cannot open file %s", preload[i]);
+      was_error = 1;
+    }
+  }
+  if (!was_error) was_error = server_run(ctx, server, compile_request);
+  compiler_ctx_t_delete(ctx);
+  free(preload);
+  return was_error;
+}
+
 /**
  * @brief Main entry.
  *
@@ -88,13 +255,41 @@ int main(int argc, char **argv) {
   outf = NULL;
   inf = NULL;
   parse_options(argc, argv);
-  if (!inf) print_help(argc, argv);
+  if (!inf && !server) print_help(argc, argv);
 
   register_error_handler(&error_handler);
+  if (server) return run_server();
   //   yydebug=1;
 
-  driver_init();
-  ast_t *r = driver_parse(inf);
+  if (!cache_dir) cache_dir = getenv("WTC_CACHE");
+  if (no_cache || ast_debug || module || (cache_dir && !*cache_dir))
+    cache_dir = NULL;
+
+  // the output depends on the compiler, the options and the sources
+  uint64_t config = 0;
+  if (cache_dir) {
+    config = cache_compiler_hash();
+    config = hash_bytes(config, &opt_level, sizeof(opt_level));
+    config = hash_bytes(config, &no_debug, sizeof(no_debug));
+    config = hash_bytes(config, &inline_limit, sizeof(inline_limit));
+    config = hash_bytes(config, &c_source, sizeof(c_source));
+    config = hash_bytes(config, &soa, sizeof(soa));
+    config = hash_bytes(config, &regs, sizeof(regs));
+    if (cache_lookup(cache_dir, config, inf,
+                     outf ? outf : c_source ? "a.c" : "a.out"))
+      return 0;
+  }
+
+  compiler_ctx_t *ctx = compiler_ctx_t_new();
+  driver_register_module_loader(ctx, module_load);
+  ast_t *r = driver_parse(ctx, inf);
+
+  if (module) {
+    int was_error = module_write(ctx, r, inf);
+    compiler_ctx_t_delete(ctx);
+    ast_t_delete(r);
+    return was_error;
+  }
 
   writer_t *out;
   out = writer_t_new(WRITER_FILE);
@@ -108,29 +303,19 @@ int main(int argc, char **argv) {
     if (outf && !strcmp(outf, "-"))
       out->f = stdout;
     else {
-      if (!outf) outf = "a.out";
+      if (!outf) outf = c_source ? "a.c" : "a.out";
       out->f = fopen(outf, "wb");
     }
   }
 
-  int was_error = 0;
-  if (r->error_occured) {
-    was_error = 1;
-    error_t *err = error_t_new();
-    append_error_msg(err, "there were errors");
-    emit_error(err);
-  } else if (ast_debug)
-    ast_debug_print(r, out);
-  else if (emit_code(r, out, no_debug)) {
-    was_error = 1;
-    error_t *err = error_t_new();
-    append_error_msg(err, "there were errors");
-    emit_error(err);
-  }
-
-  driver_destroy();
-  ast_t_delete(r);
+  int was_error = compile(r, out);
 
   writer_t_delete(out);
+  // only clean compilations are cached, a hit would not repeat the messages
+  if (cache_dir && !was_error && !errnum() && strcmp(outf, "-"))
+    cache_store(ctx, cache_dir, config, inf, outf);
+
+  compiler_ctx_t_delete(ctx);
+  ast_t_delete(r);
   return was_error;
 }
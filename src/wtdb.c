@@ -115,7 +115,7 @@ void load_file() {
   fread(binary_file, 1, binary_length, f);
   fclose(f);
 
-  if (binary_file[0] != SECTION_HEADER || binary_file[1] != 1) {
+  if (binary_file[0] != SECTION_HEADER || !code_version_ok(binary_file[1])) {
     printf("%s%s is not a valid binary file%s\n", RED_BOLD, binary_file_name,
            TERM_RESET);
     printf("no file loaded\n");
@@ -166,7 +166,7 @@ void cont() {
     for (int i = 0; i < env->n_out_vars; i++) {
       write_output(outw, env, i);
     }
-    out_text(outw, "%swork: %d\ntime: %d%s\n", CYAN_BOLD, env->W, env->T,
+    out_text(outw, "%swork: %" PRId64 "\ntime: %" PRId64 "%s\n", CYAN_BOLD, env->W, env->T,
              TERM_RESET);
   } else if (err > 0) {
     int hits = 0;
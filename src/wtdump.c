@@ -69,7 +69,7 @@ int main(int argc, char **argv) {
   out_text(w, "input file:         %s\n", inf);
   out_text(w, "version byte:       %x\n", in[1]);
 
-  if (in[1] != 1) {
+  if (!code_version_ok(in[1])) {
     out_text(w, "version byte %x not supported\n", in[1]);
     exit(-2);
   }
@@ -61,7 +61,7 @@ int main(int argc, char **argv) {
   fread(in, 1, len, f);
   fclose(f);
 
-  if (in[0] != SECTION_HEADER || in[1] != 1) {
+  if (in[0] != SECTION_HEADER || !code_version_ok(in[1])) {
     printf("invalid input file\n");
     exit(1);
   }
@@ -115,7 +115,7 @@ int main(int argc, char **argv) {
     } else {
       for (int i = 0; i < env->n_out_vars; i++) write_output(w, env, i);
     }
-    if (wt_stat) out_text(w, "W/T: %d %d\n", env->W, env->T);
+    if (wt_stat) out_text(w, "W/T: %" PRId64 " %" PRId64 "\n", env->W, env->T);
     return 0;
   }
   exit(err);